@@ -1,11 +1,26 @@
+#define _GNU_SOURCE
+
+#include "../src/alog.h"
+#include "../src/bus.h"
 #include "../src/channels.h"
+#include "../src/channels_inline.h"
+#include "../src/ingest.h"
+#include "../src/percpu.h"
+#include "../src/pool.h"
+#include "../src/rpc.h"
+#include "../src/stream.h"
+#include "../src/tee.h"
+#include "../src/writer.h"
+#include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 // High-resolution timing
 static inline uint64_t get_nanos(void) {
@@ -267,6 +282,64 @@ void bench_item_sizes(void) {
   }
 }
 
+void *swap_producer(void *arg) {
+  bench_args_t *a = (bench_args_t *)arg;
+  void *buf = malloc(g_item_size);
+  for (size_t i = 0; i < a->count; i++) {
+    memset(buf, 0xAB, 64); // Touch the header as a producer would
+    channel_send_swap(a->ch, &buf);
+  }
+  free(buf);
+  return NULL;
+}
+
+void *swap_consumer(void *arg) {
+  bench_args_t *a = (bench_args_t *)arg;
+  void *buf = malloc(g_item_size);
+  for (size_t i = 0; i < a->count; i++) {
+    channel_recv_swap(a->ch, &buf);
+  }
+  free(buf);
+  return NULL;
+}
+
+// =============================================================================
+// Benchmark 3b: Large Items, Copy vs Buffer Swap
+// =============================================================================
+void bench_swap_large_items(void) {
+  printf("\n======== Benchmark: Large Items, Copy vs Swap ========\n");
+  printf("%-10s | %-6s | %-18s\n", "Item Size", "Mode", "Throughput");
+  printf("-----------|--------|-------------------\n");
+
+  const size_t NUM_ITEMS = 2000000;
+  const size_t CAPACITY = 1024;
+  size_t sizes[] = {4096, 16384, 65536};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    g_item_size = sizes[s];
+    for (int swap = 0; swap <= 1; swap++) {
+      channel_opts_t opts = {.swap_buffers = swap};
+      channel_t *ch = channel_create_opts(g_item_size, CAPACITY, &opts);
+      bench_args_t args = {ch, NUM_ITEMS, 0};
+      pthread_t producer, consumer;
+
+      uint64_t start = get_nanos();
+      pthread_create(&consumer, NULL, swap ? swap_consumer : sized_consumer,
+                     &args);
+      pthread_create(&producer, NULL, swap ? swap_producer : sized_producer,
+                     &args);
+      pthread_join(producer, NULL);
+      channel_close(ch);
+      pthread_join(consumer, NULL);
+      uint64_t elapsed = get_nanos() - start;
+
+      printf("%-10zu | %-6s | %10.2f mil/sec\n", g_item_size,
+             swap ? "swap" : "copy", NUM_ITEMS / (elapsed / 1e9) / 1e6);
+      channel_destroy(ch);
+    }
+  }
+}
+
 // =============================================================================
 // Benchmark 4: Capacity Impact on Bounded Channels
 // =============================================================================
@@ -371,14 +444,1792 @@ void bench_latency(void) {
 
   channel_destroy(ch1);
   channel_destroy(ch2);
+
+  // Uncontended try_send/try_recv pairs on an adaptive channel's ring, as
+  // calls into the library and with channels_inline.h
+  channel_opts_t opts = {.adaptive = true};
+  for (int use_inline = 0; use_inline < 2; use_inline++) {
+    channel_t *ch = channel_create_opts(sizeof(int64_t), 64, &opts);
+    start = get_nanos();
+    for (size_t i = 0; i < NUM_ITERATIONS * 10; i++) {
+      if (use_inline) {
+        channel_try_send_inline(ch, &val);
+        channel_try_recv_inline(ch, &val);
+      } else {
+        channel_try_send(ch, &val);
+        channel_try_recv(ch, &val);
+      }
+    }
+    elapsed = get_nanos() - start;
+    printf("Uncontended %-11s %.2f ns per operation\n",
+           use_inline ? "(inline):" : "(call):",
+           (double)elapsed / (NUM_ITERATIONS * 20));
+    channel_destroy(ch);
+  }
+}
+
+// =============================================================================
+// Helper for wake policy benchmark
+// =============================================================================
+#define POOL_WORKERS 8
+#define POOL_WORKING_SET (32 * 1024)
+
+typedef struct {
+  channel_t *jobs;
+  channel_t *done;
+  size_t handled;
+} pool_worker_t;
+
+void *pool_worker(void *arg) {
+  pool_worker_t *w = (pool_worker_t *)arg;
+  /* Per-worker state that is only cache-warm if this worker ran recently */
+  unsigned char *state = malloc(POOL_WORKING_SET);
+  memset(state, 1, POOL_WORKING_SET);
+  int64_t job;
+
+  while (channel_recv(w->jobs, &job)) {
+    int64_t sum = job;
+    for (size_t i = 0; i < POOL_WORKING_SET; i += 64) {
+      sum += state[i];
+    }
+    w->handled++;
+    channel_send(w->done, &sum);
+  }
+  free(state);
+  return NULL;
+}
+
+// =============================================================================
+// Benchmark 6: Wake Policy (worker pool below saturation)
+// =============================================================================
+void bench_wake_policy(void) {
+  printf("\n======== Benchmark: Wake Policy (%d workers, 1 job) ====\n",
+         POOL_WORKERS);
+  printf("%-10s | %-16s | %-14s\n", "Policy", "Round-trip", "Workers used");
+  printf("-----------|------------------|---------------\n");
+
+  const size_t NUM_JOBS = 200000;
+  channel_wake_policy_t policies[] = {CHANNEL_WAKE_FIFO, CHANNEL_WAKE_LIFO};
+  const char *names[] = {"FIFO", "LIFO"};
+
+  for (size_t p = 0; p < 2; p++) {
+    channel_opts_t opts = {.wake_policy = policies[p]};
+    channel_t *jobs = channel_create_opts(sizeof(int64_t), 64, &opts);
+    channel_t *done = channel_create(sizeof(int64_t), 64);
+
+    pthread_t threads[POOL_WORKERS];
+    pool_worker_t workers[POOL_WORKERS];
+    for (int i = 0; i < POOL_WORKERS; i++) {
+      workers[i] = (pool_worker_t){jobs, done, 0};
+      pthread_create(&threads[i], NULL, pool_worker, &workers[i]);
+    }
+
+    uint64_t start = get_nanos();
+    int64_t val = 0;
+    for (size_t i = 0; i < NUM_JOBS; i++) {
+      channel_send(jobs, &val);
+      channel_recv(done, &val);
+    }
+    uint64_t elapsed = get_nanos() - start;
+
+    channel_close(jobs);
+    int used = 0;
+    for (int i = 0; i < POOL_WORKERS; i++) {
+      pthread_join(threads[i], NULL);
+      /* Count workers that did more than 1% of the jobs */
+      if (workers[i].handled * 100 > NUM_JOBS) {
+        used++;
+      }
+    }
+
+    printf("%-10s | %12.2f ns | %d\n", names[p],
+           (double)elapsed / NUM_JOBS, used);
+
+    channel_destroy(jobs);
+    channel_destroy(done);
+  }
+}
+
+// =============================================================================
+// Helper for real-time wakeup benchmark
+// =============================================================================
+#define RT_SAMPLES 20000
+#define RT_NOISE_THREADS 3
+
+typedef struct {
+  channel_t *ch;
+  atomic_bool *stop;
+} rt_noise_args_t;
+
+/* Normal-priority producers keeping the channel lock busy */
+void *rt_noise_producer(void *arg) {
+  rt_noise_args_t *a = (rt_noise_args_t *)arg;
+  int64_t filler = 0;
+  while (!atomic_load(a->stop)) {
+    for (int i = 0; i < 16; i++) {
+      channel_send(a->ch, &filler);
+    }
+    sched_yield();
+  }
+  return NULL;
+}
+
+/* Normal-priority CPU hog that preempts lock holders */
+void *rt_cpu_hog(void *arg) {
+  atomic_bool *stop = (atomic_bool *)arg;
+  volatile uint64_t spin = 0;
+  while (!atomic_load(stop)) {
+    spin++;
+  }
+  return NULL;
+}
+
+typedef struct {
+  channel_t *ch;
+  uint64_t *latencies;
+  bool realtime;
+} rt_receiver_args_t;
+
+void *rt_receiver(void *arg) {
+  rt_receiver_args_t *a = (rt_receiver_args_t *)arg;
+  struct sched_param param = {.sched_priority = 50};
+  a->realtime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+
+  size_t samples = 0;
+  int64_t stamp;
+  while (samples < RT_SAMPLES && channel_recv(a->ch, &stamp)) {
+    if (stamp > 0) {
+      a->latencies[samples++] = get_nanos() - (uint64_t)stamp;
+    }
+  }
+  return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// =============================================================================
+// Benchmark 7: Real-Time Receiver Wakeup Latency Under Load
+// =============================================================================
+void bench_rt_wakeup(void) {
+  printf("\n======== Benchmark: RT Receiver Wakeup Latency ========\n");
+  printf("%-10s | %-12s | %-12s | %-12s\n", "Mutex", "Median", "p99",
+         "Max");
+  printf("-----------|--------------|--------------|-------------\n");
+
+  bool realtime = true;
+  for (int pi = 0; pi <= 1; pi++) {
+    channel_opts_t opts = {.priority_inherit = pi};
+    channel_t *ch = channel_create_opts(sizeof(int64_t), 4096, &opts);
+    if (!ch) {
+      printf("%-10s | unsupported on this platform\n", "PI");
+      continue;
+    }
+
+    atomic_bool stop = false;
+    uint64_t *latencies = calloc(RT_SAMPLES, sizeof(uint64_t));
+    rt_receiver_args_t recv_args = {ch, latencies, false};
+    rt_noise_args_t noise_args = {ch, &stop};
+
+    pthread_t receiver, noise[RT_NOISE_THREADS], hog;
+    pthread_create(&receiver, NULL, rt_receiver, &recv_args);
+    for (int i = 0; i < RT_NOISE_THREADS; i++) {
+      pthread_create(&noise[i], NULL, rt_noise_producer, &noise_args);
+    }
+    pthread_create(&hog, NULL, rt_cpu_hog, &stop);
+
+    struct timespec period = {0, 50000};
+    for (size_t i = 0; i < RT_SAMPLES; i++) {
+      int64_t stamp = (int64_t)get_nanos();
+      channel_send(ch, &stamp);
+      nanosleep(&period, NULL);
+    }
+
+    pthread_join(receiver, NULL);
+    atomic_store(&stop, true);
+    channel_close(ch);
+    for (int i = 0; i < RT_NOISE_THREADS; i++) {
+      pthread_join(noise[i], NULL);
+    }
+    pthread_join(hog, NULL);
+    realtime = realtime && recv_args.realtime;
+
+    qsort(latencies, RT_SAMPLES, sizeof(uint64_t), compare_u64);
+    printf("%-10s | %9.2f us | %9.2f us | %9.2f us\n",
+           pi ? "PI" : "Default", latencies[RT_SAMPLES / 2] / 1e3,
+           latencies[RT_SAMPLES * 99 / 100] / 1e3,
+           latencies[RT_SAMPLES - 1] / 1e3);
+
+    free(latencies);
+    channel_destroy(ch);
+  }
+
+  if (!realtime) {
+    printf("(SCHED_FIFO not permitted, receiver ran at normal priority)\n");
+  }
+}
+
+// =============================================================================
+// Helper for active queue management benchmark
+// =============================================================================
+#define AQM_ITEMS 200000
+
+typedef struct {
+  channel_t *ch;
+  uint64_t *latencies;
+  size_t received;
+} aqm_consumer_args_t;
+
+/* Consumer that is slower than the producer, spinning ~2us per item */
+void *aqm_consumer(void *arg) {
+  aqm_consumer_args_t *a = (aqm_consumer_args_t *)arg;
+  int64_t stamp;
+  while (channel_recv(a->ch, &stamp)) {
+    a->latencies[a->received++] = get_nanos() - (uint64_t)stamp;
+    uint64_t until = get_nanos() + 2000;
+    while (get_nanos() < until) {
+    }
+  }
+  return NULL;
+}
+
+// =============================================================================
+// Benchmark 8: Sustained Overload, Tail-Drop vs CoDel
+// =============================================================================
+void bench_codel_overload(void) {
+  printf("\n======== Benchmark: Sustained Overload (CoDel) ========\n");
+  printf("%-10s | %-12s | %-12s | %-8s\n", "Mode", "Median", "p99",
+         "Dropped");
+  printf("-----------|--------------|--------------|---------\n");
+
+  const char *modes[] = {"None", "CoDel", "CoDel+shed"};
+  for (int aqm = 0; aqm <= 2; aqm++) {
+    channel_opts_t opts = {
+        .codel_target_ns = aqm ? 500000 : 0,
+        .codel_interval_ns = aqm ? 5000000 : 0,
+        .codel_shed_sends = aqm == 2,
+    };
+    channel_t *ch = channel_create_opts(sizeof(int64_t), 10000, &opts);
+    aqm_consumer_args_t args = {ch, calloc(AQM_ITEMS, sizeof(uint64_t)), 0};
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, aqm_consumer, &args);
+    for (size_t i = 0; i < AQM_ITEMS; i++) {
+      int64_t stamp = (int64_t)get_nanos();
+      channel_send(ch, &stamp);
+    }
+    channel_close(ch);
+    pthread_join(consumer, NULL);
+
+    channel_stats_t stats;
+    channel_stats(ch, &stats);
+    qsort(args.latencies, args.received, sizeof(uint64_t), compare_u64);
+    printf("%-10s | %9.2f us | %9.2f us | %5.1f%%\n", modes[aqm],
+           args.latencies[args.received / 2] / 1e3,
+           args.latencies[args.received * 99 / 100] / 1e3,
+           100.0 * stats.dropped / AQM_ITEMS);
+
+    free(args.latencies);
+    channel_destroy(ch);
+  }
+}
+
+// =============================================================================
+// Helper for channel group benchmark
+// =============================================================================
+typedef struct {
+  channel_t **chs;
+  size_t num_chs;
+  size_t count;
+} fan_in_producer_args_t;
+
+/* Spread items round-robin over this producer's channels */
+void *fan_in_producer(void *arg) {
+  fan_in_producer_args_t *a = (fan_in_producer_args_t *)arg;
+  int64_t val = 0;
+  for (size_t i = 0; i < a->count; i++) {
+    channel_send(a->chs[i % a->num_chs], &val);
+  }
+  return NULL;
+}
+
+// =============================================================================
+// Benchmark 9: Fan-In Through a Channel Group
+// =============================================================================
+void bench_group_fan_in(void) {
+  printf("\n======== Benchmark: Group Fan-In (4 producers) ========\n");
+  printf("%-10s | %-18s\n", "Channels", "Throughput");
+  printf("-----------|-------------------\n");
+
+  const size_t NUM_ITEMS = 4000000;
+  const int NUM_PRODUCERS = 4;
+  size_t sizes[] = {4, 16, 64};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t num_chs = sizes[s];
+    channel_group_t *g = channel_group_create();
+    channel_t *chs[CHANNEL_GROUP_MAX];
+    for (size_t i = 0; i < num_chs; i++) {
+      chs[i] = channel_create(sizeof(int64_t), 1024);
+      channel_group_join(g, chs[i]);
+    }
+
+    pthread_t producers[NUM_PRODUCERS];
+    fan_in_producer_args_t args[NUM_PRODUCERS];
+    size_t per_producer = num_chs / NUM_PRODUCERS;
+
+    uint64_t start = get_nanos();
+    for (int p = 0; p < NUM_PRODUCERS; p++) {
+      args[p] = (fan_in_producer_args_t){&chs[p * per_producer], per_producer,
+                                         NUM_ITEMS / NUM_PRODUCERS};
+      pthread_create(&producers[p], NULL, fan_in_producer, &args[p]);
+    }
+    int64_t val;
+    for (size_t i = 0; i < NUM_ITEMS; i++) {
+      channel_group_recv(g, &val, NULL);
+    }
+    uint64_t elapsed = get_nanos() - start;
+    for (int p = 0; p < NUM_PRODUCERS; p++) {
+      pthread_join(producers[p], NULL);
+    }
+
+    printf("%-10zu | %10.2f mil/sec\n", num_chs,
+           NUM_ITEMS / (elapsed / 1e9) / 1e6);
+
+    channel_group_destroy(g);
+    for (size_t i = 0; i < num_chs; i++) {
+      channel_destroy(chs[i]);
+    }
+  }
+}
+
+// =============================================================================
+// Helper for select benchmark
+// =============================================================================
+#define SELECT_CHANNELS 4
+
+typedef struct {
+  channel_t *ping;
+  channel_t **replies;
+  size_t iterations;
+} select_pong_args_t;
+
+/* Answer each ping on the next reply channel in turn */
+void *select_pong_thread(void *arg) {
+  select_pong_args_t *a = (select_pong_args_t *)arg;
+  int64_t val;
+  for (size_t i = 0; i < a->iterations; i++) {
+    channel_recv(a->ping, &val);
+    channel_send(a->replies[i % SELECT_CHANNELS], &val);
+  }
+  return NULL;
+}
+
+// =============================================================================
+// Benchmark 10: Select Wakeup Latency, futex_waitv vs Registration
+// =============================================================================
+void bench_select_wakeup(void) {
+  printf("\n======== Benchmark: Select Wakeup (%d channels) ========\n",
+         SELECT_CHANNELS);
+  printf("%-14s | %-14s\n", "Mode", "Round-trip");
+  printf("---------------|---------------\n");
+
+  const size_t NUM_ITERATIONS = 200000;
+
+  for (int futex = 1; futex >= 0; futex--) {
+    if (channel_select_use_futex(futex) != futex) {
+      printf("%-14s | unsupported\n", "futex_waitv");
+      continue;
+    }
+
+    channel_t *ping = channel_create(sizeof(int64_t), 1);
+    channel_t *replies[SELECT_CHANNELS];
+    int64_t vals[SELECT_CHANNELS];
+    channel_case_t cases[SELECT_CHANNELS];
+    for (int i = 0; i < SELECT_CHANNELS; i++) {
+      replies[i] = channel_create(sizeof(int64_t), 1);
+      cases[i] = (channel_case_t){replies[i], &vals[i]};
+    }
+
+    select_pong_args_t args = {ping, replies, NUM_ITERATIONS};
+    pthread_t thread;
+    pthread_create(&thread, NULL, select_pong_thread, &args);
+
+    uint64_t start = get_nanos();
+    int64_t val = 0;
+    for (size_t i = 0; i < NUM_ITERATIONS; i++) {
+      channel_send(ping, &val);
+      channel_select(cases, SELECT_CHANNELS);
+    }
+    uint64_t elapsed = get_nanos() - start;
+    pthread_join(thread, NULL);
+
+    printf("%-14s | %10.2f ns\n", futex ? "futex_waitv" : "registration",
+           (double)elapsed / NUM_ITERATIONS);
+
+    channel_destroy(ping);
+    for (int i = 0; i < SELECT_CHANNELS; i++) {
+      channel_destroy(replies[i]);
+    }
+  }
+  channel_select_use_futex(true);
+}
+
+// =============================================================================
+// Benchmark 11: Adaptive SPSC Ring vs Locked Channel
+// =============================================================================
+void bench_adaptive_spsc(void) {
+  printf("\n======== Benchmark: Adaptive SPSC vs Locked ========\n");
+  printf("%-22s | %-18s\n", "Mode", "Throughput");
+  printf("-----------------------|-------------------\n");
+
+  const size_t NUM_ITEMS = 20000000;
+  const size_t CAPACITY = 1024;
+
+  struct {
+    const char *name;
+    bool adaptive;
+    int producers;
+  } modes[] = {
+      {"locked, 1 producer", false, 1},
+      {"adaptive, 1 producer", true, 1},
+      {"locked, 2 producers", false, 2},
+      {"adaptive, 2 producers", true, 2},
+  };
+
+  for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+    channel_opts_t opts = {.adaptive = modes[m].adaptive};
+    channel_t *ch = channel_create_opts(sizeof(int64_t), CAPACITY, &opts);
+    int num_prod = modes[m].producers;
+
+    pthread_t producers[2];
+    pthread_t consumer;
+    bench_args_t prod_args[2];
+    bench_args_t cons_args = {ch, NUM_ITEMS, 0};
+
+    uint64_t start = get_nanos();
+
+    pthread_create(&consumer, NULL, consumer_func, &cons_args);
+    for (int i = 0; i < num_prod; i++) {
+      prod_args[i] = (bench_args_t){ch, NUM_ITEMS / num_prod, i};
+      pthread_create(&producers[i], NULL, producer_func, &prod_args[i]);
+    }
+    for (int i = 0; i < num_prod; i++) {
+      pthread_join(producers[i], NULL);
+    }
+    pthread_join(consumer, NULL);
+
+    uint64_t elapsed = get_nanos() - start;
+    printf("%-22s | %10.2f mil/sec\n", modes[m].name,
+           (double)NUM_ITEMS / (elapsed / 1e9) / 1e6);
+
+    channel_destroy(ch);
+  }
+}
+
+// =============================================================================
+// Benchmark 12: Queue Lock vs Mutex Under Producer Contention
+// =============================================================================
+void bench_queue_lock(void) {
+  printf("\n======== Benchmark: Queue Lock vs Mutex ========\n");
+  printf("%-10s | %-18s | %-18s\n", "Producers", "Mutex", "Queue lock");
+  printf("-----------|--------------------|-------------------\n");
+
+  const size_t TOTAL_ITEMS = 4000000;
+  const size_t CAPACITY = 1024;
+
+  for (int num_prod = 2; num_prod <= 32; num_prod *= 2) {
+    double rate[2];
+    for (int q = 0; q < 2; q++) {
+      channel_opts_t opts = {.lock = q ? CHANNEL_LOCK_QUEUE
+                                       : CHANNEL_LOCK_MUTEX};
+      channel_t *ch = channel_create_opts(sizeof(int64_t), CAPACITY, &opts);
+
+      pthread_t *producers = malloc(num_prod * sizeof(pthread_t));
+      bench_args_t *prod_args = malloc(num_prod * sizeof(bench_args_t));
+      pthread_t consumer;
+      size_t per_producer = TOTAL_ITEMS / num_prod;
+      bench_args_t cons_args = {ch, per_producer * num_prod, 0};
+
+      uint64_t start = get_nanos();
+      pthread_create(&consumer, NULL, consumer_func, &cons_args);
+      for (int i = 0; i < num_prod; i++) {
+        prod_args[i] = (bench_args_t){ch, per_producer, i};
+        pthread_create(&producers[i], NULL, producer_func, &prod_args[i]);
+      }
+      for (int i = 0; i < num_prod; i++) {
+        pthread_join(producers[i], NULL);
+      }
+      pthread_join(consumer, NULL);
+      uint64_t elapsed = get_nanos() - start;
+      rate[q] = (double)(per_producer * num_prod) / (elapsed / 1e9);
+
+      free(producers);
+      free(prod_args);
+      channel_destroy(ch);
+    }
+    printf("%-10d | %10.2f mil/sec | %10.2f mil/sec\n", num_prod,
+           rate[0] / 1e6, rate[1] / 1e6);
+  }
+}
+
+// =============================================================================
+// Benchmark 13: Batch Transfers, Split Copies vs Magic Ring
+// =============================================================================
+#define BATCH_SIZE 100
+
+static void *batch_producer(void *arg) {
+  bench_args_t *a = (bench_args_t *)arg;
+  int64_t items[BATCH_SIZE] = {0};
+  for (size_t i = 0; i < a->count; i += BATCH_SIZE) {
+    channel_send_batch(a->ch, items, BATCH_SIZE);
+  }
+  return NULL;
+}
+
+static void *batch_consumer(void *arg) {
+  bench_args_t *a = (bench_args_t *)arg;
+  int64_t items[BATCH_SIZE];
+  size_t received = 0;
+  while (received < a->count) {
+    received += channel_recv_batch(a->ch, items, BATCH_SIZE);
+  }
+  return NULL;
+}
+
+void bench_batch_magic_ring(void) {
+  printf("\n======== Benchmark: Batches of %d, Split vs Magic Ring ========\n",
+         BATCH_SIZE);
+  printf("%-18s | %-18s\n", "Mode", "Throughput");
+  printf("-------------------|-------------------\n");
+
+  const size_t NUM_ITEMS = 50000000;
+  const size_t CAPACITY = 1000;
+
+  struct {
+    const char *name;
+    bool batch;
+    bool magic_ring;
+  } modes[] = {
+      {"single items", false, false},
+      {"batch", true, false},
+      {"batch, magic ring", true, true},
+  };
+
+  for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+    channel_opts_t opts = {.magic_ring = modes[m].magic_ring};
+    channel_t *ch = channel_create_opts(sizeof(int64_t), CAPACITY, &opts);
+    if (!ch) {
+      printf("%-18s | unsupported\n", modes[m].name);
+      continue;
+    }
+    size_t count = modes[m].batch ? NUM_ITEMS : NUM_ITEMS / 10;
+
+    bench_args_t args = {ch, count, 0};
+    pthread_t prod, cons;
+    uint64_t start = get_nanos();
+    pthread_create(&cons, NULL, modes[m].batch ? batch_consumer : consumer_func,
+                   &args);
+    pthread_create(&prod, NULL, modes[m].batch ? batch_producer : producer_func,
+                   &args);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    uint64_t elapsed = get_nanos() - start;
+
+    printf("%-18s | %10.2f mil/sec\n", modes[m].name,
+           (double)count / (elapsed / 1e9) / 1e6);
+    channel_destroy(ch);
+  }
+}
+
+// =============================================================================
+// Benchmark 14: Resident Memory of a Burst-Sized Ring After the Burst
+// =============================================================================
+/* Resident set size in MB, 0 where /proc is unavailable */
+static double rss_mb(void) {
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f) {
+    return 0;
+  }
+  long size = 0, resident = 0;
+  if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(f);
+  return (double)resident * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+void bench_idle_release(void) {
+  printf("\n======== Benchmark: RSS After a 256MB Burst ========\n");
+  printf("%-16s | %-12s | %-12s | %-12s\n", "Mode", "Before", "After burst",
+         "Idle 200ms");
+  printf("-----------------|--------------|--------------|-------------\n");
+
+  const size_t ITEM_SIZE = 4096;
+  const size_t CAPACITY = 65536;
+  char *item = calloc(1, ITEM_SIZE);
+
+  for (int release = 0; release <= 1; release++) {
+    channel_opts_t opts = {.release_idle_ns = release ? 100000000 : 0};
+    double before = rss_mb();
+    channel_t *ch = channel_create_opts(ITEM_SIZE, CAPACITY, &opts);
+
+    for (size_t i = 0; i < CAPACITY; i++) {
+      channel_send(ch, item);
+    }
+    for (size_t i = 0; i < CAPACITY; i++) {
+      channel_recv(ch, item);
+    }
+    double burst = rss_mb();
+
+    /* A trickle of traffic while idle */
+    for (int i = 0; i < 20; i++) {
+      struct timespec ts = {0, 10000000};
+      nanosleep(&ts, NULL);
+      channel_send(ch, item);
+      channel_recv(ch, item);
+    }
+    printf("%-16s | %9.1f MB | %9.1f MB | %9.1f MB\n",
+           release ? "release_idle_ns" : "default", before, burst, rss_mb());
+    channel_destroy(ch);
+  }
+  free(item);
+}
+
+// =============================================================================
+// Benchmark 15: Consumer Pool Autoscaling on a Burst
+// =============================================================================
+/* Stands in for a consumer that waits 100us on I/O per item */
+static void io_bound_handler(void *item, void *ctx) {
+  (void)item;
+  struct timespec ts = {0, 100000};
+  nanosleep(&ts, NULL);
+  atomic_fetch_add((atomic_size_t *)ctx, 1);
+}
+
+void bench_pool_autoscale(void) {
+  printf("\n======== Benchmark: Draining an I/O-Bound Burst ========\n");
+  printf("%-16s | %-12s | %-12s\n", "Pool", "Drain (ms)", "Peak workers");
+  printf("-----------------|--------------|-------------\n");
+
+  const size_t BURST = 5000;
+  struct {
+    const char *name;
+    size_t min, max;
+  } configs[] = {
+      {"fixed 1", 1, 1}, {"autoscale 1-16", 1, 16}, {"fixed 16", 16, 16}};
+
+  for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+    channel_t *ch = channel_create(sizeof(int), 0);
+    atomic_size_t handled = 0;
+    channel_pool_opts_t opts = {
+        .min_workers = configs[c].min,
+        .max_workers = configs[c].max,
+        .backlog_threshold = 64,
+        .scale_up_delay_ns = 1000000,
+        .idle_timeout_ns = 100000000,
+    };
+    channel_pool_t *pool = channel_pool_create(
+        ch, sizeof(int), io_bound_handler, &handled, &opts);
+
+    uint64_t start = get_nanos();
+    for (size_t i = 0; i < BURST; i++) {
+      int v = (int)i;
+      channel_send(ch, &v);
+    }
+    while (atomic_load(&handled) < BURST) {
+      struct timespec ts = {0, 100000};
+      nanosleep(&ts, NULL);
+    }
+    double ms = (get_nanos() - start) / 1e6;
+
+    channel_pool_stats_t stats;
+    channel_pool_stats(pool, &stats);
+    printf("%-16s | %12.1f | %12zu\n", configs[c].name, ms,
+           stats.peak_workers);
+
+    channel_close(ch);
+    channel_pool_destroy(pool);
+    channel_destroy(ch);
+  }
+}
+
+// =============================================================================
+// Benchmark 16: Light Tenant Latency Under a Heavy Tenant
+// =============================================================================
+#define LIGHT_TENANTS 3
+#define LIGHT_ITEMS 200
+
+typedef struct {
+  uint64_t sent_ns;
+  int tenant;
+} tenant_item_t;
+
+typedef struct {
+  channel_t *ch;
+  bool fair;
+  int tenant;
+  atomic_bool *stop;
+  uint64_t *latencies;
+  size_t nlat;
+} tenant_args_t;
+
+/* Sends as fast as the channel takes items until told to stop */
+static void *heavy_tenant(void *arg) {
+  tenant_args_t *a = arg;
+  tenant_item_t item = {.tenant = 0};
+  while (!atomic_load(a->stop)) {
+    item.sent_ns = get_nanos();
+    if (!(a->fair ? channel_send_tenant(a->ch, &item, 0)
+                  : channel_send(a->ch, &item))) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* Sends one timestamped item per millisecond */
+static void *light_tenant(void *arg) {
+  tenant_args_t *a = arg;
+  tenant_item_t item = {.tenant = a->tenant};
+  for (int i = 0; i < LIGHT_ITEMS; i++) {
+    struct timespec ts = {0, 1000000};
+    nanosleep(&ts, NULL);
+    item.sent_ns = get_nanos();
+    if (a->fair) {
+      channel_send_tenant(a->ch, &item, (size_t)a->tenant);
+    } else {
+      channel_send(a->ch, &item);
+    }
+  }
+  return NULL;
+}
+
+/* Spends about 2us per item and records the light tenants' latencies */
+static void *tenant_consumer(void *arg) {
+  tenant_args_t *a = arg;
+  tenant_item_t item;
+  while (channel_recv(a->ch, &item)) {
+    uint64_t now = get_nanos();
+    if (item.tenant != 0) {
+      a->latencies[a->nlat++] = now - item.sent_ns;
+    }
+    while (get_nanos() - now < 2000) {
+    }
+  }
+  return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+void bench_fair_tenants(void) {
+  printf("\n======== Benchmark: Light Tenant Latency, Heavy Tenant Flooding "
+         "========\n");
+  printf("%-16s | %-12s | %-12s | %-12s\n", "Channel", "p50 (us)",
+         "p99 (us)", "max (us)");
+  printf("-----------------|--------------|--------------|-------------\n");
+
+  const size_t DEPTH = 256;
+  for (int fair = 0; fair <= 1; fair++) {
+    channel_opts_t opts = {.tenants = fair ? LIGHT_TENANTS + 1 : 0};
+    size_t capacity = fair ? DEPTH : DEPTH * (LIGHT_TENANTS + 1);
+    channel_t *ch =
+        channel_create_opts(sizeof(tenant_item_t), capacity, &opts);
+    atomic_bool stop = false;
+    uint64_t *latencies =
+        malloc(LIGHT_TENANTS * LIGHT_ITEMS * sizeof(uint64_t));
+
+    tenant_args_t cargs = {.ch = ch, .latencies = latencies};
+    tenant_args_t hargs = {.ch = ch, .fair = fair, .stop = &stop};
+    tenant_args_t largs[LIGHT_TENANTS];
+    pthread_t consumer, heavy, light[LIGHT_TENANTS];
+    pthread_create(&consumer, NULL, tenant_consumer, &cargs);
+    pthread_create(&heavy, NULL, heavy_tenant, &hargs);
+    for (int i = 0; i < LIGHT_TENANTS; i++) {
+      largs[i] = (tenant_args_t){.ch = ch, .fair = fair, .tenant = i + 1};
+      pthread_create(&light[i], NULL, light_tenant, &largs[i]);
+    }
+
+    for (int i = 0; i < LIGHT_TENANTS; i++) {
+      pthread_join(light[i], NULL);
+    }
+    atomic_store(&stop, true);
+    channel_close(ch);
+    pthread_join(heavy, NULL);
+    pthread_join(consumer, NULL);
+
+    qsort(latencies, cargs.nlat, sizeof(uint64_t), cmp_u64);
+    printf("%-16s | %12.1f | %12.1f | %12.1f\n",
+           fair ? "fair (4 tenants)" : "shared FIFO",
+           latencies[cargs.nlat / 2] / 1e3,
+           latencies[cargs.nlat * 99 / 100] / 1e3,
+           latencies[cargs.nlat - 1] / 1e3);
+    free(latencies);
+    channel_destroy(ch);
+  }
+}
+
+// =============================================================================
+// Benchmark 17: Deadline Order With 1M Pending Items
+// =============================================================================
+void bench_deadline_heap(void) {
+  printf("\n======== Benchmark: Send+Recv With 1M Items Pending ========\n");
+  printf("%-16s | %-12s | %-14s\n", "Channel", "Fill (ns/op)",
+         "Steady (ns/op)");
+  printf("-----------------|--------------|---------------\n");
+
+  const size_t PENDING = 1000000;
+  const size_t OPS = 1000000;
+  int item = 0;
+
+  for (int edf = 0; edf <= 1; edf++) {
+    channel_opts_t opts = {.deadline_order = edf};
+    channel_t *ch = channel_create_opts(sizeof(int), PENDING + 1, &opts);
+    unsigned seed = 1;
+    uint64_t base = get_nanos();
+
+    uint64_t start = get_nanos();
+    for (size_t i = 0; i < PENDING; i++) {
+      seed = seed * 1103515245 + 12345;
+      uint64_t deadline = base + (seed >> 4) % 1000000000ULL;
+      if (edf) {
+        channel_send_deadline(ch, &item, deadline);
+      } else {
+        channel_send(ch, &item);
+      }
+    }
+    double fill = (double)(get_nanos() - start) / PENDING;
+
+    /* Keep the queue at 1M: every receive is followed by a send */
+    start = get_nanos();
+    for (size_t i = 0; i < OPS; i++) {
+      channel_recv(ch, &item);
+      seed = seed * 1103515245 + 12345;
+      uint64_t deadline = base + (seed >> 4) % 1000000000ULL;
+      if (edf) {
+        channel_send_deadline(ch, &item, deadline);
+      } else {
+        channel_send(ch, &item);
+      }
+    }
+    double steady = (double)(get_nanos() - start) / OPS;
+
+    printf("%-16s | %12.1f | %14.1f\n", edf ? "deadline_order" : "FIFO",
+           fill, steady);
+    channel_destroy(ch);
+  }
+}
+
+// =============================================================================
+// Benchmark 18: Async Logger Hot Path
+// =============================================================================
+typedef struct {
+  alog_t *log;
+  FILE *out;
+  pthread_mutex_t *mu;
+  size_t count;
+  uint64_t cpu_ns;
+} log_args_t;
+
+#define LOG_BURST 1000
+
+static uint64_t thread_cpu_nanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Logs in bursts that fit the queue, letting the writer catch up in between
+void *alog_producer(void *arg) {
+  log_args_t *args = (log_args_t *)arg;
+  // Register the thread's queue outside the measurement
+  ALOG(args->log, "producer started");
+  alog_flush(args->log);
+  args->cpu_ns = 0;
+  for (size_t i = 0; i < args->count; i += LOG_BURST) {
+    uint64_t start = thread_cpu_nanos();
+    for (size_t j = i; j < i + LOG_BURST; j++) {
+      ALOG(args->log, "request %zu from %s took %d us", j, "client", 42);
+    }
+    args->cpu_ns += thread_cpu_nanos() - start;
+    alog_flush(args->log);
+  }
+  return NULL;
+}
+
+void *fprintf_producer(void *arg) {
+  log_args_t *args = (log_args_t *)arg;
+  uint64_t start = thread_cpu_nanos();
+  for (size_t i = 0; i < args->count; i++) {
+    pthread_mutex_lock(args->mu);
+    fprintf(args->out, "request %zu from %s took %d us\n", i, "client", 42);
+    pthread_mutex_unlock(args->mu);
+  }
+  args->cpu_ns = thread_cpu_nanos() - start;
+  return NULL;
+}
+
+void bench_alog(void) {
+  printf("\n======== Benchmark: Log Call Cost (to /dev/null) ========\n");
+  printf("%-16s | %-8s | %-16s | %-10s\n", "Logger", "Threads",
+         "Caller CPU ns/op", "Wall (ms)");
+  printf("-----------------|----------|------------------|-----------\n");
+
+  const size_t COUNT = 1000000;
+  const int thread_counts[] = {1, 4};
+  int fd = open("/dev/null", O_WRONLY);
+  FILE *out = fdopen(dup(fd), "w");
+  pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+
+  for (int kind = 0; kind < 3; kind++) {
+    const char *name = kind == 0   ? "fprintf+mutex"
+                       : kind == 1 ? "alog"
+                                   : "alog lossy";
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(int); t++) {
+      int n = thread_counts[t];
+      alog_opts_t opts = {.lossy = kind == 2};
+      alog_t *log = kind ? alog_create(fd, &opts) : NULL;
+      pthread_t threads[4];
+      log_args_t args[4];
+
+      uint64_t start = get_nanos();
+      for (int i = 0; i < n; i++) {
+        args[i] = (log_args_t){
+            .log = log, .out = out, .mu = &mu, .count = COUNT / n};
+        pthread_create(&threads[i], NULL,
+                       kind ? alog_producer : fprintf_producer, &args[i]);
+      }
+      uint64_t cpu = 0;
+      for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        cpu += args[i].cpu_ns;
+      }
+      if (log) {
+        alog_destroy(log);
+      } else {
+        fflush(out);
+      }
+      double wall = (double)(get_nanos() - start) / 1e6;
+
+      printf("%-16s | %8d | %16.1f | %10.1f\n", name, n,
+             (double)cpu / (double)(COUNT / n * n), wall);
+    }
+  }
+  fclose(out);
+  close(fd);
+}
+
+// =============================================================================
+// Benchmark 19: Appending Channel Items to a File
+// =============================================================================
+typedef struct {
+  channel_t *ch;
+  int fd;
+  size_t writes;
+} item_writer_args_t;
+
+// The pattern the writer stage replaces: one write per item
+void *per_item_writer(void *arg) {
+  item_writer_args_t *args = (item_writer_args_t *)arg;
+  char item[64];
+  while (channel_recv(args->ch, item)) {
+    if (write(args->fd, item, sizeof(item)) != (ssize_t)sizeof(item)) {
+      break;
+    }
+    args->writes++;
+  }
+  return NULL;
+}
+
+void bench_file_writer(void) {
+  printf("\n======== Benchmark: Append 64-byte Items to a File ========\n");
+  printf("%-24s | %-10s | %-8s | %-8s | %-6s\n", "Writer", "MB/sec",
+         "Writes", "Syncs", "Amp");
+  printf("-------------------------|------------|----------|----------|"
+         "-------\n");
+
+  const size_t COUNT = 500000;
+  const char *path = "/tmp/channels_bench_writer";
+  struct {
+    const char *name;
+    bool stage;
+    channel_writer_opts_t opts;
+  } configs[] = {
+      {"write() per item", false, {0}},
+      {"stage", true, {0}},
+      {"stage, sync per batch", true, {.sync = CHANNEL_WRITER_SYNC_BATCH}},
+      {"stage, O_DIRECT", true, {.direct = true}},
+      {"stage, O_DIRECT+sync", true,
+       {.direct = true, .sync = CHANNEL_WRITER_SYNC_BATCH}},
+  };
+
+  for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+    channel_t *ch = channel_create(64, 4096);
+    pthread_t consumer;
+    item_writer_args_t wargs = {.ch = ch};
+    channel_writer_t *w = NULL;
+    uint64_t start = get_nanos();
+    if (configs[c].stage) {
+      w = channel_writer_create(ch, 64, path, &configs[c].opts);
+    } else {
+      wargs.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      pthread_create(&consumer, NULL, per_item_writer, &wargs);
+    }
+
+    char item[64] = {0};
+    for (size_t i = 0; i < COUNT; i++) {
+      memcpy(item, &i, sizeof(i));
+      channel_send(ch, item);
+    }
+    channel_close(ch);
+
+    channel_writer_stats_t stats = {.writes = 0};
+    if (w) {
+      channel_writer_destroy(w, &stats);
+    } else {
+      pthread_join(consumer, NULL);
+      close(wargs.fd);
+      stats.writes = wargs.writes;
+      stats.write_amplification = 1.0;
+    }
+    double secs = (double)(get_nanos() - start) / 1e9;
+
+    printf("%-24s | %10.1f | %8zu | %8zu | %6.3f%s\n", configs[c].name,
+           (double)(COUNT * 64) / secs / 1e6, stats.writes, stats.syncs,
+           stats.write_amplification,
+           configs[c].opts.direct && !stats.direct ? " (no O_DIRECT)" : "");
+    channel_destroy(ch);
+  }
+  unlink(path);
+}
+
+// =============================================================================
+// Benchmark 20: Topic Fan-out, Locked Map vs Event Bus
+// =============================================================================
+#define BUS_TOPICS 16
+#define BUS_SUBS 2
+
+// The routing the bus replaces: a mutex-protected topic map searched by name
+typedef struct {
+  pthread_mutex_t mu;
+  const char *names[BUS_TOPICS];
+  channel_t *subs[BUS_TOPICS][BUS_SUBS];
+} locked_map_t;
+
+typedef struct {
+  locked_map_t *map;
+  channel_bus_t *bus;
+  const uint64_t *topics;
+  size_t count;
+  size_t batch;
+} bus_bench_args_t;
+
+static const char *bus_topic_names[BUS_TOPICS] = {
+    "orders.new",   "orders.fill",  "orders.cancel", "quotes.eq",
+    "quotes.fx",    "quotes.rates", "risk.limits",   "risk.pnl",
+    "audit.login",  "audit.admin",  "market.open",   "market.close",
+    "feed.heartbt", "feed.gap",     "ops.deploy",    "ops.alert"};
+
+void *locked_map_publisher(void *arg) {
+  bus_bench_args_t *args = (bus_bench_args_t *)arg;
+  int64_t ev = 1;
+  for (size_t i = 0; i < args->count; i++) {
+    const char *name = bus_topic_names[i % BUS_TOPICS];
+    pthread_mutex_lock(&args->map->mu);
+    for (int t = 0; t < BUS_TOPICS; t++) {
+      if (strcmp(args->map->names[t], name) == 0) {
+        for (int s = 0; s < BUS_SUBS; s++) {
+          channel_send(args->map->subs[t][s], &ev);
+        }
+        break;
+      }
+    }
+    pthread_mutex_unlock(&args->map->mu);
+  }
+  return NULL;
+}
+
+void *bus_publisher(void *arg) {
+  bus_bench_args_t *args = (bus_bench_args_t *)arg;
+  int64_t ev[16] = {0};
+  for (size_t i = 0; i < args->count; i += args->batch) {
+    uint64_t topic = args->topics[i / args->batch % BUS_TOPICS];
+    channel_bus_publish_batch(args->bus, topic, ev, args->batch);
+  }
+  return NULL;
+}
+
+void bench_bus_fan_out(void) {
+  printf("\n======== Benchmark: Publish to 16 Topics x 2 Subscribers "
+         "========\n");
+  printf("%-22s | %-10s | %-18s\n", "Router", "Publishers",
+         "Events/sec");
+  printf("-----------------------|------------|-------------------\n");
+
+  const size_t COUNT = 1000000;
+  const int NPUB = 4;
+  uint64_t topics[BUS_TOPICS];
+  for (int t = 0; t < BUS_TOPICS; t++) {
+    topics[t] = channel_bus_topic(bus_topic_names[t]);
+  }
+
+  for (int mode = 0; mode < 3; mode++) {
+    channel_t *subs[BUS_TOPICS][BUS_SUBS];
+    locked_map_t map = {.mu = PTHREAD_MUTEX_INITIALIZER};
+    channel_bus_t *bus = mode ? channel_bus_create() : NULL;
+    for (int t = 0; t < BUS_TOPICS; t++) {
+      map.names[t] = bus_topic_names[t];
+      for (int s = 0; s < BUS_SUBS; s++) {
+        subs[t][s] = channel_create(sizeof(int64_t), 0);
+        map.subs[t][s] = subs[t][s];
+        if (bus) {
+          channel_bus_subscribe(bus, topics[t], subs[t][s]);
+        }
+      }
+    }
+
+    pthread_t threads[4];
+    bus_bench_args_t args = {.map = &map,
+                             .bus = bus,
+                             .topics = topics,
+                             .count = COUNT / NPUB,
+                             .batch = mode == 2 ? 16 : 1};
+    uint64_t start = get_nanos();
+    for (int i = 0; i < NPUB; i++) {
+      pthread_create(&threads[i], NULL,
+                     mode ? bus_publisher : locked_map_publisher, &args);
+    }
+    for (int i = 0; i < NPUB; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    double secs = (double)(get_nanos() - start) / 1e9;
+
+    const char *names[] = {"locked map", "bus", "bus, batches of 16"};
+    printf("%-22s | %10d | %14.2f mil\n", names[mode], NPUB,
+           (double)COUNT / secs / 1e6);
+
+    if (bus) {
+      channel_bus_destroy(bus);
+    }
+    for (int t = 0; t < BUS_TOPICS; t++) {
+      for (int s = 0; s < BUS_SUBS; s++) {
+        channel_destroy(subs[t][s]);
+      }
+    }
+  }
+}
+
+// =============================================================================
+// Benchmark 21: RPC, Reply Channel per Call vs Reply-Slot Arena
+// =============================================================================
+typedef struct {
+  int64_t arg;
+  channel_t *reply;
+} chan_rpc_req_t;
+
+// Server for the pattern the arena replaces: each request brings its own
+// reply channel
+void *reply_channel_server(void *arg) {
+  channel_t *requests = (channel_t *)arg;
+  chan_rpc_req_t req;
+  while (channel_recv(requests, &req)) {
+    int64_t resp = req.arg * 2;
+    channel_send(req.reply, &resp);
+  }
+  return NULL;
+}
+
+typedef struct {
+  channel_t *requests;
+  channel_rpc_t *rpc;
+  size_t count;
+  size_t depth;
+} rpc_bench_args_t;
+
+void *reply_channel_client(void *arg) {
+  rpc_bench_args_t *args = (rpc_bench_args_t *)arg;
+  for (size_t i = 0; i < args->count; i++) {
+    chan_rpc_req_t req = {.arg = (int64_t)i,
+                          .reply = channel_create(sizeof(int64_t), 1)};
+    channel_send(args->requests, &req);
+    int64_t resp;
+    channel_recv(req.reply, &resp);
+    channel_destroy(req.reply);
+  }
+  return NULL;
+}
+
+static void rpc_double(const void *req, void *resp, void *ctx) {
+  (void)ctx;
+  *(int64_t *)resp = *(const int64_t *)req * 2;
+}
+
+void *arena_rpc_client(void *arg) {
+  rpc_bench_args_t *args = (rpc_bench_args_t *)arg;
+  uint32_t ids[16];
+  for (size_t i = 0; i < args->count; i += args->depth) {
+    for (size_t d = 0; d < args->depth; d++) {
+      int64_t req = (int64_t)(i + d);
+      ids[d] = channel_rpc_begin(args->rpc, &req);
+    }
+    for (size_t d = 0; d < args->depth; d++) {
+      int64_t resp;
+      channel_rpc_wait(args->rpc, ids[d], &resp);
+    }
+  }
+  return NULL;
+}
+
+void bench_rpc(void) {
+  printf("\n======== Benchmark: In-Process RPC ========\n");
+  printf("%-26s | %-8s | %-16s\n", "Pattern", "Clients", "RPCs/sec");
+  printf("---------------------------|----------|-----------------\n");
+
+  const size_t COUNT = 400000;
+  const int client_counts[] = {1, 4};
+  const char *names[] = {"reply channel per call", "reply-slot arena",
+                         "arena, 16 in flight"};
+
+  for (int mode = 0; mode < 3; mode++) {
+    for (size_t c = 0; c < sizeof(client_counts) / sizeof(int); c++) {
+      int n = client_counts[c];
+      channel_t *requests = NULL;
+      channel_rpc_t *rpc = NULL;
+      pthread_t server;
+      if (mode == 0) {
+        requests = channel_create(sizeof(chan_rpc_req_t), 256);
+        pthread_create(&server, NULL, reply_channel_server, requests);
+      } else {
+        rpc = channel_rpc_create(sizeof(int64_t), sizeof(int64_t),
+                                 rpc_double, NULL, NULL);
+      }
+
+      pthread_t threads[4];
+      rpc_bench_args_t args = {.requests = requests,
+                               .rpc = rpc,
+                               .count = COUNT / n,
+                               .depth = mode == 2 ? 16 : 1};
+      uint64_t start = get_nanos();
+      for (int i = 0; i < n; i++) {
+        pthread_create(&threads[i], NULL,
+                       mode ? arena_rpc_client : reply_channel_client, &args);
+      }
+      for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+      }
+      double secs = (double)(get_nanos() - start) / 1e9;
+      printf("%-26s | %8d | %12.2f mil\n", names[mode], n,
+             (double)COUNT / secs / 1e6);
+
+      if (mode == 0) {
+        channel_close(requests);
+        pthread_join(server, NULL);
+        channel_destroy(requests);
+      } else {
+        channel_rpc_destroy(rpc);
+      }
+    }
+  }
+}
+
+// =============================================================================
+// Benchmark 22: Consumer Group Replay, Channel per Group vs Mapped Stream
+// =============================================================================
+typedef struct {
+  uint64_t seq;
+  char payload[56];
+} stream_item_t;
+
+typedef struct {
+  channel_t *ch;
+  channel_stream_group_t *g;
+  uint64_t sum;
+} replay_args_t;
+
+// Copying replay: each group drains its own channel
+void *channel_replay_reader(void *arg) {
+  replay_args_t *args = (replay_args_t *)arg;
+  stream_item_t items[256];
+  size_t n;
+  while ((n = channel_recv_batch(args->ch, items, 256))) {
+    for (size_t i = 0; i < n; i++) {
+      args->sum += items[i].seq;
+    }
+  }
+  return NULL;
+}
+
+// Zero-copy replay straight from the mapped log
+void *stream_replay_reader(void *arg) {
+  replay_args_t *args = (replay_args_t *)arg;
+  const void *p;
+  size_t n;
+  while ((n = channel_stream_read(args->g, &p, 256))) {
+    const stream_item_t *items = p;
+    for (size_t i = 0; i < n; i++) {
+      args->sum += items[i].seq;
+    }
+    channel_stream_commit(args->g);
+  }
+  return NULL;
+}
+
+void bench_stream_replay(void) {
+  printf("\n======== Benchmark: Consumer Group Replay ========\n");
+  printf("%-22s | %-8s | %-16s\n", "Pattern", "Groups", "Items/sec/group");
+  printf("-----------------------|----------|-----------------\n");
+
+  const size_t COUNT = 1000000;
+  const int group_counts[] = {1, 4};
+  char path[] = "/tmp/channels_bench_stream_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+  unlink(path);
+
+  // Fill the log once, every run replays it from the start
+  channel_stream_t *s = channel_stream_open(path, sizeof(stream_item_t),
+                                            NULL);
+  stream_item_t *items = calloc(1024, sizeof(stream_item_t));
+  for (size_t i = 0; i < COUNT; i += 1024) {
+    for (size_t j = 0; j < 1024; j++) {
+      items[j].seq = i + j;
+    }
+    channel_stream_append(s, items, 1024);
+  }
+  channel_stream_close(s);
+  size_t total = (size_t)channel_stream_length(s);
+
+  for (int mode = 0; mode < 2; mode++) {
+    for (size_t c = 0; c < sizeof(group_counts) / sizeof(int); c++) {
+      int n = group_counts[c];
+      pthread_t threads[4];
+      replay_args_t args[4];
+      uint64_t start = get_nanos();
+      for (int i = 0; i < n; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "replay%d", i);
+        args[i] = (replay_args_t){.g = channel_stream_group(s, name)};
+        channel_stream_seek(args[i].g, 0);
+        if (mode == 0) {
+          args[i].ch = channel_create(sizeof(stream_item_t), 1024);
+        }
+        pthread_create(&threads[i], NULL,
+                       mode ? stream_replay_reader : channel_replay_reader,
+                       &args[i]);
+      }
+
+      // The copying pattern needs a dispatcher pushing the log into every
+      // group's channel
+      if (mode == 0) {
+        for (size_t i = 0; i < total; i += 1024) {
+          for (size_t j = 0; j < 1024; j++) {
+            items[j].seq = i + j;
+          }
+          for (int g = 0; g < n; g++) {
+            channel_send_batch(args[g].ch, items, 1024);
+          }
+        }
+        for (int g = 0; g < n; g++) {
+          channel_close(args[g].ch);
+        }
+      }
+      for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        if (args[i].ch) {
+          channel_destroy(args[i].ch);
+        }
+      }
+      double secs = (double)(get_nanos() - start) / 1e9;
+      printf("%-22s | %8d | %12.2f mil\n",
+             mode ? "zero-copy stream" : "channel per group", n,
+             (double)total / secs / 1e6);
+    }
+  }
+
+  free(items);
+  channel_stream_destroy(s);
+  unlink(path);
+}
+
+// =============================================================================
+// Benchmark 23: Draining with N Threads, Per-Item Receive vs Parallel For
+// =============================================================================
+// Per-thread work done on each item, so both patterns touch it alike
+static _Thread_local int64_t drain_sum;
+
+void *drain_per_item(void *arg) {
+  channel_t *ch = (channel_t *)arg;
+  int64_t val;
+  while (channel_recv(ch, &val)) {
+    drain_sum += val;
+  }
+  return NULL;
+}
+
+static void parallel_sink(void *item, void *ctx) {
+  (void)ctx;
+  drain_sum += *(int64_t *)item;
+}
+
+void bench_parallel_for(void) {
+  printf("\n======== Benchmark: Parallel Drain (closed channel) ========\n");
+  printf("%-22s | %-8s | %-16s\n", "Pattern", "Threads", "Items/sec");
+  printf("-----------------------|----------|-----------------\n");
+
+  const size_t COUNT = 2000000;
+  const size_t thread_counts[] = {1, 4};
+  for (int mode = 0; mode < 2; mode++) {
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(size_t); t++) {
+      size_t n = thread_counts[t];
+      channel_t *ch = channel_create(sizeof(int64_t), 0);
+      for (size_t i = 0; i < COUNT; i++) {
+        int64_t val = (int64_t)i;
+        channel_send(ch, &val);
+      }
+      channel_close(ch);
+
+      uint64_t start = get_nanos();
+      if (mode == 0) {
+        pthread_t threads[4];
+        for (size_t i = 0; i < n; i++) {
+          pthread_create(&threads[i], NULL, drain_per_item, ch);
+        }
+        for (size_t i = 0; i < n; i++) {
+          pthread_join(threads[i], NULL);
+        }
+      } else {
+        channel_parallel_for(ch, sizeof(int64_t), n, parallel_sink, NULL, 64,
+                             NULL);
+      }
+      double secs = (double)(get_nanos() - start) / 1e9;
+      printf("%-22s | %8zu | %12.2f mil\n",
+             mode ? "parallel_for, batch 64" : "channel_recv per item", n,
+             (double)COUNT / secs / 1e6);
+      channel_destroy(ch);
+    }
+  }
+}
+
+// =============================================================================
+// Benchmark 24: Fan-out to Branches, Per-Item Sends vs Tee Stage
+// =============================================================================
+void *drain_branch(void *arg) {
+  channel_t *ch = (channel_t *)arg;
+  int64_t items[256];
+  while (channel_recv_batch(ch, items, 256)) {
+  }
+  return NULL;
+}
+
+// The pattern the tee replaces: receive each item and send it to every
+// branch in turn
+typedef struct {
+  channel_t *src;
+  channel_t **branches;
+  size_t nbranches;
+} fan_out_args_t;
+
+void *per_item_fan_out(void *arg) {
+  fan_out_args_t *args = (fan_out_args_t *)arg;
+  int64_t val;
+  while (channel_recv(args->src, &val)) {
+    for (size_t i = 0; i < args->nbranches; i++) {
+      channel_send(args->branches[i], &val);
+    }
+  }
+  for (size_t i = 0; i < args->nbranches; i++) {
+    channel_close(args->branches[i]);
+  }
+  return NULL;
+}
+
+void bench_tee(void) {
+  printf("\n======== Benchmark: Fan-out to Branches ========\n");
+  printf("%-22s | %-8s | %-16s\n", "Pattern", "Branches", "Items/sec");
+  printf("-----------------------|----------|-----------------\n");
+
+  const size_t COUNT = 1000000;
+  const size_t branch_counts[] = {1, 4};
+  for (int mode = 0; mode < 2; mode++) {
+    for (size_t b = 0; b < sizeof(branch_counts) / sizeof(size_t); b++) {
+      size_t n = branch_counts[b];
+      channel_t *src = channel_create(sizeof(int64_t), 1024);
+      channel_t *chs[4];
+      channel_tee_branch_t branches[4];
+      pthread_t readers[4];
+      for (size_t i = 0; i < n; i++) {
+        chs[i] = channel_create(sizeof(int64_t), 1024);
+        branches[i] = (channel_tee_branch_t){.ch = chs[i],
+                                             .policy = CHANNEL_TEE_BLOCK};
+        pthread_create(&readers[i], NULL, drain_branch, chs[i]);
+      }
+
+      uint64_t start = get_nanos();
+      pthread_t fan;
+      fan_out_args_t args = {src, chs, n};
+      channel_tee_t *t = NULL;
+      if (mode == 0) {
+        pthread_create(&fan, NULL, per_item_fan_out, &args);
+      } else {
+        t = channel_tee_create(src, sizeof(int64_t), branches, n, NULL);
+      }
+      int64_t batch[256];
+      for (size_t i = 0; i < COUNT; i += 256) {
+        for (size_t j = 0; j < 256; j++) {
+          batch[j] = (int64_t)(i + j);
+        }
+        channel_send_batch(src, batch, 256);
+      }
+      channel_close(src);
+      if (mode == 0) {
+        pthread_join(fan, NULL);
+      } else {
+        channel_tee_destroy(t);
+      }
+      for (size_t i = 0; i < n; i++) {
+        pthread_join(readers[i], NULL);
+      }
+      double secs = (double)(get_nanos() - start) / 1e9;
+      printf("%-22s | %8zu | %12.2f mil\n",
+             mode ? "tee, batched sends" : "per-item sends", n,
+             (double)COUNT / secs / 1e6);
+
+      for (size_t i = 0; i < n; i++) {
+        channel_destroy(chs[i]);
+      }
+      channel_destroy(src);
+    }
+  }
+}
+
+// =============================================================================
+// Benchmark 25: File Ingest, Single getline Reader vs Parallel Chunks
+// =============================================================================
+typedef struct {
+  channel_t *ch;
+  size_t records;
+} ingest_drain_args_t;
+
+// Consumer for both patterns, looking at each record's first byte
+void *drain_records(void *arg) {
+  ingest_drain_args_t *args = (ingest_drain_args_t *)arg;
+  channel_ingest_record_t recs[256];
+  size_t n;
+  while ((n = channel_recv_batch(args->ch, recs, 256))) {
+    for (size_t i = 0; i < n; i++) {
+      drain_sum += recs[i].len ? recs[i].data[0] : 0;
+    }
+    args->records += n;
+  }
+  return NULL;
+}
+
+void bench_ingest(void) {
+  printf("\n======== Benchmark: File Ingest (128MB, warm cache) ========\n");
+  printf("%-24s | %-8s | %-10s | %-8s\n", "Pattern", "Threads", "Records",
+         "GB/s");
+  printf("-------------------------|----------|------------|---------\n");
+
+  char path[] = "/tmp/channels_bench_ingest_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return;
+  }
+  FILE *f = fdopen(fd, "w");
+  const size_t SIZE = 128 << 20;
+  const char *padding = "payload-payload-payload-payload-payload-payload-";
+  size_t written = 0;
+  for (size_t i = 0; written < SIZE; i++) {
+    int len = fprintf(f, "%zu,event,%zu,%.*s\n", i, i * 7919 % 100000,
+                      (int)(i % 48), padding);
+    written += (size_t)len;
+  }
+  fclose(f);
+
+  // Baseline: one thread reading line by line with getline. Its records
+  // point into a line buffer that is reused, which is only safe because the
+  // consumer never looks past the first byte
+  {
+    channel_t *ch = channel_create(sizeof(channel_ingest_record_t), 4096);
+    ingest_drain_args_t args = {.ch = ch};
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, drain_records, &args);
+    uint64_t start = get_nanos();
+    FILE *in = fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    uint64_t offset = 0;
+    while ((len = getline(&line, &cap, in)) > 0) {
+      channel_ingest_record_t rec = {line, (size_t)len - 1, offset};
+      channel_send(ch, &rec);
+      offset += (uint64_t)len;
+    }
+    fclose(in);
+    channel_close(ch);
+    pthread_join(consumer, NULL);
+    double secs = (double)(get_nanos() - start) / 1e9;
+    printf("%-24s | %8d | %10zu | %8.2f\n", "getline, channel_send", 1,
+           args.records, (double)written / secs / 1e9);
+    free(line);
+    channel_destroy(ch);
+  }
+
+  const size_t thread_counts[] = {1, 4};
+  for (int ordered = 0; ordered < 2; ordered++) {
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(size_t); t++) {
+      channel_t *ch = channel_create(sizeof(channel_ingest_record_t), 4096);
+      ingest_drain_args_t args = {.ch = ch};
+      pthread_t consumer;
+      pthread_create(&consumer, NULL, drain_records, &args);
+      uint64_t start = get_nanos();
+      channel_ingest_opts_t opts = {.threads = thread_counts[t],
+                                    .ordered = ordered};
+      channel_ingest_t *in = channel_ingest_start(path, ch, &opts);
+      pthread_join(consumer, NULL);
+      double secs = (double)(get_nanos() - start) / 1e9;
+      channel_ingest_destroy(in);
+      printf("%-24s | %8zu | %10zu | %8.2f\n",
+             ordered ? "ingest, ordered" : "ingest, unordered",
+             thread_counts[t], args.records, (double)written / secs / 1e9);
+      channel_destroy(ch);
+    }
+  }
+  unlink(path);
+}
+
+// =============================================================================
+// Benchmark 26: Many Producers, Shared Channel vs Per-CPU Rings
+// =============================================================================
+typedef struct {
+  channel_t *ch;
+  channel_percpu_t *c;
+  size_t count;
+} percpu_bench_args_t;
+
+void *many_producer(void *arg) {
+  percpu_bench_args_t *args = (percpu_bench_args_t *)arg;
+  for (size_t i = 0; i < args->count; i++) {
+    int64_t val = (int64_t)i;
+    if (args->c) {
+      channel_percpu_send(args->c, &val);
+    } else {
+      channel_send(args->ch, &val);
+    }
+  }
+  return NULL;
+}
+
+void *many_consumer(void *arg) {
+  percpu_bench_args_t *args = (percpu_bench_args_t *)arg;
+  int64_t vals[256];
+  size_t n;
+  for (;;) {
+    n = args->c ? channel_percpu_recv_batch(args->c, vals, 256)
+                : channel_recv_batch(args->ch, vals, 256);
+    if (n == 0) {
+      break;
+    }
+    for (size_t i = 0; i < n; i++) {
+      drain_sum += vals[i];
+    }
+  }
+  return NULL;
+}
+
+void bench_percpu(void) {
+  printf("\n======== Benchmark: Many Producers, One Consumer ========\n");
+  printf("%-22s | %-9s | %-16s\n", "Pattern", "Producers", "Items/sec");
+  printf("-----------------------|-----------|-----------------\n");
+
+  // The same total capacity for both, 1024 items per CPU
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  const size_t PER_CPU = 1024;
+  const size_t TOTAL = 1000000;
+  const size_t producer_counts[] = {8, 1000};
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 64 * 1024);
+  for (int mode = 0; mode < 2; mode++) {
+    for (size_t p = 0; p < sizeof(producer_counts) / sizeof(size_t); p++) {
+      size_t n = producer_counts[p];
+      percpu_bench_args_t args = {.count = TOTAL / n};
+      if (mode == 0) {
+        args.ch = channel_create(sizeof(int64_t), PER_CPU * (size_t)cpus);
+      } else {
+        args.c = channel_percpu_create(sizeof(int64_t), PER_CPU);
+      }
+      pthread_t *producers = malloc(n * sizeof(pthread_t));
+      pthread_t consumer;
+
+      uint64_t start = get_nanos();
+      pthread_create(&consumer, NULL, many_consumer, &args);
+      for (size_t i = 0; i < n; i++) {
+        pthread_create(&producers[i], &attr, many_producer, &args);
+      }
+      for (size_t i = 0; i < n; i++) {
+        pthread_join(producers[i], NULL);
+      }
+      if (mode == 0) {
+        channel_close(args.ch);
+      } else {
+        channel_percpu_close(args.c);
+      }
+      pthread_join(consumer, NULL);
+      double secs = (double)(get_nanos() - start) / 1e9;
+
+      printf("%-22s | %9zu | %12.2f mil\n",
+             mode == 0 ? "channel_send" : "channel_percpu_send", n,
+             (double)(args.count * n) / secs / 1e6);
+      if (mode == 0) {
+        channel_destroy(args.ch);
+      } else {
+        channel_percpu_destroy(args.c);
+      }
+      free(producers);
+    }
+  }
+  pthread_attr_destroy(&attr);
 }
 
 int main(void) {
   bench_scaling_producers();
   bench_bounded_vs_unbounded();
   bench_item_sizes();
+  bench_swap_large_items();
   bench_capacity_impact();
   bench_latency();
+  bench_wake_policy();
+  bench_rt_wakeup();
+  bench_codel_overload();
+  bench_group_fan_in();
+  bench_select_wakeup();
+  bench_adaptive_spsc();
+  bench_queue_lock();
+  bench_batch_magic_ring();
+  bench_idle_release();
+  bench_pool_autoscale();
+  bench_fair_tenants();
+  bench_deadline_heap();
+  bench_alog();
+  bench_file_writer();
+  bench_bus_fan_out();
+  bench_rpc();
+  bench_stream_replay();
+  bench_parallel_for();
+  bench_tee();
+  bench_ingest();
+  bench_percpu();
 
   printf("\n=================================\n");
   printf("Benchmarks complete!\n");
@@ -0,0 +1,568 @@
+#define _GNU_SOURCE
+
+#include "alog.h"
+#include "channels.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ALOG_DEFAULT_CAPACITY 4096
+#define ALOG_DEFAULT_INTERVAL_NS 1000000ULL
+
+/* Formatted bytes gathered before a write, and the most one record takes */
+#define ALOG_ARENA_SIZE (64 * 1024)
+#define ALOG_LINE_MAX 1024
+
+/* iovecs gathered before a write */
+#define ALOG_IOV_MAX 256
+
+/* Strings at least this long are written from where they are instead of
+ * being copied into the arena */
+#define ALOG_STR_REF_MIN 64
+
+/* A log call as queued, one cache line */
+typedef struct alog_record_t {
+  const char *fmt;
+
+  /* CLOCK_REALTIME_COARSE time of the call */
+  uint64_t time_ns;
+
+  uint8_t nargs;
+  uint8_t types[ALOG_MAX_ARGS];
+  alog_arg_t args[ALOG_MAX_ARGS];
+} alog_record_t;
+
+/* A logging thread's queue. The thread is its only producer and the writer
+ * its only consumer, so the adaptive channel stays on its lock-free ring */
+typedef struct log_entry_t {
+  channel_t *ch;
+
+  /* Records the thread dropped, only written by that thread */
+  _Atomic size_t dropped;
+
+  /* Set when the thread exits, the writer frees the entry once drained */
+  atomic_bool exited;
+} log_entry_t;
+
+struct alog_t {
+  int fd;
+  alog_opts_t opts;
+
+  /* Each thread's entry */
+  pthread_key_t key;
+
+  /* Protects the entry array and the flush and stop state. cond wakes the
+   * writer, flushed wakes alog_flush callers */
+  pthread_mutex_t mu;
+  pthread_cond_t cond;
+  pthread_cond_t flushed;
+  log_entry_t **entries;
+  size_t size;
+  size_t cap;
+
+  /* Flush requests made, and the last one the writer has served */
+  uint64_t flush_req;
+  uint64_t flush_done;
+  bool stopping;
+
+  /* Dropped counts of freed entries */
+  size_t retired_dropped;
+
+  _Atomic size_t written;
+  _Atomic size_t writes;
+
+  pthread_t writer;
+};
+
+/* Formatted output waiting to be written */
+typedef struct batch_t {
+  char arena[ALOG_ARENA_SIZE];
+  size_t used;
+
+  struct iovec iov[ALOG_IOV_MAX];
+  int iovcnt;
+
+  /* Records in the batch */
+  size_t records;
+} batch_t;
+
+/* Thread exit, let the writer retire the thread's entry */
+static void entry_exit(void *arg) {
+  log_entry_t *e = arg;
+  atomic_store_explicit(&e->exited, true, memory_order_release);
+}
+
+/* Set up the calling thread's queue on its first log call */
+static log_entry_t *register_thread(alog_t *log) {
+  log_entry_t *e = malloc(sizeof(log_entry_t));
+  if (!e) {
+    return NULL;
+  }
+  channel_opts_t opts = {.adaptive = true};
+  e->ch = channel_create_opts(sizeof(alog_record_t), log->opts.queue_capacity,
+                              &opts);
+  if (!e->ch) {
+    free(e);
+    return NULL;
+  }
+  atomic_init(&e->dropped, 0);
+  atomic_init(&e->exited, false);
+
+  pthread_mutex_lock(&log->mu);
+  if (log->size == log->cap) {
+    size_t cap = log->cap ? log->cap * 2 : 16;
+    log_entry_t **entries = realloc(log->entries, cap * sizeof(*entries));
+    if (!entries) {
+      pthread_mutex_unlock(&log->mu);
+      channel_destroy(e->ch);
+      free(e);
+      return NULL;
+    }
+    log->entries = entries;
+    log->cap = cap;
+  }
+  log->entries[log->size++] = e;
+  pthread_mutex_unlock(&log->mu);
+
+  pthread_setspecific(log->key, e);
+  return e;
+}
+
+/* Capture a log call into the calling thread's queue */
+void alog_write(alog_t *log, const char *fmt, unsigned nargs,
+                const uint8_t *types, const alog_arg_t *args) {
+  log_entry_t *e = pthread_getspecific(log->key);
+  if (!e && !(e = register_thread(log))) {
+    return;
+  }
+
+  alog_record_t r;
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  r.fmt = fmt;
+  r.time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  r.nargs = (uint8_t)(nargs < ALOG_MAX_ARGS ? nargs : ALOG_MAX_ARGS);
+  for (unsigned i = 0; i < r.nargs; i++) {
+    r.types[i] = types[i];
+    r.args[i] = args[i];
+  }
+
+  if (!log->opts.lossy) {
+    channel_send(e->ch, &r);
+  } else if (!channel_try_send(e->ch, &r)) {
+    atomic_store_explicit(
+        &e->dropped,
+        atomic_load_explicit(&e->dropped, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+  }
+}
+
+/* Write the batch out, retrying partial writes */
+static void batch_flush(alog_t *log, batch_t *b) {
+  struct iovec *iov = b->iov;
+  int cnt = b->iovcnt;
+  while (cnt > 0) {
+    ssize_t n = writev(log->fd, iov, cnt);
+    atomic_fetch_add_explicit(&log->writes, 1, memory_order_relaxed);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    while (cnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= (ssize_t)iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= (size_t)n;
+    }
+  }
+  atomic_fetch_add_explicit(&log->written, b->records, memory_order_relaxed);
+  b->used = 0;
+  b->iovcnt = 0;
+  b->records = 0;
+}
+
+/* Account for len bytes just formatted at the end of the arena */
+static void batch_commit(batch_t *b, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  char *start = b->arena + b->used;
+  struct iovec *last = b->iovcnt ? &b->iov[b->iovcnt - 1] : NULL;
+  if (last && (char *)last->iov_base + last->iov_len == start) {
+    last->iov_len += len;
+  } else {
+    b->iov[b->iovcnt++] = (struct iovec){.iov_base = start, .iov_len = len};
+  }
+  b->used += len;
+}
+
+/* Append bytes to the batch, up to the record's budget end */
+static void batch_put(batch_t *b, const char *s, size_t len, size_t end) {
+  if (len > end - b->used) {
+    len = end - b->used;
+  }
+  memcpy(b->arena + b->used, s, len);
+  batch_commit(b, len);
+}
+
+/* Append a number in decimal, padded with zeros to at least width digits,
+ * without going through snprintf */
+static void put_decimal(batch_t *b, uint64_t v, bool neg, int width,
+                        size_t end) {
+  char buf[24];
+  char *p = buf + sizeof(buf);
+  do {
+    *--p = (char)('0' + v % 10);
+    v /= 10;
+  } while (v || buf + sizeof(buf) - p < width);
+  if (neg) {
+    *--p = '-';
+  }
+  batch_put(b, p, (size_t)(buf + sizeof(buf) - p), end);
+}
+
+/* Append one argument formatted by a single conversion spec, converting the
+ * captured value to the type the conversion expects */
+static void put_arg(batch_t *b, const char *spec, char conv, uint8_t type,
+                    alog_arg_t arg, size_t end) {
+  char *out = b->arena + b->used;
+  size_t room = end - b->used;
+  int n = 0;
+
+  switch (conv) {
+  case 'd':
+  case 'i': {
+    long long v = type == ALOG_DOUBLE ? (long long)arg.d : (long long)arg.i;
+    n = snprintf(out, room, spec, v);
+    break;
+  }
+  case 'o':
+  case 'u':
+  case 'x':
+  case 'X': {
+    unsigned long long v =
+        type == ALOG_DOUBLE ? (unsigned long long)arg.d : arg.u;
+    n = snprintf(out, room, spec, v);
+    break;
+  }
+  case 'c':
+    n = snprintf(out, room, spec, (int)arg.i);
+    break;
+  case 'p':
+    n = snprintf(out, room, spec, arg.p);
+    break;
+  case 's':
+    n = snprintf(out, room, spec,
+                 type == ALOG_STR && arg.p ? (const char *)arg.p : "(?)");
+    break;
+  default: {
+    /* Floating point conversions */
+    double v = type == ALOG_DOUBLE ? arg.d
+               : type == ALOG_INT  ? (double)arg.i
+                                   : (double)arg.u;
+    n = snprintf(out, room, spec, v);
+    break;
+  }
+  }
+
+  /* With no room left, snprintf wrote nothing but still reports a length */
+  if (n > 0 && room > 0) {
+    batch_commit(b, (size_t)n < room ? (size_t)n : room - 1);
+  }
+}
+
+/* Format one record into the batch: a timestamp, the message and a newline.
+ * Long plain %s arguments get an iovec of their own instead of a copy */
+static void batch_record(batch_t *b, const alog_record_t *r) {
+  size_t end = b->used + ALOG_LINE_MAX;
+  put_decimal(b, r->time_ns / 1000000000ULL, false, 1, end);
+  batch_put(b, ".", 1, end);
+  put_decimal(b, r->time_ns / 1000000ULL % 1000, false, 3, end);
+  batch_put(b, " ", 1, end);
+
+  const char *p = r->fmt;
+  unsigned argi = 0;
+  while (*p) {
+    const char *pct = strchr(p, '%');
+    if (!pct) {
+      batch_put(b, p, strlen(p), end);
+      break;
+    }
+    batch_put(b, p, (size_t)(pct - p), end);
+    if (pct[1] == '%') {
+      batch_put(b, "%", 1, end);
+      p = pct + 2;
+      continue;
+    }
+
+    /* Copy flags, width and precision, skip length modifiers */
+    char spec[32];
+    size_t len = 0;
+    const char *q = pct;
+    spec[len++] = *q++;
+    while (*q && strchr("-+ #0123456789.", *q) && len < sizeof(spec) - 4) {
+      spec[len++] = *q++;
+    }
+    while (*q && strchr("hlLqjzt", *q)) {
+      q++;
+    }
+    char conv = *q;
+    if (!conv || !strchr("diouxXcpsfFeEgGaA", conv) || argi >= r->nargs) {
+      /* Unknown conversion or missing argument, print it as written */
+      batch_put(b, pct, (size_t)(q - pct) + (conv ? 1 : 0), end);
+      p = conv ? q + 1 : q;
+      continue;
+    }
+    bool plain = len == 1;
+    if (strchr("diouxX", conv)) {
+      spec[len++] = 'l';
+      spec[len++] = 'l';
+    }
+    spec[len++] = conv;
+    spec[len] = '\0';
+
+    uint8_t type = r->types[argi];
+    alog_arg_t arg = r->args[argi++];
+    if (plain && conv == 's' && type == ALOG_STR && arg.p) {
+      size_t slen = strlen(arg.p);
+      if (slen >= ALOG_STR_REF_MIN) {
+        b->iov[b->iovcnt++] =
+            (struct iovec){.iov_base = (void *)arg.p, .iov_len = slen};
+      } else {
+        batch_put(b, arg.p, slen, end);
+      }
+    } else if (plain && (conv == 'd' || conv == 'i') && type == ALOG_INT) {
+      /* The common integer conversions skip snprintf */
+      uint64_t mag = arg.i < 0 ? 0 - (uint64_t)arg.i : (uint64_t)arg.i;
+      put_decimal(b, mag, arg.i < 0, 1, end);
+    } else if (plain && conv == 'u' && type != ALOG_DOUBLE) {
+      put_decimal(b, arg.u, false, 1, end);
+    } else {
+      put_arg(b, spec, conv, type, arg, end);
+    }
+    p = q + 1;
+  }
+
+  size_t last = b->iov[b->iovcnt - 1].iov_len;
+  const char *tail = (const char *)b->iov[b->iovcnt - 1].iov_base + last - 1;
+  if (*tail != '\n') {
+    /* Room for the newline is always kept */
+    b->arena[b->used] = '\n';
+    batch_commit(b, 1);
+  }
+  b->records++;
+}
+
+/* Whether the batch may not have room for another record */
+static bool batch_full(const batch_t *b) {
+  return b->used + ALOG_LINE_MAX + 1 > ALOG_ARENA_SIZE ||
+         b->iovcnt + 2 * ALOG_MAX_ARGS + 3 > ALOG_IOV_MAX;
+}
+
+/* Drop an exited thread's entry once its queue is drained */
+static void retire_entry(alog_t *log, log_entry_t *e) {
+  pthread_mutex_lock(&log->mu);
+  for (size_t i = 0; i < log->size; i++) {
+    if (log->entries[i] == e) {
+      log->entries[i] = log->entries[--log->size];
+      break;
+    }
+  }
+  log->retired_dropped += atomic_load(&e->dropped);
+  pthread_mutex_unlock(&log->mu);
+  channel_destroy(e->ch);
+  free(e);
+}
+
+/* Format and write everything queued in every entry, returning the number
+ * of records handled */
+static size_t drain_all(alog_t *log, batch_t *b, log_entry_t ***snap,
+                        size_t *snap_cap) {
+  pthread_mutex_lock(&log->mu);
+  if (*snap_cap < log->size) {
+    log_entry_t **grown = realloc(*snap, log->size * sizeof(**snap));
+    if (grown) {
+      *snap = grown;
+      *snap_cap = log->size;
+    }
+  }
+  size_t n = log->size < *snap_cap ? log->size : *snap_cap;
+  if (n) {
+    memcpy(*snap, log->entries, n * sizeof(**snap));
+  }
+  pthread_mutex_unlock(&log->mu);
+
+  size_t handled = 0;
+  for (size_t i = 0; i < n; i++) {
+    log_entry_t *e = (*snap)[i];
+    /* Read before the queue, so everything the thread logged is seen */
+    bool exited = atomic_load_explicit(&e->exited, memory_order_acquire);
+    channel_stats_t s;
+    channel_stats(e->ch, &s);
+    for (size_t k = 0; k < s.queued; k++) {
+      alog_record_t r;
+      channel_recv(e->ch, &r);
+      if (batch_full(b)) {
+        batch_flush(log, b);
+      }
+      batch_record(b, &r);
+    }
+    handled += s.queued;
+    if (exited && s.queued == 0) {
+      retire_entry(log, e);
+    }
+  }
+  if (b->iovcnt) {
+    batch_flush(log, b);
+  }
+  return handled;
+}
+
+/* Background thread: drain the queues, sleeping while they are all empty */
+static void *alog_writer(void *arg) {
+  alog_t *log = arg;
+  batch_t *b = malloc(sizeof(batch_t));
+  log_entry_t **snap = NULL;
+  size_t snap_cap = 0;
+  if (!b) {
+    return NULL;
+  }
+  b->used = 0;
+  b->iovcnt = 0;
+  b->records = 0;
+
+  pthread_mutex_lock(&log->mu);
+  for (;;) {
+    uint64_t req = log->flush_req;
+    bool stopping = log->stopping;
+    pthread_mutex_unlock(&log->mu);
+
+    size_t handled = drain_all(log, b, &snap, &snap_cap);
+
+    pthread_mutex_lock(&log->mu);
+    if (log->flush_done < req) {
+      log->flush_done = req;
+      pthread_cond_broadcast(&log->flushed);
+    }
+    if (handled == 0) {
+      if (stopping) {
+        break;
+      }
+      if (log->flush_req == req && !log->stopping) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t t = (uint64_t)ts.tv_sec * 1000000000ULL +
+                     (uint64_t)ts.tv_nsec + log->opts.flush_interval_ns;
+        ts.tv_sec = (time_t)(t / 1000000000ULL);
+        ts.tv_nsec = (long)(t % 1000000000ULL);
+        pthread_cond_timedwait(&log->cond, &log->mu, &ts);
+      }
+    }
+  }
+  pthread_mutex_unlock(&log->mu);
+
+  free(snap);
+  free(b);
+  return NULL;
+}
+
+/* Create a logger and start its writer */
+alog_t *alog_create(int fd, const alog_opts_t *opts) {
+  alog_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+
+  alog_t *log = calloc(1, sizeof(alog_t));
+  if (!log) {
+    return NULL;
+  }
+  log->fd = fd;
+  log->opts = *opts;
+  if (log->opts.queue_capacity == 0) {
+    log->opts.queue_capacity = ALOG_DEFAULT_CAPACITY;
+  }
+  if (log->opts.flush_interval_ns == 0) {
+    log->opts.flush_interval_ns = ALOG_DEFAULT_INTERVAL_NS;
+  }
+  atomic_init(&log->written, 0);
+  atomic_init(&log->writes, 0);
+
+  if (pthread_key_create(&log->key, entry_exit) != 0) {
+    free(log);
+    return NULL;
+  }
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_mutex_init(&log->mu, NULL);
+  pthread_cond_init(&log->cond, &attr);
+  pthread_cond_init(&log->flushed, NULL);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&log->writer, NULL, alog_writer, log) != 0) {
+    pthread_cond_destroy(&log->flushed);
+    pthread_cond_destroy(&log->cond);
+    pthread_mutex_destroy(&log->mu);
+    pthread_key_delete(log->key);
+    free(log);
+    return NULL;
+  }
+  return log;
+}
+
+/* Ask the writer for a full pass and wait for it */
+void alog_flush(alog_t *log) {
+  pthread_mutex_lock(&log->mu);
+  uint64_t req = ++log->flush_req;
+  pthread_cond_signal(&log->cond);
+  while (log->flush_done < req) {
+    pthread_cond_wait(&log->flushed, &log->mu);
+  }
+  pthread_mutex_unlock(&log->mu);
+}
+
+/* Snapshot the counters, summing the per-thread drop counts */
+void alog_stats(alog_t *log, alog_stats_t *stats) {
+  pthread_mutex_lock(&log->mu);
+  size_t dropped = log->retired_dropped;
+  for (size_t i = 0; i < log->size; i++) {
+    dropped += atomic_load_explicit(&log->entries[i]->dropped,
+                                    memory_order_relaxed);
+  }
+  pthread_mutex_unlock(&log->mu);
+  stats->dropped = dropped;
+  stats->written = atomic_load(&log->written);
+  stats->writes = atomic_load(&log->writes);
+}
+
+/* Drain, stop the writer and free every queue */
+void alog_destroy(alog_t *log) {
+  pthread_mutex_lock(&log->mu);
+  log->stopping = true;
+  pthread_cond_signal(&log->cond);
+  pthread_mutex_unlock(&log->mu);
+  pthread_join(log->writer, NULL);
+
+  for (size_t i = 0; i < log->size; i++) {
+    channel_destroy(log->entries[i]->ch);
+    free(log->entries[i]);
+  }
+  free(log->entries);
+  pthread_key_delete(log->key);
+  pthread_cond_destroy(&log->flushed);
+  pthread_cond_destroy(&log->cond);
+  pthread_mutex_destroy(&log->mu);
+  free(log);
+}
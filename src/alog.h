@@ -0,0 +1,176 @@
+#ifndef ALOG_H_
+#define ALOG_H_
+
+/* Asynchronous logger. Logging threads capture the format pointer and raw
+ * arguments into a fixed-size binary record on a channel of their own, and
+ * a background thread formats the records and writes them out in batches
+ * with writev */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Handle to a logger */
+typedef struct alog_t alog_t;
+
+/* Most arguments a single log call can take */
+#define ALOG_MAX_ARGS 5
+
+/* Kind of a captured argument */
+typedef enum {
+  ALOG_INT,
+  ALOG_UINT,
+  ALOG_DOUBLE,
+  /* A string, formatted after the call returns, so it must stay valid until
+   * written, e.g. a literal */
+  ALOG_STR,
+  ALOG_PTR,
+} alog_type_t;
+
+/* A captured argument */
+typedef union alog_arg_t {
+  int64_t i;
+  uint64_t u;
+  double d;
+  const void *p;
+} alog_arg_t;
+
+/* Optional logger settings, a zero-initialized struct gives the defaults */
+typedef struct alog_opts_t {
+  /* Records each thread can have waiting, 0 for the default of 4096 */
+  size_t queue_capacity;
+
+  /* Drop records, counting them in alog_stats, when a thread's queue is full
+   * instead of waiting for the writer to catch up */
+  bool lossy;
+
+  /* How long the writer sleeps once every queue is empty, 0 for the default
+   * of 1ms */
+  uint64_t flush_interval_ns;
+} alog_opts_t;
+
+/* Counters reported by alog_stats */
+typedef struct alog_stats_t {
+  /* Records written out */
+  size_t written;
+
+  /* Records dropped by lossy loggers */
+  size_t dropped;
+
+  /* writev calls made */
+  size_t writes;
+} alog_stats_t;
+
+/**
+ * @brief Creates a logger writing to a file descriptor.
+ * Starts the background writer thread.
+ *
+ * @param fd The file descriptor to write to, left open by alog_destroy.
+ * @param opts Logger settings, NULL for defaults.
+ * @return A pointer to the logger, NULL on failure.
+ */
+alog_t *alog_create(int fd, const alog_opts_t *opts);
+
+/**
+ * @brief Queues a record, normally called through ALOG.
+ * The first call from a thread sets up the thread's queue.
+ *
+ * @param log The logger handle.
+ * @param fmt printf format, which must stay valid until written. Length
+ * modifiers are ignored as arguments are formatted by their captured type.
+ * @param nargs The number of arguments, at most ALOG_MAX_ARGS.
+ * @param types The kind of each argument.
+ * @param args The arguments.
+ */
+void alog_write(alog_t *log, const char *fmt, unsigned nargs,
+                const uint8_t *types, const alog_arg_t *args);
+
+/**
+ * @brief Waits until every record queued before the call has been written.
+ *
+ * @param log The logger handle.
+ */
+void alog_flush(alog_t *log);
+
+/**
+ * @brief Reads a snapshot of the logger's counters.
+ *
+ * @param log The logger handle.
+ * @param stats Written with the current counters.
+ */
+void alog_stats(alog_t *log, alog_stats_t *stats);
+
+/**
+ * @brief Writes out everything queued, stops the writer and frees the logger.
+ * No thread may log to it any more.
+ *
+ * @param log The logger handle.
+ */
+void alog_destroy(alog_t *log);
+
+static inline alog_arg_t alog_arg_int(int64_t v) {
+  return (alog_arg_t){.i = v};
+}
+static inline alog_arg_t alog_arg_uint(uint64_t v) {
+  return (alog_arg_t){.u = v};
+}
+static inline alog_arg_t alog_arg_double(double v) {
+  return (alog_arg_t){.d = v};
+}
+static inline alog_arg_t alog_arg_ptr(const void *v) {
+  return (alog_arg_t){.p = v};
+}
+
+/* Kind and value of an argument, picked by its static type */
+#define ALOG_TYPE(x)                                                           \
+  _Generic((x), _Bool: ALOG_UINT, char: ALOG_INT, signed char: ALOG_INT,       \
+      short: ALOG_INT, int: ALOG_INT, long: ALOG_INT, long long: ALOG_INT,     \
+      unsigned char: ALOG_UINT, unsigned short: ALOG_UINT,                     \
+      unsigned: ALOG_UINT, unsigned long: ALOG_UINT,                           \
+      unsigned long long: ALOG_UINT, float: ALOG_DOUBLE, double: ALOG_DOUBLE,  \
+      char *: ALOG_STR, const char *: ALOG_STR, default: ALOG_PTR)
+#define ALOG_ARG(x)                                                            \
+  _Generic((x), _Bool: alog_arg_uint, char: alog_arg_int,                      \
+      signed char: alog_arg_int, short: alog_arg_int, int: alog_arg_int,       \
+      long: alog_arg_int, long long: alog_arg_int,                             \
+      unsigned char: alog_arg_uint, unsigned short: alog_arg_uint,             \
+      unsigned: alog_arg_uint, unsigned long: alog_arg_uint,                   \
+      unsigned long long: alog_arg_uint, float: alog_arg_double,               \
+      double: alog_arg_double, default: alog_arg_ptr)(x)
+
+#define ALOG_CAT_(a, b) a##b
+#define ALOG_CAT(a, b) ALOG_CAT_(a, b)
+#define ALOG_COUNT_(_1, _2, _3, _4, _5, _6, n, ...) n
+#define ALOG_COUNT(...) ALOG_COUNT_(__VA_ARGS__, 5, 4, 3, 2, 1, 0, -1)
+
+#define ALOG_0(log, fmt) alog_write(log, fmt, 0, NULL, NULL)
+#define ALOG_1(log, fmt, a)                                                    \
+  alog_write(log, fmt, 1, (const uint8_t[]){ALOG_TYPE(a)},                     \
+             (const alog_arg_t[]){ALOG_ARG(a)})
+#define ALOG_2(log, fmt, a, b)                                                 \
+  alog_write(log, fmt, 2, (const uint8_t[]){ALOG_TYPE(a), ALOG_TYPE(b)},       \
+             (const alog_arg_t[]){ALOG_ARG(a), ALOG_ARG(b)})
+#define ALOG_3(log, fmt, a, b, c)                                              \
+  alog_write(log, fmt, 3,                                                      \
+             (const uint8_t[]){ALOG_TYPE(a), ALOG_TYPE(b), ALOG_TYPE(c)},      \
+             (const alog_arg_t[]){ALOG_ARG(a), ALOG_ARG(b), ALOG_ARG(c)})
+#define ALOG_4(log, fmt, a, b, c, d)                                           \
+  alog_write(log, fmt, 4,                                                      \
+             (const uint8_t[]){ALOG_TYPE(a), ALOG_TYPE(b), ALOG_TYPE(c),       \
+                               ALOG_TYPE(d)},                                  \
+             (const alog_arg_t[]){ALOG_ARG(a), ALOG_ARG(b), ALOG_ARG(c),       \
+                                  ALOG_ARG(d)})
+#define ALOG_5(log, fmt, a, b, c, d, e)                                        \
+  alog_write(log, fmt, 5,                                                      \
+             (const uint8_t[]){ALOG_TYPE(a), ALOG_TYPE(b), ALOG_TYPE(c),       \
+                               ALOG_TYPE(d), ALOG_TYPE(e)},                    \
+             (const alog_arg_t[]){ALOG_ARG(a), ALOG_ARG(b), ALOG_ARG(c),       \
+                                  ALOG_ARG(d), ALOG_ARG(e)})
+
+/* Log a printf-style message with up to ALOG_MAX_ARGS arguments, e.g.
+ * ALOG(log, "user %s took %d ms", name, ms). A newline is added if the
+ * format does not end with one */
+#define ALOG(log, ...)                                                         \
+  ALOG_CAT(ALOG_, ALOG_COUNT(__VA_ARGS__))(log, __VA_ARGS__)
+
+#endif // ALOG_H_
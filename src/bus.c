@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+
+#include "bus.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Subscribers of one topic. Never changed once published in a table */
+typedef struct bus_topic_t {
+  uint64_t hash;
+  size_t nsubs;
+  channel_t *subs[];
+} bus_topic_t;
+
+/* Open-addressed topic table, also never changed once published */
+typedef struct bus_table_t {
+  size_t mask;
+  size_t ntopics;
+  bus_topic_t *slots[];
+} bus_table_t;
+
+/* A publishing thread's read-side marker. active holds the epoch the thread
+ * entered under while it may be reading a table, 0 otherwise */
+typedef struct bus_reader_t {
+  _Atomic uint64_t active;
+  atomic_bool in_use;
+  struct bus_reader_t *next;
+} bus_reader_t;
+
+struct channel_bus_t {
+  /* The current table, replaced whole by subscription changes */
+  _Atomic(bus_table_t *) table;
+
+  /* Bumped by every table swap */
+  _Atomic uint64_t epoch;
+
+  /* Every reader marker, only ever pushed to. Markers of exited threads are
+   * reused */
+  _Atomic(bus_reader_t *) readers;
+  pthread_key_t key;
+
+  /* Serializes subscription changes */
+  pthread_mutex_t mu;
+};
+
+/* 64-bit FNV-1a */
+uint64_t channel_bus_topic(const char *name) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+    h ^= *p;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/* Slot holding topic hash, or the empty slot where it would go */
+static size_t table_find(const bus_table_t *t, uint64_t hash) {
+  size_t i = (size_t)hash & t->mask;
+  while (t->slots[i] && t->slots[i]->hash != hash) {
+    i = (i + 1) & t->mask;
+  }
+  return i;
+}
+
+/* Empty table with room for ntopics at half load */
+static bus_table_t *table_alloc(size_t ntopics) {
+  size_t size = 8;
+  while (size < ntopics * 2) {
+    size *= 2;
+  }
+  bus_table_t *t = calloc(1, sizeof(bus_table_t) + size * sizeof(void *));
+  if (t) {
+    t->mask = size - 1;
+  }
+  return t;
+}
+
+/* Copy of old with the topic's entry swapped for repl, which may be NULL to
+ * drop the topic. The other entries are shared with old */
+static bus_table_t *table_replace(const bus_table_t *old, uint64_t hash,
+                                  bus_topic_t *repl) {
+  size_t ntopics = old->ntopics + (repl ? 1 : 0);
+  bus_table_t *t = table_alloc(ntopics);
+  if (!t) {
+    return NULL;
+  }
+  for (size_t i = 0; i <= old->mask; i++) {
+    bus_topic_t *e = old->slots[i];
+    if (e && e->hash != hash) {
+      t->slots[table_find(t, e->hash)] = e;
+      t->ntopics++;
+    }
+  }
+  if (repl) {
+    t->slots[table_find(t, hash)] = repl;
+    t->ntopics++;
+  }
+  return t;
+}
+
+/* Thread exit, hand the marker to a later thread */
+static void reader_exit(void *arg) {
+  bus_reader_t *r = arg;
+  atomic_store_explicit(&r->in_use, false, memory_order_release);
+}
+
+/* The calling thread's marker, claimed on its first publish */
+static bus_reader_t *reader_get(channel_bus_t *bus) {
+  bus_reader_t *r = pthread_getspecific(bus->key);
+  if (r) {
+    return r;
+  }
+
+  for (r = atomic_load(&bus->readers); r; r = r->next) {
+    bool free_slot = false;
+    if (!atomic_load(&r->in_use) &&
+        atomic_compare_exchange_strong(&r->in_use, &free_slot, true)) {
+      break;
+    }
+  }
+  if (!r) {
+    r = malloc(sizeof(bus_reader_t));
+    if (!r) {
+      return NULL;
+    }
+    atomic_init(&r->active, 0);
+    atomic_init(&r->in_use, true);
+    r->next = atomic_load(&bus->readers);
+    while (!atomic_compare_exchange_weak(&bus->readers, &r->next, r)) {
+    }
+  }
+  pthread_setspecific(bus->key, r);
+  return r;
+}
+
+/* Swap in a new table and wait until no reader can still see the old one.
+ * Called with bus->mu held */
+static void table_publish_locked(channel_bus_t *bus, bus_table_t *t) {
+  bus_table_t *old = atomic_exchange(&bus->table, t);
+  uint64_t epoch = atomic_fetch_add(&bus->epoch, 1) + 1;
+
+  /* A reader that entered before the bump may hold old */
+  for (bus_reader_t *r = atomic_load(&bus->readers); r; r = r->next) {
+    uint64_t seen;
+    while ((seen = atomic_load(&r->active)) != 0 && seen < epoch) {
+      sched_yield();
+    }
+  }
+  free(old);
+}
+
+/* Start with an empty table */
+channel_bus_t *channel_bus_create(void) {
+  channel_bus_t *bus = calloc(1, sizeof(channel_bus_t));
+  if (!bus) {
+    return NULL;
+  }
+  bus_table_t *t = table_alloc(0);
+  if (!t || pthread_key_create(&bus->key, reader_exit) != 0) {
+    free(t);
+    free(bus);
+    return NULL;
+  }
+  atomic_init(&bus->table, t);
+  atomic_init(&bus->epoch, 1);
+  atomic_init(&bus->readers, NULL);
+  pthread_mutex_init(&bus->mu, NULL);
+  return bus;
+}
+
+/* Add ch to the topic's subscribers with a fresh entry and table */
+bool channel_bus_subscribe(channel_bus_t *bus, uint64_t topic, channel_t *ch) {
+  pthread_mutex_lock(&bus->mu);
+  bus_table_t *old = atomic_load(&bus->table);
+  bus_topic_t *cur = old->slots[table_find(old, topic)];
+  size_t nsubs = cur ? cur->nsubs : 0;
+  for (size_t i = 0; i < nsubs; i++) {
+    if (cur->subs[i] == ch) {
+      pthread_mutex_unlock(&bus->mu);
+      return false;
+    }
+  }
+
+  bus_topic_t *e =
+      malloc(sizeof(bus_topic_t) + (nsubs + 1) * sizeof(channel_t *));
+  if (!e) {
+    pthread_mutex_unlock(&bus->mu);
+    return false;
+  }
+  e->hash = topic;
+  e->nsubs = nsubs + 1;
+  if (nsubs) {
+    memcpy(e->subs, cur->subs, nsubs * sizeof(channel_t *));
+  }
+  e->subs[nsubs] = ch;
+
+  bus_table_t *t = table_replace(old, topic, e);
+  if (!t) {
+    free(e);
+    pthread_mutex_unlock(&bus->mu);
+    return false;
+  }
+  table_publish_locked(bus, t);
+  free(cur);
+  pthread_mutex_unlock(&bus->mu);
+  return true;
+}
+
+/* Drop ch from the topic's subscribers, the topic goes with its last one */
+bool channel_bus_unsubscribe(channel_bus_t *bus, uint64_t topic,
+                             channel_t *ch) {
+  pthread_mutex_lock(&bus->mu);
+  bus_table_t *old = atomic_load(&bus->table);
+  bus_topic_t *cur = old->slots[table_find(old, topic)];
+  size_t at = 0;
+  while (cur && at < cur->nsubs && cur->subs[at] != ch) {
+    at++;
+  }
+  if (!cur || at == cur->nsubs) {
+    pthread_mutex_unlock(&bus->mu);
+    return false;
+  }
+
+  bus_topic_t *e = NULL;
+  if (cur->nsubs > 1) {
+    e = malloc(sizeof(bus_topic_t) + (cur->nsubs - 1) * sizeof(channel_t *));
+    if (!e) {
+      pthread_mutex_unlock(&bus->mu);
+      return false;
+    }
+    e->hash = topic;
+    e->nsubs = cur->nsubs - 1;
+    memcpy(e->subs, cur->subs, at * sizeof(channel_t *));
+    memcpy(e->subs + at, cur->subs + at + 1,
+           (cur->nsubs - at - 1) * sizeof(channel_t *));
+  }
+
+  bus_table_t *t = table_replace(old, topic, e);
+  if (!t) {
+    free(e);
+    pthread_mutex_unlock(&bus->mu);
+    return false;
+  }
+  table_publish_locked(bus, t);
+  free(cur);
+  pthread_mutex_unlock(&bus->mu);
+  return true;
+}
+
+/* Fan the events out under a read-side marker, no lock taken */
+size_t channel_bus_publish_batch(channel_bus_t *bus, uint64_t topic,
+                                 const void *events, size_t n) {
+  bus_reader_t *r = reader_get(bus);
+  if (!r) {
+    return 0;
+  }
+
+  /* Announce the epoch before loading the table, so a swap either waits for
+   * this reader or is seen by it */
+  atomic_store(&r->active, atomic_load(&bus->epoch));
+  bus_table_t *t = atomic_load(&bus->table);
+  bus_topic_t *e = t->slots[table_find(t, topic)];
+
+  size_t delivered = 0;
+  for (size_t i = 0; e && i < e->nsubs; i++) {
+    if (channel_send_batch(e->subs[i], events, n) == n) {
+      delivered++;
+    }
+  }
+  atomic_store_explicit(&r->active, 0, memory_order_release);
+  return delivered;
+}
+
+/* A batch of one */
+size_t channel_bus_publish(channel_bus_t *bus, uint64_t topic,
+                           const void *event) {
+  return channel_bus_publish_batch(bus, topic, event, 1);
+}
+
+/* Free the table, its topics and the reader markers */
+void channel_bus_destroy(channel_bus_t *bus) {
+  bus_table_t *t = atomic_load(&bus->table);
+  for (size_t i = 0; i <= t->mask; i++) {
+    free(t->slots[i]);
+  }
+  free(t);
+
+  bus_reader_t *r = atomic_load(&bus->readers);
+  while (r) {
+    bus_reader_t *next = r->next;
+    free(r);
+    r = next;
+  }
+  pthread_key_delete(bus->key);
+  pthread_mutex_destroy(&bus->mu);
+  free(bus);
+}
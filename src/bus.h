@@ -0,0 +1,91 @@
+#ifndef BUS_H_
+#define BUS_H_
+
+/* Topic-based event bus. Publishers look topics up in a read-mostly
+ * subscription table without taking a lock; subscription changes copy the
+ * table, swap it in and free the old one once no publisher can still be
+ * reading it */
+
+#include "channels.h"
+
+/* Handle to an event bus */
+typedef struct channel_bus_t channel_bus_t;
+
+/**
+ * @brief Hashes a topic name into the id the bus functions take.
+ * Compute it once per topic rather than per publish. Topics are told apart
+ * by this 64-bit FNV-1a hash alone.
+ *
+ * @param name The topic name.
+ * @return The topic id.
+ */
+uint64_t channel_bus_topic(const char *name);
+
+/**
+ * @brief Creates an event bus.
+ * Events are copied into subscriber channels as items, so every channel
+ * subscribed to a topic must have the item size its publishers use.
+ *
+ * @return A pointer to the bus, NULL on failure.
+ */
+channel_bus_t *channel_bus_create(void);
+
+/**
+ * @brief Subscribes a channel to a topic.
+ * Publishes that start after this returns deliver to the channel.
+ *
+ * @param bus The bus handle.
+ * @param topic The topic id from channel_bus_topic.
+ * @param ch The channel to deliver to.
+ * @return true on success, false if already subscribed or out of memory.
+ */
+bool channel_bus_subscribe(channel_bus_t *bus, uint64_t topic, channel_t *ch);
+
+/**
+ * @brief Unsubscribes a channel from a topic.
+ * Waits for publishes that may still deliver to the channel, so once this
+ * returns the channel can be destroyed. A publish blocked on the channel
+ * being full holds this up, so close the channel or keep receiving first.
+ *
+ * @param bus The bus handle.
+ * @param topic The topic id.
+ * @param ch The subscribed channel.
+ * @return true on success, false if the channel was not subscribed.
+ */
+bool channel_bus_unsubscribe(channel_bus_t *bus, uint64_t topic,
+                             channel_t *ch);
+
+/**
+ * @brief Delivers events to every channel subscribed to a topic.
+ * Each subscriber gets the events with one channel_send_batch. Blocks while a
+ * bounded subscriber is full.
+ *
+ * @param bus The bus handle.
+ * @param topic The topic id.
+ * @param events Pointer to n consecutive events.
+ * @param n The number of events.
+ * @return The number of subscribers that received all n events.
+ */
+size_t channel_bus_publish_batch(channel_bus_t *bus, uint64_t topic,
+                                 const void *events, size_t n);
+
+/**
+ * @brief Delivers one event to every channel subscribed to a topic.
+ *
+ * @param bus The bus handle.
+ * @param topic The topic id.
+ * @param event Pointer to the event.
+ * @return The number of subscribers that received the event.
+ */
+size_t channel_bus_publish(channel_bus_t *bus, uint64_t topic,
+                           const void *event);
+
+/**
+ * @brief Frees the bus. No thread may use it any more; subscribed channels
+ * are left alone.
+ *
+ * @param bus The bus handle.
+ */
+void channel_bus_destroy(channel_bus_t *bus);
+
+#endif // BUS_H_
@@ -1,26 +1,320 @@
+#define _GNU_SOURCE
+
 #include "channels.h"
+#include "channels_inline.h"
+#include "futex.h"
+#include "qlock.h"
+#include <errno.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#endif
+
 #define CH_CLOSED 1 << 0
 #define CH_BOUNDED 1 << 1
+#define CH_SWAP 1 << 2
+#define CH_EXPIRY 1 << 3
+#define CH_CODEL 1 << 4
+#define CH_CODEL_SHED 1 << 5
+#define CH_MAGIC 1 << 6
+
+/* Algorithm a channel runs, an adaptive channel goes from SPSC to LOCKED */
+#define CH_MODE_LOCKED 0
+#define CH_MODE_SPSC CHANNEL_FAST_SPSC
+
+/* Size to align data written by different threads to, avoiding false
+ * sharing */
+#define CACHE_LINE 64
+
+/* CoDel interval used when only a target is given */
+#define CODEL_DEFAULT_INTERVAL_NS 100000000ULL
+
+/* Per-item bookkeeping stored in front of the item in its slot, only present
+ * when an option needs it */
+typedef struct slot_meta_t {
+  /* CLOCK_MONOTONIC time after which the item is dropped, 0 for never */
+  uint64_t expires_at;
+
+  /* CLOCK_MONOTONIC time the item was sent, for sojourn time */
+  uint64_t enqueued_at;
+} slot_meta_t;
+
+/* CoDel active queue management state, see RFC 8289 */
+typedef struct codel_t {
+  /* Sojourn time considered acceptable */
+  uint64_t target;
+
+  /* Window the sojourn time must stay above target before dropping */
+  uint64_t interval;
+
+  /* When the sojourn time first went above target, 0 if below */
+  uint64_t first_above_time;
+
+  /* The same for shedding senders, kept apart so that sends never move the
+   * dequeue side's state */
+  uint64_t shed_above_time;
+
+  /* When the next drop is due while in the dropping state */
+  uint64_t drop_next;
+
+  /* Drops since entering the dropping state, and the value at last entry */
+  uint32_t drop_count;
+  uint32_t last_count;
+
+  bool dropping;
+} codel_t;
+
+/* State shared by the registrations of one channel_select call */
+typedef struct select_waiter_t {
+  pthread_mutex_t mu;
+  pthread_cond_t cond;
+
+  /* -1 while waiting, then the index of the case that claimed the wakeup */
+  atomic_int fired;
+} select_waiter_t;
+
+/* A condition to wait on with the channel lock held. Channels using a queue
+ * lock wait on a futex word instead, since pthread_cond_wait can only release
+ * a pthread mutex */
+typedef struct chan_cond_t {
+  pthread_cond_t cond;
+#if defined(HAVE_QLOCK)
+  _Atomic uint32_t seq;
+
+  /* Threads waiting, and how many of them a signal has already been sent
+   * to, only changed with the channel lock held */
+  uint32_t waiters;
+  uint32_t signaled;
+#endif
+} chan_cond_t;
+
+/* A receiver blocked in channel_recv. Each waiter parks on its own condition
+ * variable so a sender can pick exactly which receiver runs next */
+typedef struct waiter_t {
+  chan_cond_t cond;
+
+  /* Set by the waker once the waiter has been unlinked from the list */
+  bool woken;
+
+  /* For a channel_select registration, the shared state to wake through
+   * instead of cond, and the case this channel is for */
+  select_waiter_t *sel;
+  int sel_index;
+
+  struct waiter_t *prev;
+  struct waiter_t *next;
+} waiter_t;
+
+/* Parked receivers, newest at the head and oldest at the tail */
+typedef struct waitlist_t {
+  waiter_t *head;
+  waiter_t *tail;
+} waitlist_t;
+
+/* A set of channels received from together. Members publish whether they
+ * hold items in the ready bitmap so receivers find work with a bit scan */
+typedef struct channel_group_t {
+  /* Bit i is set while member i is non-empty */
+  _Atomic uint64_t ready;
+
+  /* Bit i is set once member i is closed */
+  _Atomic uint64_t closed;
+
+  /* Bit i is set for every member that has joined */
+  _Atomic uint64_t members;
+
+  /* Receivers parked on cond, so senders only lock mu when needed */
+  atomic_int sleepers;
+
+  /* Member to start the next scan from */
+  atomic_uint cursor;
+
+  /* Protects size and channels, and parks receivers when nothing is ready */
+  pthread_mutex_t mu;
+  pthread_cond_t cond;
+
+  size_t size;
+  struct channel_t *channels[CHANNEL_GROUP_MAX];
+} channel_group_t;
+
+/* Wake parked group receivers, after a bitmap change they should see */
+static void group_wake(channel_group_t *g) {
+  if (atomic_load(&g->sleepers) > 0) {
+    pthread_mutex_lock(&g->mu);
+    pthread_cond_broadcast(&g->cond);
+    pthread_mutex_unlock(&g->mu);
+  }
+}
+
+/* Member index went from empty to non-empty */
+static void group_mark_ready(channel_group_t *g, int index) {
+  atomic_fetch_or(&g->ready, UINT64_C(1) << index);
+  group_wake(g);
+}
+
+/* Member index was drained */
+static void group_clear_ready(channel_group_t *g, int index) {
+  atomic_fetch_and(&g->ready, ~(UINT64_C(1) << index));
+}
+
+/* Member index was closed, receivers may now be able to finish */
+static void group_mark_closed(channel_group_t *g, int index) {
+  atomic_fetch_or(&g->closed, UINT64_C(1) << index);
+  group_wake(g);
+}
+
+#if defined(__linux__)
+/* A channel registered with a poller */
+typedef struct poll_entry_t {
+  struct channel_poller_t *poller;
+  struct channel_t *ch;
+
+  /* Where a received item goes, and the caller's tag for events */
+  void *value;
+  void *udata;
+
+  /* Set while the channel may have an item or has just been closed */
+  atomic_bool pending;
+
+  /* Set once the closed event has been reported */
+  bool done;
+} poll_entry_t;
+
+/* A file descriptor registered with a poller, the epoll data pointer */
+typedef struct poll_fd_t {
+  int fd;
+  void *udata;
+  struct poll_fd_t *next;
+} poll_fd_t;
+
+/* Waits on channels and file descriptors together. Channels signal an
+ * eventfd registered in the epoll set when they become ready */
+typedef struct channel_poller_t {
+  int epfd;
+  int efd;
+
+  /* Set once the eventfd has been written and not yet drained, so a burst
+   * of ready channels costs one write */
+  atomic_bool signaled;
+
+  /* Protects the entry array and fd list */
+  pthread_mutex_t mu;
+  poll_entry_t **entries;
+  size_t size;
+  size_t cap;
+  poll_fd_t *fds;
+} channel_poller_t;
+
+/* A watched channel became non-empty or closed */
+static void poller_notify(poll_entry_t *e) {
+  atomic_store(&e->pending, true);
+  if (!atomic_exchange(&e->poller->signaled, true)) {
+    uint64_t one = 1;
+    ssize_t n = write(e->poller->efd, &one, sizeof(one));
+    (void)n;
+  }
+}
+#endif
+
+/* One tenant's sub-queue in a fair channel, a ring of depth slots */
+typedef struct tenant_t {
+  /* Index of the sub-queue's first slot in the queue, and of its oldest item
+   * relative to base */
+  size_t base;
+  size_t head;
+  size_t count;
+
+  /* Items served per round, and how many are left of the current round */
+  uint32_t weight;
+  uint32_t deficit;
+
+  /* Senders waiting for room in this sub-queue */
+  chan_cond_t send_cond;
+} tenant_t;
+
+/* Deficit round-robin state of a fair channel. Tenants with items wait in
+ * the active ring and the one at its front is being served */
+typedef struct fair_t {
+  size_t ntenants;
+
+  /* Slots per sub-queue */
+  size_t depth;
+
+  /* Ring of the indices of non-empty tenants */
+  size_t *active;
+  size_t active_head;
+  size_t active_len;
+
+  tenant_t tenants[];
+} fair_t;
+
+/* Entries before the heap root, so the four children of every node share a
+ * cache line */
+#define EDF_HEAP_SKEW 3
+
+/* A queued item of a deadline_order channel */
+typedef struct edf_entry_t {
+  uint64_t deadline;
+  size_t slot;
+} edf_entry_t;
+
+/* Deadline order state: a 4-ary min-heap over the slots holding items, and
+ * a stack of the free ones. Items stay in their slot until received */
+typedef struct edf_t {
+  /* Heap entry i is heap[i + EDF_HEAP_SKEW], count entries in all */
+  edf_entry_t *heap;
+
+  size_t *free_slots;
+  size_t nfree;
+} edf_t;
 
 /* The main channel type */
 typedef struct channel_t {
+  /* Lock-free ring of an adaptive channel, the fields below up to queue are
+   * laid out as channel_fast_t for the inline fast paths */
+  channel_spsc_t spsc;
+
+  /* CH_MODE_SPSC while an adaptive channel runs on spsc, only changed with mu
+   * held */
+  atomic_int mode;
+
   /* The size of items in the channel */
   size_t item_size;
 
+  /* The number of unread items that can be in the channel at a time */
+  size_t capacity;
+
+  /* The buffer used by senders and receivers, whose size is slot_size *
+   * capacity */
+  void *queue;
+
+  /* The size of one slot in the queue: meta_size plus item_size, or plus a
+   * pointer when the slots hold swap buffers */
+  size_t slot_size;
+
+  /* The size of the slot_meta_t header in each slot, 0 if unused */
+  size_t meta_size;
+
   /* The number unread items in the channel */
   size_t count;
 
-  /* The number of unread items that can be in the channel at a time */
-  size_t capacity;
+  /* Items a bounded channel holds before sends wait, the capacity asked
+   * for. A magic ring rounds capacity, the ring's size, up past it */
+  size_t limit;
 
   /* Pointer to the next slot for the receiver to take data */
   size_t recv_ptr;
@@ -29,162 +323,2408 @@ typedef struct channel_t {
   size_t send_ptr;
 
   /* Condition variable to wake sleeping producer threads */
-  pthread_cond_t send_cond;
+  chan_cond_t send_cond;
+
+  /* Consumer threads sleeping until an item arrives */
+  waitlist_t recv_waiters;
 
-  /* Condition variable to wake a sleeping consumer thread */
-  pthread_cond_t recv_cond;
+  /* Which of the sleeping consumers a send wakes */
+  channel_wake_policy_t wake_policy;
 
   /* Mutex for the queue and condition variables */
   pthread_mutex_t mu;
 
+#if defined(HAVE_QLOCK)
+  /* Queue lock used in place of mu if requested, NULL otherwise */
+  qlock_t *qlock;
+#endif
+
   /* Flags for state management, bounded or unbounded, open or closed */
   uint8_t flags;
 
-  /* The buffer used by senders and receivers, whose size is item_size *
-   * capacity */
-  void *queue;
-} channel_t;
+  /* Most expired items a receive drops before yielding the lock, 0 for no
+   * limit */
+  size_t max_expired_scan;
 
-/* Initialize a channel of size item_size * capacity and return a pointer to it
- */
-channel_t *channel_create(size_t item_size, size_t capacity) {
-  channel_t *ch = malloc(sizeof(channel_t));
+  /* Number of expired items dropped by receivers */
+  size_t expired;
 
-  ch->item_size = item_size;
-  ch->capacity = capacity;
-  ch->flags = (capacity > 0) ? CH_BOUNDED : 0;
-  ch->count = 0;
-  ch->recv_ptr = 0;
-  ch->send_ptr = 0;
+  /* Active queue management state, used when CH_CODEL is set */
+  codel_t codel;
 
-  pthread_mutex_init(&ch->mu, NULL);
-  pthread_cond_init(&ch->recv_cond, NULL);
-  pthread_cond_init(&ch->send_cond, NULL);
+  /* Number of items dropped by active queue management */
+  size_t dropped;
 
-  if (capacity == 0) {
-    ch->capacity = 1 << 4;
-  }
+  /* How long the channel must stay nearly empty before idle queue pages are
+   * released, 0 if never, and since when it has been */
+  uint64_t release_idle_ns;
+  uint64_t low_since;
 
-  ch->queue = calloc(ch->capacity, item_size);
+  /* Bytes of queue memory released so far */
+  size_t released;
 
-  if (!ch->queue) {
-    free(ch);
-    return NULL;
+  /* Tenant sub-queues of a fair channel, NULL otherwise */
+  fair_t *fair;
+
+  /* Deadline heap of a deadline_order channel, NULL otherwise */
+  edf_t *edf;
+
+  /* Called when a send takes count above backlog_threshold, if set */
+  channel_backlog_fn backlog_fn;
+  void *backlog_arg;
+  size_t backlog_threshold;
+
+  /* The group this channel has joined, if any, and its bit in the group */
+  channel_group_t *group;
+  int group_index;
+
+#if defined(__linux__)
+  /* The poller watching this channel, if any */
+  struct poll_entry_t *poll_entry;
+#endif
+
+  /* Futex word bumped on sends and close while futex_waiters is non-zero,
+   * so channel_select can sleep on several channels with futex_waitv */
+  _Atomic uint32_t seq;
+  atomic_int futex_waiters;
+} channel_t;
+
+_Static_assert(offsetof(channel_t, spsc) == offsetof(channel_fast_t, spsc) &&
+                   offsetof(channel_t, mode) ==
+                       offsetof(channel_fast_t, mode) &&
+                   offsetof(channel_t, item_size) ==
+                       offsetof(channel_fast_t, item_size) &&
+                   offsetof(channel_t, capacity) ==
+                       offsetof(channel_fast_t, capacity) &&
+                   offsetof(channel_t, queue) ==
+                       offsetof(channel_fast_t, queue),
+               "channel_t must start with the channel_fast_t layout");
+
+/* Acquire the channel lock, whichever kind the channel uses */
+static inline void mu_lock(channel_t *ch) {
+#if defined(HAVE_QLOCK)
+  if (ch->qlock) {
+    qlock_lock(ch->qlock);
+    return;
   }
+#endif
+  pthread_mutex_lock(&ch->mu);
+}
 
-  return ch;
+/* Release the channel lock */
+static inline void mu_unlock(channel_t *ch) {
+#if defined(HAVE_QLOCK)
+  if (ch->qlock) {
+    qlock_unlock(ch->qlock);
+    return;
+  }
+#endif
+  pthread_mutex_unlock(&ch->mu);
 }
 
-/* Send a pointer to value into the channel, place it into the queue */
-bool channel_send(channel_t *ch, const void *value) {
-  pthread_mutex_lock(&ch->mu);
-  if (ch->flags & CH_CLOSED) {
-    pthread_mutex_unlock(&ch->mu);
-    return false;
+/* Current CLOCK_MONOTONIC time in nanoseconds */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Condition attributes measuring timed waits against CLOCK_MONOTONIC */
+static pthread_once_t cond_attr_once = PTHREAD_ONCE_INIT;
+static pthread_condattr_t cond_attr;
+
+static void cond_attr_init(void) {
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+}
+
+static void chan_cond_init(channel_t *ch, chan_cond_t *c) {
+#if defined(HAVE_QLOCK)
+  if (ch->qlock) {
+    atomic_init(&c->seq, 0);
+    c->waiters = 0;
+    c->signaled = 0;
+    return;
   }
+#endif
+  pthread_once(&cond_attr_once, cond_attr_init);
+  pthread_cond_init(&c->cond, &cond_attr);
+}
 
-  if (ch->flags & CH_BOUNDED) {
-    while (ch->count >= ch->capacity && !(ch->flags & CH_CLOSED)) {
-      pthread_cond_wait(&ch->send_cond, &ch->mu);
-    }
-    if (ch->flags & CH_CLOSED) {
-      pthread_mutex_unlock(&ch->mu);
+static void chan_cond_destroy(channel_t *ch, chan_cond_t *c) {
+#if defined(HAVE_QLOCK)
+  if (ch->qlock) {
+    return;
+  }
+#endif
+  pthread_cond_destroy(&c->cond);
+}
+
+/* Release the channel lock, sleep until signaled or until deadline, a
+ * CLOCK_MONOTONIC time in nanoseconds or 0 for none, and take the lock again.
+ * May wake spuriously. Returns false without sleeping once the deadline has
+ * passed */
+static bool chan_cond_wait_until(channel_t *ch, chan_cond_t *c,
+                                 uint64_t deadline) {
+  struct timespec ts;
+  if (deadline) {
+    uint64_t now = now_ns();
+    if (now >= deadline) {
       return false;
     }
-  } else if (ch->capacity <= ch->count) {
-    /* Out of room in an unbounded channel, need to increase the size */
-    size_t new_cap = ch->capacity * 2;
-    void *new_queue = malloc(new_cap * ch->item_size);
-    if (new_queue == NULL) {
-      pthread_mutex_unlock(&ch->mu);
-      return false;
+#if defined(HAVE_QLOCK)
+    /* FUTEX_WAIT takes a relative timeout */
+    if (ch->qlock) {
+      deadline -= now;
     }
-    if (ch->recv_ptr < ch->send_ptr) {
-      /* The queue is in the correct order */
-      memcpy(new_queue, (char *)ch->queue + ch->recv_ptr * ch->item_size,
-             ch->count * ch->item_size);
-    } else {
-      /* If we have wrapped around the end of the queue, need to reorganize */
-      /* Ex. [0.. send_ptr.. recv_ptr.. capacity] */
+#endif
+    ts.tv_sec = (time_t)(deadline / 1000000000ULL);
+    ts.tv_nsec = (long)(deadline % 1000000000ULL);
+  }
 
-      /* This grabs [recv_ptr.. capacity], puts it into the new_queue */
-      size_t start_items = ch->capacity - ch->recv_ptr;
-      memcpy(new_queue, (char *)ch->queue + ch->recv_ptr * ch->item_size,
-             start_items * ch->item_size);
+#if defined(HAVE_QLOCK)
+  if (ch->qlock) {
+    /* A signal after the lock is dropped changes seq and fails the wait */
+    uint32_t seq = atomic_load_explicit(&c->seq, memory_order_relaxed);
+    c->waiters++;
+    qlock_unlock(ch->qlock);
+    futex_wait(&c->seq, seq, deadline ? &ts : NULL);
+    qlock_lock(ch->qlock);
+    c->waiters--;
+    if (c->signaled > 0) {
+      c->signaled--;
+    }
+    return true;
+  }
+#endif
+  if (deadline) {
+    pthread_cond_timedwait(&c->cond, &ch->mu, &ts);
+  } else {
+    pthread_cond_wait(&c->cond, &ch->mu);
+  }
+  return true;
+}
 
-      /* Grab the rest and put it after */
-      memcpy((char *)new_queue + start_items * ch->item_size, ch->queue,
-             ch->send_ptr * ch->item_size);
+/* Release the channel lock, sleep until signaled and take the lock again.
+ * May wake spuriously */
+static inline void chan_cond_wait(channel_t *ch, chan_cond_t *c) {
+  chan_cond_wait_until(ch, c, 0);
+}
 
-      /* New buffer is now properly ordered! */
+/* Wake up to n threads waiting on c, with the channel lock held */
+static void chan_cond_wake(channel_t *ch, chan_cond_t *c, int n) {
+#if defined(HAVE_QLOCK)
+  if (ch->qlock) {
+    /* Only wake threads no earlier signal is already on its way to, or every
+     * send would wake another waiter before the first got to run */
+    uint32_t unsignaled = c->waiters - c->signaled;
+    if (unsignaled) {
+      if ((uint32_t)n > unsignaled) {
+        n = (int)unsignaled;
+      }
+      c->signaled += (uint32_t)n;
+      atomic_fetch_add(&c->seq, 1);
+      futex_wake(&c->seq, n);
     }
+    return;
+  }
+#endif
+  if (n == 1) {
+    pthread_cond_signal(&c->cond);
+  } else {
+    pthread_cond_broadcast(&c->cond);
+  }
+}
+
+static inline void chan_cond_signal(channel_t *ch, chan_cond_t *c) {
+  chan_cond_wake(ch, c, 1);
+}
+
+static inline void chan_cond_broadcast(channel_t *ch, chan_cond_t *c) {
+  chan_cond_wake(ch, c, INT_MAX);
+}
+
+/* Link w at the head of the wait list */
+static void waitlist_push(channel_t *ch, waiter_t *w) {
+  w->woken = false;
+  w->prev = NULL;
+  w->next = ch->recv_waiters.head;
+  if (w->next) {
+    w->next->prev = w;
+  } else {
+    ch->recv_waiters.tail = w;
+  }
+  ch->recv_waiters.head = w;
+}
 
-    free(ch->queue);
-    ch->queue = new_queue;
-    ch->capacity = new_cap;
-    ch->recv_ptr = 0;
-    ch->send_ptr = ch->count;
+/* Unlink w from the wait list */
+static void waitlist_remove(channel_t *ch, waiter_t *w) {
+  if (w->prev) {
+    w->prev->next = w->next;
+  } else {
+    ch->recv_waiters.head = w->next;
   }
+  if (w->next) {
+    w->next->prev = w->prev;
+  } else {
+    ch->recv_waiters.tail = w->prev;
+  }
+}
 
-  /* Copy the value into the correct place in the buffer */
-  void *slot = (char *)ch->queue + (ch->item_size * ch->send_ptr);
-  memcpy(slot, value, ch->item_size);
-  ch->count++;
+/* Park the calling receiver until a sender or channel_close wakes it or the
+ * deadline passes (0 for none), must be called with ch->mu held. Returns
+ * whether it was woken */
+static bool waiter_park_until(channel_t *ch, waiter_t *w, uint64_t deadline) {
+  chan_cond_init(ch, &w->cond);
+  w->sel = NULL;
+  waitlist_push(ch, w);
 
-  /* Buffer is circular for simplicity */
-  ch->send_ptr = (ch->send_ptr + 1) % ch->capacity;
+  while (!w->woken) {
+    if (!chan_cond_wait_until(ch, &w->cond, deadline)) {
+      waitlist_remove(ch, w);
+      break;
+    }
+  }
+  chan_cond_destroy(ch, &w->cond);
+  return w->woken;
+}
 
-  /* Wake up the receiver if it is waiting */
-  pthread_cond_signal(&ch->recv_cond);
-  pthread_mutex_unlock(&ch->mu);
+/* Park the calling receiver until a sender or channel_close wakes it */
+static inline void waiter_park(channel_t *ch, waiter_t *w) {
+  waiter_park_until(ch, w, 0);
+}
+
+/* Unlink w from the wait list and wake it, must be called with ch->mu held.
+ * Returns false if w belonged to a channel_select that another channel has
+ * already woken, in which case it will not consume anything from ch */
+static bool waiter_wake(channel_t *ch, waiter_t *w) {
+  waitlist_remove(ch, w);
+  w->woken = true;
+  if (!w->sel) {
+    chan_cond_signal(ch, &w->cond);
+    return true;
+  }
+
+  select_waiter_t *sel = w->sel;
+  int expected = -1;
+  if (!atomic_compare_exchange_strong(&sel->fired, &expected, w->sel_index)) {
+    return false;
+  }
+  pthread_mutex_lock(&sel->mu);
+  pthread_cond_signal(&sel->cond);
+  pthread_mutex_unlock(&sel->mu);
   return true;
 }
 
-/* Receive an item from the channel if available, write the data into *value */
-bool channel_recv(channel_t *ch, void *value) {
-  pthread_mutex_lock(&ch->mu);
+/* Wake a single parked receiver according to the channel's wake policy */
+static void waiter_wake_one(channel_t *ch) {
+  /* LIFO picks the most recently parked receiver, its stack and working set
+   * are the most likely to still be in cache */
+  for (;;) {
+    waiter_t *w = (ch->wake_policy == CHANNEL_WAKE_LIFO)
+                      ? ch->recv_waiters.head
+                      : ch->recv_waiters.tail;
+    if (!w || waiter_wake(ch, w)) {
+      return;
+    }
+  }
+}
+
+/* Wake futex_waitv sleepers in channel_select, with ch->mu held. The mutex
+ * orders this check after a selector's increment of futex_waiters */
+static inline void futex_notify(channel_t *ch) {
+#if defined(HAVE_FUTEX_WAITV)
+  if (atomic_load_explicit(&ch->futex_waiters, memory_order_relaxed) > 0) {
+    atomic_fetch_add(&ch->seq, 1);
+    futex_wake(&ch->seq, INT_MAX);
+  }
+#else
+  (void)ch;
+#endif
+}
+
+/* Free the buffers owned by the slots of a swap channel */
+static void free_swap_buffers(channel_t *ch) {
+  for (size_t i = 0; i < ch->capacity; i++) {
+    free(*(void **)((char *)ch->queue + ch->slot_size * i + ch->meta_size));
+  }
+}
+
+/* Initialize the channel mutex, with priority inheritance if requested so a
+ * real-time receiver blocked on mu boosts whichever thread holds it */
+static int channel_mutex_init(pthread_mutex_t *mu, const channel_opts_t *opts) {
+  if (!opts->priority_inherit) {
+    return pthread_mutex_init(mu, NULL);
+  }
+
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && _POSIX_THREAD_PRIO_INHERIT > 0
+  pthread_mutexattr_t attr;
+  int err = pthread_mutexattr_init(&attr);
+  if (err == 0) {
+    err = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    if (err == 0) {
+      err = pthread_mutex_init(mu, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+  }
+  return err;
+#else
+  (void)mu;
+  return ENOTSUP;
+#endif
+}
+
+/* Allocate the queue as a magic ring: one memfd mapped twice back to back,
+ * so slots past the end alias the start. Rounds capacity up so the ring
+ * fills whole pages, as the second mapping must start on a page boundary,
+ * leaving limit as the point where sends wait */
+static void *magic_ring_alloc(channel_t *ch) {
+#if defined(__linux__)
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t a = page, b = ch->slot_size;
+  while (b) {
+    size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  size_t unit = page / a;
+  ch->capacity = (ch->capacity + unit - 1) / unit * unit;
+  size_t size = ch->capacity * ch->slot_size;
+
+  int fd = memfd_create("channel", MFD_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, (off_t)size) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  /* Reserve both halves first so nothing else can land in between */
+  char *base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  void *lo = mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                  fd, 0);
+  void *hi = mmap(base + size, size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_FIXED, fd, 0);
+  close(fd);
+  if (lo == MAP_FAILED || hi == MAP_FAILED) {
+    munmap(base, 2 * size);
+    return NULL;
+  }
+  return base;
+#else
+  (void)ch;
+  return NULL;
+#endif
+}
+
+/* Free the queue, however it was allocated */
+static void queue_free(channel_t *ch) {
+#if defined(__linux__)
+  if (ch->flags & CH_MAGIC) {
+    munmap(ch->queue, 2 * ch->capacity * ch->slot_size);
+    return;
+  }
+#endif
+  free(ch->queue);
+}
+
+/* Set up the channel lock, a queue lock in place of the mutex if requested
+ * and supported */
+static int channel_lock_init(channel_t *ch, const channel_opts_t *opts) {
+#if defined(HAVE_QLOCK)
+  ch->qlock = NULL;
+  if (opts->lock == CHANNEL_LOCK_QUEUE) {
+    /* Queue lock waiters cannot boost the owner */
+    if (opts->priority_inherit) {
+      return ENOTSUP;
+    }
+    ch->qlock = qlock_create();
+    return ch->qlock ? 0 : ENOMEM;
+  }
+#endif
+  return channel_mutex_init(&ch->mu, opts);
+}
 
-  /* Go to sleep if there is nothing in the queue */
-  while (ch->count == 0 && !(ch->flags & CH_CLOSED)) {
-    pthread_cond_wait(&ch->recv_cond, &ch->mu);
+static void channel_lock_destroy(channel_t *ch) {
+#if defined(HAVE_QLOCK)
+  if (ch->qlock) {
+    qlock_destroy(ch->qlock);
+    return;
   }
+#endif
+  pthread_mutex_destroy(&ch->mu);
+}
 
-  /* Exit if the channel is closed and empty */
-  if (ch->count == 0 && (ch->flags & CH_CLOSED)) {
-    pthread_mutex_unlock(&ch->mu);
+/* Set up the tenant sub-queues of a fair channel, each of depth slots */
+static bool fair_create(channel_t *ch, const channel_opts_t *opts,
+                        size_t depth) {
+  size_t n = opts->tenants;
+  fair_t *f = malloc(sizeof(fair_t) + n * sizeof(tenant_t));
+  size_t *active = malloc(n * sizeof(size_t));
+  if (!f || !active) {
+    free(f);
+    free(active);
     return false;
   }
+  f->ntenants = n;
+  f->depth = depth;
+  f->active = active;
+  f->active_head = 0;
+  f->active_len = 0;
+  for (size_t i = 0; i < n; i++) {
+    tenant_t *t = &f->tenants[i];
+    t->base = i * depth;
+    t->head = 0;
+    t->count = 0;
+    t->weight = 1;
+    if (opts->tenant_weights && opts->tenant_weights[i]) {
+      t->weight = opts->tenant_weights[i];
+    }
+    t->deficit = 0;
+    chan_cond_init(ch, &t->send_cond);
+  }
+  ch->fair = f;
+  return true;
+}
 
-  /* Copy the next item to be received into *value */
-  void *slot = (char *)ch->queue + (ch->item_size * ch->recv_ptr);
-  memcpy(value, slot, ch->item_size);
-  ch->count--;
+static void fair_destroy(channel_t *ch) {
+  fair_t *f = ch->fair;
+  if (!f) {
+    return;
+  }
+  for (size_t i = 0; i < f->ntenants; i++) {
+    chan_cond_destroy(ch, &f->tenants[i].send_cond);
+  }
+  free(f->active);
+  free(f);
+}
 
-  /* Buffer is circular for simplicity */
-  ch->recv_ptr = (ch->recv_ptr + 1) % ch->capacity;
+/* Allocate a heap of capacity entries, cache-line aligned so each group of
+ * siblings fills one line */
+static edf_entry_t *edf_heap_alloc(size_t capacity) {
+  size_t size = (capacity + EDF_HEAP_SKEW) * sizeof(edf_entry_t);
+  size = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  return aligned_alloc(CACHE_LINE, size);
+}
 
-  /* Wake up a producer if it is waiting for room in the buffer */
-  pthread_cond_signal(&ch->send_cond);
-  pthread_mutex_unlock(&ch->mu);
+/* Set up the deadline heap of a deadline_order channel, every slot free */
+static bool edf_create(channel_t *ch) {
+  edf_t *e = malloc(sizeof(edf_t));
+  edf_entry_t *heap = edf_heap_alloc(ch->capacity);
+  size_t *free_slots = malloc(ch->capacity * sizeof(size_t));
+  if (!e || !heap || !free_slots) {
+    free(e);
+    free(heap);
+    free(free_slots);
+    return false;
+  }
+  /* Hand out low slots first */
+  for (size_t i = 0; i < ch->capacity; i++) {
+    free_slots[i] = ch->capacity - 1 - i;
+  }
+  e->heap = heap;
+  e->free_slots = free_slots;
+  e->nfree = ch->capacity;
+  ch->edf = e;
   return true;
 }
 
-/* Close the channel off to further sending */
-void channel_close(channel_t *ch) {
-  pthread_mutex_lock(&ch->mu);
+static void edf_destroy(channel_t *ch) {
+  edf_t *e = ch->edf;
+  if (!e) {
+    return;
+  }
+  free(e->heap);
+  free(e->free_slots);
+  free(e);
+}
 
-  /* Set the closed bit, wake up all the sleeping threads */
-  ch->flags |= CH_CLOSED;
-  pthread_cond_broadcast(&ch->send_cond);
-  pthread_cond_broadcast(&ch->recv_cond);
-  pthread_mutex_unlock(&ch->mu);
+/* Give every slot its own item_size buffer for channel_send_swap */
+static bool alloc_swap_buffers(channel_t *ch) {
+  for (size_t i = 0; i < ch->capacity; i++) {
+    void **buf = (void **)((char *)ch->queue + ch->slot_size * i +
+                           ch->meta_size);
+    *buf = malloc(ch->item_size);
+    if (!*buf) {
+      free_swap_buffers(ch);
+      return false;
+    }
+  }
+  return true;
 }
 
-/* Cleanup resources */
-void channel_destroy(channel_t *ch) {
-  pthread_cond_destroy(&ch->send_cond);
-  pthread_cond_destroy(&ch->recv_cond);
-  pthread_mutex_destroy(&ch->mu);
-  free(ch->queue);
-  free(ch);
+/* Initialize a channel of size item_size * capacity and return a pointer to it
+ */
+channel_t *channel_create(size_t item_size, size_t capacity) {
+  return channel_create_opts(item_size, capacity, NULL);
+}
+
+/* Initialize a channel with the given options, NULL opts means defaults */
+channel_t *channel_create_opts(size_t item_size, size_t capacity,
+                               const channel_opts_t *opts) {
+  channel_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+
+  /* Unbounded channels would need to allocate swap buffers as they grow, and
+   * would have to remap a magic ring */
+  if ((opts->swap_buffers || opts->magic_ring) && capacity == 0) {
+    return NULL;
+  }
+
+  /* Tenant sub-queues are fixed-size rings of plain items */
+  if (opts->tenants &&
+      (capacity == 0 || opts->swap_buffers || opts->expiring_items ||
+       opts->codel_target_ns || opts->magic_ring)) {
+    return NULL;
+  }
+
+  /* Deadline order keeps plain items in scattered slots */
+  if (opts->deadline_order &&
+      (opts->swap_buffers || opts->expiring_items || opts->codel_target_ns ||
+       opts->magic_ring || opts->tenants)) {
+    return NULL;
+  }
+
+  channel_t *ch = aligned_alloc(CACHE_LINE, sizeof(channel_t));
+  if (!ch) {
+    return NULL;
+  }
+
+  ch->item_size = item_size;
+  ch->meta_size = 0;
+  ch->capacity = capacity;
+  ch->flags = (capacity > 0) ? CH_BOUNDED : 0;
+  ch->count = 0;
+  ch->recv_ptr = 0;
+  ch->send_ptr = 0;
+  ch->recv_waiters.head = NULL;
+  ch->recv_waiters.tail = NULL;
+  ch->wake_policy = opts->wake_policy;
+  ch->max_expired_scan = opts->max_expired_scan;
+  ch->expired = 0;
+  ch->codel = (codel_t){
+      .target = opts->codel_target_ns,
+      .interval = opts->codel_interval_ns ? opts->codel_interval_ns
+                                          : CODEL_DEFAULT_INTERVAL_NS,
+  };
+  ch->dropped = 0;
+  ch->release_idle_ns = opts->release_idle_ns;
+  ch->low_since = 0;
+  ch->released = 0;
+  ch->fair = NULL;
+  ch->edf = NULL;
+  ch->backlog_fn = NULL;
+  ch->backlog_arg = NULL;
+  ch->backlog_threshold = 0;
+  ch->group = NULL;
+  ch->group_index = 0;
+  atomic_init(&ch->seq, 0);
+#if defined(__linux__)
+  ch->poll_entry = NULL;
+#endif
+  atomic_init(&ch->futex_waiters, 0);
+  atomic_init(&ch->mode, CH_MODE_LOCKED);
+  atomic_init(&ch->spsc.head, 0);
+  atomic_init(&ch->spsc.producer, 0);
+  atomic_init(&ch->spsc.send_busy, false);
+  atomic_init(&ch->spsc.send_parked, false);
+  atomic_init(&ch->spsc.tail, 0);
+  atomic_init(&ch->spsc.consumer, 0);
+  atomic_init(&ch->spsc.recv_busy, false);
+  atomic_init(&ch->spsc.recv_parked, false);
+
+  if (channel_lock_init(ch, opts) != 0) {
+    free(ch);
+    return NULL;
+  }
+  chan_cond_init(ch, &ch->send_cond);
+
+  if (capacity == 0) {
+    ch->capacity = 1 << 4;
+  }
+  if (opts->tenants) {
+    /* The queue holds every tenant's sub-queue back to back */
+    ch->capacity = opts->tenants * capacity;
+  }
+  if ((opts->tenants && !fair_create(ch, opts, capacity)) ||
+      (opts->deadline_order && !edf_create(ch))) {
+    chan_cond_destroy(ch, &ch->send_cond);
+    channel_lock_destroy(ch);
+    free(ch);
+    return NULL;
+  }
+
+  if (opts->expiring_items) {
+    ch->flags |= CH_EXPIRY;
+  }
+  if (opts->codel_target_ns) {
+    ch->flags |= CH_CODEL;
+    if (opts->codel_shed_sends) {
+      ch->flags |= CH_CODEL_SHED;
+    }
+  }
+  if (ch->flags & (CH_EXPIRY | CH_CODEL)) {
+    ch->meta_size = sizeof(slot_meta_t);
+  }
+  if (opts->swap_buffers) {
+    ch->flags |= CH_SWAP;
+  }
+  ch->slot_size =
+      ch->meta_size + ((ch->flags & CH_SWAP) ? sizeof(void *) : item_size);
+  if (ch->meta_size) {
+    /* Keep every slot's metadata aligned */
+    size_t align = _Alignof(slot_meta_t);
+    ch->slot_size = (ch->slot_size + align - 1) / align * align;
+  }
+  if ((ch->flags & CH_SWAP) || ch->fair || ch->edf) {
+    /* Slots own their buffers, releasing them would leak, and tenant
+     * sub-queues and deadline heaps do not keep their items in one window */
+    ch->release_idle_ns = 0;
+  }
+  if (opts->adaptive && !(ch->flags & (CH_SWAP | CH_EXPIRY | CH_CODEL)) &&
+      !ch->release_idle_ns && !ch->fair && !ch->edf && !opts->magic_ring) {
+    /* The ring only moves plain items, options with per-slot state start on
+     * the locked algorithm. So does a magic ring, as the lock-free ring
+     * fills up to capacity rather than limit */
+    atomic_store(&ch->mode, CH_MODE_SPSC);
+  }
+
+  ch->limit = ch->capacity;
+  if (opts->magic_ring) {
+    ch->flags |= CH_MAGIC;
+    ch->queue = magic_ring_alloc(ch);
+  } else {
+    ch->queue = calloc(ch->capacity, ch->slot_size);
+  }
+
+  if (ch->queue && (ch->flags & CH_SWAP) && !alloc_swap_buffers(ch)) {
+    queue_free(ch);
+    ch->queue = NULL;
+  }
+
+  if (!ch->queue) {
+    fair_destroy(ch);
+    edf_destroy(ch);
+    chan_cond_destroy(ch, &ch->send_cond);
+    channel_lock_destroy(ch);
+    free(ch);
+    return NULL;
+  }
+
+  return ch;
+}
+
+/* Address of slot idx in the queue */
+static inline void *slot_at(channel_t *ch, size_t idx) {
+  return (char *)ch->queue + ch->slot_size * idx;
+}
+
+/* Address of the item field of slot, past its metadata. For swap channels
+ * this holds the pointer to the slot's buffer */
+static inline void *slot_payload(channel_t *ch, void *slot) {
+  return (char *)slot + ch->meta_size;
+}
+
+/* Address of the item stored in slot, which for swap channels is the buffer
+ * the slot currently owns */
+static inline void *slot_item(channel_t *ch, void *slot) {
+  void *payload = slot_payload(ch, slot);
+  return (ch->flags & CH_SWAP) ? *(void **)payload : payload;
+}
+
+/* Fill in the metadata of the slot about to be published */
+static inline void write_meta(channel_t *ch, void *slot, uint64_t expires_at) {
+  if (ch->meta_size) {
+    slot_meta_t *meta = slot;
+    meta->expires_at = expires_at;
+    meta->enqueued_at = now_ns();
+  }
+}
+
+/* Double the capacity of an unbounded deadline_order channel. Items keep
+ * their slots, so the queue is simply extended */
+static bool edf_grow_locked(channel_t *ch) {
+  edf_t *e = ch->edf;
+  size_t new_cap = ch->capacity * 2;
+  edf_entry_t *heap = edf_heap_alloc(new_cap);
+  size_t *free_slots = realloc(e->free_slots, new_cap * sizeof(size_t));
+  if (free_slots) {
+    e->free_slots = free_slots;
+  }
+  void *queue = realloc(ch->queue, new_cap * ch->slot_size);
+  if (queue) {
+    ch->queue = queue;
+  }
+  if (!heap || !free_slots || !queue) {
+    free(heap);
+    return false;
+  }
+
+  memcpy(heap, e->heap, (ch->count + EDF_HEAP_SKEW) * sizeof(edf_entry_t));
+  free(e->heap);
+  e->heap = heap;
+  for (size_t i = new_cap; i > ch->capacity; i--) {
+    e->free_slots[e->nfree++] = i - 1;
+  }
+  ch->capacity = new_cap;
+  return true;
+}
+
+/* Double the capacity of an unbounded channel, returns false if out of memory
+ */
+static bool grow_locked(channel_t *ch) {
+  if (ch->edf) {
+    return edf_grow_locked(ch);
+  }
+  size_t new_cap = ch->capacity * 2;
+  void *new_queue = malloc(new_cap * ch->slot_size);
+  if (new_queue == NULL) {
+    return false;
+  }
+  if (ch->recv_ptr < ch->send_ptr) {
+    /* The queue is in the correct order */
+    memcpy(new_queue, slot_at(ch, ch->recv_ptr), ch->count * ch->slot_size);
+  } else {
+    /* If we have wrapped around the end of the queue, need to reorganize */
+    /* Ex. [0.. send_ptr.. recv_ptr.. capacity] */
+
+    /* This grabs [recv_ptr.. capacity], puts it into the new_queue */
+    size_t start_items = ch->capacity - ch->recv_ptr;
+    memcpy(new_queue, slot_at(ch, ch->recv_ptr), start_items * ch->slot_size);
+
+    /* Grab the rest and put it after */
+    memcpy((char *)new_queue + start_items * ch->slot_size, ch->queue,
+           ch->send_ptr * ch->slot_size);
+
+    /* New buffer is now properly ordered! */
+  }
+
+  free(ch->queue);
+  ch->queue = new_queue;
+  ch->capacity = new_cap;
+  ch->recv_ptr = 0;
+  ch->send_ptr = ch->count;
+  return true;
+}
+
+/* Move an adaptive channel onto the locked algorithm, with ch->mu held.
+ * Waits for both sides to leave the ring, then carries its items over */
+static void spsc_upgrade_locked(channel_t *ch) {
+  channel_spsc_t *sp = &ch->spsc;
+  atomic_store(&ch->mode, CH_MODE_LOCKED);
+
+  /* Pairs with spsc_enter, a side either sees the new mode or is seen busy.
+   * Busy sections only copy one item so this wait is short */
+  while (atomic_load(&sp->send_busy) || atomic_load(&sp->recv_busy)) {
+    sched_yield();
+  }
+
+  size_t head = atomic_load(&sp->head);
+  size_t tail = atomic_load(&sp->tail);
+  ch->count = head - tail;
+  ch->send_ptr = head % ch->capacity;
+  ch->recv_ptr = tail % ch->capacity;
+
+  /* Threads parked in SPSC mode retry on the locked algorithm */
+  chan_cond_broadcast(ch, &ch->send_cond);
+  while (ch->recv_waiters.head) {
+    waiter_wake(ch, ch->recv_waiters.head);
+  }
+}
+
+/* Lock the channel for the locked algorithm, upgrading an adaptive channel
+ * first if it is still in SPSC mode */
+static inline void lock_channel(channel_t *ch) {
+  mu_lock(ch);
+  if (atomic_load_explicit(&ch->mode, memory_order_relaxed) == CH_MODE_SPSC) {
+    spsc_upgrade_locked(ch);
+  }
+}
+
+/* Coarse CLOCK_MONOTONIC time in nanoseconds, cheaper to read where
+ * millisecond resolution is enough */
+static uint64_t coarse_now_ns(void) {
+  struct timespec ts;
+#if defined(CLOCK_MONOTONIC_COARSE)
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Give the whole pages inside bytes [from, to) of the queue back to the OS.
+ * They read back as zeros, which is fine outside the live items */
+static void release_range(channel_t *ch, size_t from, size_t to) {
+#if defined(__linux__)
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t base = (uintptr_t)ch->queue;
+  uintptr_t lo = (base + from + page - 1) & ~(page - 1);
+  uintptr_t hi = (base + to) & ~(page - 1);
+  if (hi <= lo) {
+    return;
+  }
+  /* A magic ring's pages belong to its memfd and must be punched out of it,
+   * dropping one mapping's view of them would not free anything */
+  int advice = (ch->flags & CH_MAGIC) ? MADV_REMOVE : MADV_DONTNEED;
+  if (madvise((void *)lo, hi - lo, advice) == 0) {
+    ch->released += hi - lo;
+  }
+#else
+  (void)ch;
+  (void)from;
+  (void)to;
+#endif
+}
+
+/* Release the queue pages outside the live items */
+static void release_idle_pages_locked(channel_t *ch) {
+  size_t size = ch->capacity * ch->slot_size;
+  size_t head = ch->recv_ptr * ch->slot_size;
+  size_t tail = (ch->recv_ptr + ch->count) % ch->capacity * ch->slot_size;
+
+  if (ch->count == 0) {
+    release_range(ch, 0, size);
+  } else if (head < tail) {
+    release_range(ch, 0, head);
+    release_range(ch, tail, size);
+  } else {
+    /* The live items wrap around, or fill the whole queue */
+    release_range(ch, tail, head);
+  }
+}
+
+/* Release idle pages once the channel has been at most 1/8 full for
+ * release_idle_ns, then again every release_idle_ns while it stays that
+ * way, as a trickle of items walks through fresh pages */
+static void check_idle_locked(channel_t *ch) {
+  if (ch->count > ch->capacity / 8) {
+    ch->low_since = 0;
+    return;
+  }
+  uint64_t now = coarse_now_ns();
+  if (ch->low_since == 0) {
+    ch->low_since = now;
+  } else if (now - ch->low_since >= ch->release_idle_ns) {
+    release_idle_pages_locked(ch);
+    ch->low_since = now;
+  }
+}
+
+/* Point recv_ptr at the oldest item of the tenant at the front of the active
+ * ring, starting its round if it has just got there */
+static void fair_point_head_locked(channel_t *ch) {
+  fair_t *f = ch->fair;
+  if (f->active_len == 0) {
+    return;
+  }
+  tenant_t *t = &f->tenants[f->active[f->active_head]];
+  if (t->deficit == 0) {
+    t->deficit = t->weight;
+  }
+  ch->recv_ptr = t->base + t->head;
+}
+
+/* Put a tenant that just got its first item at the back of the active ring
+ */
+static void fair_activate_locked(channel_t *ch, size_t index) {
+  fair_t *f = ch->fair;
+  f->active[(f->active_head + f->active_len) % f->ntenants] = index;
+  if (f->active_len++ == 0) {
+    fair_point_head_locked(ch);
+  }
+}
+
+/* Consume the item at recv_ptr from the tenant being served. Once its round
+ * is used up it goes to the back of the ring, or leaves it if empty */
+static void fair_advance_locked(channel_t *ch) {
+  fair_t *f = ch->fair;
+  size_t index = f->active[f->active_head];
+  tenant_t *t = &f->tenants[index];
+  t->head = (t->head + 1) % f->depth;
+  t->count--;
+  t->deficit--;
+
+  if (t->count == 0 || t->deficit == 0) {
+    f->active_head = (f->active_head + 1) % f->ntenants;
+    f->active_len--;
+    t->deficit = 0;
+    if (t->count) {
+      f->active[(f->active_head + f->active_len) % f->ntenants] = index;
+      f->active_len++;
+    }
+  }
+  fair_point_head_locked(ch);
+
+  /* Only this tenant's senders can use the free slot */
+  chan_cond_signal(ch, &t->send_cond);
+}
+
+/* Add the item in slot to the deadline heap, with ch->mu held and before
+ * count is raised */
+static void edf_push_locked(channel_t *ch, uint64_t deadline, size_t slot) {
+  edf_entry_t *h = ch->edf->heap + EDF_HEAP_SKEW;
+  size_t i = ch->count;
+  while (i > 0) {
+    size_t parent = (i - 1) / 4;
+    if (h[parent].deadline <= deadline) {
+      break;
+    }
+    h[i] = h[parent];
+    i = parent;
+  }
+  h[i] = (edf_entry_t){.deadline = deadline, .slot = slot};
+  ch->recv_ptr = h[0].slot;
+}
+
+/* Remove the root of the deadline heap and free its slot, with ch->mu held
+ * and after count is lowered */
+static void edf_pop_locked(channel_t *ch) {
+  edf_t *e = ch->edf;
+  edf_entry_t *h = e->heap + EDF_HEAP_SKEW;
+  size_t n = ch->count;
+  e->free_slots[e->nfree++] = h[0].slot;
+  if (n == 0) {
+    return;
+  }
+
+  /* Sift the last entry down from the root */
+  edf_entry_t last = h[n];
+  size_t i = 0;
+  for (;;) {
+    size_t first = 4 * i + 1;
+    if (first >= n) {
+      break;
+    }
+    size_t end = first + 4 < n ? first + 4 : n;
+    size_t min = first;
+    for (size_t c = first + 1; c < end; c++) {
+      if (h[c].deadline < h[min].deadline) {
+        min = c;
+      }
+    }
+    if (h[min].deadline >= last.deadline) {
+      break;
+    }
+    h[i] = h[min];
+    i = min;
+  }
+  h[i] = last;
+  ch->recv_ptr = h[0].slot;
+}
+
+/* Release n slots starting at recv_ptr back to senders */
+static void advance_recv_locked(channel_t *ch, size_t n) {
+  ch->count -= n;
+  if (ch->count == 0 && ch->group) {
+    group_clear_ready(ch->group, ch->group_index);
+  }
+  if (ch->fair) {
+    /* Fair channels hand out one item at a time */
+    fair_advance_locked(ch);
+    return;
+  }
+
+  if (ch->edf) {
+    /* Deadline channels hand out one item at a time too */
+    edf_pop_locked(ch);
+  } else {
+    /* Buffer is circular for simplicity */
+    ch->recv_ptr = (ch->recv_ptr + n) % ch->capacity;
+    if (ch->release_idle_ns) {
+      check_idle_locked(ch);
+    }
+  }
+
+  /* Wake up producers waiting for room in the buffer */
+  if (n == 1) {
+    chan_cond_signal(ch, &ch->send_cond);
+  } else {
+    chan_cond_broadcast(ch, &ch->send_cond);
+  }
+}
+
+/* Drop the run of expired items at the head of the queue with a single index
+ * advance. Returns false if it stopped at max_expired_scan with more expired
+ * items possibly left */
+static bool drop_expired_locked(channel_t *ch) {
+  uint64_t now = now_ns();
+  size_t dropped = 0;
+  size_t idx = ch->recv_ptr;
+  bool done = true;
+
+  while (dropped < ch->count) {
+    uint64_t expires_at = ((slot_meta_t *)slot_at(ch, idx))->expires_at;
+    if (expires_at == 0 || expires_at > now) {
+      break;
+    }
+    if (ch->max_expired_scan && dropped == ch->max_expired_scan) {
+      done = false;
+      break;
+    }
+    dropped++;
+    idx = (idx + 1) % ch->capacity;
+  }
+
+  if (dropped) {
+    ch->expired += dropped;
+    advance_recv_locked(ch, dropped);
+  }
+  return done;
+}
+
+/* Integer square root, for the CoDel control law */
+static uint64_t isqrt(uint64_t n) {
+  uint64_t x = n;
+  uint64_t y = (x + 1) / 2;
+  while (y < x) {
+    x = y;
+    y = (x + n / x) / 2;
+  }
+  return x;
+}
+
+/* Whether the head item has been queued too long for too long, timing the
+ * interval in *above_time. Never allows dropping the last item so a consumer
+ * is not left idle */
+static bool codel_above_target(channel_t *ch, uint64_t now,
+                               uint64_t *above_time) {
+  codel_t *c = &ch->codel;
+  slot_meta_t *head = slot_at(ch, ch->recv_ptr);
+  uint64_t sojourn = now - head->enqueued_at;
+
+  if (sojourn < c->target || ch->count <= 1) {
+    *above_time = 0;
+    return false;
+  }
+  if (*above_time == 0) {
+    *above_time = now + c->interval;
+    return false;
+  }
+  return now >= *above_time;
+}
+
+/* The dequeue side's test, on the state RFC 8289 describes */
+static bool codel_ok_to_drop(channel_t *ch, uint64_t now) {
+  return codel_above_target(ch, now, &ch->codel.first_above_time);
+}
+
+/* Drop the head item on behalf of active queue management */
+static void codel_drop_head(channel_t *ch) {
+  ch->dropped++;
+  advance_recv_locked(ch, 1);
+}
+
+/* Run the CoDel dequeue logic, dropping head items while the minimum sojourn
+ * time has stayed above target for an interval. Leaves at least one item */
+static void codel_dequeue_locked(channel_t *ch) {
+  codel_t *c = &ch->codel;
+  uint64_t now = now_ns();
+  bool ok_to_drop = codel_ok_to_drop(ch, now);
+
+  if (c->dropping) {
+    if (!ok_to_drop) {
+      c->dropping = false;
+      return;
+    }
+    /* Drop faster the longer the queue stays above target */
+    while (c->dropping && now >= c->drop_next) {
+      codel_drop_head(ch);
+      c->drop_count++;
+      if (!codel_ok_to_drop(ch, now)) {
+        c->dropping = false;
+      } else {
+        c->drop_next += c->interval / isqrt(c->drop_count);
+      }
+    }
+  } else if (ok_to_drop) {
+    codel_drop_head(ch);
+    c->dropping = true;
+    if (ch->flags & CH_CODEL_SHED) {
+      /* Blocked senders can now shed their items instead of waiting */
+      chan_cond_broadcast(ch, &ch->send_cond);
+    }
+
+    /* Resume near the previous drop rate if we only recently left the
+     * dropping state. drop_next may still be ahead, which counts as recent
+     * rather than wrapping around */
+    uint32_t delta = c->drop_count - c->last_count;
+    if (delta > 1 &&
+        (now < c->drop_next || now - c->drop_next < 16 * c->interval)) {
+      c->drop_count = delta;
+    } else {
+      c->drop_count = 1;
+    }
+    c->drop_next = now + c->interval / isqrt(c->drop_count);
+    c->last_count = c->drop_count;
+  }
+}
+
+/* Outcome of waiting to send */
+typedef enum {
+  /* The slot at send_ptr may be written */
+  SEND_READY,
+  /* The channel is closed or could not grow */
+  SEND_FAILED,
+  /* Active queue management discarded the item */
+  SEND_SHED,
+  /* A bounded channel is full and the caller does not want to wait */
+  SEND_FULL,
+} send_status_t;
+
+/* Whether active queue management is currently discarding new items. Senders
+ * apply the same test as the receiver to the age of the head item, so a
+ * burst is cut off without waiting for the next receive, but time it with
+ * their own timer. An empty queue always accepts, so the consumer gets to
+ * re-evaluate the state */
+static bool codel_shedding(channel_t *ch) {
+  if (!(ch->flags & CH_CODEL_SHED) || ch->count == 0) {
+    return false;
+  }
+  return ch->codel.dropping ||
+         codel_above_target(ch, now_ns(), &ch->codel.shed_above_time);
+}
+
+/* Wait, if block is set, until the slot at send_ptr is free to write,
+ * growing unbounded channels */
+static send_status_t reserve_send_locked(channel_t *ch, bool block) {
+  if (ch->flags & CH_CLOSED) {
+    return SEND_FAILED;
+  }
+
+  if (ch->flags & CH_BOUNDED) {
+    while (ch->count >= ch->limit && !(ch->flags & CH_CLOSED) &&
+           !codel_shedding(ch)) {
+      if (!block) {
+        return SEND_FULL;
+      }
+      chan_cond_wait(ch, &ch->send_cond);
+    }
+    if (ch->flags & CH_CLOSED) {
+      return SEND_FAILED;
+    }
+  } else if (ch->count >= ch->capacity && !codel_shedding(ch) &&
+             !grow_locked(ch)) {
+    /* Out of room in an unbounded channel and could not increase the size */
+    return SEND_FAILED;
+  }
+
+  if (codel_shedding(ch)) {
+    ch->dropped++;
+    return SEND_SHED;
+  }
+  return SEND_READY;
+}
+
+/* Publish the n items written from send_ptr on */
+static void commit_send_locked(channel_t *ch, size_t n) {
+  ch->count += n;
+
+  /* Buffer is circular for simplicity */
+  ch->send_ptr = (ch->send_ptr + n) % ch->capacity;
+  if (ch->release_idle_ns) {
+    check_idle_locked(ch);
+  }
+
+  /* Wake up a receiver per item if any are waiting */
+  for (size_t i = 0; i < n && ch->recv_waiters.head; i++) {
+    waiter_wake_one(ch);
+  }
+  futex_notify(ch);
+
+  if (ch->backlog_fn && ch->count > ch->backlog_threshold &&
+      ch->count - n <= ch->backlog_threshold) {
+    ch->backlog_fn(ch->backlog_arg);
+  }
+
+  /* Tell whoever watches this channel that it just became non-empty */
+  if (ch->count == n) {
+    if (ch->group) {
+      group_mark_ready(ch->group, ch->group_index);
+    }
+#if defined(__linux__)
+    if (ch->poll_entry) {
+      poller_notify(ch->poll_entry);
+    }
+#endif
+  }
+}
+
+/* State of the head of the queue after dropping stale items */
+typedef enum {
+  /* A live item is at recv_ptr */
+  HEAD_READY,
+  /* The queue is empty */
+  HEAD_EMPTY,
+  /* The expiry scan limit was reached, more stale items may follow */
+  HEAD_SCAN_LIMIT,
+} head_status_t;
+
+/* Drop expired items and apply active queue management at the head */
+static head_status_t prepare_head_locked(channel_t *ch) {
+  if ((ch->flags & CH_EXPIRY) && !drop_expired_locked(ch)) {
+    return HEAD_SCAN_LIMIT;
+  }
+  if (ch->count == 0) {
+    return HEAD_EMPTY;
+  }
+  if (ch->flags & CH_CODEL) {
+    codel_dequeue_locked(ch);
+  }
+  return HEAD_READY;
+}
+
+/* Wait until there is a live item at recv_ptr or the deadline passes (0 for
+ * none) */
+static channel_status_t await_recv_until_locked(channel_t *ch,
+                                                uint64_t deadline) {
+  for (;;) {
+    /* Go to sleep if there is nothing in the queue */
+    while (ch->count == 0 && !(ch->flags & CH_CLOSED)) {
+      waiter_t w;
+      if (!waiter_park_until(ch, &w, deadline) && ch->count == 0 &&
+          !(ch->flags & CH_CLOSED)) {
+        return CHANNEL_TIMEOUT;
+      }
+    }
+
+    /* Exit if the channel is closed and empty */
+    if (ch->count == 0) {
+      return CHANNEL_CLOSED;
+    }
+
+    head_status_t status = prepare_head_locked(ch);
+    if (status == HEAD_READY) {
+      return CHANNEL_OK;
+    }
+    if (status == HEAD_SCAN_LIMIT) {
+      /* Let other threads at the lock before going on */
+      mu_unlock(ch);
+      mu_lock(ch);
+    }
+  }
+}
+
+/* Wait until there is a live item at recv_ptr, returns false if the channel
+ * is closed and empty */
+static inline bool await_recv_locked(channel_t *ch) {
+  return await_recv_until_locked(ch, 0) == CHANNEL_OK;
+}
+
+/* Release the slot at recv_ptr back to senders */
+static void commit_recv_locked(channel_t *ch) { advance_recv_locked(ch, 1); }
+
+/* Address unique to the calling thread, identifies the SPSC sides */
+_Thread_local char channel_thread_tag;
+
+/* Take ownership of one side of the ring for the calling thread, false if
+ * another thread already owns it */
+static inline bool spsc_claim(_Atomic uintptr_t *owner) {
+  uintptr_t self = (uintptr_t)&channel_thread_tag;
+  uintptr_t cur = atomic_load_explicit(owner, memory_order_relaxed);
+  if (cur == self) {
+    return true;
+  }
+  return cur == 0 && atomic_compare_exchange_strong(owner, &cur, self);
+}
+
+/* Mark a side busy, false if the channel has left SPSC mode */
+static inline bool spsc_enter(channel_t *ch, atomic_bool *busy) {
+  atomic_store(busy, true);
+  if (atomic_load(&ch->mode) == CH_MODE_SPSC) {
+    return true;
+  }
+  atomic_store_explicit(busy, false, memory_order_release);
+  return false;
+}
+
+/* Wake the receiver parked on the ring, after it cleared recv_parked */
+void channel_spsc_wake_recv(channel_t *ch) {
+  mu_lock(ch);
+  waiter_wake_one(ch);
+  mu_unlock(ch);
+}
+
+/* Wake the sender parked on the ring, after it cleared send_parked */
+void channel_spsc_wake_send(channel_t *ch) {
+  mu_lock(ch);
+  chan_cond_signal(ch, &ch->send_cond);
+  mu_unlock(ch);
+}
+
+/* Outcome of an operation on the lock-free ring */
+typedef enum {
+  SPSC_DONE,
+  /* The ring is full or empty and the caller does not want to wait */
+  SPSC_WOULD_BLOCK,
+  /* Nothing was moved, the channel is on the locked algorithm now */
+  SPSC_LOCKED,
+} spsc_status_t;
+
+/* Send on the lock-free ring, waiting for room if block is set. Gives up
+ * with SPSC_LOCKED once the channel is on the locked algorithm, upgrading it
+ * first if a second producer or a full unbounded queue calls for it */
+static spsc_status_t spsc_send(channel_t *ch, const void *value, bool block) {
+  channel_spsc_t *sp = &ch->spsc;
+  if (!spsc_claim(&sp->producer)) {
+    lock_channel(ch);
+    mu_unlock(ch);
+    return SPSC_LOCKED;
+  }
+
+  for (;;) {
+    if (!spsc_enter(ch, &sp->send_busy)) {
+      return SPSC_LOCKED;
+    }
+    size_t head = atomic_load_explicit(&sp->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&sp->tail, memory_order_acquire);
+    bool bounded = ch->flags & CH_BOUNDED;
+    if (head - tail < ch->capacity) {
+      memcpy(slot_at(ch, head % ch->capacity), value, ch->item_size);
+      atomic_store(&sp->head, head + 1);
+      atomic_store_explicit(&sp->send_busy, false, memory_order_release);
+      /* Clearing the flag makes later sends skip the lock until the
+       * consumer parks again. The load keeps the common case free of a
+       * locked instruction */
+      if (atomic_load(&sp->recv_parked) &&
+          atomic_exchange(&sp->recv_parked, false)) {
+        channel_spsc_wake_recv(ch);
+      }
+      return SPSC_DONE;
+    }
+    atomic_store_explicit(&sp->send_busy, false, memory_order_release);
+
+    if (!bounded) {
+      /* Only the locked algorithm can grow the queue */
+      lock_channel(ch);
+      mu_unlock(ch);
+      return SPSC_LOCKED;
+    }
+    if (!block) {
+      return SPSC_WOULD_BLOCK;
+    }
+
+    /* Full, sleep until the consumer frees a slot or the channel upgrades */
+    mu_lock(ch);
+    atomic_store(&sp->send_parked, true);
+    if (atomic_load(&ch->mode) == CH_MODE_SPSC &&
+        head - atomic_load(&sp->tail) >= ch->capacity) {
+      chan_cond_wait(ch, &ch->send_cond);
+    }
+    atomic_store(&sp->send_parked, false);
+    mu_unlock(ch);
+  }
+}
+
+/* Receive from the lock-free ring, waiting for an item if block is set.
+ * Gives up with SPSC_LOCKED once the channel is on the locked algorithm,
+ * upgrading it first if a second consumer calls for it */
+static spsc_status_t spsc_recv(channel_t *ch, void *value, bool block) {
+  channel_spsc_t *sp = &ch->spsc;
+  if (!spsc_claim(&sp->consumer)) {
+    lock_channel(ch);
+    mu_unlock(ch);
+    return SPSC_LOCKED;
+  }
+
+  for (;;) {
+    if (!spsc_enter(ch, &sp->recv_busy)) {
+      return SPSC_LOCKED;
+    }
+    size_t tail = atomic_load_explicit(&sp->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&sp->head, memory_order_acquire);
+    if (head != tail) {
+      memcpy(value, slot_at(ch, tail % ch->capacity), ch->item_size);
+      atomic_store(&sp->tail, tail + 1);
+      atomic_store_explicit(&sp->recv_busy, false, memory_order_release);
+      if (atomic_load(&sp->send_parked) &&
+          atomic_exchange(&sp->send_parked, false)) {
+        channel_spsc_wake_send(ch);
+      }
+      return SPSC_DONE;
+    }
+    atomic_store_explicit(&sp->recv_busy, false, memory_order_release);
+    if (!block) {
+      return SPSC_WOULD_BLOCK;
+    }
+
+    /* Empty, park until the producer publishes or the channel upgrades. The
+     * producer checks recv_parked after publishing head, so one of the two
+     * sees the other */
+    mu_lock(ch);
+    atomic_store(&sp->recv_parked, true);
+    if (atomic_load(&ch->mode) == CH_MODE_SPSC &&
+        atomic_load(&sp->head) == tail) {
+      waiter_t w;
+      waiter_park(ch, &w);
+    }
+    atomic_store(&sp->recv_parked, false);
+    mu_unlock(ch);
+  }
+}
+
+/* Queue value at the back of one tenant's sub-queue, waiting for room if
+ * block is set */
+static bool send_tenant(channel_t *ch, const void *value, size_t tenant,
+                        bool block) {
+  fair_t *f = ch->fair;
+  if (!f || tenant >= f->ntenants) {
+    return false;
+  }
+  tenant_t *t = &f->tenants[tenant];
+
+  lock_channel(ch);
+  while (t->count >= f->depth && !(ch->flags & CH_CLOSED) && block) {
+    chan_cond_wait(ch, &t->send_cond);
+  }
+  if ((ch->flags & CH_CLOSED) || t->count >= f->depth) {
+    mu_unlock(ch);
+    return false;
+  }
+
+  size_t idx = t->base + (t->head + t->count) % f->depth;
+  memcpy(slot_at(ch, idx), value, ch->item_size);
+  if (t->count++ == 0) {
+    fair_activate_locked(ch, tenant);
+  }
+  commit_send_locked(ch, 1);
+  mu_unlock(ch);
+  return true;
+}
+
+bool channel_send_tenant(channel_t *ch, const void *value, size_t tenant) {
+  return send_tenant(ch, value, tenant, true);
+}
+
+/* Copy value into a free slot and add it to the deadline heap */
+static bool send_deadline(channel_t *ch, const void *value,
+                          uint64_t deadline_ns, bool block) {
+  edf_t *e = ch->edf;
+  if (!e) {
+    return false;
+  }
+
+  lock_channel(ch);
+  if (reserve_send_locked(ch, block) != SEND_READY) {
+    mu_unlock(ch);
+    return false;
+  }
+  size_t idx = e->free_slots[--e->nfree];
+  memcpy(slot_at(ch, idx), value, ch->item_size);
+  edf_push_locked(ch, deadline_ns, idx);
+  commit_send_locked(ch, 1);
+  mu_unlock(ch);
+  return true;
+}
+
+bool channel_send_deadline(channel_t *ch, const void *value,
+                           uint64_t deadline_ns) {
+  return send_deadline(ch, value, deadline_ns, true);
+}
+
+/* Read the deadline at the root of the heap */
+bool channel_peek_deadline(channel_t *ch, uint64_t *deadline_ns) {
+  if (!ch->edf) {
+    return false;
+  }
+  lock_channel(ch);
+  bool queued = ch->count > 0;
+  if (queued) {
+    *deadline_ns = ch->edf->heap[EDF_HEAP_SKEW].deadline;
+  }
+  mu_unlock(ch);
+  return queued;
+}
+
+/* Copy value into the next slot with the given expiry, waiting for room if
+ * block is set */
+static bool send_value(channel_t *ch, const void *value, uint64_t expires_at,
+                       bool block) {
+  if (ch->fair) {
+    return send_tenant(ch, value, 0, block);
+  }
+  if (ch->edf) {
+    return send_deadline(ch, value, UINT64_MAX, block);
+  }
+
+  lock_channel(ch);
+  send_status_t status = reserve_send_locked(ch, block);
+  if (status != SEND_READY) {
+    /* Failed, full, or shed by CoDel, which counted it as dropped */
+    mu_unlock(ch);
+    return false;
+  }
+
+  /* Copy the value into the correct place in the buffer */
+  void *slot = slot_at(ch, ch->send_ptr);
+  write_meta(ch, slot, expires_at);
+  memcpy(slot_item(ch, slot), value, ch->item_size);
+  commit_send_locked(ch, 1);
+  mu_unlock(ch);
+  return true;
+}
+
+/* Send a pointer to value into the channel, place it into the queue */
+bool channel_send(channel_t *ch, const void *value) {
+  if (atomic_load_explicit(&ch->mode, memory_order_relaxed) == CH_MODE_SPSC &&
+      spsc_send(ch, value, true) == SPSC_DONE) {
+    return true;
+  }
+  return send_value(ch, value, 0, true);
+}
+
+/* Send like channel_send, but fail instead of waiting for room */
+bool channel_try_send(channel_t *ch, const void *value) {
+  if (atomic_load_explicit(&ch->mode, memory_order_relaxed) == CH_MODE_SPSC) {
+    spsc_status_t status = spsc_send(ch, value, false);
+    if (status != SPSC_LOCKED) {
+      return status == SPSC_DONE;
+    }
+  }
+  return send_value(ch, value, 0, false);
+}
+
+/* Send a value that receivers drop if it is still queued after ttl_ns */
+bool channel_send_ttl(channel_t *ch, const void *value, uint64_t ttl_ns) {
+  if (!(ch->flags & CH_EXPIRY)) {
+    return false;
+  }
+  return send_value(ch, value, now_ns() + ttl_ns, true);
+}
+
+/* Receive an item from the channel if available, write the data into *value */
+bool channel_recv(channel_t *ch, void *value) {
+  if (atomic_load_explicit(&ch->mode, memory_order_relaxed) == CH_MODE_SPSC &&
+      spsc_recv(ch, value, true) == SPSC_DONE) {
+    return true;
+  }
+
+  lock_channel(ch);
+  if (!await_recv_locked(ch)) {
+    mu_unlock(ch);
+    return false;
+  }
+
+  /* Copy the next item to be received into *value */
+  memcpy(value, slot_item(ch, slot_at(ch, ch->recv_ptr)), ch->item_size);
+  commit_recv_locked(ch);
+  mu_unlock(ch);
+  return true;
+}
+
+/* Receive like channel_recv, but fail instead of waiting for an item */
+bool channel_try_recv(channel_t *ch, void *value) {
+  if (atomic_load_explicit(&ch->mode, memory_order_relaxed) == CH_MODE_SPSC) {
+    spsc_status_t status = spsc_recv(ch, value, false);
+    if (status != SPSC_LOCKED) {
+      return status == SPSC_DONE;
+    }
+  }
+
+  lock_channel(ch);
+  head_status_t status;
+  while ((status = prepare_head_locked(ch)) == HEAD_SCAN_LIMIT) {
+    /* Let other threads at the lock before going on */
+    mu_unlock(ch);
+    mu_lock(ch);
+  }
+  if (status == HEAD_READY) {
+    memcpy(value, slot_item(ch, slot_at(ch, ch->recv_ptr)), ch->item_size);
+    commit_recv_locked(ch);
+  }
+  mu_unlock(ch);
+  return status == HEAD_READY;
+}
+
+/* Receive an item like channel_recv, waiting at most timeout_ns for one */
+channel_status_t channel_recv_timeout(channel_t *ch, void *value,
+                                      uint64_t timeout_ns) {
+  uint64_t deadline = now_ns() + timeout_ns;
+  lock_channel(ch);
+  channel_status_t status = await_recv_until_locked(ch, deadline);
+  if (status == CHANNEL_OK) {
+    memcpy(value, slot_item(ch, slot_at(ch, ch->recv_ptr)), ch->item_size);
+    commit_recv_locked(ch);
+  }
+  mu_unlock(ch);
+  return status;
+}
+
+/* Whether slots hold just the item, so runs of them can be copied whole */
+static inline bool plain_slots(channel_t *ch) {
+  return ch->meta_size == 0 && !(ch->flags & CH_SWAP) && !ch->fair &&
+         !ch->edf;
+}
+
+/* Number of the n slots from idx on that are contiguous in memory, all of
+ * them with a magic ring */
+static inline size_t slot_run(channel_t *ch, size_t idx, size_t n) {
+  if (ch->flags & CH_MAGIC) {
+    return n;
+  }
+  return n < ch->capacity - idx ? n : ch->capacity - idx;
+}
+
+/* Copy n items from src into the slots from send_ptr on */
+static void copy_in_locked(channel_t *ch, const char *src, size_t n) {
+  size_t idx = ch->send_ptr;
+  if (!plain_slots(ch)) {
+    for (size_t i = 0; i < n; i++) {
+      void *slot = slot_at(ch, (idx + i) % ch->capacity);
+      write_meta(ch, slot, 0);
+      memcpy(slot_item(ch, slot), src + i * ch->item_size, ch->item_size);
+    }
+    return;
+  }
+  while (n > 0) {
+    size_t run = slot_run(ch, idx, n);
+    memcpy(slot_at(ch, idx), src, run * ch->item_size);
+    src += run * ch->item_size;
+    idx = (idx + run) % ch->capacity;
+    n -= run;
+  }
+}
+
+/* Copy n plain items from the slots from recv_ptr on into dst */
+static void copy_out_locked(channel_t *ch, char *dst, size_t n) {
+  size_t idx = ch->recv_ptr;
+  while (n > 0) {
+    size_t run = slot_run(ch, idx, n);
+    memcpy(dst, slot_at(ch, idx), run * ch->item_size);
+    dst += run * ch->item_size;
+    idx = (idx + run) % ch->capacity;
+    n -= run;
+  }
+}
+
+/* Send n items from the array items, filling as much room as there is per
+ * lock acquisition. Without block, stops at the first item there is no room
+ * for */
+static size_t send_batch(channel_t *ch, const void *items, size_t n,
+                         bool block) {
+  const char *src = items;
+  size_t sent = 0;
+  size_t skipped = 0;
+
+  if (ch->fair || ch->edf) {
+    /* Items go to tenant 0, or without a deadline, one at a time */
+    while (sent < n && send_value(ch, src + sent * ch->item_size, 0, block)) {
+      sent++;
+    }
+    return sent;
+  }
+
+  lock_channel(ch);
+  while (sent + skipped < n) {
+    send_status_t status = reserve_send_locked(ch, block);
+    if (status == SEND_FAILED || status == SEND_FULL) {
+      break;
+    }
+    if (status == SEND_SHED) {
+      /* Skip the item, reserve counted it as dropped */
+      skipped++;
+      continue;
+    }
+
+    size_t done = sent + skipped;
+    size_t limit = (ch->flags & CH_BOUNDED) ? ch->limit : ch->capacity;
+    size_t room = limit - ch->count;
+    size_t k = n - done < room ? n - done : room;
+    copy_in_locked(ch, src + done * ch->item_size, k);
+    commit_send_locked(ch, k);
+    sent += k;
+  }
+  mu_unlock(ch);
+  return sent;
+}
+
+/* Blocking batch send */
+size_t channel_send_batch(channel_t *ch, const void *items, size_t n) {
+  return send_batch(ch, items, n, true);
+}
+
+/* Batch send of what fits right away */
+size_t channel_try_send_batch(channel_t *ch, const void *items, size_t n) {
+  return send_batch(ch, items, n, false);
+}
+
+/* Receive up to max items into the array items, waiting for the first */
+size_t channel_recv_batch(channel_t *ch, void *items, size_t max) {
+  char *dst = items;
+  size_t got = 0;
+  if (max == 0) {
+    return 0;
+  }
+
+  lock_channel(ch);
+  if (!await_recv_locked(ch)) {
+    mu_unlock(ch);
+    return 0;
+  }
+
+  if (plain_slots(ch)) {
+    got = ch->count < max ? ch->count : max;
+    copy_out_locked(ch, dst, got);
+    advance_recv_locked(ch, got);
+  } else {
+    /* Items with metadata go through the head checks one at a time */
+    do {
+      memcpy(dst + got * ch->item_size,
+             slot_item(ch, slot_at(ch, ch->recv_ptr)), ch->item_size);
+      commit_recv_locked(ch);
+      got++;
+    } while (got < max && ch->count > 0 &&
+             prepare_head_locked(ch) == HEAD_READY);
+  }
+  mu_unlock(ch);
+  return got;
+}
+
+/* Trade the caller's buffer for the one owned by slot */
+static inline void swap_buffer(void *slot, void **buf) {
+  void *owned = *(void **)slot;
+  *(void **)slot = *buf;
+  *buf = owned;
+}
+
+/* Send *buf by handing it to the next free slot, *buf becomes that slot's
+ * previous (free) buffer */
+bool channel_send_swap(channel_t *ch, void **buf) {
+  if (!(ch->flags & CH_SWAP)) {
+    return false;
+  }
+
+  lock_channel(ch);
+  send_status_t status = reserve_send_locked(ch, true);
+  if (status != SEND_READY) {
+    /* A shed item stays with the caller, who reuses the buffer */
+    mu_unlock(ch);
+    return false;
+  }
+
+  void *slot = slot_at(ch, ch->send_ptr);
+  write_meta(ch, slot, 0);
+  swap_buffer(slot_payload(ch, slot), buf);
+  commit_send_locked(ch, 1);
+  mu_unlock(ch);
+  return true;
+}
+
+/* Receive into *buf by taking the next slot's buffer, the caller's old buffer
+ * is left behind in the slot for a future send */
+bool channel_recv_swap(channel_t *ch, void **buf) {
+  if (!(ch->flags & CH_SWAP)) {
+    return false;
+  }
+
+  lock_channel(ch);
+  if (!await_recv_locked(ch)) {
+    mu_unlock(ch);
+    return false;
+  }
+
+  swap_buffer(slot_payload(ch, slot_at(ch, ch->recv_ptr)), buf);
+  commit_recv_locked(ch);
+  mu_unlock(ch);
+  return true;
+}
+
+/* Close the channel off to further sending */
+void channel_close(channel_t *ch) {
+  lock_channel(ch);
+
+  /* Set the closed bit, wake up all the sleeping threads */
+  ch->flags |= CH_CLOSED;
+  chan_cond_broadcast(ch, &ch->send_cond);
+  if (ch->fair) {
+    for (size_t i = 0; i < ch->fair->ntenants; i++) {
+      chan_cond_broadcast(ch, &ch->fair->tenants[i].send_cond);
+    }
+  }
+  while (ch->recv_waiters.head) {
+    waiter_wake(ch, ch->recv_waiters.head);
+  }
+  futex_notify(ch);
+  if (ch->group) {
+    group_mark_closed(ch->group, ch->group_index);
+  }
+#if defined(__linux__)
+  if (ch->poll_entry) {
+    poller_notify(ch->poll_entry);
+  }
+#endif
+  mu_unlock(ch);
+}
+
+/* Set or clear the channel's backlog callback */
+bool channel_watch_backlog(channel_t *ch, size_t threshold,
+                           channel_backlog_fn fn, void *arg) {
+  lock_channel(ch);
+  if (fn && ch->backlog_fn) {
+    mu_unlock(ch);
+    return false;
+  }
+  ch->backlog_fn = fn;
+  ch->backlog_arg = arg;
+  ch->backlog_threshold = threshold;
+  if (fn && ch->count > threshold) {
+    fn(arg);
+  }
+  mu_unlock(ch);
+  return true;
+}
+
+/* Whether channel_select may use futex_waitv, cleared if the kernel lacks it
+ */
+#if defined(HAVE_FUTEX_WAITV)
+static atomic_bool select_futex_enabled = true;
+#else
+static atomic_bool select_futex_enabled = false;
+#endif
+
+/* Case to start polling from, rotated so early cases cannot starve the rest
+ */
+static _Thread_local unsigned select_start;
+
+/* Result of polling select cases without blocking */
+#define SELECT_NONE_READY -2
+#define SELECT_ALL_CLOSED -1
+
+/* Receive from the first ready case, or report that none are ready or all
+ * are closed and empty */
+static int select_poll(channel_case_t *cases, size_t n) {
+  size_t closed = 0;
+  size_t start = select_start++ % n;
+
+  for (size_t k = 0; k < n; k++) {
+    size_t i = (start + k) % n;
+    channel_t *ch = cases[i].ch;
+    lock_channel(ch);
+    if (ch->count > 0 && prepare_head_locked(ch) == HEAD_READY) {
+      memcpy(cases[i].value, slot_item(ch, slot_at(ch, ch->recv_ptr)),
+             ch->item_size);
+      commit_recv_locked(ch);
+      mu_unlock(ch);
+      return (int)i;
+    }
+    if (ch->count == 0 && (ch->flags & CH_CLOSED)) {
+      closed++;
+    }
+    mu_unlock(ch);
+  }
+  return closed == n ? SELECT_ALL_CLOSED : SELECT_NONE_READY;
+}
+
+#if defined(HAVE_FUTEX_WAITV)
+/* Select by sleeping on every channel's seq word at once with futex_waitv.
+ * Returns SELECT_NONE_READY if the kernel does not support it */
+static int select_futex(channel_case_t *cases, size_t n) {
+  struct futex_waitv waiters[FUTEX_WAITV_MAX];
+  int result;
+
+  for (size_t i = 0; i < n; i++) {
+    atomic_fetch_add(&cases[i].ch->futex_waiters, 1);
+    waiters[i] = (struct futex_waitv){
+        .uaddr = (uintptr_t)&cases[i].ch->seq,
+        .flags = FUTEX_32 | FUTEX_PRIVATE_FLAG,
+    };
+  }
+
+  for (;;) {
+    /* Snapshot the words before polling so a send in between changes them
+     * and makes the wait return immediately */
+    for (size_t i = 0; i < n; i++) {
+      waiters[i].val = atomic_load(&cases[i].ch->seq);
+    }
+    result = select_poll(cases, n);
+    if (result != SELECT_NONE_READY) {
+      break;
+    }
+    if (futex_waitv(waiters, (unsigned int)n) < 0 && errno == ENOSYS) {
+      atomic_store(&select_futex_enabled, false);
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    atomic_fetch_sub(&cases[i].ch->futex_waiters, 1);
+  }
+  return result;
+}
+#endif
+
+/* Select by registering a waiter with every channel, all sharing one
+ * select_waiter_t that the first channel to get an item claims. A channel
+ * spends its one wakeup of a send on that claim, so if the poll then takes
+ * another case, the wakeup is passed on to the woken channel's next
+ * receiver */
+static int select_register(channel_case_t *cases, size_t n) {
+  waiter_t *nodes = malloc(n * sizeof(waiter_t));
+  if (!nodes) {
+    return SELECT_ALL_CLOSED;
+  }
+  select_waiter_t sel;
+  pthread_mutex_init(&sel.mu, NULL);
+  pthread_cond_init(&sel.cond, NULL);
+
+  int result;
+  size_t registered = 0;
+  while ((result = select_poll(cases, n)) == SELECT_NONE_READY) {
+    atomic_store(&sel.fired, -1);
+
+    for (registered = 0; registered < n; registered++) {
+      channel_t *ch = cases[registered].ch;
+      lock_channel(ch);
+      if (ch->count > 0 || (ch->flags & CH_CLOSED)) {
+        /* Something arrived since polling, no need to sleep. A channel
+         * already registered may have claimed the select first */
+        mu_unlock(ch);
+        int expected = -1;
+        atomic_compare_exchange_strong(&sel.fired, &expected,
+                                       (int)registered);
+        break;
+      }
+      nodes[registered].sel = &sel;
+      nodes[registered].sel_index = (int)registered;
+      waitlist_push(ch, &nodes[registered]);
+      mu_unlock(ch);
+    }
+
+    pthread_mutex_lock(&sel.mu);
+    while (atomic_load(&sel.fired) == -1) {
+      pthread_cond_wait(&sel.cond, &sel.mu);
+    }
+    pthread_mutex_unlock(&sel.mu);
+
+    for (size_t i = 0; i < registered; i++) {
+      channel_t *ch = cases[i].ch;
+      mu_lock(ch);
+      if (!nodes[i].woken) {
+        waitlist_remove(ch, &nodes[i]);
+      }
+      mu_unlock(ch);
+    }
+  }
+
+  /* Only the last round's registrations can hold a wakeup the poll did not
+   * use, as every earlier round ended with nothing to take */
+  for (size_t i = 0; i < registered; i++) {
+    if (!nodes[i].woken || (int)i == result) {
+      continue;
+    }
+    channel_t *ch = cases[i].ch;
+    mu_lock(ch);
+    if (ch->count > 0) {
+      waiter_wake_one(ch);
+    }
+    mu_unlock(ch);
+  }
+
+  pthread_cond_destroy(&sel.cond);
+  pthread_mutex_destroy(&sel.mu);
+  free(nodes);
+  return result;
+}
+
+/* Receive from whichever case's channel has an item first */
+int channel_select(channel_case_t *cases, size_t n) {
+  if (n == 0) {
+    return SELECT_ALL_CLOSED;
+  }
+
+#if defined(HAVE_FUTEX_WAITV)
+  if (n <= FUTEX_WAITV_MAX && atomic_load(&select_futex_enabled)) {
+    int result = select_futex(cases, n);
+    if (result != SELECT_NONE_READY) {
+      return result;
+    }
+  }
+#endif
+  return select_register(cases, n);
+}
+
+/* Turn the futex_waitv path of channel_select on or off */
+bool channel_select_use_futex(bool enable) {
+#if defined(HAVE_FUTEX_WAITV)
+  atomic_store(&select_futex_enabled, enable);
+  return enable;
+#else
+  (void)enable;
+  return false;
+#endif
+}
+
+/* Create an empty channel group */
+channel_group_t *channel_group_create(void) {
+  channel_group_t *g = malloc(sizeof(channel_group_t));
+  if (!g) {
+    return NULL;
+  }
+  atomic_init(&g->ready, 0);
+  atomic_init(&g->closed, 0);
+  atomic_init(&g->members, 0);
+  atomic_init(&g->sleepers, 0);
+  atomic_init(&g->cursor, 0);
+  g->size = 0;
+  pthread_mutex_init(&g->mu, NULL);
+  pthread_cond_init(&g->cond, NULL);
+  return g;
+}
+
+/* Add ch to the group, publishing its current state in the bitmaps */
+int channel_group_join(channel_group_t *g, channel_t *ch) {
+  /* Same lock order as a send notifying the group: channel, then group */
+  lock_channel(ch);
+  pthread_mutex_lock(&g->mu);
+  if (ch->group || g->size == CHANNEL_GROUP_MAX) {
+    pthread_mutex_unlock(&g->mu);
+    mu_unlock(ch);
+    return -1;
+  }
+
+  int index = (int)g->size++;
+  g->channels[index] = ch;
+  ch->group = g;
+  ch->group_index = index;
+  atomic_fetch_or(&g->members, UINT64_C(1) << index);
+  if (ch->count > 0) {
+    atomic_fetch_or(&g->ready, UINT64_C(1) << index);
+  }
+  if (ch->flags & CH_CLOSED) {
+    atomic_fetch_or(&g->closed, UINT64_C(1) << index);
+  }
+
+  /* A receiver may be parked on a group that had nothing ready */
+  pthread_cond_broadcast(&g->cond);
+  pthread_mutex_unlock(&g->mu);
+  mu_unlock(ch);
+  return index;
+}
+
+/* Whether every member is closed and drained */
+static bool group_finished(channel_group_t *g) {
+  uint64_t members = atomic_load(&g->members);
+  return atomic_load(&g->ready) == 0 && atomic_load(&g->closed) == members;
+}
+
+/* Pick the next ready member, rotating from the cursor so busy channels
+ * with low indexes cannot starve the rest */
+static int group_pick(channel_group_t *g, uint64_t ready) {
+  unsigned start = atomic_load_explicit(&g->cursor, memory_order_relaxed);
+  uint64_t after = ready & (~UINT64_C(0) << start);
+  int index = __builtin_ctzll(after ? after : ready);
+  atomic_store_explicit(&g->cursor, (unsigned)(index + 1) % CHANNEL_GROUP_MAX,
+                        memory_order_relaxed);
+  return index;
+}
+
+/* Receive from whichever member has an item, parking only when none do */
+bool channel_group_recv(channel_group_t *g, void *value, int *index) {
+  for (;;) {
+    uint64_t ready = atomic_load(&g->ready);
+    if (ready == 0) {
+      pthread_mutex_lock(&g->mu);
+      atomic_fetch_add(&g->sleepers, 1);
+      while (atomic_load(&g->ready) == 0 && !group_finished(g)) {
+        pthread_cond_wait(&g->cond, &g->mu);
+      }
+      atomic_fetch_sub(&g->sleepers, 1);
+      pthread_mutex_unlock(&g->mu);
+      if (group_finished(g)) {
+        return false;
+      }
+      continue;
+    }
+
+    int i = group_pick(g, ready);
+    channel_t *ch = g->channels[i];
+    lock_channel(ch);
+    /* Another receiver may have drained it since the bitmap was read */
+    if (ch->count > 0 && prepare_head_locked(ch) == HEAD_READY) {
+      memcpy(value, slot_item(ch, slot_at(ch, ch->recv_ptr)), ch->item_size);
+      commit_recv_locked(ch);
+      mu_unlock(ch);
+      if (index) {
+        *index = i;
+      }
+      return true;
+    }
+    mu_unlock(ch);
+  }
+}
+
+/* Detach every member and free the group */
+void channel_group_destroy(channel_group_t *g) {
+  for (size_t i = 0; i < g->size; i++) {
+    channel_t *ch = g->channels[i];
+    mu_lock(ch);
+    ch->group = NULL;
+    mu_unlock(ch);
+  }
+  pthread_cond_destroy(&g->cond);
+  pthread_mutex_destroy(&g->mu);
+  free(g);
+}
+
+/* Snapshot the channel's counters */
+void channel_stats(channel_t *ch, channel_stats_t *stats) {
+  mu_lock(ch);
+  stats->expired = ch->expired;
+  stats->dropped = ch->dropped;
+  stats->released = ch->released;
+  stats->queued = ch->count;
+  stats->head_age_ns = 0;
+  if (atomic_load_explicit(&ch->mode, memory_order_relaxed) == CH_MODE_SPSC) {
+    stats->queued = atomic_load(&ch->spsc.head) - atomic_load(&ch->spsc.tail);
+  } else if (ch->meta_size && ch->count > 0) {
+    slot_meta_t *head = slot_at(ch, ch->recv_ptr);
+    stats->head_age_ns = now_ns() - head->enqueued_at;
+  }
+  mu_unlock(ch);
+}
+
+/* Cleanup resources */
+void channel_destroy(channel_t *ch) {
+  fair_destroy(ch);
+  edf_destroy(ch);
+  chan_cond_destroy(ch, &ch->send_cond);
+  channel_lock_destroy(ch);
+  if (ch->flags & CH_SWAP) {
+    free_swap_buffers(ch);
+  }
+  queue_free(ch);
+  free(ch);
+}
+
+#if defined(__linux__)
+/* Create a poller with its epoll instance and wakeup eventfd */
+channel_poller_t *channel_poller_create(void) {
+  channel_poller_t *p = calloc(1, sizeof(channel_poller_t));
+  if (!p) {
+    return NULL;
+  }
+  p->epfd = epoll_create1(EPOLL_CLOEXEC);
+  p->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+  if (p->epfd < 0 || p->efd < 0 ||
+      epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->efd, &ev) != 0) {
+    if (p->epfd >= 0) {
+      close(p->epfd);
+    }
+    if (p->efd >= 0) {
+      close(p->efd);
+    }
+    free(p);
+    return NULL;
+  }
+  atomic_init(&p->signaled, false);
+  pthread_mutex_init(&p->mu, NULL);
+  return p;
+}
+
+/* Watch ch, receiving its items into value when polled */
+bool channel_poller_add_channel(channel_poller_t *p, channel_t *ch,
+                                void *value, void *udata) {
+  poll_entry_t *e = malloc(sizeof(poll_entry_t));
+  if (!e) {
+    return false;
+  }
+  e->poller = p;
+  e->ch = ch;
+  e->value = value;
+  e->udata = udata;
+  e->done = false;
+
+  pthread_mutex_lock(&p->mu);
+  if (p->size == p->cap) {
+    size_t new_cap = p->cap ? p->cap * 2 : 8;
+    poll_entry_t **entries =
+        realloc(p->entries, new_cap * sizeof(poll_entry_t *));
+    if (!entries) {
+      pthread_mutex_unlock(&p->mu);
+      free(e);
+      return false;
+    }
+    p->entries = entries;
+    p->cap = new_cap;
+  }
+
+  lock_channel(ch);
+  if (ch->poll_entry) {
+    mu_unlock(ch);
+    pthread_mutex_unlock(&p->mu);
+    free(e);
+    return false;
+  }
+  atomic_init(&e->pending, false);
+  ch->poll_entry = e;
+  p->entries[p->size++] = e;
+  if (ch->count > 0 || (ch->flags & CH_CLOSED)) {
+    poller_notify(e);
+  }
+  mu_unlock(ch);
+  pthread_mutex_unlock(&p->mu);
+  return true;
+}
+
+/* Watch fd for the given epoll events */
+bool channel_poller_add_fd(channel_poller_t *p, int fd, uint32_t events,
+                           void *udata) {
+  poll_fd_t *f = malloc(sizeof(poll_fd_t));
+  if (!f) {
+    return false;
+  }
+  f->fd = fd;
+  f->udata = udata;
+
+  struct epoll_event ev = {.events = events, .data.ptr = f};
+  pthread_mutex_lock(&p->mu);
+  if (epoll_ctl(p->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    pthread_mutex_unlock(&p->mu);
+    free(f);
+    return false;
+  }
+  f->next = p->fds;
+  p->fds = f;
+  pthread_mutex_unlock(&p->mu);
+  return true;
+}
+
+/* Stop watching fd */
+bool channel_poller_remove_fd(channel_poller_t *p, int fd) {
+  pthread_mutex_lock(&p->mu);
+  for (poll_fd_t **link = &p->fds; *link; link = &(*link)->next) {
+    poll_fd_t *f = *link;
+    if (f->fd == fd) {
+      epoll_ctl(p->epfd, EPOLL_CTL_DEL, fd, NULL);
+      *link = f->next;
+      pthread_mutex_unlock(&p->mu);
+      free(f);
+      return true;
+    }
+  }
+  pthread_mutex_unlock(&p->mu);
+  return false;
+}
+
+/* Take one item from every pending channel, or report it closed */
+static size_t poller_collect_channels(channel_poller_t *p,
+                                      channel_poll_event_t *events,
+                                      size_t max) {
+  size_t n = 0;
+  pthread_mutex_lock(&p->mu);
+  for (size_t i = 0; i < p->size && n < max; i++) {
+    poll_entry_t *e = p->entries[i];
+    if (e->done || !atomic_load(&e->pending)) {
+      continue;
+    }
+
+    channel_t *ch = e->ch;
+    lock_channel(ch);
+    if (ch->count > 0 && prepare_head_locked(ch) == HEAD_READY) {
+      memcpy(e->value, slot_item(ch, slot_at(ch, ch->recv_ptr)),
+             ch->item_size);
+      commit_recv_locked(ch);
+      events[n++] = (channel_poll_event_t){.ch = ch, .fd = -1,
+                                           .udata = e->udata};
+    } else if (ch->count == 0 && (ch->flags & CH_CLOSED)) {
+      e->done = true;
+      events[n++] = (channel_poll_event_t){.ch = ch, .closed = true,
+                                           .fd = -1, .udata = e->udata};
+    }
+    /* Stay pending while items remain, senders only signal on the empty to
+     * non-empty transition */
+    atomic_store(&e->pending, ch->count > 0 && !e->done);
+    mu_unlock(ch);
+  }
+  pthread_mutex_unlock(&p->mu);
+  return n;
+}
+
+/* Wait for ready channels and file descriptors, returning all that are
+ * ready in one call */
+int channel_poller_wait(channel_poller_t *p, channel_poll_event_t *events,
+                        size_t max, int timeout_ms) {
+  if (max == 0) {
+    return 0;
+  }
+  struct epoll_event ready[64];
+
+  /* Retries after a signal or an empty wakeup only wait out what is left */
+  uint64_t deadline =
+      timeout_ms > 0 ? now_ns() + (uint64_t)timeout_ms * 1000000ULL : 0;
+
+  for (;;) {
+    int wait_ms = timeout_ms;
+    if (deadline) {
+      uint64_t now = now_ns();
+      wait_ms = now >= deadline
+                    ? 0
+                    : (int)((deadline - now + 999999ULL) / 1000000ULL);
+    }
+    size_t n = poller_collect_channels(p, events, max);
+
+    /* Only sleep if no channel had anything */
+    int room = (int)(max - n < 64 ? max - n : 64);
+    int nfds =
+        room > 0 ? epoll_wait(p->epfd, ready, room, n ? 0 : wait_ms) : 0;
+    if (nfds < 0) {
+      if (errno == EINTR && n == 0) {
+        continue;
+      }
+      return n ? (int)n : -1;
+    }
+
+    bool woken = false;
+    for (int i = 0; i < nfds; i++) {
+      poll_fd_t *f = ready[i].data.ptr;
+      if (!f) {
+        uint64_t count;
+        ssize_t r = read(p->efd, &count, sizeof(count));
+        (void)r;
+        atomic_store(&p->signaled, false);
+        woken = true;
+        continue;
+      }
+      events[n++] = (channel_poll_event_t){
+          .fd = f->fd, .revents = ready[i].events, .udata = f->udata};
+    }
+
+    if (woken && n < max) {
+      n += poller_collect_channels(p, events + n, max - n);
+    }
+    if (n > 0 || nfds == 0) {
+      return (int)n;
+    }
+  }
+}
+
+/* Detach every channel and release the poller */
+void channel_poller_destroy(channel_poller_t *p) {
+  for (size_t i = 0; i < p->size; i++) {
+    channel_t *ch = p->entries[i]->ch;
+    mu_lock(ch);
+    ch->poll_entry = NULL;
+    mu_unlock(ch);
+    free(p->entries[i]);
+  }
+  while (p->fds) {
+    poll_fd_t *f = p->fds;
+    p->fds = f->next;
+    free(f);
+  }
+  free(p->entries);
+  close(p->efd);
+  close(p->epfd);
+  pthread_mutex_destroy(&p->mu);
+  free(p);
 }
+#endif
@@ -3,10 +3,166 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Handle to the channel */
 typedef struct channel_t channel_t;
 
+/* Handle to a group of channels received from together */
+typedef struct channel_group_t channel_group_t;
+
+/* The most channels a group can hold */
+#define CHANNEL_GROUP_MAX 64
+
+/* One receive case for channel_select */
+typedef struct channel_case_t {
+  /* The channel to receive from */
+  channel_t *ch;
+
+  /* Where to write the item if this case is chosen */
+  void *value;
+} channel_case_t;
+
+/* Order in which blocked receivers are woken as items arrive */
+typedef enum {
+  /* Wake the longest-waiting receiver first (default) */
+  CHANNEL_WAKE_FIFO = 0,
+  /* Wake the most recently parked receiver first, keeping a small set of
+   * cache-warm workers busy while idle ones stay asleep */
+  CHANNEL_WAKE_LIFO,
+} channel_wake_policy_t;
+
+/* Lock protecting a channel's queue */
+typedef enum {
+  /* A pthread mutex (default) */
+  CHANNEL_LOCK_MUTEX = 0,
+  /* An MCS queue lock where each waiter spins on its own node, grouped into
+   * per-NUMA-node cohorts that pass the lock among themselves before handing
+   * it to another node. Linux only, other platforms use the mutex */
+  CHANNEL_LOCK_QUEUE,
+} channel_lock_t;
+
+/* Optional channel settings, a zero-initialized struct gives the defaults */
+typedef struct channel_opts_t {
+  /* Which blocked receiver a send wakes */
+  channel_wake_policy_t wake_policy;
+
+  /* Use a priority-inheritance mutex so a real-time thread blocked on the
+   * channel boosts a lower-priority thread holding the lock. Creation fails
+   * if the platform does not support PTHREAD_PRIO_INHERIT */
+  bool priority_inherit;
+
+  /* Which lock protects the channel. CHANNEL_LOCK_QUEUE cannot be combined
+   * with priority_inherit */
+  channel_lock_t lock;
+
+  /* Give every slot of a bounded channel its own item_size buffer so large
+   * items can move with channel_send_swap/channel_recv_swap by exchanging
+   * buffer pointers instead of copying. Not supported for unbounded channels
+   */
+  bool swap_buffers;
+
+  /* Store an expiry time with every item so channel_send_ttl can be used.
+   * Receivers drop expired items at the head of the queue before returning
+   * a live one */
+  bool expiring_items;
+
+  /* Most expired items a single receive drops before briefly releasing the
+   * lock, bounding lock hold time. 0 means no limit */
+  size_t max_expired_scan;
+
+  /* Enable CoDel active queue management: once the time items spend queued
+   * has stayed above this target for a whole interval, receivers drop items
+   * from the head at an increasing rate until it falls below again. 0
+   * disables it */
+  uint64_t codel_target_ns;
+
+  /* CoDel interval, 0 for the default of 100ms */
+  uint64_t codel_interval_ns;
+
+  /* While CoDel is dropping, also discard newly sent items instead of
+   * queueing or blocking on them, so the standing queue drains even when
+   * producers do not slow down. A discarded send returns false like a send
+   * to a closed channel, is left out of batch send counts and is counted as
+   * dropped */
+  bool codel_shed_sends;
+
+  /* Start with a lock-free single-producer single-consumer ring and switch,
+   * once and for good, to the locked multi-producer multi-consumer algorithm
+   * when a second thread sends or receives, or the channel is closed, grows,
+   * or is used with anything but channel_send and channel_recv. Has no
+   * effect together with swap_buffers, expiring_items, CoDel,
+   * release_idle_ns or magic_ring */
+  bool adaptive;
+
+  /* Map a bounded channel's queue twice back to back from one memfd, so any
+   * run of up to capacity items is contiguous in memory and the batch calls
+   * copy it with a single memcpy. The mapping is rounded up to whole pages,
+   * but sends still wait once capacity items are queued. Linux only,
+   * creation fails elsewhere or for unbounded channels */
+  bool magic_ring;
+
+  /* Once the channel has stayed at most 1/8 full for this many nanoseconds,
+   * give the memory of queue pages outside the queued items back to the OS,
+   * and keep doing so every period while it stays that way. Capacity is
+   * unchanged; released pages are faulted back in as items reach them.
+   * Checked on sends and receives. Ignored for swap_buffers channels. 0
+   * disables it */
+  uint64_t release_idle_ns;
+
+  /* Split a bounded channel into this many tenant sub-queues, each holding
+   * up to capacity items. channel_send_tenant queues into one of them, and
+   * receivers serve the non-empty ones by deficit round-robin, so a tenant
+   * that fills its own sub-queue only blocks its own senders. channel_send
+   * uses tenant 0. Cannot be combined with swap_buffers, expiring_items,
+   * CoDel or magic_ring. 0 disables it */
+  size_t tenants;
+
+  /* How many items each tenant is served per round, one entry per tenant.
+   * NULL, or a 0 entry, means 1 */
+  const uint32_t *tenant_weights;
+
+  /* Hand receivers the queued item with the earliest deadline given to
+   * channel_send_deadline instead of the oldest one. Items sent any other
+   * way have no deadline and come after all that do. Items with equal
+   * deadlines come out in no particular order. Kept in a 4-ary heap, so
+   * sends and receives cost O(log n). Cannot be combined with swap_buffers,
+   * expiring_items, CoDel, magic_ring or tenants */
+  bool deadline_order;
+} channel_opts_t;
+
+/* Counters reported by channel_stats */
+typedef struct channel_stats_t {
+  /* Items dropped by receivers because their TTL ran out */
+  size_t expired;
+
+  /* Items dropped or shed by CoDel active queue management */
+  size_t dropped;
+
+  /* Bytes of idle queue memory given back to the OS by release_idle_ns */
+  size_t released;
+
+  /* Items currently queued */
+  size_t queued;
+
+  /* How long the head item has been queued, 0 if the channel is empty or
+   * does not timestamp items (only expiring_items and CoDel channels do) */
+  uint64_t head_age_ns;
+} channel_stats_t;
+
+/* Outcome of a receive that can time out */
+typedef enum {
+  /* An item was received */
+  CHANNEL_OK = 0,
+  /* The channel is closed and empty */
+  CHANNEL_CLOSED,
+  /* Nothing arrived before the timeout */
+  CHANNEL_TIMEOUT,
+} channel_status_t;
+
+/* Called by channel_watch_backlog, with the channel locked */
+typedef void (*channel_backlog_fn)(void *arg);
+
 /**
  * @brief Creates a new channel that holds capacity items of size item_size.
  * Capacity of 0 indicates an unbounded channel that grows dynamically.
@@ -18,16 +174,41 @@ typedef struct channel_t channel_t;
  */
 channel_t *channel_create(size_t item_size, size_t capacity);
 
+/**
+ * @brief Creates a new channel like channel_create with extra options.
+ *
+ * @param item_size The size of the items the channel stores.
+ * @param capacity Maximum number of items the channel can hold (0 for
+ * unbounded).
+ * @param opts Channel options, NULL for defaults.
+ * @return A pointer to the initialized channel_t, NULL on failure.
+ */
+channel_t *channel_create_opts(size_t item_size, size_t capacity,
+                               const channel_opts_t *opts);
+
 /**
  * @brief Sends a value into the channel.
  * Blocks if bounded channel is at capacity until space is available.
  *
  * @param ch The channel handle.
  * @param value A pointer to the data to send.
- * @return true on success, false otherwise (closed)
+ * @return true on success, false otherwise (closed, or shed by CoDel with
+ * codel_shed_sends)
  */
 bool channel_send(channel_t *ch, const void *value);
 
+/**
+ * @brief Sends a value into the channel if there is room right away.
+ * Never blocks: a full bounded channel (or full tenant sub-queue) fails the
+ * send instead. Does not move an adaptive channel off its lock-free ring.
+ *
+ * @param ch The channel handle.
+ * @param value A pointer to the data to send.
+ * @return true on success, false otherwise (full, closed, or shed by CoDel
+ * with codel_shed_sends)
+ */
+bool channel_try_send(channel_t *ch, const void *value);
+
 /**
  * @brief Receives a value from the channel.
  * Blocks until a value is available.
@@ -38,6 +219,143 @@ bool channel_send(channel_t *ch, const void *value);
  */
 bool channel_recv(channel_t *ch, void *value);
 
+/**
+ * @brief Receives a value from the channel, giving up after a timeout.
+ * Blocks like channel_recv for at most timeout_ns nanoseconds.
+ *
+ * @param ch The channel handle.
+ * @param value Pointer to write received data.
+ * @param timeout_ns Longest time to wait in nanoseconds.
+ * @return CHANNEL_OK on success, CHANNEL_CLOSED once the channel is closed and
+ * empty, CHANNEL_TIMEOUT if nothing arrived in time.
+ */
+channel_status_t channel_recv_timeout(channel_t *ch, void *value,
+                                      uint64_t timeout_ns);
+
+/**
+ * @brief Receives a value from the channel if one is there right away.
+ * Never blocks. Does not move an adaptive channel off its lock-free ring.
+ *
+ * @param ch The channel handle.
+ * @param value Pointer to write received data.
+ * @return true on success, false otherwise (empty or closed)
+ */
+bool channel_try_recv(channel_t *ch, void *value);
+
+/**
+ * @brief Sends an array of values into the channel.
+ * Blocks while a bounded channel is full, copying in as many items as fit
+ * each time there is room. The items stay in order but may interleave with
+ * other senders' items.
+ *
+ * @param ch The channel handle.
+ * @param items Pointer to n consecutive items.
+ * @param n The number of items to send.
+ * @return The number of items queued, less than n only if the channel closed
+ * or CoDel shed some of them with codel_shed_sends.
+ */
+size_t channel_send_batch(channel_t *ch, const void *items, size_t n);
+
+/**
+ * @brief Sends as many of n values as there is room for right away.
+ * Never blocks. Items are sent in order, so the ones not sent are the last
+ * n minus the return value.
+ *
+ * @param ch The channel handle.
+ * @param items Array of n items.
+ * @param n The number of items.
+ * @return The number of items sent, less than n if the channel filled up or
+ * is closed. Items shed by CoDel with codel_shed_sends are not counted; once
+ * CoDel sheds one it sheds the rest, so they too are the last ones.
+ */
+size_t channel_try_send_batch(channel_t *ch, const void *items, size_t n);
+
+/**
+ * @brief Receives up to max values from the channel.
+ * Blocks until at least one value is available, then takes as many as are
+ * queued, up to max.
+ *
+ * @param ch The channel handle.
+ * @param items Array with room for max items.
+ * @param max The most items to receive.
+ * @return The number of items received, 0 once the channel is closed and
+ * empty.
+ */
+size_t channel_recv_batch(channel_t *ch, void *items, size_t max);
+
+/**
+ * @brief Sends a value into one tenant's sub-queue of a fair channel.
+ * Blocks while that tenant's sub-queue is full, regardless of the others.
+ *
+ * @param ch The channel handle, created with tenants.
+ * @param value A pointer to the data to send.
+ * @param tenant The tenant index, less than opts.tenants.
+ * @return true on success, false otherwise (closed, not a fair channel, or
+ * no such tenant)
+ */
+bool channel_send_tenant(channel_t *ch, const void *value, size_t tenant);
+
+/**
+ * @brief Sends a value that expires ttl_ns nanoseconds from now.
+ * Blocks like channel_send. Receivers silently drop the item (counting it in
+ * channel_stats) if it is still queued when it expires.
+ *
+ * @param ch The channel handle, created with expiring_items.
+ * @param value A pointer to the data to send.
+ * @param ttl_ns Time to live in nanoseconds.
+ * @return true on success, false otherwise (closed, or no expiring_items)
+ */
+bool channel_send_ttl(channel_t *ch, const void *value, uint64_t ttl_ns);
+
+/**
+ * @brief Sends a value ordered by deadline into a deadline_order channel.
+ * Blocks like channel_send.
+ *
+ * @param ch The channel handle, created with deadline_order.
+ * @param value A pointer to the data to send.
+ * @param deadline_ns CLOCK_MONOTONIC time in nanoseconds the item is due by.
+ * @return true on success, false otherwise (closed, or no deadline_order)
+ */
+bool channel_send_deadline(channel_t *ch, const void *value,
+                           uint64_t deadline_ns);
+
+/**
+ * @brief Reads the earliest deadline queued in a deadline_order channel.
+ * Lets consumers check whether the next item is already late, and shed it,
+ * without receiving it first.
+ *
+ * @param ch The channel handle, created with deadline_order.
+ * @param deadline_ns Written with the earliest deadline, UINT64_MAX for an
+ * item sent without one.
+ * @return true if an item is queued, false if empty or no deadline_order.
+ */
+bool channel_peek_deadline(channel_t *ch, uint64_t *deadline_ns);
+
+/**
+ * @brief Sends a buffer into a swap_buffers channel without copying it.
+ * Blocks like channel_send. The slot takes ownership of *buf and *buf is
+ * replaced with the slot's previous, free buffer, so the caller always holds
+ * exactly one item_size buffer. Buffers handed in must come from malloc.
+ *
+ * @param ch The channel handle.
+ * @param buf In: the filled buffer to send. Out: a free buffer to reuse.
+ * @return true on success, false otherwise (closed, not a swap channel, or
+ * shed by CoDel with codel_shed_sends)
+ */
+bool channel_send_swap(channel_t *ch, void **buf);
+
+/**
+ * @brief Receives a buffer from a swap_buffers channel without copying it.
+ * Blocks like channel_recv. *buf is left in the slot for a later send and
+ * replaced with the buffer holding the received item.
+ *
+ * @param ch The channel handle.
+ * @param buf In: a buffer to give up. Out: the buffer holding the item.
+ * @return true on success, false otherwise (closed and empty, or not a swap
+ * channel)
+ */
+bool channel_recv_swap(channel_t *ch, void **buf);
+
 /**
  * @brief Closes the channel, preventing further sends.
  * Wakes all blocked threads to allow graceful shutdown.
@@ -46,6 +364,185 @@ bool channel_recv(channel_t *ch, void *value);
  */
 void channel_close(channel_t *ch);
 
+/**
+ * @brief Reads a snapshot of the channel's counters.
+ *
+ * @param ch The channel handle.
+ * @param stats Written with the current counters.
+ */
+void channel_stats(channel_t *ch, channel_stats_t *stats);
+
+/**
+ * @brief Registers a callback for when the channel's backlog builds up.
+ * fn is called whenever a send takes the number of queued items from at most
+ * threshold to above it, and once straight away if the channel is already
+ * above it. It runs with the channel locked, so it must be short and must not
+ * use the channel. A channel has at most one backlog watcher.
+ *
+ * @param ch The channel handle.
+ * @param threshold Number of queued items above which fn is called.
+ * @param fn The callback, NULL to remove the current one.
+ * @param arg Passed to fn.
+ * @return true on success, false if another callback is registered.
+ */
+bool channel_watch_backlog(channel_t *ch, size_t threshold,
+                           channel_backlog_fn fn, void *arg);
+
+/**
+ * @brief Receives from whichever of several channels has an item first.
+ * Blocks until one of the channels has an item. On Linux 5.16+ the caller
+ * sleeps on all channels at once with futex_waitv; otherwise it registers a
+ * shared waiter with each channel.
+ *
+ * @param cases The channels to receive from and where to store the item.
+ * @param n The number of cases.
+ * @return The index of the case that received an item, or -1 once every
+ * channel is closed and empty.
+ */
+int channel_select(channel_case_t *cases, size_t n);
+
+/**
+ * @brief Enables or disables the futex_waitv path of channel_select.
+ * It is on by default where supported and is turned off automatically if the
+ * running kernel lacks futex_waitv.
+ *
+ * @param enable Whether to use futex_waitv.
+ * @return true if channel_select will now use futex_waitv.
+ */
+bool channel_select_use_futex(bool enable);
+
+/**
+ * @brief Creates an empty channel group.
+ * Channels join a group once and stay in it, so receiving from many channels
+ * does not re-register with each of them on every call.
+ *
+ * @return A pointer to the group, NULL on failure.
+ */
+channel_group_t *channel_group_create(void);
+
+/**
+ * @brief Adds a channel to a group.
+ * A channel can belong to at most one group. It can still be used with
+ * channel_recv directly.
+ *
+ * @param g The group handle.
+ * @param ch The channel to add.
+ * @return The member index of ch, or -1 if the group is full or ch already
+ * belongs to a group.
+ */
+int channel_group_join(channel_group_t *g, channel_t *ch);
+
+/**
+ * @brief Receives a value from whichever member channel has one.
+ * Blocks while every member is empty. Ready members are served in rotation.
+ *
+ * @param g The group handle.
+ * @param value Pointer to write received data, large enough for the item
+ * size of any member.
+ * @param index If not NULL, written with the member index the value came
+ * from.
+ * @return true on success, false once every member is closed and empty.
+ */
+bool channel_group_recv(channel_group_t *g, void *value, int *index);
+
+/**
+ * @brief Destroys the group, detaching its members.
+ * Must not be called while a receiver is blocked on the group, and must be
+ * called before any member channel is destroyed.
+ *
+ * @param g The group handle.
+ */
+void channel_group_destroy(channel_group_t *g);
+
+#if defined(__linux__)
+/* Handle to a poller waiting on channels and file descriptors together */
+typedef struct channel_poller_t channel_poller_t;
+
+/* One ready channel or file descriptor reported by channel_poller_wait */
+typedef struct channel_poll_event_t {
+  /* The channel this event is for, NULL for a file descriptor event. An item
+   * was received into the channel's value buffer unless closed is set */
+  channel_t *ch;
+
+  /* The channel is closed and drained, reported once */
+  bool closed;
+
+  /* The file descriptor this event is for, -1 for a channel event */
+  int fd;
+
+  /* The epoll events that fired on fd */
+  uint32_t revents;
+
+  /* The tag given when the channel or fd was added */
+  void *udata;
+} channel_poll_event_t;
+
+/**
+ * @brief Creates a poller backed by a single epoll instance.
+ *
+ * @return A pointer to the poller, NULL on failure.
+ */
+channel_poller_t *channel_poller_create(void);
+
+/**
+ * @brief Adds a channel to the poller.
+ * A channel can be watched by at most one poller.
+ *
+ * @param p The poller handle.
+ * @param ch The channel to watch.
+ * @param value Buffer an item is received into when the channel is ready.
+ * @param udata Tag reported with the channel's events.
+ * @return true on success, false otherwise.
+ */
+bool channel_poller_add_channel(channel_poller_t *p, channel_t *ch,
+                                void *value, void *udata);
+
+/**
+ * @brief Adds a file descriptor to the poller.
+ *
+ * @param p The poller handle.
+ * @param fd The file descriptor to watch.
+ * @param events epoll events to wait for, e.g. EPOLLIN.
+ * @param udata Tag reported with the descriptor's events.
+ * @return true on success, false otherwise.
+ */
+bool channel_poller_add_fd(channel_poller_t *p, int fd, uint32_t events,
+                           void *udata);
+
+/**
+ * @brief Removes a file descriptor from the poller.
+ *
+ * @param p The poller handle.
+ * @param fd The file descriptor to stop watching.
+ * @return true if fd was being watched.
+ */
+bool channel_poller_remove_fd(channel_poller_t *p, int fd);
+
+/**
+ * @brief Waits until channels or file descriptors are ready.
+ * Receives one item from every ready channel and reports every ready
+ * descriptor in a single call. Only one thread may wait on a poller at a
+ * time.
+ *
+ * @param p The poller handle.
+ * @param events Array to fill with ready events.
+ * @param max Capacity of events.
+ * @param timeout_ms Longest time to wait, -1 to wait forever.
+ * @return The number of events, 0 on timeout, -1 on error.
+ */
+int channel_poller_wait(channel_poller_t *p, channel_poll_event_t *events,
+                        size_t max, int timeout_ms);
+
+/**
+ * @brief Destroys the poller, detaching its channels.
+ * Must be called before any watched channel is destroyed. File descriptors
+ * are not closed.
+ *
+ * @param p The poller handle.
+ */
+void channel_poller_destroy(channel_poller_t *p);
+#endif
+
 /**
  * @brief Destroys the channel and frees all resources.
  *
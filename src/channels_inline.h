@@ -0,0 +1,162 @@
+#ifndef CHANNELS_INLINE_H_
+#define CHANNELS_INLINE_H_
+
+/* Optional inline fast paths. Including this header instead of channels.h
+ * lets uncontended operations on an adaptive channel run on its lock-free
+ * ring without a call into the library. Anything the ring cannot handle
+ * falls through to the out-of-line functions. The header publishes the
+ * start of channel_t's layout, so code using it has to be rebuilt along with
+ * the library */
+
+#include "channels.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Lock-free ring state of an adaptive channel in SPSC mode. head and tail
+ * count the items ever sent and received, an item's slot is its count modulo
+ * capacity. Each side sets its busy flag while it touches the ring so an
+ * upgrade can wait for it to get out */
+typedef struct channel_spsc_t {
+  /* Written by the producer */
+  _Alignas(64) _Atomic size_t head;
+  _Atomic uintptr_t producer;
+  atomic_bool send_busy;
+  atomic_bool send_parked;
+
+  /* Written by the consumer */
+  _Alignas(64) _Atomic size_t tail;
+  _Atomic uintptr_t consumer;
+  atomic_bool recv_busy;
+  atomic_bool recv_parked;
+} channel_spsc_t;
+
+/* The start of every channel_t, all the fast paths read. channels.c checks
+ * that the two agree */
+typedef struct channel_fast_t {
+  channel_spsc_t spsc;
+
+  /* CHANNEL_FAST_SPSC while the channel runs on spsc. Once it moves to the
+   * locked algorithm it never comes back */
+  atomic_int mode;
+
+  /* Fixed while the channel runs on spsc, whose slots hold just the item */
+  size_t item_size;
+  size_t capacity;
+  void *queue;
+} channel_fast_t;
+
+/* Value of mode while the lock-free ring is in use */
+#define CHANNEL_FAST_SPSC 1
+
+/* Its address identifies the calling thread as a ring's producer or
+ * consumer */
+extern _Thread_local char channel_thread_tag;
+
+/**
+ * @brief Wakes the receiver parked on an adaptive channel's ring. Called by
+ * the inline send path, not meant to be used directly.
+ *
+ * @param ch The channel handle.
+ */
+void channel_spsc_wake_recv(channel_t *ch);
+
+/**
+ * @brief Wakes the sender parked on an adaptive channel's ring. Called by
+ * the inline receive path, not meant to be used directly.
+ *
+ * @param ch The channel handle.
+ */
+void channel_spsc_wake_send(channel_t *ch);
+
+/* Mark a side of the ring busy, false if the channel has left SPSC mode */
+static inline bool channel_fast_enter(channel_fast_t *f, atomic_bool *busy) {
+  atomic_store(busy, true);
+  if (atomic_load(&f->mode) == CHANNEL_FAST_SPSC) {
+    return true;
+  }
+  atomic_store_explicit(busy, false, memory_order_release);
+  return false;
+}
+
+/* Send on the ring if the calling thread already owns its producer side and
+ * there is room, false to leave the send to the library */
+static inline bool channel_fast_send(channel_t *ch, const void *value) {
+  channel_fast_t *f = (channel_fast_t *)ch;
+  channel_spsc_t *sp = &f->spsc;
+  if (atomic_load_explicit(&f->mode, memory_order_relaxed) !=
+          CHANNEL_FAST_SPSC ||
+      atomic_load_explicit(&sp->producer, memory_order_relaxed) !=
+          (uintptr_t)&channel_thread_tag ||
+      !channel_fast_enter(f, &sp->send_busy)) {
+    return false;
+  }
+
+  size_t head = atomic_load_explicit(&sp->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&sp->tail, memory_order_acquire);
+  if (head - tail >= f->capacity) {
+    atomic_store_explicit(&sp->send_busy, false, memory_order_release);
+    return false;
+  }
+  memcpy((char *)f->queue + head % f->capacity * f->item_size, value,
+         f->item_size);
+  atomic_store(&sp->head, head + 1);
+  atomic_store_explicit(&sp->send_busy, false, memory_order_release);
+  if (atomic_load(&sp->recv_parked) &&
+      atomic_exchange(&sp->recv_parked, false)) {
+    channel_spsc_wake_recv(ch);
+  }
+  return true;
+}
+
+/* Receive from the ring if the calling thread already owns its consumer side
+ * and there is an item, false to leave the receive to the library */
+static inline bool channel_fast_recv(channel_t *ch, void *value) {
+  channel_fast_t *f = (channel_fast_t *)ch;
+  channel_spsc_t *sp = &f->spsc;
+  if (atomic_load_explicit(&f->mode, memory_order_relaxed) !=
+          CHANNEL_FAST_SPSC ||
+      atomic_load_explicit(&sp->consumer, memory_order_relaxed) !=
+          (uintptr_t)&channel_thread_tag ||
+      !channel_fast_enter(f, &sp->recv_busy)) {
+    return false;
+  }
+
+  size_t tail = atomic_load_explicit(&sp->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&sp->head, memory_order_acquire);
+  if (head == tail) {
+    atomic_store_explicit(&sp->recv_busy, false, memory_order_release);
+    return false;
+  }
+  memcpy(value, (char *)f->queue + tail % f->capacity * f->item_size,
+         f->item_size);
+  atomic_store(&sp->tail, tail + 1);
+  atomic_store_explicit(&sp->recv_busy, false, memory_order_release);
+  if (atomic_load(&sp->send_parked) &&
+      atomic_exchange(&sp->send_parked, false)) {
+    channel_spsc_wake_send(ch);
+  }
+  return true;
+}
+
+/* channel_send with the uncontended case inline */
+static inline bool channel_send_inline(channel_t *ch, const void *value) {
+  return channel_fast_send(ch, value) || channel_send(ch, value);
+}
+
+/* channel_try_send with the uncontended case inline */
+static inline bool channel_try_send_inline(channel_t *ch, const void *value) {
+  return channel_fast_send(ch, value) || channel_try_send(ch, value);
+}
+
+/* channel_recv with the uncontended case inline */
+static inline bool channel_recv_inline(channel_t *ch, void *value) {
+  return channel_fast_recv(ch, value) || channel_recv(ch, value);
+}
+
+/* channel_try_recv with the uncontended case inline */
+static inline bool channel_try_recv_inline(channel_t *ch, void *value) {
+  return channel_fast_recv(ch, value) || channel_try_recv(ch, value);
+}
+
+#endif // CHANNELS_INLINE_H_
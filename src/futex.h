@@ -0,0 +1,53 @@
+#ifndef FUTEX_H_
+#define FUTEX_H_
+
+/* Thin wrappers over the Linux futex system calls, for use inside the
+ * library only. HAVE_FUTEX and HAVE_FUTEX_WAITV say what is available */
+
+#if defined(__linux__)
+
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HAVE_FUTEX 1
+
+/* Sleep while *addr == expected, or until timeout if not NULL */
+static inline long futex_wait(_Atomic uint32_t *addr, uint32_t expected,
+                              const struct timespec *timeout) {
+  return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, timeout, NULL,
+                 0);
+}
+
+/* Wake up to n threads sleeping on addr */
+static inline long futex_wake(_Atomic uint32_t *addr, int n) {
+  return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* futex_wait for a word in memory shared between processes */
+static inline long futex_wait_shared(_Atomic uint32_t *addr, uint32_t expected,
+                                     const struct timespec *timeout) {
+  return syscall(SYS_futex, addr, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+/* futex_wake for a word in memory shared between processes */
+static inline long futex_wake_shared(_Atomic uint32_t *addr, int n) {
+  return syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+#if defined(SYS_futex_waitv) && defined(FUTEX_WAITV_MAX)
+#define HAVE_FUTEX_WAITV 1
+
+/* Sleep until any of the n futexes changes from its expected value (Linux
+ * 5.16+, fails with ENOSYS on older kernels) */
+static inline long futex_waitv(struct futex_waitv *waiters, unsigned int n) {
+  return syscall(SYS_futex_waitv, waiters, n, 0, NULL, CLOCK_MONOTONIC);
+}
+#endif
+
+#endif // __linux__
+
+#endif // FUTEX_H_
@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+
+#include "ingest.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INGEST_DEFAULT_CHUNK (1 << 20)
+
+/* Records a worker first makes room for, per byte of chunk */
+#define INGEST_RECORD_ESTIMATE 64
+
+struct channel_ingest_t {
+  channel_t *out;
+
+  /* Settings with the defaults filled in */
+  channel_ingest_opts_t opts;
+
+  /* The mapped file, NULL if it is empty */
+  const char *map;
+  size_t size;
+
+  /* Chunks handed out so far, of nchunks */
+  size_t nchunks;
+  _Atomic size_t next_chunk;
+
+  _Atomic size_t records;
+
+  /* Ordered mode: the chunk whose records go next. turn_cond wakes the
+   * workers waiting for their chunk's turn */
+  pthread_mutex_t mu;
+  pthread_cond_t turn_cond;
+  size_t turn;
+
+  pthread_t *threads;
+  size_t nthreads;
+  bool joined;
+
+  /* Workers still running, the last one out closes the channel. Starts one
+   * above nthreads until every worker has been started */
+  _Atomic size_t running;
+
+  uint64_t start_ns;
+  uint64_t end_ns;
+};
+
+/* A worker's records of the chunk it is cutting up */
+typedef struct ingest_worker_t {
+  channel_ingest_t *in;
+  channel_ingest_record_t *records;
+  size_t n;
+  size_t cap;
+
+  /* Ordered mode: whether this worker holds the turn for its chunk */
+  bool has_turn;
+} ingest_worker_t;
+
+/* Current CLOCK_MONOTONIC time in nanoseconds */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Send the records collected so far. In ordered mode this first waits for
+ * the chunk's turn, and passes the turn on after the chunk's last records */
+static void publish(ingest_worker_t *w, size_t chunk, bool last) {
+  channel_ingest_t *in = w->in;
+  if (in->opts.ordered && !w->has_turn) {
+    pthread_mutex_lock(&in->mu);
+    while (in->turn != chunk) {
+      pthread_cond_wait(&in->turn_cond, &in->mu);
+    }
+    pthread_mutex_unlock(&in->mu);
+    w->has_turn = true;
+  }
+
+  if (w->n) {
+    size_t sent = channel_send_batch(in->out, w->records, w->n);
+    atomic_fetch_add_explicit(&in->records, sent, memory_order_relaxed);
+    w->n = 0;
+  }
+
+  if (last && w->has_turn) {
+    pthread_mutex_lock(&in->mu);
+    in->turn++;
+    pthread_cond_broadcast(&in->turn_cond);
+    pthread_mutex_unlock(&in->mu);
+    w->has_turn = false;
+  }
+}
+
+/* Add a record, publishing early if the array cannot grow */
+static void add_record(ingest_worker_t *w, size_t chunk, size_t offset,
+                       size_t len) {
+  if (w->n == w->cap) {
+    size_t cap = w->cap ? w->cap * 2 : 64;
+    channel_ingest_record_t *records =
+        realloc(w->records, cap * sizeof(channel_ingest_record_t));
+    if (records) {
+      w->records = records;
+      w->cap = cap;
+    } else {
+      publish(w, chunk, false);
+    }
+  }
+  if (w->n < w->cap) {
+    w->records[w->n++] = (channel_ingest_record_t){
+        .data = w->in->map + offset, .len = len, .offset = offset};
+  }
+}
+
+/* Cut one chunk into records. A record belongs to the chunk it starts in,
+ * so the chunk's first one starts after the first delimiter before or at its
+ * start, and its last one may run past its end */
+static void split_chunk(ingest_worker_t *w, size_t chunk) {
+  channel_ingest_t *in = w->in;
+  const char *map = in->map;
+  char delim = in->opts.delimiter;
+  size_t begin = chunk * in->opts.chunk_size;
+  size_t end = begin + in->opts.chunk_size;
+  if (end > in->size) {
+    end = in->size;
+  }
+
+  size_t pos = begin;
+  if (begin > 0) {
+    const char *p = memchr(map + begin - 1, delim, in->size - begin + 1);
+    pos = p ? (size_t)(p - map) + 1 : in->size;
+  }
+  while (pos < end) {
+    const char *p = memchr(map + pos, delim, in->size - pos);
+    size_t rec_end = p ? (size_t)(p - map) : in->size;
+    add_record(w, chunk, pos, rec_end - pos);
+    pos = rec_end + 1;
+  }
+  publish(w, chunk, true);
+}
+
+/* Drop a reference to the running count, closing the channel with the last
+ * one */
+static void worker_exit(channel_ingest_t *in) {
+  if (atomic_fetch_sub(&in->running, 1) == 1) {
+    in->end_ns = now_ns();
+    if (!in->opts.keep_open) {
+      channel_close(in->out);
+    }
+  }
+}
+
+/* Claim chunks until none are left */
+static void *ingest_worker(void *arg) {
+  ingest_worker_t w = {.in = arg};
+  channel_ingest_t *in = w.in;
+  size_t estimate = in->opts.chunk_size / INGEST_RECORD_ESTIMATE;
+  w.records = malloc(estimate * sizeof(channel_ingest_record_t));
+  w.cap = w.records ? estimate : 0;
+
+  size_t chunk;
+  while ((chunk = atomic_fetch_add(&in->next_chunk, 1)) < in->nchunks) {
+    split_chunk(&w, chunk);
+  }
+  free(w.records);
+  worker_exit(in);
+  return NULL;
+}
+
+/* Map the file, then start the workers */
+channel_ingest_t *channel_ingest_start(const char *path, channel_t *out,
+                                       const channel_ingest_opts_t *opts) {
+  channel_ingest_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+
+  channel_ingest_t *in = calloc(1, sizeof(channel_ingest_t));
+  if (!in) {
+    return NULL;
+  }
+  in->out = out;
+  in->opts = *opts;
+  if (in->opts.threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    in->opts.threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (in->opts.chunk_size == 0) {
+    in->opts.chunk_size = INGEST_DEFAULT_CHUNK;
+  }
+  if (in->opts.delimiter == 0) {
+    in->opts.delimiter = '\n';
+  }
+  in->start_ns = now_ns();
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    free(in);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    free(in);
+    return NULL;
+  }
+  in->size = (size_t)st.st_size;
+  if (in->size) {
+    void *map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      free(in);
+      return NULL;
+    }
+    madvise(map, in->size, MADV_SEQUENTIAL);
+    in->map = map;
+  }
+  close(fd);
+  in->nchunks = (in->size + in->opts.chunk_size - 1) / in->opts.chunk_size;
+  atomic_init(&in->next_chunk, 0);
+  atomic_init(&in->records, 0);
+  atomic_init(&in->running, 1);
+
+  in->threads = calloc(in->opts.threads, sizeof(pthread_t));
+  if (!in->threads) {
+    goto fail;
+  }
+  pthread_mutex_init(&in->mu, NULL);
+  pthread_cond_init(&in->turn_cond, NULL);
+  for (size_t i = 0; i < in->opts.threads; i++) {
+    atomic_fetch_add(&in->running, 1);
+    if (pthread_create(&in->threads[i], NULL, ingest_worker, in) != 0) {
+      atomic_fetch_sub(&in->running, 1);
+      break;
+    }
+    in->nthreads++;
+  }
+  if (in->nthreads == 0) {
+    pthread_cond_destroy(&in->turn_cond);
+    pthread_mutex_destroy(&in->mu);
+    goto fail;
+  }
+  worker_exit(in);
+  return in;
+
+fail:
+  if (in->map) {
+    munmap((void *)in->map, in->size);
+  }
+  free(in->threads);
+  free(in);
+  return NULL;
+}
+
+/* Join the workers once */
+void channel_ingest_wait(channel_ingest_t *in, channel_ingest_stats_t *stats) {
+  if (!in->joined) {
+    for (size_t i = 0; i < in->nthreads; i++) {
+      pthread_join(in->threads[i], NULL);
+    }
+    in->joined = true;
+  }
+
+  if (stats) {
+    double secs = (double)(in->end_ns - in->start_ns) / 1e9;
+    *stats = (channel_ingest_stats_t){
+        .records = atomic_load(&in->records),
+        .bytes = in->size,
+        .chunks = in->nchunks,
+        .threads = in->nthreads,
+        .bytes_per_sec = secs > 0 ? (double)in->size / secs : 0,
+    };
+  }
+}
+
+/* Wait, then release the mapping the records point into */
+void channel_ingest_destroy(channel_ingest_t *in) {
+  channel_ingest_wait(in, NULL);
+  if (in->map) {
+    munmap((void *)in->map, in->size);
+  }
+  pthread_cond_destroy(&in->turn_cond);
+  pthread_mutex_destroy(&in->mu);
+  free(in->threads);
+  free(in);
+}
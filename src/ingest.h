@@ -0,0 +1,90 @@
+#ifndef INGEST_H_
+#define INGEST_H_
+
+/* Parallel file ingest. The file is mapped once and split into chunks that
+ * worker threads cut into delimited records in parallel, publishing each
+ * chunk's records to a channel with one batch send, in file order or as
+ * chunks finish */
+
+#include "channels.h"
+
+/* Handle to an ingest job */
+typedef struct channel_ingest_t channel_ingest_t;
+
+/* One record, the item type of the output channel. Points into the mapped
+ * file, so it stays valid until channel_ingest_destroy */
+typedef struct channel_ingest_record_t {
+  /* The record's bytes, without the delimiter */
+  const char *data;
+  size_t len;
+
+  /* Byte offset of the record in the file, increasing in file order */
+  uint64_t offset;
+} channel_ingest_record_t;
+
+/* Optional ingest settings, a zero-initialized struct gives the defaults */
+typedef struct channel_ingest_opts_t {
+  /* Worker threads, 0 for one per online CPU */
+  size_t threads;
+
+  /* Bytes of the file per chunk, 0 for the default of 1MB. A record belongs
+   * to the chunk it starts in */
+  size_t chunk_size;
+
+  /* Byte ending each record, 0 for '\n'. A final record without one is
+   * still delivered */
+  char delimiter;
+
+  /* Publish chunks in file order, so records arrive in file order. Workers
+   * that finish a chunk early wait for its turn */
+  bool ordered;
+
+  /* Leave the channel open once every record is published instead of
+   * closing it, e.g. to ingest several files into one channel */
+  bool keep_open;
+} channel_ingest_opts_t;
+
+/* Counters reported by channel_ingest_wait */
+typedef struct channel_ingest_stats_t {
+  /* Records published, and the file's size */
+  size_t records;
+  uint64_t bytes;
+
+  size_t chunks;
+  size_t threads;
+
+  /* File bytes per second from start until the last record was published */
+  double bytes_per_sec;
+} channel_ingest_stats_t;
+
+/**
+ * @brief Maps a file and starts the workers that publish its records.
+ * The last worker to finish closes the channel unless keep_open is set, so
+ * consumers can simply receive until the channel is closed.
+ *
+ * @param path The file to read.
+ * @param out The channel to publish to, whose item size must be
+ * sizeof(channel_ingest_record_t).
+ * @param opts Ingest settings, NULL for defaults.
+ * @return A pointer to the ingest job, NULL on failure.
+ */
+channel_ingest_t *channel_ingest_start(const char *path, channel_t *out,
+                                       const channel_ingest_opts_t *opts);
+
+/**
+ * @brief Waits until every record is published. The records stay valid.
+ *
+ * @param in The ingest handle.
+ * @param stats Written with the final counters if not NULL.
+ */
+void channel_ingest_wait(channel_ingest_t *in, channel_ingest_stats_t *stats);
+
+/**
+ * @brief Waits for the workers if needed, then unmaps the file and frees the
+ * job. Records received from it must no longer be used.
+ *
+ * @param in The ingest handle.
+ */
+void channel_ingest_destroy(channel_ingest_t *in);
+
+#endif // INGEST_H_
@@ -0,0 +1,521 @@
+#define _GNU_SOURCE
+
+#include "percpu.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if defined(SYS_membarrier)
+#include <linux/membarrier.h>
+#define HAVE_MEMBARRIER 1
+#endif
+#endif
+
+/* Restartable sequences registered by glibc 2.35+, with the critical
+ * section written for x86-64 */
+#if defined(__linux__) && defined(__x86_64__) && defined(__GLIBC__) &&       \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#include <sys/rseq.h>
+#define HAVE_RSEQ 1
+#endif
+
+#define CACHE_LINE 64
+
+/* Empty polls of the rings before a receiver goes to sleep */
+#define PERCPU_SPIN 64
+
+#define PERCPU_STR_(x) #x
+#define PERCPU_STR(x) PERCPU_STR_(x)
+
+/* A ring of items [head, tail), each index masked by the channel's mask */
+typedef struct percpu_ring_t {
+  /* Advanced by the ring's producers, in a restartable sequence on the
+   * ring's CPU or under send_lock */
+  _Alignas(CACHE_LINE) _Atomic size_t tail;
+  atomic_flag send_lock;
+
+  /* Advanced by the receiver holding recv_lock */
+  _Alignas(CACHE_LINE) _Atomic size_t head;
+  atomic_flag recv_lock;
+
+  char *slots;
+} percpu_ring_t;
+
+struct channel_percpu_t {
+  size_t item_size;
+  size_t capacity;
+  size_t mask;
+
+  /* One ring per configured CPU, then a spare one under its send lock for
+   * threads whose CPU number is out of range */
+  percpu_ring_t *rings;
+  size_t ncpus;
+
+  /* Sends use restartable sequences rather than the send locks */
+  bool rseq;
+
+  /* Receivers issue a membarrier before their last look at the rings, so a
+   * send needs only a compiler barrier before checking recv_sleepers */
+  bool membarrier;
+
+  _Atomic bool closed;
+  _Atomic size_t recv_sleepers;
+  _Atomic size_t send_sleepers;
+
+  /* Protects sleeping. recv_cond wakes receivers when items arrive, and
+   * send_cond wakes senders when a ring has room */
+  _Alignas(CACHE_LINE) pthread_mutex_t mu;
+  pthread_cond_t recv_cond;
+  pthread_cond_t send_cond;
+};
+
+/* Where each receiving thread starts its round of the rings */
+static _Thread_local size_t recv_start;
+
+/* Hint to the CPU that this is a spin loop */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/* The slot of index i */
+static inline char *ring_slot(channel_percpu_t *c, percpu_ring_t *r,
+                              size_t i) {
+  return r->slots + (i & c->mask) * c->item_size;
+}
+
+/* Append an item under the ring's send lock */
+static bool push_locked(channel_percpu_t *c, percpu_ring_t *r,
+                        const void *value) {
+  for (size_t spins = 0;
+       atomic_flag_test_and_set_explicit(&r->send_lock, memory_order_acquire);
+       spins++) {
+    /* The holder may have been preempted, give it the CPU */
+    if (spins & 63) {
+      cpu_relax();
+    } else {
+      sched_yield();
+    }
+  }
+  size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  bool room = tail - head < c->capacity;
+  if (room) {
+    memcpy(ring_slot(c, r, tail), value, c->item_size);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  }
+  atomic_flag_clear_explicit(&r->send_lock, memory_order_release);
+  return room;
+}
+
+/* The calling thread's CPU number, for the fallback */
+static size_t current_cpu(void) {
+#if defined(__linux__)
+  int cpu = sched_getcpu();
+  return cpu >= 0 ? (size_t)cpu : 0;
+#else
+  return 0;
+#endif
+}
+
+#if defined(HAVE_RSEQ)
+/* The calling thread's rseq area, registered by the C library */
+static inline struct rseq *rseq_area(void) {
+  return (struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset);
+}
+
+/* Copy len bytes from src to dst, then store tail + 1 to *tailp, as one
+ * restartable sequence. Fails having stored nothing if the thread is not on
+ * cpu or *tailp is no longer tail, and the kernel sends it to the abort
+ * handler if the thread is preempted, migrated or signalled before the
+ * final store. The item's stores come first, so on x86 a receiver that sees
+ * the new tail sees the item */
+static inline bool rseq_push(struct rseq *rs, uint32_t cpu, size_t *tailp,
+                             size_t tail, void *dst, const void *src,
+                             size_t len) {
+  __asm__ goto(
+      /* Descriptor: start, length up to the commit, abort handler */
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0, 0\n\t"
+      ".quad 1f, 2f - 1f, 4f\n\t"
+      ".popsection\n\t"
+      "leaq 3b(%%rip), %%rax\n\t"
+      "movq %%rax, %[rseq_cs]\n\t"
+      "1:\n\t"
+      "cmpl %[cpu], %[cpu_id]\n\t"
+      "jnz %l[fail]\n\t"
+      "cmpq %[tail], %[tailp]\n\t"
+      "jnz %l[fail]\n\t"
+      "movq %[src], %%rsi\n\t"
+      "movq %[dst], %%rdi\n\t"
+      "movq %[len], %%rcx\n\t"
+      "5:\n\t"
+      "cmpq $8, %%rcx\n\t"
+      "jb 6f\n\t"
+      "movq (%%rsi), %%rax\n\t"
+      "movq %%rax, (%%rdi)\n\t"
+      "addq $8, %%rsi\n\t"
+      "addq $8, %%rdi\n\t"
+      "subq $8, %%rcx\n\t"
+      "jmp 5b\n\t"
+      "6:\n\t"
+      "testq %%rcx, %%rcx\n\t"
+      "jz 7f\n\t"
+      "movb (%%rsi), %%al\n\t"
+      "movb %%al, (%%rdi)\n\t"
+      "incq %%rsi\n\t"
+      "incq %%rdi\n\t"
+      "decq %%rcx\n\t"
+      "jmp 6b\n\t"
+      "7:\n\t"
+      "leaq 1(%[tail]), %%rax\n\t"
+      /* Commit */
+      "movq %%rax, %[tailp]\n\t"
+      "2:\n\t"
+      /* Abort handler, preceded by the signature the kernel checks */
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".byte 0x0f, 0xb9, 0x3d\n\t"
+      ".long " PERCPU_STR(RSEQ_SIG) "\n\t"
+      "4:\n\t"
+      "jmp %l[fail]\n\t"
+      ".popsection\n\t"
+      :
+      : [rseq_cs] "m"(rs->rseq_cs), [cpu_id] "m"(rs->cpu_id), [cpu] "r"(cpu),
+        [tailp] "m"(*tailp), [tail] "r"(tail), [src] "r"(src),
+        [dst] "r"(dst), [len] "r"(len)
+      : "rax", "rcx", "rsi", "rdi", "memory", "cc"
+      : fail);
+  return true;
+fail:
+  return false;
+}
+#endif
+
+/* Append an item to the current CPU's ring, false if it is full */
+static bool try_push(channel_percpu_t *c, const void *value) {
+#if defined(HAVE_RSEQ)
+  if (c->rseq) {
+    struct rseq *rs = rseq_area();
+    for (;;) {
+      uint32_t cpu = *(volatile uint32_t *)&rs->cpu_id;
+      if (cpu >= c->ncpus) {
+        break;
+      }
+      percpu_ring_t *r = &c->rings[cpu];
+      /* Head first, so the stale head can only make the ring look fuller */
+      size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+      size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+      if (tail - head >= c->capacity) {
+        return false;
+      }
+      if (rseq_push(rs, cpu, (size_t *)&r->tail, tail, ring_slot(c, r, tail),
+                    value, c->item_size)) {
+        return true;
+      }
+    }
+    return push_locked(c, &c->rings[c->ncpus], value);
+  }
+#endif
+  size_t cpu = current_cpu();
+  return push_locked(c, &c->rings[cpu < c->ncpus ? cpu : c->ncpus], value);
+}
+
+/* Full barrier of a receiver about to sleep, pairing with wake_receiver */
+static void receiver_fence(channel_percpu_t *c) {
+#if defined(HAVE_MEMBARRIER)
+  if (c->membarrier &&
+      syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0) {
+    return;
+  }
+#endif
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+/* Wake a receiver after a send if any are asleep */
+static void wake_receiver(channel_percpu_t *c) {
+  if (c->membarrier) {
+    atomic_signal_fence(memory_order_seq_cst);
+  } else {
+    atomic_thread_fence(memory_order_seq_cst);
+  }
+  if (atomic_load_explicit(&c->recv_sleepers, memory_order_relaxed)) {
+    pthread_mutex_lock(&c->mu);
+    pthread_cond_signal(&c->recv_cond);
+    pthread_mutex_unlock(&c->mu);
+  }
+}
+
+/* Wake a sender waiting for room for each of the n items just received. A
+ * woken sender whose ring is still full waits again, and its ring being full
+ * means receivers have more items to take and will wake it later */
+static void wake_senders(channel_percpu_t *c, size_t n) {
+  atomic_thread_fence(memory_order_seq_cst);
+  size_t sleepers = atomic_load_explicit(&c->send_sleepers,
+                                         memory_order_relaxed);
+  if (sleepers) {
+    pthread_mutex_lock(&c->mu);
+    if (n >= sleepers) {
+      pthread_cond_broadcast(&c->send_cond);
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        pthread_cond_signal(&c->send_cond);
+      }
+    }
+    pthread_mutex_unlock(&c->mu);
+  }
+}
+
+/* Take up to max items from a ring, skipping it and setting busy if another
+ * receiver has it */
+static size_t ring_pop(channel_percpu_t *c, percpu_ring_t *r, char *items,
+                       size_t max, bool *busy) {
+  if (atomic_load_explicit(&r->tail, memory_order_relaxed) ==
+      atomic_load_explicit(&r->head, memory_order_relaxed)) {
+    return 0;
+  }
+  if (atomic_flag_test_and_set_explicit(&r->recv_lock,
+                                        memory_order_acquire)) {
+    *busy = true;
+    return 0;
+  }
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  size_t n = tail - head < max ? tail - head : max;
+
+  /* At most two runs, split where the ring wraps */
+  size_t first = c->capacity - (head & c->mask);
+  if (first > n) {
+    first = n;
+  }
+  memcpy(items, ring_slot(c, r, head), first * c->item_size);
+  memcpy(items + first * c->item_size, r->slots,
+         (n - first) * c->item_size);
+  atomic_store_explicit(&r->head, head + n, memory_order_release);
+  atomic_flag_clear_explicit(&r->recv_lock, memory_order_release);
+  return n;
+}
+
+/* One round of the rings, taking up to max items. busy is set if a ring was
+ * skipped because another receiver held it, as it may still hold items */
+static size_t drain(channel_percpu_t *c, char *items, size_t max,
+                    bool *busy) {
+  size_t nrings = c->ncpus + 1;
+  size_t start = recv_start % nrings;
+  size_t n = 0;
+  *busy = false;
+  for (size_t i = 0; i < nrings && n < max; i++) {
+    size_t k = ring_pop(c, &c->rings[(start + i) % nrings],
+                        items + n * c->item_size, max - n, busy);
+    if (k) {
+      n += k;
+      /* Start from the next ring next time, so no ring is favoured */
+      recv_start = start + i + 1;
+    }
+  }
+  return n;
+}
+
+/* Whether every ring is empty */
+static bool rings_empty(channel_percpu_t *c) {
+  for (size_t i = 0; i <= c->ncpus; i++) {
+    percpu_ring_t *r = &c->rings[i];
+    if (atomic_load_explicit(&r->tail, memory_order_acquire) !=
+        atomic_load_explicit(&r->head, memory_order_acquire)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Allocate a ring per CPU and a spare, and pick the send path */
+channel_percpu_t *channel_percpu_create(size_t item_size, size_t capacity) {
+  if (item_size == 0 || capacity == 0) {
+    return NULL;
+  }
+  channel_percpu_t *c = calloc(1, sizeof(channel_percpu_t));
+  if (!c) {
+    return NULL;
+  }
+  c->item_size = item_size;
+  c->capacity = 1;
+  while (c->capacity < capacity) {
+    c->capacity <<= 1;
+  }
+  c->mask = c->capacity - 1;
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  c->ncpus = cpus > 0 ? (size_t)cpus : 1;
+
+  size_t nrings = c->ncpus + 1;
+  c->rings = aligned_alloc(CACHE_LINE, nrings * sizeof(percpu_ring_t));
+  if (!c->rings) {
+    free(c);
+    return NULL;
+  }
+  memset(c->rings, 0, nrings * sizeof(percpu_ring_t));
+  for (size_t i = 0; i < nrings; i++) {
+    percpu_ring_t *r = &c->rings[i];
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->head, 0);
+    atomic_flag_clear(&r->send_lock);
+    atomic_flag_clear(&r->recv_lock);
+    r->slots = malloc(c->capacity * item_size);
+    if (!r->slots) {
+      goto fail;
+    }
+  }
+
+#if defined(HAVE_RSEQ)
+  c->rseq = __rseq_size > 0;
+#endif
+#if defined(HAVE_MEMBARRIER)
+  c->membarrier = syscall(SYS_membarrier,
+                          MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0,
+                          0) == 0;
+#endif
+  atomic_init(&c->closed, false);
+  atomic_init(&c->recv_sleepers, 0);
+  atomic_init(&c->send_sleepers, 0);
+  pthread_mutex_init(&c->mu, NULL);
+  pthread_cond_init(&c->recv_cond, NULL);
+  pthread_cond_init(&c->send_cond, NULL);
+  return c;
+
+fail:
+  for (size_t i = 0; i < nrings; i++) {
+    free(c->rings[i].slots);
+  }
+  free(c->rings);
+  free(c);
+  return NULL;
+}
+
+/* Push, or wait under the lock for room on whichever CPU the thread is on */
+bool channel_percpu_send(channel_percpu_t *c, const void *value) {
+  if (atomic_load_explicit(&c->closed, memory_order_relaxed)) {
+    return false;
+  }
+  bool sent = try_push(c, value);
+  if (!sent) {
+    pthread_mutex_lock(&c->mu);
+    atomic_fetch_add(&c->send_sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (!(sent = try_push(c, value)) && !atomic_load(&c->closed)) {
+      pthread_cond_wait(&c->send_cond, &c->mu);
+    }
+    atomic_fetch_sub(&c->send_sleepers, 1);
+    pthread_mutex_unlock(&c->mu);
+    if (!sent) {
+      return false;
+    }
+  }
+  wake_receiver(c);
+  return true;
+}
+
+/* Push once, without waiting */
+bool channel_percpu_try_send(channel_percpu_t *c, const void *value) {
+  if (atomic_load_explicit(&c->closed, memory_order_relaxed) ||
+      !try_push(c, value)) {
+    return false;
+  }
+  wake_receiver(c);
+  return true;
+}
+
+/* Receive a batch of one */
+bool channel_percpu_recv(channel_percpu_t *c, void *value) {
+  return channel_percpu_recv_batch(c, value, 1) == 1;
+}
+
+/* Poll the rings for a while, then sleep until a send or close */
+size_t channel_percpu_recv_batch(channel_percpu_t *c, void *items,
+                                 size_t max) {
+  if (max == 0) {
+    return 0;
+  }
+  size_t n = 0;
+  bool busy;
+  for (size_t spin = 0; spin < PERCPU_SPIN && n == 0; spin++) {
+    n = drain(c, items, max, &busy);
+    if (n == 0) {
+      /* Closed is read first, so items sent before the close are seen */
+      if (atomic_load(&c->closed) && rings_empty(c)) {
+        return 0;
+      }
+      cpu_relax();
+    }
+  }
+
+  if (n == 0) {
+    pthread_mutex_lock(&c->mu);
+    atomic_fetch_add(&c->recv_sleepers, 1);
+    for (;;) {
+      receiver_fence(c);
+      n = drain(c, items, max, &busy);
+      if (n || (atomic_load(&c->closed) && rings_empty(c))) {
+        break;
+      }
+      if (busy) {
+        /* The holder may leave items behind or be taking the last of them
+         * after the close was broadcast, so look again rather than sleep */
+        pthread_mutex_unlock(&c->mu);
+        sched_yield();
+        pthread_mutex_lock(&c->mu);
+        continue;
+      }
+      pthread_cond_wait(&c->recv_cond, &c->mu);
+    }
+    atomic_fetch_sub(&c->recv_sleepers, 1);
+    pthread_mutex_unlock(&c->mu);
+  }
+  if (n) {
+    wake_senders(c, n);
+  }
+  return n;
+}
+
+/* One round of the rings */
+size_t channel_percpu_try_recv_batch(channel_percpu_t *c, void *items,
+                                     size_t max) {
+  bool busy;
+  size_t n = drain(c, items, max, &busy);
+  if (n) {
+    wake_senders(c, n);
+  }
+  return n;
+}
+
+/* Fail further sends and wake every sleeper */
+void channel_percpu_close(channel_percpu_t *c) {
+  atomic_store(&c->closed, true);
+  pthread_mutex_lock(&c->mu);
+  pthread_cond_broadcast(&c->recv_cond);
+  pthread_cond_broadcast(&c->send_cond);
+  pthread_mutex_unlock(&c->mu);
+}
+
+/* Whether sends take the restartable sequence path */
+bool channel_percpu_uses_rseq(channel_percpu_t *c) { return c->rseq; }
+
+/* Free the rings and the channel */
+void channel_percpu_destroy(channel_percpu_t *c) {
+  for (size_t i = 0; i <= c->ncpus; i++) {
+    free(c->rings[i].slots);
+  }
+  free(c->rings);
+  pthread_cond_destroy(&c->recv_cond);
+  pthread_cond_destroy(&c->send_cond);
+  pthread_mutex_destroy(&c->mu);
+  free(c);
+}
@@ -0,0 +1,103 @@
+#ifndef PERCPU_H_
+#define PERCPU_H_
+
+/* Per-CPU sharded channel. Each CPU has its own ring, and a send appends to
+ * the ring of the CPU it runs on inside a restartable sequence, with no lock
+ * or atomic instruction, so memory grows with the number of CPUs rather than
+ * producers. Receivers drain every ring */
+
+#include "channels.h"
+
+/* Handle to a per-CPU channel */
+typedef struct channel_percpu_t channel_percpu_t;
+
+/**
+ * @brief Creates a per-CPU channel with one ring for each configured CPU.
+ * Sends use restartable sequences (rseq) on x86-64 Linux when the C library
+ * has registered them. Otherwise each ring is guarded by a spinlock and
+ * sends pick a ring with sched_getcpu.
+ *
+ * @param item_size The size of the items the channel stores.
+ * @param capacity Items each CPU's ring holds, rounded up to a power of two.
+ * @return A pointer to the channel, NULL on failure.
+ */
+channel_percpu_t *channel_percpu_create(size_t item_size, size_t capacity);
+
+/**
+ * @brief Appends an item to the current CPU's ring, waiting while it is
+ * full. Items from different CPUs have no order among them, and a thread
+ * that migrates between sends may have its items reordered.
+ *
+ * @param c The channel.
+ * @param value The item to copy in.
+ * @return false if the channel is closed.
+ */
+bool channel_percpu_send(channel_percpu_t *c, const void *value);
+
+/**
+ * @brief Appends an item to the current CPU's ring if it has room.
+ *
+ * @param c The channel.
+ * @param value The item to copy in.
+ * @return false if the ring is full or the channel is closed.
+ */
+bool channel_percpu_try_send(channel_percpu_t *c, const void *value);
+
+/**
+ * @brief Receives one item from any ring, waiting until one arrives.
+ *
+ * @param c The channel.
+ * @param value Written with the item.
+ * @return false once the channel is closed and every ring is empty.
+ */
+bool channel_percpu_recv(channel_percpu_t *c, void *value);
+
+/**
+ * @brief Receives up to max items from the rings, waiting until there is at
+ * least one. Any number of threads may receive at once.
+ *
+ * @param c The channel.
+ * @param items Written with the items, room for max of them.
+ * @param max The most items to receive.
+ * @return The number of items received, 0 once the channel is closed and
+ * every ring is empty.
+ */
+size_t channel_percpu_recv_batch(channel_percpu_t *c, void *items, size_t max);
+
+/**
+ * @brief Receives up to max items from the rings without waiting.
+ *
+ * @param c The channel.
+ * @param items Written with the items, room for max of them.
+ * @param max The most items to receive.
+ * @return The number of items received.
+ */
+size_t channel_percpu_try_recv_batch(channel_percpu_t *c, void *items,
+                                     size_t max);
+
+/**
+ * @brief Closes the channel. Sends fail from then on, and receivers get the
+ * remaining items before they see the close. Call it once producers have
+ * returned from their last send, as a send racing with it may be lost.
+ *
+ * @param c The channel.
+ */
+void channel_percpu_close(channel_percpu_t *c);
+
+/**
+ * @brief Reports whether sends use restartable sequences or the spinlock
+ * fallback.
+ *
+ * @param c The channel.
+ * @return true if sends use restartable sequences.
+ */
+bool channel_percpu_uses_rseq(channel_percpu_t *c);
+
+/**
+ * @brief Frees the channel. No thread may still be using it.
+ *
+ * @param c The channel.
+ */
+void channel_percpu_destroy(channel_percpu_t *c);
+
+#endif // PERCPU_H_
@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+
+#include "pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define POOL_DEFAULT_DELAY_NS 10000000ULL
+#define POOL_DEFAULT_IDLE_NS 1000000000ULL
+#define PARALLEL_DEFAULT_BATCH 64
+
+struct channel_pool_t {
+  channel_t *ch;
+  size_t item_size;
+  channel_pool_fn fn;
+  void *ctx;
+
+  /* Settings with the defaults filled in */
+  channel_pool_opts_t opts;
+
+  /* Protects everything below. cond wakes the manager on a backlog or stop,
+   * and destroy as workers exit */
+  pthread_mutex_t mu;
+  pthread_cond_t cond;
+
+  /* Set by the channel's backlog callback, cleared by the manager before it
+   * looks at the channel so a new backlog in between is not lost */
+  bool behind;
+
+  bool stopping;
+  channel_pool_stats_t stats;
+
+  pthread_t manager;
+};
+
+/* Current CLOCK_MONOTONIC time in nanoseconds */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Receive and handle items until the channel closes, or until idle for too
+ * long while there are more than min_workers */
+static void *pool_worker(void *arg) {
+  channel_pool_t *p = arg;
+  void *item = malloc(p->item_size);
+
+  for (;;) {
+    channel_status_t status = CHANNEL_CLOSED;
+    if (item) {
+      status = channel_recv_timeout(p->ch, item, p->opts.idle_timeout_ns);
+    }
+    if (status == CHANNEL_OK) {
+      p->fn(item, p->ctx);
+      continue;
+    }
+
+    pthread_mutex_lock(&p->mu);
+    if (status == CHANNEL_CLOSED ||
+        p->stats.workers > p->opts.min_workers) {
+      p->stats.workers--;
+      p->stats.retired++;
+      pthread_cond_broadcast(&p->cond);
+      pthread_mutex_unlock(&p->mu);
+      break;
+    }
+    pthread_mutex_unlock(&p->mu);
+  }
+  free(item);
+  return NULL;
+}
+
+/* Start a worker, with p->mu held */
+static bool spawn_worker_locked(channel_pool_t *p) {
+  pthread_t t;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int err = pthread_create(&t, &attr, pool_worker, p);
+  pthread_attr_destroy(&attr);
+  if (err != 0) {
+    return false;
+  }
+  p->stats.workers++;
+  p->stats.spawned++;
+  if (p->stats.workers > p->stats.peak_workers) {
+    p->stats.peak_workers = p->stats.workers;
+  }
+  return true;
+}
+
+/* Channel backlog callback, runs with the channel locked */
+static void pool_on_backlog(void *arg) {
+  channel_pool_t *p = arg;
+  pthread_mutex_lock(&p->mu);
+  if (!p->behind) {
+    p->behind = true;
+    pthread_cond_broadcast(&p->cond);
+  }
+  pthread_mutex_unlock(&p->mu);
+}
+
+/* Whether the channel is still further behind than the pool allows */
+static bool pool_overloaded(channel_pool_t *p) {
+  channel_stats_t s;
+  channel_stats(p->ch, &s);
+  if (s.queued > p->opts.backlog_threshold) {
+    return true;
+  }
+  return p->opts.sojourn_threshold_ns &&
+         s.head_age_ns > p->opts.sojourn_threshold_ns;
+}
+
+/* Sleep until a backlog is reported, then add a worker for every
+ * scale_up_delay_ns the pool stays behind */
+static void *pool_manager(void *arg) {
+  channel_pool_t *p = arg;
+
+  pthread_mutex_lock(&p->mu);
+  while (!p->stopping) {
+    if (!p->behind) {
+      pthread_cond_wait(&p->cond, &p->mu);
+      continue;
+    }
+
+    /* Give the current workers a chance to catch up first */
+    uint64_t deadline = now_ns() + p->opts.scale_up_delay_ns;
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline / 1000000000ULL),
+        .tv_nsec = (long)(deadline % 1000000000ULL),
+    };
+    while (!p->stopping &&
+           pthread_cond_timedwait(&p->cond, &p->mu, &ts) != ETIMEDOUT) {
+    }
+    if (p->stopping) {
+      break;
+    }
+
+    /* The channel lock is taken before p->mu by the callback, so look at the
+     * channel without holding p->mu */
+    p->behind = false;
+    pthread_mutex_unlock(&p->mu);
+    bool overloaded = pool_overloaded(p);
+    pthread_mutex_lock(&p->mu);
+
+    if (overloaded) {
+      if (p->stats.workers < p->opts.max_workers) {
+        spawn_worker_locked(p);
+      }
+      /* The callback only fires on crossing the threshold, so keep checking
+       * while the backlog stands */
+      p->behind = true;
+    }
+  }
+  pthread_mutex_unlock(&p->mu);
+  return NULL;
+}
+
+/* Start min_workers workers and the manager, and watch the channel */
+channel_pool_t *channel_pool_create(channel_t *ch, size_t item_size,
+                                    channel_pool_fn fn, void *ctx,
+                                    const channel_pool_opts_t *opts) {
+  channel_pool_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+
+  channel_pool_t *p = calloc(1, sizeof(channel_pool_t));
+  if (!p) {
+    return NULL;
+  }
+  p->ch = ch;
+  p->item_size = item_size;
+  p->fn = fn;
+  p->ctx = ctx;
+  p->opts = *opts;
+  if (p->opts.min_workers == 0) {
+    p->opts.min_workers = 1;
+  }
+  if (p->opts.max_workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    p->opts.max_workers = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (p->opts.max_workers < p->opts.min_workers) {
+    p->opts.max_workers = p->opts.min_workers;
+  }
+  if (p->opts.scale_up_delay_ns == 0) {
+    p->opts.scale_up_delay_ns = POOL_DEFAULT_DELAY_NS;
+  }
+  if (p->opts.idle_timeout_ns == 0) {
+    p->opts.idle_timeout_ns = POOL_DEFAULT_IDLE_NS;
+  }
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_mutex_init(&p->mu, NULL);
+  pthread_cond_init(&p->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (!channel_watch_backlog(ch, p->opts.backlog_threshold, pool_on_backlog,
+                             p)) {
+    goto fail;
+  }
+  if (pthread_create(&p->manager, NULL, pool_manager, p) != 0) {
+    channel_watch_backlog(ch, 0, NULL, NULL);
+    goto fail;
+  }
+
+  pthread_mutex_lock(&p->mu);
+  for (size_t i = 0; i < p->opts.min_workers; i++) {
+    spawn_worker_locked(p);
+  }
+  bool started = p->stats.workers > 0;
+  pthread_mutex_unlock(&p->mu);
+  if (!started) {
+    channel_pool_destroy(p);
+    return NULL;
+  }
+  return p;
+
+fail:
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->mu);
+  free(p);
+  return NULL;
+}
+
+/* Snapshot the pool's counters */
+void channel_pool_stats(channel_pool_t *p, channel_pool_stats_t *stats) {
+  pthread_mutex_lock(&p->mu);
+  *stats = p->stats;
+  pthread_mutex_unlock(&p->mu);
+}
+
+/* Stop the manager, wait for every worker to see the channel closed */
+void channel_pool_destroy(channel_pool_t *p) {
+  channel_watch_backlog(p->ch, 0, NULL, NULL);
+
+  pthread_mutex_lock(&p->mu);
+  p->stopping = true;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->mu);
+  pthread_join(p->manager, NULL);
+
+  pthread_mutex_lock(&p->mu);
+  while (p->stats.workers > 0) {
+    pthread_cond_wait(&p->cond, &p->mu);
+  }
+  pthread_mutex_unlock(&p->mu);
+
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->mu);
+  free(p);
+}
+
+/* One worker of channel_parallel_for */
+typedef struct parallel_worker_t {
+  channel_t *ch;
+  size_t item_size;
+  channel_pool_fn fn;
+  void *ctx;
+  size_t batch;
+
+  channel_parallel_stats_t stats;
+} parallel_worker_t;
+
+/* Receive batches and hand their items to fn until the channel is drained */
+static void *parallel_worker(void *arg) {
+  parallel_worker_t *w = arg;
+  char *items = malloc(w->batch * w->item_size);
+  if (!items) {
+    return NULL;
+  }
+
+  uint64_t waited = now_ns();
+  size_t n;
+  while ((n = channel_recv_batch(w->ch, items, w->batch))) {
+    uint64_t got = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      w->fn(items + i * w->item_size, w->ctx);
+    }
+    uint64_t done = now_ns();
+    w->stats.items += n;
+    w->stats.batches++;
+    w->stats.wait_ns += got - waited;
+    w->stats.busy_ns += done - got;
+    waited = done;
+  }
+  w->stats.wait_ns += now_ns() - waited;
+  free(items);
+  return NULL;
+}
+
+/* Run nthreads - 1 workers on new threads and one on the caller's */
+size_t channel_parallel_for(channel_t *ch, size_t item_size, size_t nthreads,
+                            channel_pool_fn fn, void *ctx, size_t batch,
+                            channel_parallel_stats_t *stats) {
+  if (nthreads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (batch == 0) {
+    batch = PARALLEL_DEFAULT_BATCH;
+  }
+
+  parallel_worker_t *workers = calloc(nthreads, sizeof(parallel_worker_t));
+  pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+  if (!workers || !threads) {
+    /* Still drain the channel, on the calling thread alone */
+    parallel_worker_t w = {ch, item_size, fn, ctx, batch, {0}};
+    free(workers);
+    free(threads);
+    parallel_worker(&w);
+    if (stats) {
+      memset(stats, 0, nthreads * sizeof(channel_parallel_stats_t));
+      stats[0] = w.stats;
+    }
+    return w.stats.items;
+  }
+
+  for (size_t i = 0; i < nthreads; i++) {
+    workers[i] = (parallel_worker_t){ch, item_size, fn, ctx, batch, {0}};
+  }
+  size_t started = 1;
+  for (; started < nthreads; started++) {
+    if (pthread_create(&threads[started], NULL, parallel_worker,
+                       &workers[started]) != 0) {
+      break;
+    }
+  }
+  parallel_worker(&workers[0]);
+
+  size_t total = 0;
+  for (size_t i = 0; i < nthreads; i++) {
+    if (i > 0 && i < started) {
+      pthread_join(threads[i], NULL);
+    }
+    total += workers[i].stats.items;
+    if (stats) {
+      stats[i] = workers[i].stats;
+    }
+  }
+  free(workers);
+  free(threads);
+  return total;
+}
@@ -0,0 +1,118 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include "channels.h"
+
+/* Handle to a pool of consumer threads attached to a channel */
+typedef struct channel_pool_t channel_pool_t;
+
+/* Handles one item received by a pool worker */
+typedef void (*channel_pool_fn)(void *item, void *ctx);
+
+/* Pool sizing settings, a zero-initialized struct gives the defaults */
+typedef struct channel_pool_opts_t {
+  /* Workers kept running however idle they are, 0 for the default of 1 */
+  size_t min_workers;
+
+  /* Most workers to run, 0 for one per online CPU, at least min_workers */
+  size_t max_workers;
+
+  /* Queued items above which the pool considers itself behind */
+  size_t backlog_threshold;
+
+  /* Also consider the pool behind while the head item has been queued longer
+   * than this. Needs a channel that timestamps items (expiring_items or
+   * CoDel). 0 disables it */
+  uint64_t sojourn_threshold_ns;
+
+  /* How long the pool must stay behind before each worker is added, 0 for
+   * the default of 10ms */
+  uint64_t scale_up_delay_ns;
+
+  /* A worker above min_workers that receives nothing for this long exits, 0
+   * for the default of 1s */
+  uint64_t idle_timeout_ns;
+} channel_pool_opts_t;
+
+/* Counters reported by channel_pool_stats */
+typedef struct channel_pool_stats_t {
+  /* Workers running now */
+  size_t workers;
+
+  /* Most workers that ran at once */
+  size_t peak_workers;
+
+  /* Workers started and exited, including the first min_workers */
+  size_t spawned;
+  size_t retired;
+} channel_pool_stats_t;
+
+/**
+ * @brief Starts a pool of workers that receive from a channel.
+ * Every worker loops receiving an item and calling fn on it. The pool
+ * watches the channel's backlog with channel_watch_backlog, so no thread
+ * polls it: once a send takes the backlog over the threshold the pool checks
+ * again after scale_up_delay_ns and adds a worker if it is still behind,
+ * repeating until it catches up or reaches max_workers. Idle workers above
+ * min_workers exit on their own.
+ *
+ * @param ch The channel to consume, which must have no other backlog watcher.
+ * @param item_size The channel's item size.
+ * @param fn Called by a worker with each item it receives.
+ * @param ctx Passed to fn.
+ * @param opts Pool settings, NULL for defaults.
+ * @return A pointer to the pool, NULL on failure.
+ */
+channel_pool_t *channel_pool_create(channel_t *ch, size_t item_size,
+                                    channel_pool_fn fn, void *ctx,
+                                    const channel_pool_opts_t *opts);
+
+/**
+ * @brief Reads a snapshot of the pool's counters.
+ *
+ * @param p The pool handle.
+ * @param stats Written with the current counters.
+ */
+void channel_pool_stats(channel_pool_t *p, channel_pool_stats_t *stats);
+
+/**
+ * @brief Waits for the workers to drain the channel and frees the pool.
+ * The channel must have been closed, or this waits until it is.
+ *
+ * @param p The pool handle.
+ */
+void channel_pool_destroy(channel_pool_t *p);
+
+/* Counters of one channel_parallel_for worker */
+typedef struct channel_parallel_stats_t {
+  /* Items handled and the batches they were received in */
+  size_t items;
+  size_t batches;
+
+  /* Time spent in fn, and waiting in the channel for items */
+  uint64_t busy_ns;
+  uint64_t wait_ns;
+} channel_parallel_stats_t;
+
+/**
+ * @brief Handles every item of a channel on nthreads threads, then returns.
+ * Each worker receives up to batch items at a time with channel_recv_batch,
+ * so workers take the channel lock once per batch rather than once per item.
+ * The calling thread is one of the workers. Returns once the channel is
+ * closed and drained.
+ *
+ * @param ch The channel to consume.
+ * @param item_size The channel's item size.
+ * @param nthreads Workers to run, 0 for one per online CPU.
+ * @param fn Called by a worker with each item it receives.
+ * @param ctx Passed to fn.
+ * @param batch Most items a worker receives at once, 0 for the default of 64.
+ * @param stats NULL, or an array of nthreads entries written with each
+ * worker's counters. Entries of workers that failed to start are zero.
+ * @return The number of items handled.
+ */
+size_t channel_parallel_for(channel_t *ch, size_t item_size, size_t nthreads,
+                            channel_pool_fn fn, void *ctx, size_t batch,
+                            channel_parallel_stats_t *stats);
+
+#endif // POOL_H_
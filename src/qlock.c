@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+
+#include "qlock.h"
+
+#if defined(HAVE_QLOCK)
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Size to align data written by different threads to */
+#define CACHE_LINE 64
+
+/* Same-node handoffs in a row before the global lock is given up */
+#define QLOCK_COHORT_BATCH 64
+
+/* Times a waiter polls before sleeping on the futex, on machines with more
+ * than one CPU */
+#define QLOCK_SPINS 128
+
+/* Most queue locks a thread can hold at the same time */
+#define QLOCK_MAX_HELD 4
+
+/* What a queue node's predecessor has told it */
+enum {
+  /* Still queued */
+  NODE_WAITING,
+  /* Still queued and asleep on the state futex */
+  NODE_SLEEPING,
+  /* Owner now, the global lock came with the handoff */
+  NODE_LOCAL,
+  /* Head of the node's queue, must take the global lock itself */
+  NODE_GLOBAL,
+};
+
+/* A thread's place in a cohort queue */
+typedef struct qnode_t {
+  _Alignas(CACHE_LINE) struct qnode_t *_Atomic next;
+  _Atomic uint32_t state;
+} qnode_t;
+
+/* The waiters from one NUMA node */
+typedef struct cohort_t {
+  _Alignas(CACHE_LINE) qnode_t *_Atomic tail;
+
+  /* Handoffs in a row within this cohort, only touched by the owner */
+  unsigned batch;
+} cohort_t;
+
+struct qlock_t {
+  /* 0 free, 1 held, 2 held with sleepers waiting */
+  _Alignas(CACHE_LINE) _Atomic uint32_t global;
+
+  /* The owner's queue node and cohort, only touched by the owner */
+  _Alignas(CACHE_LINE) qnode_t *owner;
+  cohort_t *owner_cohort;
+
+  size_t ncohorts;
+  cohort_t cohorts[];
+};
+
+/* Queue nodes of the calling thread, one per lock it holds */
+static _Thread_local qnode_t held_nodes[QLOCK_MAX_HELD];
+static _Thread_local bool held_used[QLOCK_MAX_HELD];
+
+/* The calling thread's NUMA node, re-read every so often as threads move */
+static _Thread_local unsigned numa_node;
+static _Thread_local unsigned numa_reads;
+
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static size_t numa_nodes = 1;
+
+/* Spinning only helps if the owner can run meanwhile */
+static int spin_limit = 0;
+
+/* Count the possible NUMA nodes, e.g. "0-3" means 4, and the CPUs */
+static void read_topology(void) {
+  if (sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+    spin_limit = QLOCK_SPINS;
+  }
+
+  FILE *f = fopen("/sys/devices/system/node/possible", "r");
+  if (!f) {
+    return;
+  }
+  unsigned first, last;
+  int n = fscanf(f, "%u-%u", &first, &last);
+  if (n == 2 && last < 1024) {
+    numa_nodes = last + 1;
+  }
+  fclose(f);
+}
+
+/* Hint to the CPU that this is a spin loop */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/* The cohort the calling thread queues in */
+static cohort_t *current_cohort(qlock_t *l) {
+  if ((numa_reads++ & 255) == 0) {
+    unsigned cpu, node;
+    if (getcpu(&cpu, &node) == 0) {
+      numa_node = node;
+    }
+  }
+  return &l->cohorts[numa_node % l->ncohorts];
+}
+
+qlock_t *qlock_create(void) {
+  pthread_once(&topology_once, read_topology);
+  size_t size = sizeof(qlock_t) + numa_nodes * sizeof(cohort_t);
+  qlock_t *l = aligned_alloc(CACHE_LINE, size);
+  if (!l) {
+    return NULL;
+  }
+  atomic_init(&l->global, 0);
+  l->owner = NULL;
+  l->owner_cohort = NULL;
+  l->ncohorts = numa_nodes;
+  for (size_t i = 0; i < numa_nodes; i++) {
+    atomic_init(&l->cohorts[i].tail, NULL);
+    l->cohorts[i].batch = 0;
+  }
+  return l;
+}
+
+void qlock_destroy(qlock_t *l) { free(l); }
+
+/* Take the global lock, contended only by the heads of cohort queues */
+static void global_lock(qlock_t *l) {
+  for (int i = 0; i < spin_limit; i++) {
+    uint32_t c = 0;
+    if (atomic_compare_exchange_weak(&l->global, &c, 1)) {
+      return;
+    }
+    cpu_relax();
+  }
+  while (atomic_exchange(&l->global, 2) != 0) {
+    futex_wait(&l->global, 2, NULL);
+  }
+}
+
+static void global_unlock(qlock_t *l) {
+  if (atomic_exchange(&l->global, 0) == 2) {
+    futex_wake(&l->global, 1);
+  }
+}
+
+/* Wait for the predecessor's handoff and return it */
+static uint32_t node_wait(qnode_t *n) {
+  for (int i = 0; i < spin_limit; i++) {
+    uint32_t s = atomic_load_explicit(&n->state, memory_order_acquire);
+    if (s >= NODE_LOCAL) {
+      return s;
+    }
+    cpu_relax();
+  }
+
+  uint32_t s = NODE_WAITING;
+  if (!atomic_compare_exchange_strong(&n->state, &s, NODE_SLEEPING)) {
+    return s;
+  }
+  while ((s = atomic_load(&n->state)) == NODE_SLEEPING) {
+    futex_wait(&n->state, NODE_SLEEPING, NULL);
+  }
+  return s;
+}
+
+/* Hand the lock to a queued waiter */
+static void node_grant(qnode_t *n, uint32_t state) {
+  if (atomic_exchange(&n->state, state) == NODE_SLEEPING) {
+    futex_wake(&n->state, 1);
+  }
+}
+
+void qlock_lock(qlock_t *l) {
+  /* Take a free lock straight away, like a mutex, so an owner that unlocks
+   * and relocks within its time slice does not have to queue */
+  uint32_t free_word = 0;
+  if (atomic_compare_exchange_strong(&l->global, &free_word, 1)) {
+    l->owner = NULL;
+    return;
+  }
+
+  int slot = 0;
+  while (held_used[slot]) {
+    if (++slot == QLOCK_MAX_HELD) {
+      /* The library never nests this deep */
+      abort();
+    }
+  }
+  held_used[slot] = true;
+  qnode_t *n = &held_nodes[slot];
+  atomic_store_explicit(&n->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&n->state, NODE_WAITING, memory_order_relaxed);
+
+  cohort_t *c = current_cohort(l);
+  qnode_t *prev = atomic_exchange(&c->tail, n);
+  uint32_t state = NODE_GLOBAL;
+  if (prev) {
+    atomic_store_explicit(&prev->next, n, memory_order_release);
+    state = node_wait(n);
+  }
+  if (state == NODE_GLOBAL) {
+    /* Only the head of each cohort gets here */
+    global_lock(l);
+  }
+  l->owner = n;
+  l->owner_cohort = c;
+}
+
+void qlock_unlock(qlock_t *l) {
+  qnode_t *n = l->owner;
+  if (!n) {
+    global_unlock(l);
+    return;
+  }
+
+  cohort_t *c = l->owner_cohort;
+  qnode_t *next = atomic_load_explicit(&n->next, memory_order_acquire);
+
+  /* Keep the global lock on this node while the successor is spinning for
+   * it, its caches are close. A sleeping successor would need a wakeup
+   * first, so let a running thread take the lock instead */
+  if (next && c->batch < QLOCK_COHORT_BATCH &&
+      atomic_load_explicit(&next->state, memory_order_relaxed) ==
+          NODE_WAITING) {
+    c->batch++;
+    node_grant(next, NODE_LOCAL);
+    held_used[n - held_nodes] = false;
+    return;
+  }
+
+  c->batch = 0;
+  global_unlock(l);
+  if (!next) {
+    qnode_t *expected = n;
+    if (atomic_compare_exchange_strong(&c->tail, &expected, NULL)) {
+      held_used[n - held_nodes] = false;
+      return;
+    }
+    /* A successor swapped itself in but has not linked up yet */
+    while (!(next = atomic_load_explicit(&n->next, memory_order_acquire))) {
+      sched_yield();
+    }
+  }
+  node_grant(next, NODE_GLOBAL);
+  held_used[n - held_nodes] = false;
+}
+#endif
@@ -0,0 +1,32 @@
+#ifndef QLOCK_H_
+#define QLOCK_H_
+
+/* MCS queue lock with NUMA cohorting, for use inside the library only.
+ * Waiters queue up per NUMA node and each spins on its own queue node. The
+ * head of each node's queue takes a global lock, and an owner hands that
+ * global lock straight to the next waiter from its own node, a bounded number
+ * of times in a row, before letting the other nodes in. HAVE_QLOCK says
+ * whether it is available */
+
+#include "futex.h"
+
+#if defined(HAVE_FUTEX)
+#define HAVE_QLOCK 1
+
+typedef struct qlock_t qlock_t;
+
+/* Create an unlocked queue lock with one cohort per NUMA node, NULL if out
+ * of memory */
+qlock_t *qlock_create(void);
+
+/* Acquire the lock. A thread may hold a few queue locks at once */
+void qlock_lock(qlock_t *l);
+
+/* Release the lock, must be called by the thread that acquired it */
+void qlock_unlock(qlock_t *l);
+
+/* Free an unlocked queue lock */
+void qlock_destroy(qlock_t *l);
+#endif
+
+#endif // QLOCK_H_
@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+
+#include "rpc.h"
+#include "futex.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RPC_DEFAULT_SLOTS 256
+#define RPC_DEFAULT_BATCH 64
+
+/* Polls of a reply slot before the caller goes to sleep on it */
+#define RPC_SPIN 64
+
+/* Slot header size, keeping the request and response after it aligned */
+#define RPC_ALIGN sizeof(max_align_t)
+
+/* Reply slot states. A caller that sleeps moves the slot from PENDING to
+ * WAITING so the server knows to wake it */
+enum { SLOT_PENDING, SLOT_WAITING, SLOT_DONE };
+
+/* One slot of the arena, followed by the request and the response. The
+ * request is staged here too, so only its id goes through the queue. Slots
+ * are cache-line multiples so neighbours don't share lines */
+typedef struct rpc_slot_t {
+  _Atomic uint32_t state;
+} rpc_slot_t;
+
+struct channel_rpc_t {
+  size_t req_size;
+  size_t resp_size;
+  channel_rpc_fn fn;
+  void *ctx;
+
+  /* Settings with the defaults filled in */
+  channel_rpc_opts_t opts;
+
+  /* Correlation ids of queued requests */
+  channel_t *requests;
+
+  /* Ids of free reply slots, a caller waits here when all are in flight */
+  channel_t *free_slots;
+
+  /* The slots, stride bytes apart, with the response resp_offset bytes in */
+  char *arena;
+  size_t stride;
+  size_t resp_offset;
+
+#if !defined(HAVE_FUTEX)
+  /* Without futexes callers sleep on one condition for every slot */
+  pthread_mutex_t mu;
+  pthread_cond_t done;
+#endif
+
+  pthread_t *servers;
+  size_t nservers;
+};
+
+static inline rpc_slot_t *slot_at(channel_rpc_t *rpc, uint32_t id) {
+  return (rpc_slot_t *)(rpc->arena + (size_t)id * rpc->stride);
+}
+
+static inline void *slot_req(rpc_slot_t *slot) {
+  return (char *)slot + RPC_ALIGN;
+}
+
+static inline void *slot_resp(channel_rpc_t *rpc, rpc_slot_t *slot) {
+  return (char *)slot + rpc->resp_offset;
+}
+
+/* Publish a response and wake its caller if it went to sleep */
+static void slot_complete(channel_rpc_t *rpc, rpc_slot_t *slot) {
+  uint32_t prev = atomic_exchange(&slot->state, SLOT_DONE);
+#if defined(HAVE_FUTEX)
+  (void)rpc;
+  if (prev == SLOT_WAITING) {
+    futex_wake(&slot->state, 1);
+  }
+#else
+  if (prev == SLOT_WAITING) {
+    pthread_mutex_lock(&rpc->mu);
+    pthread_cond_broadcast(&rpc->done);
+    pthread_mutex_unlock(&rpc->mu);
+  }
+#endif
+}
+
+/* Take requests in batches and answer each into its reply slot */
+static void *rpc_server(void *arg) {
+  channel_rpc_t *rpc = arg;
+  uint32_t *ids = malloc(rpc->opts.batch * sizeof(uint32_t));
+  if (!ids) {
+    return NULL;
+  }
+
+  size_t n;
+  while ((n = channel_recv_batch(rpc->requests, ids, rpc->opts.batch))) {
+    for (size_t i = 0; i < n; i++) {
+      rpc_slot_t *slot = slot_at(rpc, ids[i]);
+      rpc->fn(slot_req(slot), slot_resp(rpc, slot), rpc->ctx);
+      slot_complete(rpc, slot);
+    }
+  }
+  free(ids);
+  return NULL;
+}
+
+/* Build the arena and queues, then start the servers */
+channel_rpc_t *channel_rpc_create(size_t req_size, size_t resp_size,
+                                  channel_rpc_fn fn, void *ctx,
+                                  const channel_rpc_opts_t *opts) {
+  channel_rpc_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+
+  channel_rpc_t *rpc = calloc(1, sizeof(channel_rpc_t));
+  if (!rpc) {
+    return NULL;
+  }
+  rpc->req_size = req_size;
+  rpc->resp_size = resp_size;
+  rpc->fn = fn;
+  rpc->ctx = ctx;
+  rpc->opts = *opts;
+  if (rpc->opts.slots == 0) {
+    rpc->opts.slots = RPC_DEFAULT_SLOTS;
+  }
+  if (rpc->opts.slots >= CHANNEL_RPC_NONE) {
+    rpc->opts.slots = CHANNEL_RPC_NONE - 1;
+  }
+  if (rpc->opts.servers == 0) {
+    rpc->opts.servers = 1;
+  }
+  if (rpc->opts.batch == 0) {
+    rpc->opts.batch = RPC_DEFAULT_BATCH;
+  }
+
+  size_t req_span = (req_size + RPC_ALIGN - 1) / RPC_ALIGN * RPC_ALIGN;
+  rpc->resp_offset = RPC_ALIGN + req_span;
+  rpc->stride = (rpc->resp_offset + resp_size + 63) & ~(size_t)63;
+  rpc->arena = aligned_alloc(64, rpc->stride * rpc->opts.slots);
+  rpc->requests = channel_create(sizeof(uint32_t), rpc->opts.slots);
+  rpc->free_slots = channel_create(sizeof(uint32_t), rpc->opts.slots);
+  rpc->servers = calloc(rpc->opts.servers, sizeof(pthread_t));
+  if (!rpc->arena || !rpc->requests || !rpc->free_slots || !rpc->servers) {
+    goto fail;
+  }
+  for (uint32_t id = 0; id < rpc->opts.slots; id++) {
+    atomic_init(&slot_at(rpc, id)->state, SLOT_DONE);
+    channel_send(rpc->free_slots, &id);
+  }
+#if !defined(HAVE_FUTEX)
+  pthread_mutex_init(&rpc->mu, NULL);
+  pthread_cond_init(&rpc->done, NULL);
+#endif
+
+  for (size_t i = 0; i < rpc->opts.servers; i++) {
+    if (pthread_create(&rpc->servers[i], NULL, rpc_server, rpc) != 0) {
+      break;
+    }
+    rpc->nservers++;
+  }
+  if (rpc->nservers == 0) {
+    channel_rpc_destroy(rpc);
+    return NULL;
+  }
+  return rpc;
+
+fail:
+  if (rpc->requests) {
+    channel_destroy(rpc->requests);
+  }
+  if (rpc->free_slots) {
+    channel_destroy(rpc->free_slots);
+  }
+  free(rpc->arena);
+  free(rpc->servers);
+  free(rpc);
+  return NULL;
+}
+
+/* Claim a slot, stage the request in it and queue its id */
+uint32_t channel_rpc_begin(channel_rpc_t *rpc, const void *req) {
+  uint32_t id;
+  if (!channel_recv(rpc->free_slots, &id)) {
+    return CHANNEL_RPC_NONE;
+  }
+  rpc_slot_t *slot = slot_at(rpc, id);
+  atomic_store_explicit(&slot->state, SLOT_PENDING, memory_order_relaxed);
+  memcpy(slot_req(slot), req, rpc->req_size);
+  if (!channel_send(rpc->requests, &id)) {
+    channel_send(rpc->free_slots, &id);
+    return CHANNEL_RPC_NONE;
+  }
+  return id;
+}
+
+/* Spin briefly on the slot, then sleep on it until the server is done */
+void channel_rpc_wait(channel_rpc_t *rpc, uint32_t id, void *resp) {
+  rpc_slot_t *slot = slot_at(rpc, id);
+  for (int i = 0; i < RPC_SPIN; i++) {
+    if (atomic_load_explicit(&slot->state, memory_order_acquire) ==
+        SLOT_DONE) {
+      goto done;
+    }
+  }
+
+  uint32_t expected = SLOT_PENDING;
+  if (atomic_compare_exchange_strong(&slot->state, &expected,
+                                     SLOT_WAITING)) {
+#if defined(HAVE_FUTEX)
+    while (atomic_load(&slot->state) == SLOT_WAITING) {
+      futex_wait(&slot->state, SLOT_WAITING, NULL);
+    }
+#else
+    pthread_mutex_lock(&rpc->mu);
+    while (atomic_load(&slot->state) == SLOT_WAITING) {
+      pthread_cond_wait(&rpc->done, &rpc->mu);
+    }
+    pthread_mutex_unlock(&rpc->mu);
+#endif
+  }
+
+done:
+  memcpy(resp, slot_resp(rpc, slot), rpc->resp_size);
+  channel_send(rpc->free_slots, &id);
+}
+
+/* Begin and wait back to back */
+bool channel_rpc_call(channel_rpc_t *rpc, const void *req, void *resp) {
+  uint32_t id = channel_rpc_begin(rpc, req);
+  if (id == CHANNEL_RPC_NONE) {
+    return false;
+  }
+  channel_rpc_wait(rpc, id, resp);
+  return true;
+}
+
+/* Refuse new calls, the servers drain the queue and exit */
+void channel_rpc_close(channel_rpc_t *rpc) {
+  channel_close(rpc->requests);
+  channel_close(rpc->free_slots);
+}
+
+/* Close, join the servers and free the arena */
+void channel_rpc_destroy(channel_rpc_t *rpc) {
+  channel_rpc_close(rpc);
+  for (size_t i = 0; i < rpc->nservers; i++) {
+    pthread_join(rpc->servers[i], NULL);
+  }
+#if !defined(HAVE_FUTEX)
+  pthread_cond_destroy(&rpc->done);
+  pthread_mutex_destroy(&rpc->mu);
+#endif
+  channel_destroy(rpc->requests);
+  channel_destroy(rpc->free_slots);
+  free(rpc->arena);
+  free(rpc->servers);
+  free(rpc);
+}
@@ -0,0 +1,95 @@
+#ifndef RPC_H_
+#define RPC_H_
+
+/* Request/response calls over a channel. A caller stages its request in a
+ * slot of a preallocated arena and queues only the slot's id, the server
+ * writes the response into the same slot and the caller sleeps on the slot
+ * itself, so a call allocates nothing */
+
+#include "channels.h"
+
+/* Handle to an RPC server and its reply arena */
+typedef struct channel_rpc_t channel_rpc_t;
+
+/* Handles one request, writing resp_size bytes of response */
+typedef void (*channel_rpc_fn)(const void *req, void *resp, void *ctx);
+
+/* Returned by channel_rpc_begin when the call could not be made */
+#define CHANNEL_RPC_NONE UINT32_MAX
+
+/* Optional RPC settings, a zero-initialized struct gives the defaults */
+typedef struct channel_rpc_opts_t {
+  /* Reply slots, the most calls in flight at once. Callers wait for a free
+   * slot beyond that. 0 for the default of 256 */
+  size_t slots;
+
+  /* Server threads, 0 for the default of 1 */
+  size_t servers;
+
+  /* Most requests a server takes from the queue at once, 0 for the default
+   * of 64 */
+  size_t batch;
+} channel_rpc_opts_t;
+
+/**
+ * @brief Creates the reply arena and request queue and starts the servers.
+ *
+ * @param req_size The size of a request.
+ * @param resp_size The size of a response.
+ * @param fn Called by a server for every request.
+ * @param ctx Passed to fn.
+ * @param opts RPC settings, NULL for defaults.
+ * @return A pointer to the RPC handle, NULL on failure.
+ */
+channel_rpc_t *channel_rpc_create(size_t req_size, size_t resp_size,
+                                  channel_rpc_fn fn, void *ctx,
+                                  const channel_rpc_opts_t *opts);
+
+/**
+ * @brief Sends a request without waiting for the response.
+ * Claims a reply slot, waiting if all are in flight. Every successful call
+ * must be matched by a channel_rpc_wait, which releases the slot.
+ *
+ * @param rpc The RPC handle.
+ * @param req Pointer to the request.
+ * @return The call's correlation id, CHANNEL_RPC_NONE once the RPC handle
+ * is closed.
+ */
+uint32_t channel_rpc_begin(channel_rpc_t *rpc, const void *req);
+
+/**
+ * @brief Waits for the response to a call made with channel_rpc_begin.
+ *
+ * @param rpc The RPC handle.
+ * @param id The correlation id channel_rpc_begin returned.
+ * @param resp Written with the response.
+ */
+void channel_rpc_wait(channel_rpc_t *rpc, uint32_t id, void *resp);
+
+/**
+ * @brief Sends a request and waits for its response.
+ *
+ * @param rpc The RPC handle.
+ * @param req Pointer to the request.
+ * @param resp Written with the response.
+ * @return true on success, false once the RPC handle is closed.
+ */
+bool channel_rpc_call(channel_rpc_t *rpc, const void *req, void *resp);
+
+/**
+ * @brief Stops accepting calls. The servers answer every request already
+ * queued and exit.
+ *
+ * @param rpc The RPC handle.
+ */
+void channel_rpc_close(channel_rpc_t *rpc);
+
+/**
+ * @brief Closes the RPC handle if needed, waits for the servers and frees
+ * it. No call may be in flight.
+ *
+ * @param rpc The RPC handle.
+ */
+void channel_rpc_destroy(channel_rpc_t *rpc);
+
+#endif // RPC_H_
@@ -0,0 +1,472 @@
+#define _GNU_SOURCE
+
+#include "stream.h"
+#include "futex.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STREAM_MAGIC 0x314d525453484343ULL /* "CCHSTRM1" */
+#define STREAM_HEADER_SIZE 4096
+#define STREAM_DEFAULT_MAX (1ULL << 30)
+#define STREAM_DEFAULT_COMMIT 64
+
+/* The file grows by at least this much at a time */
+#define STREAM_GROW_MIN (1 << 20)
+
+/* Items received per batch by channel_stream_append_from */
+#define STREAM_APPEND_BATCH 256
+
+/* A group's record in the file header */
+typedef struct stream_group_rec_t {
+  char name[CHANNEL_STREAM_MAX_NAME + 1];
+  _Atomic uint64_t offset;
+  uint64_t reserved;
+} stream_group_rec_t;
+
+/* The first page of the file, items follow it */
+typedef struct stream_header_t {
+  uint64_t magic;
+  uint64_t item_size;
+
+  /* Items in the log, stored after them */
+  _Atomic uint64_t length;
+  uint64_t ngroups;
+
+  /* Bumped by every append and close. Readers in any process sleep on it,
+   * counted in waiters so appends only wake when someone sleeps. A reader
+   * that dies asleep leaves waiters high, which only costs spare wakes */
+  _Atomic uint32_t seq;
+  _Atomic uint32_t waiters;
+  uint64_t reserved[3];
+
+  stream_group_rec_t groups[CHANNEL_STREAM_MAX_GROUPS];
+} stream_header_t;
+
+_Static_assert(sizeof(stream_header_t) == STREAM_HEADER_SIZE,
+               "stream header must fill one page");
+
+struct channel_stream_group_t {
+  channel_stream_t *s;
+  stream_group_rec_t *rec;
+
+  /* Next item to read, the last commit and the last one written to rec */
+  uint64_t pos;
+  uint64_t committed;
+  uint64_t persisted;
+};
+
+struct channel_stream_t {
+  int fd;
+  size_t item_size;
+
+  /* Settings with the defaults filled in */
+  channel_stream_opts_t opts;
+
+  /* The mapping covers max_bytes, the file file_bytes of it */
+  char *map;
+  stream_header_t *header;
+  char *data;
+  size_t file_bytes;
+
+  /* Orders appends, file growth and the group table between this handle's
+   * threads, and the flock on fd between handles and processes */
+  pthread_mutex_t mu;
+  atomic_bool closed;
+
+#if !defined(HAVE_FUTEX)
+  /* Without futexes readers sleep here, woken only by this handle */
+  pthread_cond_t cond;
+  size_t waiters;
+#endif
+
+  channel_stream_group_t *groups[CHANNEL_STREAM_MAX_GROUPS];
+};
+
+/* n rounded up to a whole page */
+static size_t page_round(size_t n) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (n + page - 1) / page * page;
+}
+
+/* Take the file lock, with s->mu held once the stream is open */
+static bool file_lock(channel_stream_t *s) {
+  while (flock(s->fd, LOCK_EX) != 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Release the file lock */
+static void file_unlock(channel_stream_t *s) { flock(s->fd, LOCK_UN); }
+
+/* Whether every group record has a terminated name and an offset inside
+ * the log, so lookups stay in the record and reads don't wait forever */
+static bool groups_valid(stream_header_t *h) {
+  uint64_t len = atomic_load(&h->length);
+  for (size_t i = 0; i < h->ngroups; i++) {
+    if (h->groups[i].name[CHANNEL_STREAM_MAX_NAME] != '\0' ||
+        atomic_load(&h->groups[i].offset) > len) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Map the file, creating or checking its header */
+channel_stream_t *channel_stream_open(const char *path, size_t item_size,
+                                      const channel_stream_opts_t *opts) {
+  channel_stream_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+  if (item_size == 0) {
+    return NULL;
+  }
+
+  channel_stream_t *s = calloc(1, sizeof(channel_stream_t));
+  if (!s) {
+    return NULL;
+  }
+  s->item_size = item_size;
+  s->opts = *opts;
+  if (s->opts.max_bytes == 0) {
+    s->opts.max_bytes = STREAM_DEFAULT_MAX;
+  }
+  if (s->opts.commit_every == 0) {
+    s->opts.commit_every = STREAM_DEFAULT_COMMIT;
+  }
+
+  s->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (s->fd < 0) {
+    free(s);
+    return NULL;
+  }
+  /* So only one of the processes opening a new file writes its header,
+   * released by close on failure */
+  struct stat st;
+  if (!file_lock(s) || fstat(s->fd, &st) != 0) {
+    goto fail;
+  }
+  bool fresh = st.st_size == 0;
+  s->file_bytes = (size_t)st.st_size;
+  if (fresh) {
+    s->file_bytes = STREAM_HEADER_SIZE + STREAM_GROW_MIN;
+    if (ftruncate(s->fd, (off_t)s->file_bytes) != 0) {
+      goto fail;
+    }
+  } else if (s->file_bytes < STREAM_HEADER_SIZE) {
+    goto fail;
+  }
+  if (s->opts.max_bytes < s->file_bytes) {
+    s->opts.max_bytes = s->file_bytes;
+  }
+  s->opts.max_bytes = page_round(s->opts.max_bytes);
+
+  /* Reserve the whole range now so the log never moves, only the part
+   * backed by the file may be touched */
+  s->map = mmap(NULL, s->opts.max_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                s->fd, 0);
+  if (s->map == MAP_FAILED) {
+    goto fail;
+  }
+  s->header = (stream_header_t *)s->map;
+  s->data = s->map + STREAM_HEADER_SIZE;
+
+  if (fresh) {
+    s->header->magic = STREAM_MAGIC;
+    s->header->item_size = item_size;
+    atomic_init(&s->header->length, 0);
+  } else if (s->header->magic != STREAM_MAGIC ||
+             s->header->item_size != item_size ||
+             s->header->ngroups > CHANNEL_STREAM_MAX_GROUPS ||
+             atomic_load(&s->header->length) >
+                 (s->file_bytes - STREAM_HEADER_SIZE) / item_size ||
+             !groups_valid(s->header)) {
+    /* Not a stream of these items, or a header that would send lookups
+     * past the group records or reads past the file */
+    munmap(s->map, s->opts.max_bytes);
+    goto fail;
+  }
+
+  file_unlock(s);
+  pthread_mutex_init(&s->mu, NULL);
+#if !defined(HAVE_FUTEX)
+  pthread_cond_init(&s->cond, NULL);
+#endif
+  return s;
+
+fail:
+  close(s->fd);
+  free(s);
+  return NULL;
+}
+
+/* Items this handle can reach, another process may have mapped more */
+static uint64_t mapped_length(channel_stream_t *s) {
+  uint64_t len = channel_stream_length(s);
+  uint64_t max = (s->opts.max_bytes - STREAM_HEADER_SIZE) / s->item_size;
+  return len < max ? len : max;
+}
+
+/* Extend the file to hold bytes, with both locks held. Sized from the file
+ * itself, as another process may have grown it past s->file_bytes and
+ * sizing from that would cut its items off */
+static bool grow_locked(channel_stream_t *s, size_t bytes) {
+  struct stat st;
+  if (fstat(s->fd, &st) != 0) {
+    return false;
+  }
+  s->file_bytes = (size_t)st.st_size;
+  if (s->file_bytes >= bytes) {
+    return true;
+  }
+  size_t size = s->file_bytes * 2;
+  if (size < s->file_bytes + STREAM_GROW_MIN) {
+    size = s->file_bytes + STREAM_GROW_MIN;
+  }
+  if (size < bytes) {
+    size = bytes;
+  }
+  if (size > s->opts.max_bytes) {
+    size = s->opts.max_bytes;
+  }
+  if (ftruncate(s->fd, (off_t)size) != 0) {
+    return false;
+  }
+  s->file_bytes = size;
+  return true;
+}
+
+/* Wake readers after an append or close. The seq bump pairs with the
+ * waiters increment in read, so either the append sees the reader or the
+ * reader sees the new seq and does not sleep */
+static void wake_readers(channel_stream_t *s) {
+#if defined(HAVE_FUTEX)
+  atomic_fetch_add(&s->header->seq, 1);
+  if (atomic_load(&s->header->waiters)) {
+    futex_wake_shared(&s->header->seq, INT_MAX);
+  }
+#else
+  if (s->waiters) {
+    pthread_cond_broadcast(&s->cond);
+  }
+#endif
+}
+
+/* Copy the items in, then publish the new length */
+bool channel_stream_append(channel_stream_t *s, const void *items, size_t n) {
+  pthread_mutex_lock(&s->mu);
+  if (atomic_load(&s->closed) || !file_lock(s)) {
+    pthread_mutex_unlock(&s->mu);
+    return false;
+  }
+  uint64_t len =
+      atomic_load_explicit(&s->header->length, memory_order_relaxed);
+  size_t end = STREAM_HEADER_SIZE + (size_t)(len + n) * s->item_size;
+  if (end > s->opts.max_bytes ||
+      (end > s->file_bytes && !grow_locked(s, end))) {
+    file_unlock(s);
+    pthread_mutex_unlock(&s->mu);
+    return false;
+  }
+
+  memcpy(s->data + len * s->item_size, items, n * s->item_size);
+  atomic_store_explicit(&s->header->length, len + n, memory_order_release);
+  file_unlock(s);
+  wake_readers(s);
+  pthread_mutex_unlock(&s->mu);
+  return true;
+}
+
+/* Receive in batches and append each batch whole */
+size_t channel_stream_append_from(channel_stream_t *s, channel_t *ch) {
+  char *batch = malloc(STREAM_APPEND_BATCH * s->item_size);
+  size_t total = 0;
+  if (!batch) {
+    return 0;
+  }
+  size_t n;
+  while ((n = channel_recv_batch(ch, batch, STREAM_APPEND_BATCH))) {
+    if (!channel_stream_append(s, batch, n)) {
+      break;
+    }
+    total += n;
+  }
+  free(batch);
+  return total;
+}
+
+/* Pairs with the release store in append */
+uint64_t channel_stream_length(channel_stream_t *s) {
+  return atomic_load_explicit(&s->header->length, memory_order_acquire);
+}
+
+/* msync everything written so far, the header included */
+bool channel_stream_sync(channel_stream_t *s) {
+  uint64_t len = mapped_length(s);
+  size_t bytes = page_round(STREAM_HEADER_SIZE + (size_t)len * s->item_size);
+  return msync(s->map, bytes, MS_SYNC) == 0;
+}
+
+/* Wake readers so they stop at the end of the log */
+void channel_stream_close(channel_stream_t *s) {
+  pthread_mutex_lock(&s->mu);
+  atomic_store(&s->closed, true);
+#if defined(HAVE_FUTEX)
+  /* Readers of other handles wake too, see nothing new and sleep again */
+  wake_readers(s);
+#else
+  pthread_cond_broadcast(&s->cond);
+#endif
+  pthread_mutex_unlock(&s->mu);
+}
+
+/* Persist the commits, then release the mapping and file */
+void channel_stream_destroy(channel_stream_t *s) {
+  for (size_t i = 0; i < CHANNEL_STREAM_MAX_GROUPS; i++) {
+    if (s->groups[i]) {
+      channel_stream_flush(s->groups[i]);
+      free(s->groups[i]);
+    }
+  }
+  if (s->opts.sync) {
+    channel_stream_sync(s);
+  }
+  munmap(s->map, s->opts.max_bytes);
+  close(s->fd);
+#if !defined(HAVE_FUTEX)
+  pthread_cond_destroy(&s->cond);
+#endif
+  pthread_mutex_destroy(&s->mu);
+  free(s);
+}
+
+/* Find the group's record, adding one if it is new */
+channel_stream_group_t *channel_stream_group(channel_stream_t *s,
+                                             const char *name) {
+  if (strlen(name) > CHANNEL_STREAM_MAX_NAME) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&s->mu);
+  if (!file_lock(s)) {
+    pthread_mutex_unlock(&s->mu);
+    return NULL;
+  }
+  stream_header_t *h = s->header;
+  size_t i = 0;
+  while (i < h->ngroups && strcmp(h->groups[i].name, name) != 0) {
+    i++;
+  }
+  if (i >= h->ngroups) {
+    if (h->ngroups >= CHANNEL_STREAM_MAX_GROUPS) {
+      file_unlock(s);
+      pthread_mutex_unlock(&s->mu);
+      return NULL;
+    }
+    memset(&h->groups[i], 0, sizeof(h->groups[i]));
+    strcpy(h->groups[i].name, name);
+    atomic_init(&h->groups[i].offset, 0);
+    h->ngroups++;
+  }
+  file_unlock(s);
+
+  channel_stream_group_t *g = s->groups[i];
+  if (!g && (g = calloc(1, sizeof(channel_stream_group_t)))) {
+    g->s = s;
+    g->rec = &h->groups[i];
+    g->pos = atomic_load(&g->rec->offset);
+    g->committed = g->pos;
+    g->persisted = g->pos;
+    s->groups[i] = g;
+  }
+  pthread_mutex_unlock(&s->mu);
+  return g;
+}
+
+/* Hand out the next run of items in place, waiting if there are none */
+size_t channel_stream_read(channel_stream_group_t *g, const void **items,
+                           size_t max) {
+  channel_stream_t *s = g->s;
+  uint64_t len = mapped_length(s);
+  if (g->pos >= len) {
+#if defined(HAVE_FUTEX)
+    /* Appends through any handle in any process bump seq */
+    stream_header_t *h = s->header;
+    atomic_fetch_add(&h->waiters, 1);
+    for (;;) {
+      uint32_t seq = atomic_load(&h->seq);
+      if ((len = mapped_length(s)) > g->pos || atomic_load(&s->closed)) {
+        break;
+      }
+      futex_wait_shared(&h->seq, seq, NULL);
+    }
+    atomic_fetch_sub(&h->waiters, 1);
+#else
+    pthread_mutex_lock(&s->mu);
+    s->waiters++;
+    while ((len = mapped_length(s)) <= g->pos && !atomic_load(&s->closed)) {
+      pthread_cond_wait(&s->cond, &s->mu);
+    }
+    s->waiters--;
+    pthread_mutex_unlock(&s->mu);
+#endif
+    if (len <= g->pos) {
+      return 0;
+    }
+  }
+
+  size_t n = len - g->pos < max ? (size_t)(len - g->pos) : max;
+  *items = s->data + g->pos * s->item_size;
+  g->pos += n;
+  return n;
+}
+
+/* Write the committed offset into the header */
+static void persist_commit(channel_stream_group_t *g) {
+  atomic_store_explicit(&g->rec->offset, g->committed, memory_order_release);
+  g->persisted = g->committed;
+  if (g->s->opts.sync) {
+    msync(g->s->map, STREAM_HEADER_SIZE, MS_SYNC);
+  }
+}
+
+/* Commit in memory, write it out once enough has built up */
+void channel_stream_commit(channel_stream_group_t *g) {
+  g->committed = g->pos;
+  uint64_t behind = g->committed > g->persisted
+                        ? g->committed - g->persisted
+                        : g->persisted - g->committed;
+  if (behind >= g->s->opts.commit_every) {
+    persist_commit(g);
+  }
+}
+
+/* Persist a commit still held back by commit_every */
+void channel_stream_flush(channel_stream_group_t *g) {
+  if (g->committed != g->persisted) {
+    persist_commit(g);
+  }
+}
+
+/* Clamp to the log, the next commit records the new position */
+void channel_stream_seek(channel_stream_group_t *g, uint64_t offset) {
+  uint64_t len = mapped_length(g->s);
+  g->pos = offset < len ? offset : len;
+}
+
+/* The in-memory commit, persisted or not */
+uint64_t channel_stream_committed(channel_stream_group_t *g) {
+  return g->committed;
+}
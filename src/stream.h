@@ -0,0 +1,169 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+/* Persistent stream of channel items. Items are appended to a memory-mapped
+ * log file, and any number of named consumer groups read the same log at
+ * their own pace, each with its own committed offset kept in the file.
+ * Several handles, in one process or many, may open the same file. Appends
+ * and new groups are ordered by a lock on the file, and readers wake for
+ * appends made through any handle */
+
+#include "channels.h"
+
+/* Handle to an open stream */
+typedef struct channel_stream_t channel_stream_t;
+
+/* Handle to a consumer group of a stream */
+typedef struct channel_stream_group_t channel_stream_group_t;
+
+/* Most consumer groups a stream can have */
+#define CHANNEL_STREAM_MAX_GROUPS 63
+
+/* Longest group name, not counting the terminator */
+#define CHANNEL_STREAM_MAX_NAME 47
+
+/* Optional stream settings, a zero-initialized struct gives the defaults */
+typedef struct channel_stream_opts_t {
+  /* Largest the log may grow, the address space reserved for it. 0 for the
+   * default of 1GB. Appends fail beyond it, and a handle never reads past
+   * it, so handles sharing a file should pass the same value */
+  size_t max_bytes;
+
+  /* Items a group may read past its last persisted commit before the
+   * commit is written to the file. After a crash the group resumes from the
+   * persisted offset, so up to this many items are delivered again. 0 for
+   * the default of 64 */
+  size_t commit_every;
+
+  /* msync the log on channel_stream_sync and whenever a group's commit is
+   * written, so data and offsets survive a machine crash and not just a
+   * process crash */
+  bool sync;
+} channel_stream_opts_t;
+
+/**
+ * @brief Opens a stream file, creating it if needed.
+ * The whole log is mapped once, so pointers returned by channel_stream_read
+ * stay valid until the stream is destroyed.
+ *
+ * @param path The log file.
+ * @param item_size The size of an item, which must match an existing log.
+ * @param opts Stream settings, NULL for defaults.
+ * @return A pointer to the stream, NULL on failure or an item size mismatch.
+ */
+channel_stream_t *channel_stream_open(const char *path, size_t item_size,
+                                      const channel_stream_opts_t *opts);
+
+/**
+ * @brief Appends items to the log and wakes readers waiting for them.
+ *
+ * @param s The stream handle.
+ * @param items Pointer to n consecutive items.
+ * @param n The number of items.
+ * @return true on success, false if the log is full or closed.
+ */
+bool channel_stream_append(channel_stream_t *s, const void *items, size_t n);
+
+/**
+ * @brief Appends everything received from a channel until it is closed and
+ * drained, receiving in batches.
+ *
+ * @param s The stream handle.
+ * @param ch The channel to drain.
+ * @return The number of items appended.
+ */
+size_t channel_stream_append_from(channel_stream_t *s, channel_t *ch);
+
+/**
+ * @brief Returns the number of items in the log.
+ *
+ * @param s The stream handle.
+ */
+uint64_t channel_stream_length(channel_stream_t *s);
+
+/**
+ * @brief Writes the log and the group offsets back to the file with msync.
+ *
+ * @param s The stream handle.
+ * @return true on success.
+ */
+bool channel_stream_sync(channel_stream_t *s);
+
+/**
+ * @brief Ends appends through this handle. Its readers get the rest of the
+ * log and then 0 instead of waiting for more. Other handles are unaffected.
+ *
+ * @param s The stream handle.
+ */
+void channel_stream_close(channel_stream_t *s);
+
+/**
+ * @brief Persists every group's commits, unmaps the log and frees the
+ * stream and its groups.
+ *
+ * @param s The stream handle.
+ */
+void channel_stream_destroy(channel_stream_t *s);
+
+/**
+ * @brief Opens a consumer group, creating it at offset 0 if new.
+ * A group resumes reading from its committed offset. Each group has one
+ * handle per stream, and one thread reads it at a time. Read each group
+ * through a single stream handle, as every handle keeps its own position.
+ *
+ * @param s The stream handle.
+ * @param name The group name, at most CHANNEL_STREAM_MAX_NAME bytes.
+ * @return The group handle, NULL if the name is too long or the stream has
+ * no room for another group.
+ */
+channel_stream_group_t *channel_stream_group(channel_stream_t *s,
+                                             const char *name);
+
+/**
+ * @brief Reads the group's next items without copying them.
+ * Blocks until there is at least one unread item, then returns as many as
+ * are in the log, up to max. The items are contiguous in the mapped log.
+ *
+ * @param g The group handle.
+ * @param items Set to the first item.
+ * @param max The most items to read.
+ * @return The number of items read, 0 once the stream is closed and the
+ * group has read everything.
+ */
+size_t channel_stream_read(channel_stream_group_t *g, const void **items,
+                           size_t max);
+
+/**
+ * @brief Commits everything the group has read, so a restart resumes after
+ * it. Persisted once commit_every items have accumulated, or by
+ * channel_stream_flush.
+ *
+ * @param g The group handle.
+ */
+void channel_stream_commit(channel_stream_group_t *g);
+
+/**
+ * @brief Persists the group's commit now.
+ *
+ * @param g The group handle.
+ */
+void channel_stream_flush(channel_stream_group_t *g);
+
+/**
+ * @brief Moves the group's read position, e.g. back to 0 to replay the log.
+ * Takes effect for commits too.
+ *
+ * @param g The group handle.
+ * @param offset The index of the next item to read, at most the length.
+ */
+void channel_stream_seek(channel_stream_group_t *g, uint64_t offset);
+
+/**
+ * @brief Returns the group's committed offset, the next item a restart
+ * would read.
+ *
+ * @param g The group handle.
+ */
+uint64_t channel_stream_committed(channel_stream_group_t *g);
+
+#endif // STREAM_H_
@@ -0,0 +1,277 @@
+#define _GNU_SOURCE
+
+#include "tee.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEE_DEFAULT_BATCH 256
+
+/* How long the thread waits on an idle source before retrying spills */
+#define TEE_SPILL_RETRY_NS 1000000ULL
+
+/* A branch and its spill buffer, items [spill_head, spill_head +
+ * stats.spill_queued) of spill */
+typedef struct tee_branch_t {
+  channel_tee_branch_t cfg;
+
+  char *spill;
+  size_t spill_head;
+  size_t spill_cap;
+
+  channel_tee_stats_t stats;
+} tee_branch_t;
+
+struct channel_tee_t {
+  channel_t *src;
+  size_t item_size;
+
+  /* Settings with the defaults filled in */
+  channel_tee_opts_t opts;
+
+  /* Items received from the source */
+  char *buf;
+
+  tee_branch_t *branches;
+  size_t nbranches;
+
+  /* Protects the branch counters, so stats can be read while sends block */
+  pthread_mutex_t mu;
+
+  pthread_t thread;
+};
+
+/* Add to a branch's counters */
+static void branch_count(channel_tee_t *t, tee_branch_t *b, size_t delivered,
+                         size_t dropped) {
+  pthread_mutex_lock(&t->mu);
+  b->stats.delivered += delivered;
+  b->stats.dropped += dropped;
+  pthread_mutex_unlock(&t->mu);
+}
+
+/* Append items to the spill buffer, growing it up to the branch's limit and
+ * dropping the rest */
+static void spill_push(channel_tee_t *t, tee_branch_t *b, const char *items,
+                       size_t n) {
+  size_t queued = b->stats.spill_queued;
+  size_t limit = b->cfg.spill_limit;
+  size_t keep = n;
+  if (limit && keep > limit - queued) {
+    keep = limit - queued;
+  }
+
+  if (b->spill_head + queued + keep > b->spill_cap) {
+    /* Slide the queued items to the front, then grow if that is not enough */
+    if (b->spill_head) {
+      memmove(b->spill, b->spill + b->spill_head * t->item_size,
+              queued * t->item_size);
+      b->spill_head = 0;
+    }
+    if (queued + keep > b->spill_cap) {
+      size_t cap = b->spill_cap ? b->spill_cap : t->opts.batch;
+      while (cap < queued + keep) {
+        cap *= 2;
+      }
+      char *spill = realloc(b->spill, cap * t->item_size);
+      if (!spill) {
+        keep = b->spill_cap - queued;
+      } else {
+        b->spill = spill;
+        b->spill_cap = cap;
+      }
+    }
+  }
+  if (keep) {
+    memcpy(b->spill + (b->spill_head + queued) * t->item_size, items,
+           keep * t->item_size);
+  }
+
+  pthread_mutex_lock(&t->mu);
+  b->stats.spilled += keep;
+  b->stats.spill_queued += keep;
+  if (b->stats.spill_queued > b->stats.spill_peak) {
+    b->stats.spill_peak = b->stats.spill_queued;
+  }
+  b->stats.dropped += n - keep;
+  pthread_mutex_unlock(&t->mu);
+}
+
+/* Send what the branch has room for from its spill buffer, waiting for room
+ * if block is set */
+static void spill_flush(channel_tee_t *t, tee_branch_t *b, bool block) {
+  size_t queued = b->stats.spill_queued;
+  if (queued == 0) {
+    return;
+  }
+  const char *items = b->spill + b->spill_head * t->item_size;
+  size_t k = block ? channel_send_batch(b->cfg.ch, items, queued)
+                   : channel_try_send_batch(b->cfg.ch, items, queued);
+  b->spill_head = k == queued || block ? 0 : b->spill_head + k;
+
+  pthread_mutex_lock(&t->mu);
+  b->stats.delivered += k;
+  b->stats.spill_queued -= k;
+  if (block) {
+    /* Only a closed or shedding branch takes less */
+    b->stats.dropped += queued - k;
+    b->stats.spill_queued = 0;
+  }
+  pthread_mutex_unlock(&t->mu);
+}
+
+/* Hand a batch to one branch according to its policy */
+static void branch_deliver(channel_tee_t *t, tee_branch_t *b,
+                           const char *items, size_t n) {
+  size_t k;
+  switch (b->cfg.policy) {
+  case CHANNEL_TEE_BLOCK:
+    k = channel_send_batch(b->cfg.ch, items, n);
+    branch_count(t, b, k, n - k);
+    break;
+  case CHANNEL_TEE_DROP:
+    k = channel_try_send_batch(b->cfg.ch, items, n);
+    branch_count(t, b, k, n - k);
+    break;
+  case CHANNEL_TEE_SPILL:
+    /* Spilled items go first, new ones queue up behind them */
+    spill_flush(t, b, false);
+    k = 0;
+    if (b->stats.spill_queued == 0) {
+      k = channel_try_send_batch(b->cfg.ch, items, n);
+      branch_count(t, b, k, 0);
+    }
+    if (k < n) {
+      spill_push(t, b, items + k * t->item_size, n - k);
+    }
+    break;
+  }
+}
+
+/* Whether any branch has spilled items waiting */
+static bool spills_pending(channel_tee_t *t) {
+  for (size_t i = 0; i < t->nbranches; i++) {
+    if (t->branches[i].stats.spill_queued) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Next batch from the source. While spills are pending the wait is cut
+ * short so they get retried even if the source is idle. Returns 0 once the
+ * source is closed and drained */
+static size_t tee_receive(channel_tee_t *t) {
+  for (;;) {
+    if (!spills_pending(t)) {
+      return channel_recv_batch(t->src, t->buf, t->opts.batch);
+    }
+    for (size_t i = 0; i < t->nbranches; i++) {
+      spill_flush(t, &t->branches[i], false);
+    }
+
+    channel_stats_t s;
+    channel_stats(t->src, &s);
+    if (s.queued) {
+      return channel_recv_batch(t->src, t->buf, t->opts.batch);
+    }
+    switch (channel_recv_timeout(t->src, t->buf, TEE_SPILL_RETRY_NS)) {
+    case CHANNEL_OK:
+      return 1;
+    case CHANNEL_CLOSED:
+      return 0;
+    case CHANNEL_TIMEOUT:
+      break;
+    }
+  }
+}
+
+/* Copy every batch to the branches, then finish the spills and close */
+static void *tee_thread(void *arg) {
+  channel_tee_t *t = arg;
+  size_t n;
+  while ((n = tee_receive(t))) {
+    for (size_t i = 0; i < t->nbranches; i++) {
+      branch_deliver(t, &t->branches[i], t->buf, n);
+    }
+  }
+
+  for (size_t i = 0; i < t->nbranches; i++) {
+    spill_flush(t, &t->branches[i], true);
+    if (!t->opts.keep_open) {
+      channel_close(t->branches[i].cfg.ch);
+    }
+  }
+  return NULL;
+}
+
+/* Copy the branches, then start the thread */
+channel_tee_t *channel_tee_create(channel_t *src, size_t item_size,
+                                  const channel_tee_branch_t *branches,
+                                  size_t nbranches,
+                                  const channel_tee_opts_t *opts) {
+  channel_tee_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+  if (item_size == 0 || nbranches == 0) {
+    return NULL;
+  }
+
+  channel_tee_t *t = calloc(1, sizeof(channel_tee_t));
+  if (!t) {
+    return NULL;
+  }
+  t->src = src;
+  t->item_size = item_size;
+  t->opts = *opts;
+  if (t->opts.batch == 0) {
+    t->opts.batch = TEE_DEFAULT_BATCH;
+  }
+  t->nbranches = nbranches;
+  t->buf = malloc(t->opts.batch * item_size);
+  t->branches = calloc(nbranches, sizeof(tee_branch_t));
+  if (!t->buf || !t->branches) {
+    goto fail;
+  }
+  for (size_t i = 0; i < nbranches; i++) {
+    t->branches[i].cfg = branches[i];
+  }
+
+  pthread_mutex_init(&t->mu, NULL);
+  if (pthread_create(&t->thread, NULL, tee_thread, t) != 0) {
+    pthread_mutex_destroy(&t->mu);
+    goto fail;
+  }
+  return t;
+
+fail:
+  free(t->buf);
+  free(t->branches);
+  free(t);
+  return NULL;
+}
+
+/* Snapshot one branch's counters */
+bool channel_tee_stats(channel_tee_t *t, size_t branch,
+                       channel_tee_stats_t *stats) {
+  if (branch >= t->nbranches) {
+    return false;
+  }
+  pthread_mutex_lock(&t->mu);
+  *stats = t->branches[branch].stats;
+  pthread_mutex_unlock(&t->mu);
+  return true;
+}
+
+/* Join the thread, which returns once the source is drained */
+void channel_tee_destroy(channel_tee_t *t) {
+  pthread_join(t->thread, NULL);
+  for (size_t i = 0; i < t->nbranches; i++) {
+    free(t->branches[i].spill);
+  }
+  pthread_mutex_destroy(&t->mu);
+  free(t->buf);
+  free(t->branches);
+  free(t);
+}
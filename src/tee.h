@@ -0,0 +1,101 @@
+#ifndef TEE_H_
+#define TEE_H_
+
+/* Tee stage. A thread receives from one channel in batches and hands every
+ * batch to several downstream channels with one batch send each. Each branch
+ * has its own capacity and consumer, and its own policy for when it cannot
+ * keep up */
+
+#include "channels.h"
+
+/* Handle to a tee stage */
+typedef struct channel_tee_t channel_tee_t;
+
+/* What a branch does with items it has no room for */
+typedef enum {
+  /* Wait for room, holding up the branches after it */
+  CHANNEL_TEE_BLOCK,
+  /* Discard the items that do not fit */
+  CHANNEL_TEE_DROP,
+  /* Buffer them in the stage and deliver them in order as room frees up,
+   * without holding up the other branches */
+  CHANNEL_TEE_SPILL,
+} channel_tee_policy_t;
+
+/* One downstream channel of a tee */
+typedef struct channel_tee_branch_t {
+  /* The channel to feed, with the source's item size */
+  channel_t *ch;
+
+  channel_tee_policy_t policy;
+
+  /* Most items a CHANNEL_TEE_SPILL branch buffers, further items are
+   * dropped. 0 for no limit */
+  size_t spill_limit;
+} channel_tee_branch_t;
+
+/* Optional tee settings, a zero-initialized struct gives the defaults */
+typedef struct channel_tee_opts_t {
+  /* Most items received from the source at once, 0 for the default of 256 */
+  size_t batch;
+
+  /* Leave the branches open when the source is drained instead of closing
+   * them */
+  bool keep_open;
+} channel_tee_opts_t;
+
+/* Counters of one branch, reported by channel_tee_stats */
+typedef struct channel_tee_stats_t {
+  /* Items sent to the branch's channel, and discarded instead */
+  size_t delivered;
+  size_t dropped;
+
+  /* Items that went through the spill buffer, how many are in it now and
+   * the most there ever were */
+  size_t spilled;
+  size_t spill_queued;
+  size_t spill_peak;
+} channel_tee_stats_t;
+
+/**
+ * @brief Starts a thread that copies every item received from a channel to
+ * each branch.
+ * The thread receives up to batch items with channel_recv_batch and sends
+ * them to the branches in order with one batch send each. While a spill
+ * buffer holds items, the thread retries it every millisecond even when the
+ * source is idle. Once the source is closed and drained, spilled items are
+ * delivered, waiting for room, and the branches are closed.
+ *
+ * @param src The channel to drain, which must have no other consumer.
+ * @param item_size The item size of the source and every branch.
+ * @param branches The downstream channels and their policies, copied.
+ * @param nbranches The number of branches.
+ * @param opts Tee settings, NULL for defaults.
+ * @return A pointer to the tee, NULL on failure.
+ */
+channel_tee_t *channel_tee_create(channel_t *src, size_t item_size,
+                                  const channel_tee_branch_t *branches,
+                                  size_t nbranches,
+                                  const channel_tee_opts_t *opts);
+
+/**
+ * @brief Reads a snapshot of one branch's counters.
+ *
+ * @param t The tee handle.
+ * @param branch The branch's index in the array given at creation.
+ * @param stats Written with the current counters.
+ * @return false if there is no such branch.
+ */
+bool channel_tee_stats(channel_tee_t *t, size_t branch,
+                       channel_tee_stats_t *stats);
+
+/**
+ * @brief Waits for the tee to drain the source and deliver its spilled
+ * items, then frees it.
+ * The source must have been closed, or this waits until it is.
+ *
+ * @param t The tee handle.
+ */
+void channel_tee_destroy(channel_tee_t *t);
+
+#endif // TEE_H_
@@ -0,0 +1,452 @@
+#define _GNU_SOURCE
+
+#include "writer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* O_DIRECT block size, also the staging buffer alignment */
+#define WRITER_ALIGN 4096
+
+#define WRITER_DEFAULT_BUFFER (256 * 1024)
+#define WRITER_DEFAULT_BUFFERS 4
+#define WRITER_DEFAULT_INTERVAL_NS 10000000ULL
+
+struct channel_writer_t {
+  channel_t *ch;
+  size_t item_size;
+  int fd;
+
+  /* Settings with the defaults filled in */
+  channel_writer_opts_t opts;
+
+  /* Staging buffers, filled in order as one stream. cur is the buffer being
+   * filled and fill the bytes in it, the buffers before it are full */
+  char **bufs;
+  size_t cur;
+  size_t fill;
+
+  /* Bytes at the front of the stream already in the file, the partial
+   * block an O_DIRECT write has to rewrite */
+  size_t carry;
+
+  /* File offset of the start of the stream */
+  uint64_t offset;
+
+  /* Items staged since the last write */
+  size_t staged;
+
+  /* Whether written data waits for a sync, and when the last sync was */
+  bool dirty;
+  uint64_t synced_at;
+
+  /* Holds the next item when it spans two buffers */
+  char *scratch;
+
+  /* One entry per buffer for pwritev */
+  struct iovec *iov;
+
+  /* Protects stats and finished_at */
+  pthread_mutex_t mu;
+  channel_writer_stats_t stats;
+  uint64_t started_at;
+  uint64_t finished_at;
+
+  pthread_t thread;
+};
+
+/* Current CLOCK_MONOTONIC time in nanoseconds */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Record the first failure, after which nothing more is written */
+static void set_error(channel_writer_t *w, int err) {
+  pthread_mutex_lock(&w->mu);
+  if (!w->stats.error) {
+    w->stats.error = err;
+  }
+  pthread_mutex_unlock(&w->mu);
+}
+
+/* Make the written data durable */
+static void writer_sync(channel_writer_t *w) {
+  if (fdatasync(w->fd) != 0) {
+    set_error(w, errno);
+  }
+  w->dirty = false;
+  w->synced_at = now_ns();
+  pthread_mutex_lock(&w->mu);
+  w->stats.syncs++;
+  pthread_mutex_unlock(&w->mu);
+}
+
+/* pwritev the whole of iov at offset, retrying partial writes */
+static bool write_all(int fd, struct iovec *iov, int cnt, uint64_t offset,
+                      size_t *calls) {
+  while (cnt > 0) {
+    ssize_t n = pwritev(fd, iov, cnt, (off_t)offset);
+    (*calls)++;
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    offset += (uint64_t)n;
+    while (cnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= (ssize_t)iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= (size_t)n;
+    }
+  }
+  return true;
+}
+
+/* Write out everything staged as one pwritev, then start the stream over,
+ * keeping the partial last block in O_DIRECT mode */
+static void writer_flush(channel_writer_t *w) {
+  size_t total = w->cur * w->opts.buffer_size + w->fill;
+  if (w->staged == 0) {
+    return;
+  }
+
+  size_t len = total;
+  size_t last = w->fill;
+  if (w->stats.direct) {
+    /* Pad the last block with zeros, the buffer size is a block multiple */
+    size_t padded = (w->fill + WRITER_ALIGN - 1) & ~(size_t)(WRITER_ALIGN - 1);
+    memset(w->bufs[w->cur] + w->fill, 0, padded - w->fill);
+    len += padded - w->fill;
+    last = padded;
+  }
+
+  bool failed;
+  pthread_mutex_lock(&w->mu);
+  failed = w->stats.error != 0;
+  pthread_mutex_unlock(&w->mu);
+
+  size_t calls = 0;
+  if (!failed) {
+    struct iovec *iov = w->iov;
+    int cnt = 0;
+    for (size_t i = 0; i < w->cur; i++) {
+      iov[cnt++] = (struct iovec){w->bufs[i], w->opts.buffer_size};
+    }
+    if (last) {
+      iov[cnt++] = (struct iovec){w->bufs[w->cur], last};
+    }
+    if (!write_all(w->fd, iov, cnt, w->offset, &calls)) {
+      set_error(w, errno);
+      failed = true;
+    }
+  }
+
+  pthread_mutex_lock(&w->mu);
+  w->stats.writes += calls;
+  if (!failed) {
+    w->stats.items += w->staged;
+    w->stats.bytes += (uint64_t)(total - w->carry);
+    w->stats.bytes_written += len;
+  }
+  pthread_mutex_unlock(&w->mu);
+
+  /* Start the next stream where this one ended */
+  size_t tail = w->stats.direct ? total % WRITER_ALIGN : 0;
+  memmove(w->bufs[0], w->bufs[w->cur] + w->fill - tail, tail);
+  w->offset += total - tail;
+  w->carry = tail;
+  w->cur = 0;
+  w->fill = tail;
+  w->staged = 0;
+
+  if (!failed) {
+    w->dirty = true;
+    if (w->opts.sync == CHANNEL_WRITER_SYNC_BATCH) {
+      writer_sync(w);
+    }
+  }
+}
+
+/* Move to the next buffer once the current one is full, writing once the
+ * last one can't take another whole item */
+static void writer_advance(channel_writer_t *w) {
+  if (w->cur + 1 == w->opts.buffers) {
+    if (w->fill + w->item_size > w->opts.buffer_size) {
+      writer_flush(w);
+    }
+  } else if (w->fill == w->opts.buffer_size) {
+    w->cur++;
+    w->fill = 0;
+  }
+}
+
+/* Stage an item received into scratch, splitting it across buffers */
+static void stage_scratch(channel_writer_t *w) {
+  size_t done = 0;
+  while (done < w->item_size) {
+    size_t room = w->opts.buffer_size - w->fill;
+    size_t n = w->item_size - done < room ? w->item_size - done : room;
+    memcpy(w->bufs[w->cur] + w->fill, w->scratch + done, n);
+    w->fill += n;
+    done += n;
+    if (done < w->item_size) {
+      /* Still in the middle of the item, so this is never the last buffer */
+      w->cur++;
+      w->fill = 0;
+    }
+  }
+  w->staged++;
+  writer_advance(w);
+}
+
+/* Whether the channel has nothing queued */
+static bool channel_idle(channel_t *ch) {
+  channel_stats_t s;
+  channel_stats(ch, &s);
+  return s.queued == 0;
+}
+
+/* Receive batches into the buffers until the channel is closed and empty,
+ * writing whenever the buffers fill or the channel runs dry */
+static void *writer_thread(void *arg) {
+  channel_writer_t *w = arg;
+  bool drained = false;
+
+  for (;;) {
+    /* Never sleep on the channel with data staged or due for a sync */
+    bool interval = w->opts.sync == CHANNEL_WRITER_SYNC_INTERVAL;
+    if (!drained && (w->staged || (interval && w->dirty))) {
+      drained = channel_idle(w->ch);
+    }
+    if (drained && w->staged) {
+      writer_flush(w);
+    }
+
+    if (drained && interval && w->dirty) {
+      uint64_t due = w->synced_at + w->opts.sync_interval_ns;
+      uint64_t now = now_ns();
+      channel_status_t status = CHANNEL_TIMEOUT;
+      if (due > now) {
+        status = channel_recv_timeout(w->ch, w->scratch, due - now);
+      }
+      if (status == CHANNEL_TIMEOUT) {
+        writer_sync(w);
+        continue;
+      }
+      if (status == CHANNEL_CLOSED) {
+        break;
+      }
+      if (interval && w->dirty && now_ns() >= due) {
+        writer_sync(w);
+      }
+      drained = false;
+      stage_scratch(w);
+      continue;
+    }
+
+    size_t room = (w->opts.buffer_size - w->fill) / w->item_size;
+    if (room == 0) {
+      /* The next item spans two buffers, take it alone so the stream stays
+       * gapless */
+      if (!channel_recv(w->ch, w->scratch)) {
+        break;
+      }
+      drained = false;
+      stage_scratch(w);
+      continue;
+    }
+
+    size_t n = channel_recv_batch(w->ch, w->bufs[w->cur] + w->fill, room);
+    if (n == 0) {
+      break;
+    }
+    w->fill += n * w->item_size;
+    w->staged += n;
+    /* A short batch means the channel was emptied */
+    drained = n < room;
+    writer_advance(w);
+    if (interval && w->dirty &&
+        now_ns() >= w->synced_at + w->opts.sync_interval_ns) {
+      writer_sync(w);
+    }
+  }
+
+  writer_flush(w);
+  if (w->stats.direct && ftruncate(w->fd, (off_t)(w->offset + w->carry))) {
+    set_error(w, errno);
+  }
+  if (w->opts.sync != CHANNEL_WRITER_SYNC_NONE) {
+    writer_sync(w);
+  }
+
+  pthread_mutex_lock(&w->mu);
+  w->finished_at = now_ns();
+  pthread_mutex_unlock(&w->mu);
+  return NULL;
+}
+
+/* Free the buffers, the file is closed separately */
+static void free_buffers(channel_writer_t *w) {
+  if (w->bufs) {
+    for (size_t i = 0; i < w->opts.buffers; i++) {
+      free(w->bufs[i]);
+    }
+  }
+  free(w->bufs);
+  free(w->scratch);
+  free(w->iov);
+}
+
+/* Open the file, falling back to buffered writes if O_DIRECT is refused */
+static int open_file(channel_writer_t *w, const char *path) {
+  int flags = O_CREAT | O_CLOEXEC | (w->opts.append ? 0 : O_TRUNC);
+  if (w->opts.direct) {
+    /* Appending reads back the partial last block */
+    int fd = open(path, flags | O_RDWR | O_DIRECT, 0644);
+    if (fd >= 0) {
+      w->stats.direct = true;
+      return fd;
+    }
+    if (errno != EINVAL) {
+      return -1;
+    }
+  }
+  return open(path, flags | O_WRONLY, 0644);
+}
+
+/* Position the stream at the end of the file, reading in the partial last
+ * block when it has to be rewritten */
+static bool seek_end(channel_writer_t *w) {
+  struct stat st;
+  if (fstat(w->fd, &st) != 0) {
+    return false;
+  }
+  uint64_t size = (uint64_t)st.st_size;
+  w->carry = w->stats.direct ? size % WRITER_ALIGN : 0;
+  w->offset = size - w->carry;
+  w->fill = w->carry;
+  if (w->carry) {
+    ssize_t n = pread(w->fd, w->bufs[0], WRITER_ALIGN, (off_t)w->offset);
+    if (n < (ssize_t)w->carry) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Allocate the buffers, open the file and start the thread */
+channel_writer_t *channel_writer_create(channel_t *ch, size_t item_size,
+                                        const char *path,
+                                        const channel_writer_opts_t *opts) {
+  channel_writer_opts_t defaults = {0};
+  if (opts == NULL) {
+    opts = &defaults;
+  }
+  if (item_size == 0) {
+    return NULL;
+  }
+
+  channel_writer_t *w = calloc(1, sizeof(channel_writer_t));
+  if (!w) {
+    return NULL;
+  }
+  w->ch = ch;
+  w->item_size = item_size;
+  w->opts = *opts;
+  if (w->opts.buffer_size == 0) {
+    w->opts.buffer_size = WRITER_DEFAULT_BUFFER;
+  }
+  /* A buffer must hold an item after a carried partial block */
+  if (w->opts.buffer_size < item_size + WRITER_ALIGN) {
+    w->opts.buffer_size = item_size + WRITER_ALIGN;
+  }
+  w->opts.buffer_size = (w->opts.buffer_size + WRITER_ALIGN - 1) &
+                        ~(size_t)(WRITER_ALIGN - 1);
+  if (w->opts.buffers == 0) {
+    w->opts.buffers = WRITER_DEFAULT_BUFFERS;
+  }
+  if (w->opts.sync_interval_ns == 0) {
+    w->opts.sync_interval_ns = WRITER_DEFAULT_INTERVAL_NS;
+  }
+
+  w->fd = -1;
+  w->bufs = calloc(w->opts.buffers, sizeof(char *));
+  w->scratch = malloc(item_size);
+  w->iov = malloc(w->opts.buffers * sizeof(struct iovec));
+  if (!w->bufs || !w->scratch || !w->iov) {
+    goto fail;
+  }
+  for (size_t i = 0; i < w->opts.buffers; i++) {
+    if (posix_memalign((void **)&w->bufs[i], WRITER_ALIGN,
+                       w->opts.buffer_size) != 0) {
+      w->bufs[i] = NULL;
+      goto fail;
+    }
+  }
+
+  w->fd = open_file(w, path);
+  if (w->fd < 0 || !seek_end(w)) {
+    goto fail;
+  }
+
+  pthread_mutex_init(&w->mu, NULL);
+  w->started_at = now_ns();
+  w->synced_at = w->started_at;
+  if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+    pthread_mutex_destroy(&w->mu);
+    goto fail;
+  }
+  return w;
+
+fail:
+  if (w->fd >= 0) {
+    close(w->fd);
+  }
+  free_buffers(w);
+  free(w);
+  return NULL;
+}
+
+/* Snapshot the counters and derive the rates */
+void channel_writer_stats(channel_writer_t *w, channel_writer_stats_t *stats) {
+  pthread_mutex_lock(&w->mu);
+  *stats = w->stats;
+  uint64_t end = w->finished_at ? w->finished_at : now_ns();
+  pthread_mutex_unlock(&w->mu);
+
+  uint64_t elapsed = end - w->started_at;
+  stats->bytes_per_sec =
+      elapsed ? (double)stats->bytes * 1e9 / (double)elapsed : 0;
+  stats->write_amplification =
+      stats->bytes ? (double)stats->bytes_written / (double)stats->bytes : 0;
+}
+
+/* Wait for the thread to finish the closed channel, then release it all */
+bool channel_writer_destroy(channel_writer_t *w,
+                            channel_writer_stats_t *stats) {
+  pthread_join(w->thread, NULL);
+  if (stats) {
+    channel_writer_stats(w, stats);
+  }
+  bool ok = w->stats.error == 0;
+  if (close(w->fd) != 0) {
+    ok = false;
+  }
+  pthread_mutex_destroy(&w->mu);
+  free_buffers(w);
+  free(w);
+  return ok;
+}
@@ -0,0 +1,112 @@
+#ifndef WRITER_H_
+#define WRITER_H_
+
+/* Writer stage. A thread drains a channel in large batches straight into
+ * aligned buffers and appends the items to a file with pwritev, optionally
+ * through O_DIRECT, syncing by a group-commit policy */
+
+#include "channels.h"
+
+/* Handle to a writer stage */
+typedef struct channel_writer_t channel_writer_t;
+
+/* When written data is made durable */
+typedef enum {
+  /* Never sync, leave it to the kernel */
+  CHANNEL_WRITER_SYNC_NONE,
+  /* fdatasync after every write, so every item received since the last
+   * write shares one sync */
+  CHANNEL_WRITER_SYNC_BATCH,
+  /* fdatasync at most every sync_interval_ns while there is unsynced data */
+  CHANNEL_WRITER_SYNC_INTERVAL,
+} channel_writer_sync_t;
+
+/* Optional writer settings, a zero-initialized struct gives the defaults */
+typedef struct channel_writer_opts_t {
+  /* Size of each staging buffer, rounded up to 4096, 0 for the default of
+   * 256KB. An item may span two buffers */
+  size_t buffer_size;
+
+  /* Staging buffers gathered into one pwritev, 0 for the default of 4 */
+  size_t buffers;
+
+  /* Keep the file's contents and add to its end instead of truncating it */
+  bool append;
+
+  /* Bypass the page cache with O_DIRECT. Writes are then padded out to
+   * whole 4096-byte blocks, the partial last block is rewritten by the next
+   * write and the padding is truncated away when the stage finishes. Falls
+   * back to buffered writes if the file system refuses O_DIRECT */
+  bool direct;
+
+  channel_writer_sync_t sync;
+
+  /* Period of CHANNEL_WRITER_SYNC_INTERVAL, 0 for the default of 10ms */
+  uint64_t sync_interval_ns;
+} channel_writer_opts_t;
+
+/* Counters reported by channel_writer_stats */
+typedef struct channel_writer_stats_t {
+  /* Items and their bytes written to the file */
+  size_t items;
+  uint64_t bytes;
+
+  /* Bytes handed to the kernel including O_DIRECT padding and rewrites */
+  uint64_t bytes_written;
+
+  /* pwritev and fdatasync calls */
+  size_t writes;
+  size_t syncs;
+
+  /* Whether O_DIRECT is in use */
+  bool direct;
+
+  /* errno of the first failed write or sync, after which received items are
+   * discarded. 0 if none failed */
+  int error;
+
+  /* Item bytes per second since the stage started, until it finished */
+  double bytes_per_sec;
+
+  /* bytes_written / bytes, 0 before anything is written */
+  double write_amplification;
+} channel_writer_stats_t;
+
+/**
+ * @brief Starts a thread that appends every item received from a channel to
+ * a file.
+ * Items are written verbatim, item_size bytes each, in the order received.
+ * The thread receives with channel_recv_batch directly into the staging
+ * buffers and writes once they are all full or the channel runs empty.
+ *
+ * @param ch The channel to drain, which must have no other consumer.
+ * @param item_size The channel's item size.
+ * @param path The file to write, created if needed.
+ * @param opts Writer settings, NULL for defaults.
+ * @return A pointer to the writer, NULL on failure.
+ */
+channel_writer_t *channel_writer_create(channel_t *ch, size_t item_size,
+                                        const char *path,
+                                        const channel_writer_opts_t *opts);
+
+/**
+ * @brief Reads a snapshot of the writer's counters.
+ *
+ * @param w The writer handle.
+ * @param stats Written with the current counters.
+ */
+void channel_writer_stats(channel_writer_t *w, channel_writer_stats_t *stats);
+
+/**
+ * @brief Waits for the writer to drain the channel, then syncs (unless the
+ * policy is CHANNEL_WRITER_SYNC_NONE), closes the file and frees the writer.
+ * The channel must have been closed, or this waits until it is.
+ *
+ * @param w The writer handle.
+ * @param stats Written with the final counters if not NULL.
+ * @return true if every item was written, false if a write or sync failed.
+ */
+bool channel_writer_destroy(channel_writer_t *w,
+                            channel_writer_stats_t *stats);
+
+#endif // WRITER_H_
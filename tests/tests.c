@@ -1,11 +1,32 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/alog.h"
+#include "../src/bus.h"
 #include "../src/channels.h"
+#include "../src/channels_inline.h"
+#include "../src/ingest.h"
+#include "../src/percpu.h"
+#include "../src/pool.h"
+#include "../src/rpc.h"
+#include "../src/stream.h"
+#include "../src/tee.h"
+#include "../src/writer.h"
 #include <assert.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
 // Test counter
 static int tests_passed = 0;
 static int tests_failed = 0;
@@ -40,6 +61,11 @@ static int tests_failed = 0;
     }                                                                          \
   } while (0)
 
+static void sleep_ms(long ms) {
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
 // =============================================================================
 // Basic Functionality Tests
 // =============================================================================
@@ -125,6 +151,20 @@ TEST(test_different_types) {
   channel_destroy(ch2);
 }
 
+TEST(test_priority_inherit_channel) {
+  channel_opts_t opts = {.priority_inherit = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 10, &opts);
+  ASSERT(ch != NULL, "Priority-inheritance channel creation failed");
+
+  int val = 7;
+  ASSERT(channel_send(ch, &val), "Send failed");
+  val = 0;
+  ASSERT(channel_recv(ch, &val), "Receive failed");
+  ASSERT_EQ(val, 7, "Received wrong value");
+
+  channel_destroy(ch);
+}
+
 // =============================================================================
 // Bounded Channel Tests
 // =============================================================================
@@ -171,6 +211,471 @@ TEST(test_bounded_wraparound) {
   channel_destroy(ch);
 }
 
+/* Batches that wrap around the end of the queue keep their order */
+static void check_batch_wraparound(bool magic_ring) {
+  channel_opts_t opts = {.magic_ring = magic_ring};
+  channel_t *ch = channel_create_opts(sizeof(int), 1000, &opts);
+  ASSERT(ch != NULL, "Channel creation failed");
+
+  int items[1500];
+  for (int i = 0; i < 1500; i++) {
+    items[i] = i;
+  }
+  int out[1500];
+  int next = 0;
+
+  // Move the pointers near the end so the second batch wraps
+  ASSERT_EQ(channel_send_batch(ch, items, 700), 700, "First batch short");
+  ASSERT_EQ(channel_recv_batch(ch, out, 600), 600, "First receive short");
+  for (int i = 0; i < 600; i++) {
+    ASSERT_EQ(out[i], next++, "Items out of order");
+  }
+
+  ASSERT_EQ(channel_send_batch(ch, items + 700, 800), 800,
+            "Wrapping batch short");
+  size_t n;
+  while (next < 1500 && (n = channel_recv_batch(ch, out, 1500)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      ASSERT_EQ(out[i], next++, "Wrapped items out of order");
+    }
+  }
+  ASSERT_EQ(next, 1500, "Items missing");
+
+  channel_close(ch);
+  ASSERT_EQ(channel_send_batch(ch, items, 1), 0, "Send after close succeeded");
+  ASSERT_EQ(channel_recv_batch(ch, out, 1), 0, "Closed channel not drained");
+  channel_destroy(ch);
+}
+
+TEST(test_batch_wraparound) { check_batch_wraparound(false); }
+
+TEST(test_magic_ring_batch) {
+#if defined(__linux__)
+  check_batch_wraparound(true);
+
+  channel_opts_t opts = {.magic_ring = true};
+  ASSERT(channel_create_opts(sizeof(int), 0, &opts) == NULL,
+         "Unbounded magic ring should fail");
+
+  // The ring is rounded up to whole pages, the capacity is not
+  channel_t *ch = channel_create_opts(sizeof(int), 100, &opts);
+  ASSERT(ch != NULL, "Channel creation failed");
+  int sent = 0;
+  while (sent < 1000 && channel_try_send(ch, &sent)) {
+    sent++;
+  }
+  ASSERT_EQ(sent, 100, "Magic ring should fill at the capacity asked for");
+  int items[10] = {0};
+  ASSERT_EQ(channel_try_send_batch(ch, items, 10), 0,
+            "Full magic ring should take no batch items");
+  channel_destroy(ch);
+#endif
+}
+
+/* Pages of a drained queue are released after the idle period, and the
+ * queue still works once they have been */
+static void check_release_idle(bool magic_ring) {
+  enum { ITEM = 1024, CAPACITY = 1024 };
+  channel_opts_t opts = {.release_idle_ns = 20000000,
+                         .magic_ring = magic_ring};
+  channel_t *ch = channel_create_opts(ITEM, CAPACITY, &opts);
+  ASSERT(ch != NULL, "Channel creation failed");
+
+  static char item[ITEM];
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < CAPACITY; i++) {
+      memset(item, i & 0xff, ITEM);
+      ASSERT(channel_send(ch, item), "Send failed");
+    }
+    for (int i = 0; i < CAPACITY; i++) {
+      ASSERT(channel_recv(ch, item), "Receive failed");
+      ASSERT_EQ(item[ITEM - 1], (char)(i & 0xff), "Item corrupted");
+    }
+  }
+
+  channel_stats_t stats;
+  channel_stats(ch, &stats);
+  ASSERT_EQ(stats.released, 0, "Released pages while busy");
+
+  // Stay empty past the idle period, the next operation releases
+  sleep_ms(50);
+  memset(item, 7, ITEM);
+  ASSERT(channel_send(ch, item), "Send failed");
+  channel_stats(ch, &stats);
+  ASSERT(stats.released >= (size_t)ITEM * CAPACITY / 2,
+         "Idle pages were not released");
+
+  ASSERT(channel_recv(ch, item), "Receive failed");
+  ASSERT_EQ(item[0], 7, "Live item lost by release");
+  channel_destroy(ch);
+}
+
+TEST(test_release_idle_pages) { check_release_idle(false); }
+
+TEST(test_release_idle_magic_ring) {
+#if defined(__linux__)
+  check_release_idle(true);
+#endif
+}
+
+TEST(test_swap_send_recv) {
+  const size_t SIZE = 4096;
+  channel_opts_t opts = {.swap_buffers = true};
+  channel_t *ch = channel_create_opts(SIZE, 4, &opts);
+  ASSERT(ch != NULL, "Swap channel creation failed");
+
+  char *sent = malloc(SIZE);
+  memset(sent, 'A', SIZE);
+  void *prod_buf = sent;
+  ASSERT(channel_send_swap(ch, &prod_buf), "Swap send failed");
+  ASSERT(prod_buf != sent, "Producer should get the slot's free buffer");
+
+  void *cons_buf = malloc(SIZE);
+  ASSERT(channel_recv_swap(ch, &cons_buf), "Swap receive failed");
+  ASSERT(cons_buf == sent, "Buffer should move without copying");
+  ASSERT(((char *)cons_buf)[0] == 'A' && ((char *)cons_buf)[SIZE - 1] == 'A',
+         "Swapped buffer corrupted");
+
+  // Plain send/recv still copy through the slot buffers
+  memset(prod_buf, 'B', SIZE);
+  ASSERT(channel_send(ch, prod_buf), "Copy send failed");
+  memset(cons_buf, 0, SIZE);
+  ASSERT(channel_recv(ch, cons_buf), "Copy receive failed");
+  ASSERT(((char *)cons_buf)[SIZE - 1] == 'B', "Copied item corrupted");
+
+  free(prod_buf);
+  free(cons_buf);
+  channel_destroy(ch);
+}
+
+TEST(test_swap_requires_bounded) {
+  channel_opts_t opts = {.swap_buffers = true};
+  ASSERT(channel_create_opts(64, 0, &opts) == NULL,
+         "Unbounded swap channel should be rejected");
+
+  channel_t *ch = channel_create(64, 4);
+  void *buf = NULL;
+  ASSERT(!channel_send_swap(ch, &buf), "Swap send needs a swap channel");
+  channel_destroy(ch);
+}
+
+// =============================================================================
+// Fair Queueing Tests
+// =============================================================================
+
+TEST(test_fair_weighted_order) {
+  uint32_t weights[] = {3, 1};
+  channel_opts_t opts = {.tenants = 2, .tenant_weights = weights};
+  channel_t *ch = channel_create_opts(sizeof(int), 8, &opts);
+  ASSERT(ch != NULL, "Fair channel creation failed");
+
+  // Tenant 0 fills its whole sub-queue, tenant 1 can still send
+  for (int i = 0; i < 8; i++) {
+    ASSERT(channel_send(ch, &i), "Send to tenant 0 failed");
+  }
+  for (int i = 100; i < 104; i++) {
+    ASSERT(channel_send_tenant(ch, &i, 1), "Send to tenant 1 failed");
+  }
+
+  // Three items from tenant 0 for every one from tenant 1
+  int expected[] = {0, 1, 2, 100, 3, 4, 5, 101, 6, 7, 102, 103};
+  int got[12];
+  size_t n = channel_recv_batch(ch, got, 5);
+  ASSERT_EQ(n, 5, "Batch receive should take 5 items");
+  for (int i = 5; i < 12; i++) {
+    ASSERT(channel_recv(ch, &got[i]), "Receive failed");
+  }
+  for (int i = 0; i < 12; i++) {
+    ASSERT_EQ(got[i], expected[i], "Items served out of weighted order");
+  }
+
+  channel_destroy(ch);
+}
+
+static void *tenant_sender_thread(void *arg) {
+  channel_t *ch = arg;
+  int *sent = malloc(sizeof(int));
+  *sent = 0;
+  int val = 0;
+  while (channel_send_tenant(ch, &val, 0)) {
+    (*sent)++;
+  }
+  return sent;
+}
+
+TEST(test_fair_full_tenant_blocks_alone) {
+  channel_opts_t opts = {.tenants = 3};
+  channel_t *ch = channel_create_opts(sizeof(int), 4, &opts);
+
+  // A sender blocks on its full sub-queue while another tenant gets through
+  pthread_t t;
+  pthread_create(&t, NULL, tenant_sender_thread, ch);
+  sleep_ms(20);
+  int val = 7;
+  ASSERT(channel_send_tenant(ch, &val, 2), "Other tenant should not block");
+  ASSERT(channel_recv(ch, &val), "Receive failed");
+  ASSERT_EQ(val, 0, "Tenant 0 was queued first");
+  ASSERT(channel_recv(ch, &val), "Receive failed");
+  ASSERT_EQ(val, 7, "Tenant 2 should be served next");
+
+  // Closing releases the blocked sender
+  sleep_ms(20);
+  channel_close(ch);
+  int *sent;
+  pthread_join(t, (void **)&sent);
+  ASSERT_EQ(*sent, 5, "Tenant 0 should have refilled its freed slot");
+  free(sent);
+  channel_destroy(ch);
+}
+
+TEST(test_fair_requires_plain_bounded) {
+  channel_opts_t opts = {.tenants = 2};
+  ASSERT(channel_create_opts(sizeof(int), 0, &opts) == NULL,
+         "Unbounded fair channel should be rejected");
+  opts.expiring_items = true;
+  ASSERT(channel_create_opts(sizeof(int), 4, &opts) == NULL,
+         "Fair channel with expiry should be rejected");
+
+  channel_t *ch = channel_create(sizeof(int), 4);
+  int val = 1;
+  ASSERT(!channel_send_tenant(ch, &val, 0), "Plain channel has no tenants");
+  channel_destroy(ch);
+
+  opts.expiring_items = false;
+  ch = channel_create_opts(sizeof(int), 4, &opts);
+  ASSERT(!channel_send_tenant(ch, &val, 2), "Tenant out of range");
+  channel_destroy(ch);
+}
+
+// =============================================================================
+// Deadline Order Tests
+// =============================================================================
+
+TEST(test_deadline_order) {
+  channel_opts_t opts = {.deadline_order = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 16, &opts);
+  ASSERT(ch != NULL, "Deadline channel creation failed");
+
+  uint64_t deadline;
+  ASSERT(!channel_peek_deadline(ch, &deadline), "Empty channel has no peek");
+
+  int none = -1;
+  channel_send(ch, &none);
+  int deadlines[] = {50, 10, 40, 30, 20, 60, 5};
+  for (int i = 0; i < 7; i++) {
+    ASSERT(channel_send_deadline(ch, &deadlines[i], (uint64_t)deadlines[i]),
+           "Deadline send failed");
+  }
+  ASSERT(channel_peek_deadline(ch, &deadline), "Peek failed");
+  ASSERT_EQ(deadline, 5, "Peek should report the earliest deadline");
+
+  int expected[] = {5, 10, 20, 30, 40, 50, 60, -1};
+  for (int i = 0; i < 8; i++) {
+    int val;
+    ASSERT(channel_recv(ch, &val), "Receive failed");
+    ASSERT_EQ(val, expected[i], "Items not in deadline order");
+  }
+
+  channel_t *plain = channel_create(sizeof(int), 4);
+  ASSERT(!channel_send_deadline(plain, &none, 1),
+         "Deadline send needs deadline_order");
+  channel_destroy(plain);
+  channel_destroy(ch);
+}
+
+TEST(test_deadline_order_unbounded) {
+  channel_opts_t opts = {.deadline_order = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 0, &opts);
+
+  // Interleave sends and receives while the heap grows
+  const int n = 5000;
+  unsigned seed = 12345;
+  int last = -1;
+  int received = 0;
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+    int d = (int)((seed >> 8) % 1000000);
+    channel_send_deadline(ch, &d, (uint64_t)d);
+    if (i % 3 == 0) {
+      int val;
+      channel_recv(ch, &val);
+      received++;
+    }
+  }
+
+  // What remains comes out sorted
+  for (; received < n; received++) {
+    int val;
+    ASSERT(channel_recv(ch, &val), "Receive failed");
+    ASSERT(val >= last, "Heap returned items out of order");
+    last = val;
+  }
+  channel_destroy(ch);
+}
+
+// =============================================================================
+// Expiry Tests
+// =============================================================================
+
+TEST(test_ttl_drops_expired) {
+  channel_opts_t opts = {.expiring_items = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 10, &opts);
+
+  for (int i = 0; i < 3; i++) {
+    ASSERT(channel_send_ttl(ch, &i, 1000000), "TTL send failed");
+  }
+  int live = 99;
+  ASSERT(channel_send(ch, &live), "Send failed");
+  int fresh = 100;
+  ASSERT(channel_send_ttl(ch, &fresh, 60000000000ULL), "TTL send failed");
+  sleep_ms(10);
+
+  int val;
+  ASSERT(channel_recv(ch, &val), "Receive failed");
+  ASSERT_EQ(val, 99, "Expired items should be skipped");
+  ASSERT(channel_recv(ch, &val), "Receive failed");
+  ASSERT_EQ(val, 100, "Unexpired TTL item should be delivered");
+
+  channel_stats_t stats;
+  channel_stats(ch, &stats);
+  ASSERT_EQ(stats.expired, 3, "Expired items not counted");
+
+  channel_destroy(ch);
+}
+
+TEST(test_ttl_bounded_scan) {
+  channel_opts_t opts = {.expiring_items = true, .max_expired_scan = 2};
+  channel_t *ch = channel_create_opts(sizeof(int), 10, &opts);
+
+  for (int i = 0; i < 5; i++) {
+    channel_send_ttl(ch, &i, 1000000);
+  }
+  int live = 7;
+  channel_send(ch, &live);
+  sleep_ms(10);
+
+  int val;
+  ASSERT(channel_recv(ch, &val), "Receive failed");
+  ASSERT_EQ(val, 7, "Bounded scan should still reach the live item");
+
+  channel_stats_t stats;
+  channel_stats(ch, &stats);
+  ASSERT_EQ(stats.expired, 5, "Expired items not counted");
+
+  // Expired items alone leave the channel empty
+  channel_send_ttl(ch, &live, 1000000);
+  sleep_ms(10);
+  channel_close(ch);
+  ASSERT(!channel_recv(ch, &val), "Only expired items were left");
+
+  channel_destroy(ch);
+}
+
+TEST(test_ttl_requires_option) {
+  channel_t *ch = channel_create(sizeof(int), 10);
+  int val = 1;
+  ASSERT(!channel_send_ttl(ch, &val, 1000), "TTL send needs expiring_items");
+  channel_destroy(ch);
+}
+
+TEST(test_codel_drops_standing_queue) {
+  channel_opts_t opts = {.codel_target_ns = 1000000,
+                         .codel_interval_ns = 5000000};
+  channel_t *ch = channel_create_opts(sizeof(int), 100, &opts);
+
+  for (int i = 0; i < 100; i++) {
+    channel_send(ch, &i);
+  }
+  sleep_ms(20);
+
+  // The first receive only notices the delay, a later one starts dropping
+  int val;
+  int received = 0;
+  ASSERT(channel_recv(ch, &val), "Receive failed");
+  received++;
+  sleep_ms(10);
+  while (received < 100) {
+    channel_stats_t stats;
+    channel_stats(ch, &stats);
+    if (received + (int)stats.dropped == 100) {
+      break;
+    }
+    ASSERT(channel_recv(ch, &val), "Receive failed");
+    received++;
+  }
+
+  channel_stats_t stats;
+  channel_stats(ch, &stats);
+  ASSERT(stats.dropped > 0, "CoDel should drop from a standing queue");
+  ASSERT_EQ(received + (int)stats.dropped, 100, "Items lost or duplicated");
+  ASSERT_EQ(val, 99, "The last item should never be dropped");
+
+  channel_destroy(ch);
+}
+
+TEST(test_codel_sheds_sends) {
+  channel_opts_t opts = {.codel_target_ns = 1000000,
+                         .codel_interval_ns = 2000000,
+                         .codel_shed_sends = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 100, &opts);
+
+  for (int i = 0; i < 10; i++) {
+    channel_send(ch, &i);
+  }
+  sleep_ms(5);
+  int val = 10;
+  ASSERT(channel_send(ch, &val), "Send above target starts the interval");
+  sleep_ms(5);
+  val = 11;
+  ASSERT(!channel_send(ch, &val), "Shed send should report failure");
+
+  channel_stats_t stats;
+  channel_stats(ch, &stats);
+  ASSERT_EQ(stats.dropped, 1, "Send after a full interval should be shed");
+
+  // Shed items are left out of a batch's count
+  int batch[3] = {12, 13, 14};
+  ASSERT_EQ(channel_send_batch(ch, batch, 3), 0,
+            "Shed batch items should not count as sent");
+  channel_stats(ch, &stats);
+  ASSERT_EQ(stats.dropped, 4, "Every shed batch item should count as dropped");
+
+  channel_close(ch);
+  int received = 0;
+  while (channel_recv(ch, &val)) {
+    received++;
+  }
+  channel_stats(ch, &stats);
+  ASSERT_EQ(received + (int)stats.dropped, 15, "Items lost or duplicated");
+  ASSERT_EQ(val, 10, "Shed item should never be delivered");
+
+  channel_destroy(ch);
+}
+
+TEST(test_codel_sends_leave_dequeue_state) {
+  channel_opts_t opts = {.codel_target_ns = 1000000,
+                         .codel_interval_ns = 2000000,
+                         .codel_shed_sends = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 100, &opts);
+
+  for (int i = 0; i < 10; i++) {
+    channel_send(ch, &i);
+  }
+  sleep_ms(5);
+  int val = 10;
+  ASSERT(channel_send(ch, &val), "Send above target starts the interval");
+  sleep_ms(5);
+
+  // The first receive above target only starts the receiver's interval,
+  // however long ago a sender started its own
+  ASSERT(channel_recv(ch, &val) && val == 0, "Head should be delivered");
+  channel_stats_t stats;
+  channel_stats(ch, &stats);
+  ASSERT_EQ(stats.dropped, 0, "A send should not start the drop interval");
+
+  channel_destroy(ch);
+}
+
 // =============================================================================
 // Unbounded Channel Tests
 // =============================================================================
@@ -244,6 +749,103 @@ TEST(test_send_after_close) {
   channel_destroy(ch);
 }
 
+static bool check_recv_timeout(channel_lock_t lock) {
+  channel_opts_t opts = {.lock = lock};
+  channel_t *ch = channel_create_opts(sizeof(int), 4, &opts);
+  if (!ch) {
+    return false;
+  }
+
+  int val = 7;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bool ok = channel_recv_timeout(ch, &val, 20000000) == CHANNEL_TIMEOUT;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long waited_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                   (end.tv_nsec - start.tv_nsec) / 1000000;
+  ok = ok && waited_ms >= 19 && val == 7;
+
+  int sent = 3;
+  channel_send(ch, &sent);
+  ok = ok && channel_recv_timeout(ch, &val, 20000000) == CHANNEL_OK &&
+       val == 3;
+
+  channel_close(ch);
+  ok = ok && channel_recv_timeout(ch, &val, 20000000) == CHANNEL_CLOSED;
+  channel_destroy(ch);
+  return ok;
+}
+
+TEST(test_recv_timeout) {
+  ASSERT(check_recv_timeout(CHANNEL_LOCK_MUTEX),
+         "Timed receive returned the wrong status");
+}
+
+TEST(test_recv_timeout_queue_lock) {
+  ASSERT(check_recv_timeout(CHANNEL_LOCK_QUEUE),
+         "Timed receive returned the wrong status");
+}
+
+// Fills a bounded channel with non-blocking sends
+static bool check_try_send(bool adaptive) {
+  channel_opts_t opts = {.adaptive = adaptive};
+  channel_t *ch = channel_create_opts(sizeof(int), 2, &opts);
+  int val = 1;
+  bool ok = channel_try_send(ch, &val) && channel_try_send(ch, &val) &&
+            !channel_try_send(ch, &val);
+  ok = ok && channel_recv(ch, &val) && channel_try_send(ch, &val);
+  channel_close(ch);
+  ok = ok && !channel_try_send(ch, &val);
+  channel_destroy(ch);
+  return ok;
+}
+
+TEST(test_try_send) {
+  ASSERT(check_try_send(false), "Try send on locked channel misbehaved");
+  ASSERT(check_try_send(true), "Try send on adaptive channel misbehaved");
+}
+
+// Drains a channel with non-blocking receives
+static bool check_try_recv(bool adaptive) {
+  channel_opts_t opts = {.adaptive = adaptive};
+  channel_t *ch = channel_create_opts(sizeof(int), 2, &opts);
+  int val = 0;
+  bool ok = !channel_try_recv(ch, &val) && val == 0;
+  int sent[2] = {4, 5};
+  channel_send(ch, &sent[0]);
+  channel_send(ch, &sent[1]);
+  ok = ok && channel_try_recv(ch, &val) && val == 4;
+  ok = ok && channel_try_recv(ch, &val) && val == 5;
+  ok = ok && !channel_try_recv(ch, &val);
+  channel_send(ch, &sent[0]);
+  channel_close(ch);
+  ok = ok && channel_try_recv(ch, &val) && val == 4;
+  ok = ok && !channel_try_recv(ch, &val);
+  channel_destroy(ch);
+  return ok;
+}
+
+TEST(test_try_send_batch) {
+  channel_t *ch = channel_create(sizeof(int), 4);
+  int items[6] = {0, 1, 2, 3, 4, 5};
+  ASSERT_EQ(channel_try_send_batch(ch, items, 3), 3, "Batch should fit");
+  ASSERT_EQ(channel_try_send_batch(ch, items + 3, 3), 1,
+            "Only the room left should be filled");
+  int got[4];
+  ASSERT_EQ(channel_recv_batch(ch, got, 4), 4, "Wrong number queued");
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(got[i], i, "Batch items out of order");
+  }
+  channel_close(ch);
+  ASSERT_EQ(channel_try_send_batch(ch, items, 1), 0, "Sent after close");
+  channel_destroy(ch);
+}
+
+TEST(test_try_recv) {
+  ASSERT(check_try_recv(false), "Try recv on locked channel misbehaved");
+  ASSERT(check_try_recv(true), "Try recv on adaptive channel misbehaved");
+}
+
 // =============================================================================
 // Multi-threaded Tests
 // =============================================================================
@@ -361,59 +963,1782 @@ TEST(test_concurrent_send_recv) {
   channel_destroy(ch);
 }
 
-// =============================================================================
-// Stress Tests
-// =============================================================================
+typedef struct {
+  channel_t *ch;
+  channel_t *woken;
+  int id;
+} wake_args_t;
 
-TEST(test_high_volume) {
-  channel_t *ch = channel_create(sizeof(int), 1000);
+void *wake_order_thread(void *arg) {
+  wake_args_t *args = (wake_args_t *)arg;
+  int val;
+  if (channel_recv(args->ch, &val)) {
+    channel_send(args->woken, &args->id);
+  }
+  return NULL;
+}
 
-  const int VOLUME = 100000;
+/* Park three receivers in order, send one item and report which one ran */
+static int first_woken(channel_wake_policy_t policy) {
+  channel_opts_t opts = {.wake_policy = policy};
+  channel_t *ch = channel_create_opts(sizeof(int), 10, &opts);
+  channel_t *woken = channel_create(sizeof(int), 10);
+
+  pthread_t threads[3];
+  wake_args_t args[3];
+  for (int i = 0; i < 3; i++) {
+    args[i] = (wake_args_t){ch, woken, i};
+    pthread_create(&threads[i], NULL, wake_order_thread, &args[i]);
+    sleep_ms(50); // Give the receiver time to park
+  }
 
-  pthread_t prod, cons;
-  thread_args_t args = {ch, 0, VOLUME};
+  int val = 1;
+  int id = -1;
+  channel_send(ch, &val);
+  channel_recv(woken, &id);
 
-  pthread_create(&cons, NULL, consumer_thread, &args);
+  channel_close(ch);
+  for (int i = 0; i < 3; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  channel_destroy(woken);
+  channel_destroy(ch);
+  return id;
+}
+
+TEST(test_wake_policy_fifo) {
+  ASSERT_EQ(first_woken(CHANNEL_WAKE_FIFO), 0,
+            "FIFO should wake the oldest receiver");
+}
+
+TEST(test_wake_policy_lifo) {
+  ASSERT_EQ(first_woken(CHANNEL_WAKE_LIFO), 2,
+            "LIFO should wake the newest receiver");
+}
+
+// =============================================================================
+// Adaptive Channel Tests
+// =============================================================================
+
+TEST(test_adaptive_spsc_order) {
+  channel_opts_t opts = {.adaptive = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 8, &opts);
+  ASSERT(ch != NULL, "Channel creation failed");
+
+  pthread_t prod;
+  thread_args_t args = {ch, 0, 20000};
   pthread_create(&prod, NULL, producer_thread, &args);
 
+  int val;
+  for (int i = 0; i < 20000; i++) {
+    ASSERT(channel_recv(ch, &val), "Receive failed");
+    ASSERT_EQ(val, i, "Items out of order");
+  }
   pthread_join(prod, NULL);
+
+  // Close must wake a consumer parked on the ring
+  pthread_t cons;
+  thread_args_t cons_args = {ch, 0, 1};
+  pthread_create(&cons, NULL, consumer_thread, &cons_args);
+  sleep_ms(50);
   channel_close(ch);
 
   int *received;
   pthread_join(cons, (void **)&received);
-
-  ASSERT_EQ(*received, VOLUME, "High volume test failed");
+  ASSERT_EQ(*received, 0, "Receive on closed empty channel succeeded");
 
   free(received);
   channel_destroy(ch);
 }
 
-TEST(test_many_producers) {
-  channel_t *ch = channel_create(sizeof(int), 100);
-
-  const int NUM_PRODUCERS = 10;
-  const int ITEMS_PER = 1000;
+TEST(test_adaptive_upgrade_second_producer) {
+  channel_opts_t opts = {.adaptive = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 16, &opts);
+  ASSERT(ch != NULL, "Channel creation failed");
 
-  pthread_t producers[NUM_PRODUCERS];
-  pthread_t consumer;
+  const int ITEMS = 20000;
+  pthread_t producers[2];
+  thread_args_t args[2] = {{ch, 0, ITEMS}, {ch, 100000, ITEMS}};
+  pthread_create(&producers[0], NULL, producer_thread, &args[0]);
 
-  thread_args_t prod_args[NUM_PRODUCERS];
-  for (int i = 0; i < NUM_PRODUCERS; i++) {
-    prod_args[i].ch = ch;
-    prod_args[i].start = i * 100000;
-    prod_args[i].count = ITEMS_PER;
-    pthread_create(&producers[i], NULL, producer_thread, &prod_args[i]);
+  // Start the second producer while the first is mid-stream on the ring
+  int val;
+  int next[2] = {0, 100000};
+  int received = 0;
+  for (; received < 1000; received++) {
+    ASSERT(channel_recv(ch, &val), "Receive failed");
+    ASSERT_EQ(val, next[0]++, "Items out of order before upgrade");
   }
+  pthread_create(&producers[1], NULL, producer_thread, &args[1]);
 
-  thread_args_t cons_args = {ch, 0, NUM_PRODUCERS * ITEMS_PER};
-  pthread_create(&consumer, NULL, consumer_thread, &cons_args);
-
-  for (int i = 0; i < NUM_PRODUCERS; i++) {
+  for (; received < 2 * ITEMS; received++) {
+    ASSERT(channel_recv(ch, &val), "Receive failed");
+    int p = val >= 100000;
+    ASSERT_EQ(val, next[p]++, "Item lost, duplicated or reordered");
+  }
+  for (int i = 0; i < 2; i++) {
     pthread_join(producers[i], NULL);
   }
 
   channel_close(ch);
-
+  ASSERT(!channel_recv(ch, &val), "Receive on closed empty channel succeeded");
+  channel_destroy(ch);
+}
+
+static void *inline_producer(void *arg) {
+  thread_args_t *args = (thread_args_t *)arg;
+  for (int i = 0; i < args->count; i++) {
+    int val = args->start + i;
+    channel_send_inline(args->ch, &val);
+  }
+  return NULL;
+}
+
+TEST(test_adaptive_inline_fast_path) {
+  channel_opts_t opts = {.adaptive = true};
+  channel_t *ch = channel_create_opts(sizeof(int), 8, &opts);
+  ASSERT(ch != NULL, "Channel creation failed");
+
+  const int ITEMS = 20000;
+  pthread_t producers[2];
+  thread_args_t args[2] = {{ch, 0, ITEMS}, {ch, 100000, ITEMS}};
+  pthread_create(&producers[0], NULL, inline_producer, &args[0]);
+
+  // The inline paths share the ring with the library, and a second
+  // producer still moves the channel to the locked algorithm
+  int val;
+  int next[2] = {0, 100000};
+  int received = 0;
+  for (; received < 1000; received++) {
+    ASSERT(channel_recv_inline(ch, &val), "Receive failed");
+    ASSERT_EQ(val, next[0]++, "Items out of order on the ring");
+  }
+  pthread_create(&producers[1], NULL, inline_producer, &args[1]);
+  for (; received < 2 * ITEMS; received++) {
+    ASSERT(received % 2 ? channel_recv_inline(ch, &val)
+                        : channel_recv(ch, &val),
+           "Receive failed");
+    int p = val >= 100000;
+    ASSERT_EQ(val, next[p]++, "Item lost, duplicated or reordered");
+  }
+  for (int i = 0; i < 2; i++) {
+    pthread_join(producers[i], NULL);
+  }
+
+  ASSERT(!channel_try_recv_inline(ch, &val), "Empty channel gave an item");
+  ASSERT(channel_try_send_inline(ch, &val), "Try send failed");
+  channel_close(ch);
+  ASSERT(channel_try_recv_inline(ch, &val), "Queued item lost on close");
+  ASSERT(!channel_recv_inline(ch, &val), "Closed empty channel gave an item");
+  channel_destroy(ch);
+}
+
+// =============================================================================
+// Channel Group Tests
+// =============================================================================
+
+TEST(test_group_recv_ready_members) {
+  channel_group_t *g = channel_group_create();
+  channel_t *chs[3];
+  for (int i = 0; i < 3; i++) {
+    chs[i] = channel_create(sizeof(int), 10);
+    ASSERT_EQ(channel_group_join(g, chs[i]), i, "Wrong member index");
+  }
+  ASSERT_EQ(channel_group_join(g, chs[0]), -1,
+            "A channel can only join one group");
+
+  int val = 20;
+  channel_send(chs[2], &val);
+  val = 0;
+  channel_send(chs[0], &val);
+
+  int seen = 0;
+  for (int n = 0; n < 2; n++) {
+    int index;
+    ASSERT(channel_group_recv(g, &val, &index), "Group receive failed");
+    ASSERT_EQ(val, index * 10, "Value came from the wrong member");
+    seen |= 1 << index;
+  }
+  ASSERT_EQ(seen, 0x5, "Both ready members should be served");
+
+  for (int i = 0; i < 3; i++) {
+    channel_close(chs[i]);
+  }
+  ASSERT(!channel_group_recv(g, &val, NULL),
+         "Group receive should fail once all members are closed and empty");
+
+  channel_group_destroy(g);
+  for (int i = 0; i < 3; i++) {
+    channel_destroy(chs[i]);
+  }
+}
+
+typedef struct {
+  channel_group_t *g;
+  int received;
+} group_consumer_args_t;
+
+void *group_consumer_thread(void *arg) {
+  group_consumer_args_t *args = (group_consumer_args_t *)arg;
+  int val;
+  while (channel_group_recv(args->g, &val, NULL)) {
+    args->received++;
+  }
+  return NULL;
+}
+
+TEST(test_group_blocking_fan_in) {
+  const int NUM_CHANNELS = 8;
+  const int ITEMS_PER = 1000;
+
+  channel_group_t *g = channel_group_create();
+  channel_t *chs[NUM_CHANNELS];
+  pthread_t producers[NUM_CHANNELS];
+  thread_args_t prod_args[NUM_CHANNELS];
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    chs[i] = channel_create(sizeof(int), 16);
+    channel_group_join(g, chs[i]);
+  }
+
+  // Start the consumer first so it parks on an empty group
+  group_consumer_args_t cons_args = {g, 0};
+  pthread_t consumer;
+  pthread_create(&consumer, NULL, group_consumer_thread, &cons_args);
+
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    prod_args[i] = (thread_args_t){chs[i], 0, ITEMS_PER};
+    pthread_create(&producers[i], NULL, producer_thread, &prod_args[i]);
+  }
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    pthread_join(producers[i], NULL);
+    channel_close(chs[i]);
+  }
+  pthread_join(consumer, NULL);
+
+  ASSERT_EQ(cons_args.received, NUM_CHANNELS * ITEMS_PER,
+            "Group consumer didn't receive all messages");
+
+  channel_group_destroy(g);
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    channel_destroy(chs[i]);
+  }
+}
+
+// =============================================================================
+// Select Tests
+// =============================================================================
+
+typedef struct {
+  channel_t *ch;
+  int val;
+} delayed_send_args_t;
+
+void *delayed_send_thread(void *arg) {
+  delayed_send_args_t *args = (delayed_send_args_t *)arg;
+  sleep_ms(50);
+  channel_send(args->ch, &args->val);
+  return NULL;
+}
+
+/* Exercise channel_select with the futex_waitv path on or off */
+static void check_select(bool use_futex) {
+  channel_select_use_futex(use_futex);
+
+  channel_t *chs[3];
+  int vals[3] = {-1, -1, -1};
+  channel_case_t cases[3];
+  for (int i = 0; i < 3; i++) {
+    chs[i] = channel_create(sizeof(int), 10);
+    cases[i] = (channel_case_t){chs[i], &vals[i]};
+  }
+
+  // Ready immediately
+  int val = 11;
+  channel_send(chs[1], &val);
+  ASSERT_EQ(channel_select(cases, 3), 1, "Wrong case selected");
+  ASSERT_EQ(vals[1], 11, "Wrong value received");
+
+  // Blocks until another thread sends
+  delayed_send_args_t args = {chs[2], 22};
+  pthread_t sender;
+  pthread_create(&sender, NULL, delayed_send_thread, &args);
+  ASSERT_EQ(channel_select(cases, 3), 2, "Wrong case selected after wait");
+  ASSERT_EQ(vals[2], 22, "Wrong value received after wait");
+  pthread_join(sender, NULL);
+
+  for (int i = 0; i < 3; i++) {
+    channel_close(chs[i]);
+  }
+  ASSERT_EQ(channel_select(cases, 3), -1,
+            "Select should fail once all channels are closed and empty");
+
+  for (int i = 0; i < 3; i++) {
+    channel_destroy(chs[i]);
+  }
+}
+
+TEST(test_select_futex) { check_select(true); }
+
+TEST(test_select_fallback) {
+  check_select(false);
+  channel_select_use_futex(true);
+}
+
+typedef struct {
+  channel_t **chs;
+  int received;
+} select_consumer_args_t;
+
+void *select_consumer_thread(void *arg) {
+  select_consumer_args_t *args = (select_consumer_args_t *)arg;
+  int vals[2];
+  channel_case_t cases[2] = {{args->chs[0], &vals[0]}, {args->chs[1], &vals[1]}};
+  while (channel_select(cases, 2) >= 0) {
+    args->received++;
+  }
+  return NULL;
+}
+
+/* Two selecting consumers and a plain receiver share two channels */
+static void check_select_contended(bool use_futex) {
+  channel_select_use_futex(use_futex);
+  const int ITEMS_PER = 5000;
+
+  channel_t *chs[2] = {channel_create(sizeof(int), 8),
+                       channel_create(sizeof(int), 8)};
+  select_consumer_args_t sel_args[2] = {{chs, 0}, {chs, 0}};
+  thread_args_t recv_args = {chs[0], 0, 2 * ITEMS_PER};
+  thread_args_t prod_args[2] = {{chs[0], 0, ITEMS_PER}, {chs[1], 0, ITEMS_PER}};
+  pthread_t selectors[2], receiver, producers[2];
+
+  for (int i = 0; i < 2; i++) {
+    pthread_create(&selectors[i], NULL, select_consumer_thread, &sel_args[i]);
+  }
+  pthread_create(&receiver, NULL, consumer_thread, &recv_args);
+  for (int i = 0; i < 2; i++) {
+    pthread_create(&producers[i], NULL, producer_thread, &prod_args[i]);
+  }
+  for (int i = 0; i < 2; i++) {
+    pthread_join(producers[i], NULL);
+    channel_close(chs[i]);
+  }
+
+  int *received;
+  pthread_join(receiver, (void **)&received);
+  int total = *received;
+  free(received);
+  for (int i = 0; i < 2; i++) {
+    pthread_join(selectors[i], NULL);
+    total += sel_args[i].received;
+  }
+  ASSERT_EQ(total, 2 * ITEMS_PER, "Items lost or duplicated across select");
+
+  channel_destroy(chs[0]);
+  channel_destroy(chs[1]);
+}
+
+TEST(test_select_contended_futex) { check_select_contended(true); }
+
+TEST(test_select_contended_fallback) {
+  check_select_contended(false);
+  channel_select_use_futex(true);
+}
+
+void *select_two_thread(void *arg) {
+  channel_case_t *cases = (channel_case_t *)arg;
+  return (void *)(intptr_t)channel_select(cases, 2);
+}
+
+void *timed_recv_thread(void *arg) {
+  channel_t *ch = (channel_t *)arg;
+  int val;
+  channel_status_t *status = malloc(sizeof(channel_status_t));
+  *status = channel_recv_timeout(ch, &val, 2000000000ULL);
+  return status;
+}
+
+static void send_from_backlog(void *arg) {
+  int val = 2;
+  channel_try_send((channel_t *)arg, &val);
+}
+
+/* A selector woken by one channel that takes another channel's item must
+ * pass the wakeup on to the first channel's other receivers */
+TEST(test_select_passes_on_wakeup) {
+  channel_select_use_futex(false);
+  channel_t *a = channel_create(sizeof(int), 4);
+  channel_t *b = channel_create(sizeof(int), 4);
+  int va = -1, vb = -1;
+  channel_case_t cases[2] = {{a, &va}, {b, &vb}};
+
+  // The selector parks on a ahead of the plain receiver
+  pthread_t selector, receiver;
+  pthread_create(&selector, NULL, select_two_thread, cases);
+  sleep_ms(50);
+  pthread_create(&receiver, NULL, timed_recv_thread, a);
+  sleep_ms(50);
+
+  // The send to a wakes the selector, which then polls b first and takes
+  // the item the backlog callback sends there
+  channel_watch_backlog(a, 0, send_from_backlog, b);
+  int val = 1;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  channel_send(a, &val);
+
+  void *picked;
+  channel_status_t *status;
+  pthread_join(selector, &picked);
+  pthread_join(receiver, (void **)&status);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long waited_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                   (end.tv_nsec - start.tv_nsec) / 1000000;
+  ASSERT((intptr_t)picked >= 0, "Select should receive an item");
+  ASSERT_EQ(*status, CHANNEL_OK, "Receiver on a should get its item");
+  ASSERT(waited_ms < 1000, "Receiver on a should not sleep out its timeout");
+
+  free(status);
+  channel_watch_backlog(a, 0, NULL, NULL);
+  channel_destroy(a);
+  channel_destroy(b);
+  channel_select_use_futex(true);
+}
+
+// =============================================================================
+// Poller Tests
+// =============================================================================
+
+#if defined(__linux__)
+TEST(test_poller_channels_and_fds) {
+  channel_poller_t *p = channel_poller_create();
+  ASSERT(p != NULL, "Poller creation failed");
+
+  channel_t *a = channel_create(sizeof(int), 10);
+  channel_t *b = channel_create(sizeof(int), 10);
+  int a_val = 0, b_val = 0;
+  int fds[2];
+  ASSERT(pipe(fds) == 0, "pipe failed");
+  ASSERT(channel_poller_add_channel(p, a, &a_val, (void *)"a"), "Add failed");
+  ASSERT(channel_poller_add_channel(p, b, &b_val, (void *)"b"), "Add failed");
+  ASSERT(channel_poller_add_fd(p, fds[0], EPOLLIN, (void *)"pipe"),
+         "Add fd failed");
+
+  channel_poll_event_t events[8];
+  ASSERT_EQ(channel_poller_wait(p, events, 8, 10), 0, "Should time out");
+
+  // A channel item and a readable fd come back from the same call
+  int val = 5;
+  channel_send(a, &val);
+  char byte = 'x';
+  ASSERT(write(fds[1], &byte, 1) == 1, "write failed");
+  int n = channel_poller_wait(p, events, 8, -1);
+  ASSERT_EQ(n, 2, "Expected the channel and the fd");
+  int seen = 0;
+  for (int i = 0; i < n; i++) {
+    if (events[i].ch == a) {
+      ASSERT_EQ(a_val, 5, "Wrong item received");
+      seen |= 1;
+    } else if (events[i].fd == fds[0]) {
+      ASSERT(events[i].revents & EPOLLIN, "fd should be readable");
+      ASSERT(strcmp(events[i].udata, "pipe") == 0, "Wrong udata");
+      seen |= 2;
+    }
+  }
+  ASSERT_EQ(seen, 3, "Missing event");
+  ASSERT(read(fds[0], &byte, 1) == 1, "read failed");
+
+  // Wakes up for a send from another thread
+  delayed_send_args_t args = {b, 9};
+  pthread_t sender;
+  pthread_create(&sender, NULL, delayed_send_thread, &args);
+  n = channel_poller_wait(p, events, 8, -1);
+  pthread_join(sender, NULL);
+  ASSERT_EQ(n, 1, "Expected one channel event");
+  ASSERT(events[0].ch == b && b_val == 9, "Wrong channel event");
+
+  // Closing reports once
+  channel_close(a);
+  n = channel_poller_wait(p, events, 8, -1);
+  ASSERT_EQ(n, 1, "Expected a closed event");
+  ASSERT(events[0].ch == a && events[0].closed, "Expected a closed");
+  ASSERT_EQ(channel_poller_wait(p, events, 8, 10), 0,
+            "Closed event should be reported once");
+
+  channel_poller_destroy(p);
+  close(fds[0]);
+  close(fds[1]);
+  channel_destroy(a);
+  channel_destroy(b);
+}
+
+typedef struct {
+  pthread_t target;
+  _Atomic bool stop;
+} interrupter_args_t;
+
+static void ignore_signal(int sig) { (void)sig; }
+
+// Interrupts the target every 10 ms for at most a second
+static void *interrupter_thread(void *arg) {
+  interrupter_args_t *a = arg;
+  for (int i = 0; i < 100 && !atomic_load(&a->stop); i++) {
+    pthread_kill(a->target, SIGUSR1);
+    sleep_ms(10);
+  }
+  return NULL;
+}
+
+TEST(test_poller_timeout_survives_signals) {
+  channel_poller_t *p = channel_poller_create();
+  ASSERT(p != NULL, "Poller creation failed");
+  channel_t *ch = channel_create(sizeof(int), 10);
+  int val;
+  ASSERT(channel_poller_add_channel(p, ch, &val, NULL), "Add failed");
+
+  struct sigaction sa = {.sa_handler = ignore_signal}, old;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, &old);
+
+  // Each signal interrupts epoll_wait, the retry must not restart the wait
+  interrupter_args_t args = {.target = pthread_self()};
+  pthread_t interrupter;
+  pthread_create(&interrupter, NULL, interrupter_thread, &args);
+  channel_poll_event_t events[4];
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int n = channel_poller_wait(p, events, 4, 100);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  atomic_store(&args.stop, true);
+  pthread_join(interrupter, NULL);
+  sigaction(SIGUSR1, &old, NULL);
+
+  long waited_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                   (end.tv_nsec - start.tv_nsec) / 1000000;
+  ASSERT_EQ(n, 0, "Should time out");
+  ASSERT(waited_ms >= 99 && waited_ms < 500,
+         "Timeout should hold across interruptions");
+
+  channel_poller_destroy(p);
+  channel_destroy(ch);
+}
+#endif
+
+// =============================================================================
+// Consumer Pool Tests
+// =============================================================================
+
+static void count_backlog(void *arg) { (*(int *)arg)++; }
+
+TEST(test_backlog_watch) {
+  channel_t *ch = channel_create(sizeof(int), 16);
+  int calls = 0;
+  ASSERT(channel_watch_backlog(ch, 2, count_backlog, &calls),
+         "Watch failed");
+  ASSERT(!channel_watch_backlog(ch, 2, count_backlog, &calls),
+         "Second watcher should be refused");
+
+  for (int i = 0; i < 6; i++) {
+    channel_send(ch, &i);
+  }
+  ASSERT_EQ(calls, 1, "Callback should fire once when crossing threshold");
+
+  // Drop back to the threshold and cross it again
+  int val;
+  for (int i = 0; i < 4; i++) {
+    channel_recv(ch, &val);
+  }
+  channel_send(ch, &val);
+  ASSERT_EQ(calls, 2, "Callback should fire again after recrossing");
+
+  ASSERT(channel_watch_backlog(ch, 0, NULL, NULL), "Unwatch failed");
+  channel_destroy(ch);
+}
+
+typedef struct pool_count_t {
+  pthread_mutex_t mu;
+  int handled;
+} pool_count_t;
+
+// Simulates a consumer that waits on I/O for every item
+static void slow_handler(void *item, void *ctx) {
+  (void)item;
+  pool_count_t *c = ctx;
+  sleep_ms(2);
+  pthread_mutex_lock(&c->mu);
+  c->handled++;
+  pthread_mutex_unlock(&c->mu);
+}
+
+TEST(test_pool_scales_with_backlog) {
+  channel_t *ch = channel_create(sizeof(int), 0);
+  pool_count_t count = {.handled = 0};
+  pthread_mutex_init(&count.mu, NULL);
+  channel_pool_opts_t opts = {
+      .min_workers = 1,
+      .max_workers = 4,
+      .backlog_threshold = 8,
+      .scale_up_delay_ns = 5000000,
+      .idle_timeout_ns = 50000000,
+  };
+  channel_pool_t *p =
+      channel_pool_create(ch, sizeof(int), slow_handler, &count, &opts);
+  ASSERT(p != NULL, "Pool creation failed");
+
+  const int n = 200;
+  for (int i = 0; i < n; i++) {
+    channel_send(ch, &i);
+  }
+
+  // Wait for the burst to drain and the extra workers to retire
+  channel_pool_stats_t stats;
+  for (int i = 0; i < 200; i++) {
+    channel_pool_stats(p, &stats);
+    pthread_mutex_lock(&count.mu);
+    int handled = count.handled;
+    pthread_mutex_unlock(&count.mu);
+    if (handled == n && stats.workers == 1) {
+      break;
+    }
+    sleep_ms(10);
+  }
+  ASSERT(stats.peak_workers > 1, "Pool should have grown under backlog");
+  ASSERT(stats.peak_workers <= 4, "Pool exceeded max_workers");
+  ASSERT_EQ(stats.workers, 1, "Idle workers should retire to min_workers");
+
+  channel_close(ch);
+  channel_pool_destroy(p);
+  ASSERT_EQ(count.handled, n, "Every item should be handled once");
+  pthread_mutex_destroy(&count.mu);
+  channel_destroy(ch);
+}
+
+typedef struct {
+  _Atomic long sum;
+  _Atomic int handled;
+} parallel_sum_t;
+
+static void parallel_add(void *item, void *ctx) {
+  parallel_sum_t *s = ctx;
+  atomic_fetch_add(&s->sum, *(int *)item);
+  atomic_fetch_add(&s->handled, 1);
+}
+
+static void *close_after_producing(void *arg) {
+  producer_thread(arg);
+  channel_close(((thread_args_t *)arg)->ch);
+  return NULL;
+}
+
+TEST(test_parallel_for) {
+  // Items keep arriving while the workers run, and they return only once
+  // the producer closes the channel and it is drained
+  channel_t *ch = channel_create(sizeof(int), 256);
+  const int n = 100000;
+  pthread_t prod;
+  thread_args_t args = {ch, 0, n};
+  pthread_create(&prod, NULL, close_after_producing, &args);
+
+  parallel_sum_t s = {0};
+  channel_parallel_stats_t stats[4];
+  size_t handled =
+      channel_parallel_for(ch, sizeof(int), 4, parallel_add, &s, 32, stats);
+  pthread_join(prod, NULL);
+
+  ASSERT_EQ(handled, (size_t)n, "Wrong number of items handled");
+  ASSERT_EQ(s.handled, n, "fn not called once per item");
+  ASSERT(s.sum == (long)n * (n - 1) / 2, "Items lost or duplicated");
+  size_t items = 0;
+  size_t batches = 0;
+  for (int i = 0; i < 4; i++) {
+    items += stats[i].items;
+    batches += stats[i].batches;
+    ASSERT(stats[i].batches * 32 >= stats[i].items, "Batch exceeded limit");
+  }
+  ASSERT_EQ(items, (size_t)n, "Worker stats do not add up");
+  ASSERT(batches < (size_t)n, "Items should be claimed in batches");
+
+  // An already closed, empty channel returns right away
+  ASSERT_EQ(channel_parallel_for(ch, sizeof(int), 2, parallel_add, &s, 0,
+                                 NULL),
+            0, "Drained channel should yield nothing");
+  channel_destroy(ch);
+}
+
+// =============================================================================
+// Async Logger Tests
+// =============================================================================
+
+// Reads back everything written to a temporary file
+static size_t read_back(FILE *f, char *buf, size_t cap) {
+  rewind(f);
+  size_t n = fread(buf, 1, cap - 1, f);
+  buf[n] = '\0';
+  return n;
+}
+
+TEST(test_alog_formats_records) {
+  FILE *f = tmpfile();
+  ASSERT(f != NULL, "tmpfile failed");
+  alog_t *log = alog_create(fileno(f), NULL);
+  ASSERT(log != NULL, "Logger creation failed");
+
+  static const char long_name[] =
+      "a-name-long-enough-to-be-written-straight-from-the-caller-memory";
+  ALOG(log, "started");
+  ALOG(log, "user %s took %d ms", "bob", -12);
+  ALOG(log, "%5.2f%% of %lu items, %s\n", 12.345, 40UL, long_name);
+  ALOG(log, "%x %c %s", 255u, 'z', long_name);
+  alog_flush(log);
+
+  char buf[1024];
+  read_back(f, buf, sizeof(buf));
+  const char *want[] = {
+      " started\n",
+      " user bob took -12 ms\n",
+      " 12.35% of 40 items, "
+      "a-name-long-enough-to-be-written-straight-from-the-caller-memory\n",
+      " ff z "
+      "a-name-long-enough-to-be-written-straight-from-the-caller-memory\n",
+  };
+  const char *at = buf;
+  for (size_t i = 0; i < sizeof(want) / sizeof(want[0]); i++) {
+    const char *line = strstr(at, want[i]);
+    ASSERT(line != NULL, "Missing or out of order log line");
+    at = line + strlen(want[i]);
+  }
+  ASSERT_EQ(*at, '\0', "Unexpected trailing output");
+
+  alog_stats_t stats;
+  alog_stats(log, &stats);
+  ASSERT_EQ(stats.written, 4, "Every record should be written");
+  ASSERT_EQ(stats.dropped, 0, "Nothing should be dropped");
+
+  alog_destroy(log);
+  fclose(f);
+}
+
+TEST(test_alog_truncates_long_records) {
+  FILE *f = tmpfile();
+  ASSERT(f != NULL, "tmpfile failed");
+  alog_t *log = alog_create(fileno(f), NULL);
+  ASSERT(log != NULL, "Logger creation failed");
+
+  // The text alone fills the record's budget, so the conversions after the
+  // long string have no room left
+  static char fmt[1200];
+  memset(fmt, 'y', 1100);
+  strcpy(fmt + 1100, "%s %x");
+  static const char long_name[] =
+      "a-name-long-enough-to-be-written-straight-from-the-caller-memory";
+  ALOG(log, fmt, long_name, 255u);
+  ALOG(log, "after");
+  alog_flush(log);
+
+  static char buf[4096];
+  size_t n = read_back(f, buf, sizeof(buf));
+  size_t name_len = strlen(long_name);
+  char *second = strchr(buf, '\n');
+  ASSERT(second != NULL && second - buf < 1100,
+         "Long record was not truncated");
+  ASSERT(memcmp(second - name_len, long_name, name_len) == 0,
+         "The long string should end the first line");
+  second++;
+  ASSERT(strstr(second, long_name) == NULL &&
+             strstr(second, " after\n") != NULL &&
+             strchr(second, '\n') == buf + n - 1,
+         "Record after the long one should be a line of its own");
+
+  alog_destroy(log);
+  fclose(f);
+}
+
+static void *alog_thread(void *arg) {
+  alog_t *log = arg;
+  for (int i = 0; i < 100; i++) {
+    ALOG(log, "thread line %d", i);
+  }
+  return NULL;
+}
+
+TEST(test_alog_exited_threads) {
+  FILE *f = tmpfile();
+  ASSERT(f != NULL, "tmpfile failed");
+  alog_t *log = alog_create(fileno(f), NULL);
+  ASSERT(log != NULL, "Logger creation failed");
+
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, alog_thread, log);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  // Records of threads that have already exited are still written
+  alog_destroy(log);
+
+  static char buf[64 * 1024];
+  read_back(f, buf, sizeof(buf));
+  int lines = 0;
+  for (char *p = buf; (p = strstr(p, " thread line ")); p++) {
+    lines++;
+  }
+  ASSERT_EQ(lines, 400, "Every thread's records should be written");
+  ASSERT(strstr(buf, "thread line 99\n") != NULL, "Missing last record");
+  fclose(f);
+}
+
+TEST(test_alog_lossy_drops) {
+  FILE *f = tmpfile();
+  ASSERT(f != NULL, "tmpfile failed");
+  // A long flush interval keeps the writer asleep while the queue fills
+  alog_opts_t opts = {
+      .queue_capacity = 8, .lossy = true, .flush_interval_ns = 1000000000ULL};
+  alog_t *log = alog_create(fileno(f), &opts);
+  ASSERT(log != NULL, "Logger creation failed");
+
+  for (int i = 0; i < 100; i++) {
+    ALOG(log, "lossy %d", i);
+  }
+  alog_flush(log);
+
+  alog_stats_t stats;
+  alog_stats(log, &stats);
+  ASSERT(stats.dropped > 0, "A full queue should drop records");
+  ASSERT_EQ(stats.written + stats.dropped, 100,
+            "Every record is either written or dropped");
+
+  alog_destroy(log);
+  fclose(f);
+}
+
+// =============================================================================
+// File Writer Tests
+// =============================================================================
+
+// A record whose size does not divide the block size
+typedef struct {
+  uint32_t seq;
+  uint32_t check;
+  uint32_t pad;
+} record12_t;
+
+// Sends n records numbered from first through a writer stage, returning
+// false if the stage failed
+static bool write_records(const char *path, uint32_t first, uint32_t n,
+                          const channel_writer_opts_t *opts,
+                          channel_writer_stats_t *stats) {
+  channel_t *ch = channel_create(sizeof(record12_t), 64);
+  channel_writer_t *w =
+      channel_writer_create(ch, sizeof(record12_t), path, opts);
+  if (!w) {
+    channel_destroy(ch);
+    return false;
+  }
+  for (uint32_t i = first; i < first + n; i++) {
+    record12_t r = {.seq = i, .check = i * 2654435761u, .pad = 0};
+    channel_send(ch, &r);
+    if (i % 1000 == 0) {
+      // Let the writer catch up so it also writes partial batches
+      sleep_ms(1);
+    }
+  }
+  channel_close(ch);
+  bool ok = channel_writer_destroy(w, stats);
+  channel_destroy(ch);
+  return ok;
+}
+
+// Checks the file holds exactly records 0..n-1 in order
+static bool check_records(const char *path, uint32_t n) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  bool ok = true;
+  record12_t r;
+  for (uint32_t i = 0; i < n && ok; i++) {
+    ok = fread(&r, sizeof(r), 1, f) == 1 && r.seq == i &&
+         r.check == i * 2654435761u;
+  }
+  ok = ok && fread(&r, 1, 1, f) == 0;
+  fclose(f);
+  return ok;
+}
+
+static bool check_writer(const channel_writer_opts_t *base) {
+  char path[] = "/tmp/channels_writer_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+
+  // Small buffers so items span buffers and batches fill them
+  channel_writer_opts_t opts = *base;
+  opts.buffer_size = 8192;
+  opts.buffers = 3;
+  channel_writer_stats_t stats;
+  bool ok = write_records(path, 0, 5000, &opts, &stats);
+  opts.append = true;
+  ok = ok && write_records(path, 5000, 3001, &opts, &stats);
+  ok = ok && check_records(path, 8001);
+  ok = ok && stats.error == 0;
+  if (opts.sync != CHANNEL_WRITER_SYNC_NONE) {
+    ok = ok && stats.syncs > 0;
+  }
+  unlink(path);
+  return ok;
+}
+
+TEST(test_writer_buffered) {
+  channel_writer_opts_t opts = {.sync = CHANNEL_WRITER_SYNC_NONE};
+  ASSERT(check_writer(&opts), "Buffered writer lost or reordered records");
+  opts.sync = CHANNEL_WRITER_SYNC_BATCH;
+  ASSERT(check_writer(&opts), "Batch-synced writer lost records");
+}
+
+TEST(test_writer_direct) {
+  channel_writer_opts_t opts = {.direct = true,
+                                .sync = CHANNEL_WRITER_SYNC_INTERVAL,
+                                .sync_interval_ns = 1000000};
+  ASSERT(check_writer(&opts), "O_DIRECT writer lost or reordered records");
+}
+
+TEST(test_writer_stats) {
+  char path[] = "/tmp/channels_writer_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0, "mkstemp failed");
+  close(fd);
+
+  channel_writer_opts_t opts = {.direct = true};
+  channel_writer_stats_t stats;
+  ASSERT(write_records(path, 0, 4096, &opts, &stats), "Writer failed");
+  ASSERT_EQ(stats.items, 4096, "Every item should be counted");
+  ASSERT_EQ(stats.bytes, 4096 * sizeof(record12_t), "Wrong byte count");
+  ASSERT(stats.write_amplification >= 1.0, "Amplification below 1");
+  if (!stats.direct) {
+    ASSERT(stats.write_amplification == 1.0,
+           "Buffered writes should not amplify");
+  }
+  ASSERT(stats.bytes_per_sec > 0, "Throughput should be reported");
+  unlink(path);
+}
+
+// =============================================================================
+// Event Bus Tests
+// =============================================================================
+
+TEST(test_bus_fan_out) {
+  channel_bus_t *bus = channel_bus_create();
+  uint64_t orders = channel_bus_topic("orders");
+  uint64_t quotes = channel_bus_topic("quotes");
+  ASSERT(orders != quotes, "Topics should hash apart");
+
+  channel_t *subs[3];
+  for (int i = 0; i < 3; i++) {
+    subs[i] = channel_create(sizeof(int), 0);
+  }
+  ASSERT(channel_bus_subscribe(bus, orders, subs[0]), "Subscribe failed");
+  ASSERT(channel_bus_subscribe(bus, orders, subs[1]), "Subscribe failed");
+  ASSERT(channel_bus_subscribe(bus, quotes, subs[2]), "Subscribe failed");
+  ASSERT(!channel_bus_subscribe(bus, orders, subs[0]),
+         "Duplicate subscription should be refused");
+
+  int events[4] = {1, 2, 3, 4};
+  ASSERT_EQ(channel_bus_publish_batch(bus, orders, events, 4), 2,
+            "Both order subscribers should get the batch");
+  int ev = 9;
+  ASSERT_EQ(channel_bus_publish(bus, quotes, &ev), 1, "One quote subscriber");
+  ASSERT_EQ(channel_bus_publish(bus, channel_bus_topic("none"), &ev), 0,
+            "Unknown topic has no subscribers");
+
+  for (int s = 0; s < 2; s++) {
+    for (int i = 0; i < 4; i++) {
+      int got = 0;
+      channel_recv(subs[s], &got);
+      ASSERT_EQ(got, events[i], "Events should arrive in order");
+    }
+  }
+  int got = 0;
+  channel_recv(subs[2], &got);
+  ASSERT_EQ(got, 9, "Quote subscriber got the wrong event");
+
+  ASSERT(channel_bus_unsubscribe(bus, orders, subs[0]), "Unsubscribe failed");
+  ASSERT(!channel_bus_unsubscribe(bus, orders, subs[0]),
+         "Second unsubscribe should fail");
+  ASSERT_EQ(channel_bus_publish(bus, orders, &ev), 1,
+            "Only the remaining subscriber should get the event");
+
+  channel_bus_destroy(bus);
+  for (int i = 0; i < 3; i++) {
+    channel_destroy(subs[i]);
+  }
+}
+
+typedef struct {
+  channel_bus_t *bus;
+  uint64_t topic;
+  atomic_bool *stop;
+  size_t delivered;
+} bus_pub_args_t;
+
+static void *bus_publisher(void *arg) {
+  bus_pub_args_t *a = arg;
+  int ev = 1;
+  while (!atomic_load(a->stop)) {
+    a->delivered += channel_bus_publish(a->bus, a->topic, &ev);
+  }
+  return NULL;
+}
+
+TEST(test_bus_churn) {
+  channel_bus_t *bus = channel_bus_create();
+  uint64_t topic = channel_bus_topic("churn");
+  channel_t *stable = channel_create(sizeof(int), 0);
+  channel_bus_subscribe(bus, topic, stable);
+
+  atomic_bool stop = false;
+  pthread_t pubs[3];
+  bus_pub_args_t args[3];
+  for (int i = 0; i < 3; i++) {
+    args[i] = (bus_pub_args_t){.bus = bus, .topic = topic, .stop = &stop};
+    pthread_create(&pubs[i], NULL, bus_publisher, &args[i]);
+  }
+
+  // Wait for the publishers to get going
+  channel_stats_t s;
+  do {
+    sleep_ms(1);
+    channel_stats(stable, &s);
+  } while (s.queued == 0);
+
+  // Subscribers come and go while publishers run; each one is destroyed
+  // right after unsubscribing, which must be safe
+  for (int round = 0; round < 200; round++) {
+    if (round % 10 == 0) {
+      sleep_ms(1);
+    }
+    channel_t *ch = channel_create(sizeof(int), 0);
+    ASSERT(channel_bus_subscribe(bus, topic, ch), "Subscribe failed");
+    ASSERT(channel_bus_subscribe(bus, channel_bus_topic("other"), ch),
+           "Subscribe to second topic failed");
+    ASSERT(channel_bus_unsubscribe(bus, topic, ch), "Unsubscribe failed");
+    ASSERT(channel_bus_unsubscribe(bus, channel_bus_topic("other"), ch),
+           "Unsubscribe from second topic failed");
+    channel_destroy(ch);
+  }
+  atomic_store(&stop, true);
+
+  size_t delivered = 0;
+  for (int i = 0; i < 3; i++) {
+    pthread_join(pubs[i], NULL);
+    delivered += args[i].delivered;
+  }
+  channel_stats(stable, &s);
+  ASSERT(delivered >= s.queued, "Stable subscriber got more than delivered");
+
+  channel_bus_destroy(bus);
+  channel_destroy(stable);
+}
+
+// =============================================================================
+// RPC Tests
+// =============================================================================
+
+typedef struct {
+  int64_t a;
+  int64_t b;
+} rpc_req_t;
+
+static void rpc_add(const void *req, void *resp, void *ctx) {
+  const rpc_req_t *r = req;
+  (void)ctx;
+  *(int64_t *)resp = r->a + r->b;
+}
+
+typedef struct {
+  channel_rpc_t *rpc;
+  int base;
+  int wrong;
+} rpc_client_args_t;
+
+static void *rpc_client(void *arg) {
+  rpc_client_args_t *a = arg;
+  for (int i = 0; i < 2000; i++) {
+    rpc_req_t req = {.a = a->base, .b = i};
+    int64_t sum = 0;
+    if (!channel_rpc_call(a->rpc, &req, &sum) || sum != a->base + i) {
+      a->wrong++;
+    }
+  }
+  return NULL;
+}
+
+TEST(test_rpc_calls) {
+  // Fewer slots than clients so callers also wait for free slots
+  channel_rpc_opts_t opts = {.slots = 2, .servers = 2, .batch = 4};
+  channel_rpc_t *rpc =
+      channel_rpc_create(sizeof(rpc_req_t), sizeof(int64_t), rpc_add, NULL,
+                         &opts);
+  ASSERT(rpc != NULL, "RPC creation failed");
+
+  pthread_t threads[4];
+  rpc_client_args_t args[4];
+  for (int i = 0; i < 4; i++) {
+    args[i] = (rpc_client_args_t){.rpc = rpc, .base = i * 100000};
+    pthread_create(&threads[i], NULL, rpc_client, &args[i]);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+    ASSERT_EQ(args[i].wrong, 0, "Caller got another call's response");
+  }
+  channel_rpc_destroy(rpc);
+}
+
+TEST(test_rpc_pipelined) {
+  channel_rpc_t *rpc = channel_rpc_create(sizeof(rpc_req_t), sizeof(int64_t),
+                                          rpc_add, NULL, NULL);
+  ASSERT(rpc != NULL, "RPC creation failed");
+
+  // Several calls in flight from one thread, collected out of order
+  uint32_t ids[16];
+  for (int i = 0; i < 16; i++) {
+    rpc_req_t req = {.a = i, .b = 1000};
+    ids[i] = channel_rpc_begin(rpc, &req);
+    ASSERT(ids[i] != CHANNEL_RPC_NONE, "Begin failed");
+  }
+  for (int i = 15; i >= 0; i--) {
+    int64_t sum = 0;
+    channel_rpc_wait(rpc, ids[i], &sum);
+    ASSERT_EQ(sum, i + 1000, "Response matched to the wrong call");
+  }
+
+  channel_rpc_close(rpc);
+  rpc_req_t req = {.a = 1, .b = 2};
+  int64_t sum;
+  ASSERT(!channel_rpc_call(rpc, &req, &sum), "Call after close succeeded");
+  channel_rpc_destroy(rpc);
+}
+
+// =============================================================================
+// Stream Tests
+// =============================================================================
+
+TEST(test_stream_groups) {
+  char path[] = "/tmp/channels_stream_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0, "mkstemp failed");
+  close(fd);
+  unlink(path);
+
+  channel_stream_opts_t opts = {.max_bytes = 1 << 24, .commit_every = 16};
+  channel_stream_t *s = channel_stream_open(path, sizeof(int), &opts);
+  ASSERT(s != NULL, "Stream open failed");
+  int items[100];
+  for (int i = 0; i < 100; i++) {
+    items[i] = i;
+  }
+  ASSERT(channel_stream_append(s, items, 100), "Append failed");
+  ASSERT_EQ(channel_stream_length(s), 100, "Wrong stream length");
+
+  // A fast group reads everything, a slow one only part of it
+  channel_stream_group_t *fast = channel_stream_group(s, "fast");
+  channel_stream_group_t *slow = channel_stream_group(s, "slow");
+  ASSERT(fast && slow, "Group open failed");
+  ASSERT(channel_stream_group(s, "fast") == fast, "Group handle not reused");
+
+  const void *p;
+  size_t n;
+  int next = 0;
+  const int *first = NULL;
+  while (next < 100 && (n = channel_stream_read(fast, &p, 32))) {
+    const int *got = p;
+    if (!first) {
+      first = got;
+    }
+    for (size_t i = 0; i < n; i++) {
+      ASSERT_EQ(got[i], next++, "Fast group read out of order");
+    }
+    channel_stream_commit(fast);
+  }
+  ASSERT_EQ(next, 100, "Fast group missed items");
+  ASSERT((const int *)p == first + (100 - n),
+         "Reads should point into one contiguous log");
+
+  n = channel_stream_read(slow, &p, 30);
+  ASSERT_EQ(n, 30, "Slow group read the wrong count");
+  ASSERT(p == first, "Groups should share the same mapped items");
+  channel_stream_commit(slow);
+  ASSERT_EQ(channel_stream_committed(slow), 30, "Slow commit not recorded");
+  channel_stream_read(slow, &p, 5);
+  channel_stream_destroy(s);
+
+  // Each group resumes from its own commit, uncommitted reads come again
+  s = channel_stream_open(path, sizeof(int), &opts);
+  ASSERT(s != NULL, "Stream reopen failed");
+  ASSERT(channel_stream_open(path, sizeof(long double), &opts) == NULL,
+         "Item size mismatch should be refused");
+  ASSERT_EQ(channel_stream_length(s), 100, "Log length lost on reopen");
+  fast = channel_stream_group(s, "fast");
+  slow = channel_stream_group(s, "slow");
+  ASSERT_EQ(channel_stream_committed(fast), 100, "Fast offset lost");
+  ASSERT_EQ(channel_stream_committed(slow), 30, "Slow offset lost");
+  n = channel_stream_read(slow, &p, 1);
+  ASSERT_EQ(*(const int *)p, 30, "Slow group resumed at the wrong item");
+
+  // Seeking back replays the log
+  channel_stream_seek(fast, 10);
+  n = channel_stream_read(fast, &p, 1);
+  ASSERT_EQ(*(const int *)p, 10, "Seek went to the wrong item");
+  channel_stream_destroy(s);
+  unlink(path);
+}
+
+typedef struct {
+  channel_stream_group_t *g;
+  int next;
+  int wrong;
+} stream_reader_args_t;
+
+static void *stream_reader(void *arg) {
+  stream_reader_args_t *a = arg;
+  const void *p;
+  size_t n;
+  while ((n = channel_stream_read(a->g, &p, 64))) {
+    const int *items = p;
+    for (size_t i = 0; i < n; i++) {
+      if (items[i] != a->next++) {
+        a->wrong++;
+      }
+    }
+    channel_stream_commit(a->g);
+  }
+  return NULL;
+}
+
+static void *stream_producer(void *arg) {
+  producer_thread(arg);
+  channel_close(((thread_args_t *)arg)->ch);
+  return NULL;
+}
+
+TEST(test_stream_append_from) {
+  char path[] = "/tmp/channels_stream_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0, "mkstemp failed");
+  close(fd);
+  unlink(path);
+
+  // A small reservation so the file has to grow while readers wait
+  channel_stream_opts_t opts = {.max_bytes = 1 << 23};
+  channel_stream_t *s = channel_stream_open(path, sizeof(int), &opts);
+  ASSERT(s != NULL, "Stream open failed");
+
+  pthread_t readers[2];
+  stream_reader_args_t args[2];
+  for (int i = 0; i < 2; i++) {
+    char name[8];
+    snprintf(name, sizeof(name), "g%d", i);
+    args[i] = (stream_reader_args_t){.g = channel_stream_group(s, name)};
+    pthread_create(&readers[i], NULL, stream_reader, &args[i]);
+  }
+
+  channel_t *ch = channel_create(sizeof(int), 128);
+  pthread_t producer;
+  int count = 500000;
+  thread_args_t pargs = {ch, 0, count};
+  pthread_create(&producer, NULL, stream_producer, &pargs);
+  ASSERT_EQ(channel_stream_append_from(s, ch), (size_t)count,
+            "Not every item was appended");
+  pthread_join(producer, NULL);
+  channel_stream_close(s);
+
+  for (int i = 0; i < 2; i++) {
+    pthread_join(readers[i], NULL);
+    ASSERT_EQ(args[i].wrong, 0, "Reader saw items out of order");
+    ASSERT_EQ(args[i].next, count, "Reader missed items");
+  }
+  int extra = 0;
+  ASSERT(!channel_stream_append(s, &extra, 1), "Append after close worked");
+  channel_stream_destroy(s);
+  channel_destroy(ch);
+  unlink(path);
+}
+
+typedef struct {
+  channel_stream_group_t *g;
+  _Atomic size_t got;
+} stream_waiter_args_t;
+
+static void *stream_waiter(void *arg) {
+  stream_waiter_args_t *a = arg;
+  const void *p;
+  atomic_store(&a->got, channel_stream_read(a->g, &p, SIZE_MAX));
+  return NULL;
+}
+
+TEST(test_stream_shared_file) {
+  char path[] = "/tmp/channels_stream_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0, "mkstemp failed");
+  close(fd);
+  unlink(path);
+
+  // Two handles on one file stand in for two processes
+  channel_stream_t *a = channel_stream_open(path, sizeof(int), NULL);
+  channel_stream_t *b = channel_stream_open(path, sizeof(int), NULL);
+  ASSERT(a && b, "Stream open failed");
+
+  // A reader of one handle wakes for appends through the other, which grow
+  // the file well past the size the first handle saw
+  stream_waiter_args_t args = {.g = channel_stream_group(a, "g")};
+  pthread_t waiter;
+  pthread_create(&waiter, NULL, stream_waiter, &args);
+  sleep_ms(20);
+  enum { COUNT = 2000000 };
+  int *items = malloc(COUNT * sizeof(int));
+  for (int i = 0; i < COUNT; i++) {
+    items[i] = i;
+  }
+  ASSERT(channel_stream_append(b, items, COUNT / 2), "Append failed");
+  for (int i = 0; i < 2000 && atomic_load(&args.got) == 0; i++) {
+    sleep_ms(1);
+  }
+  size_t woke_with = atomic_load(&args.got);
+  ASSERT(channel_stream_append(b, items + COUNT / 2, COUNT / 2),
+         "Append failed");
+
+  // Growing from the first handle's stale size must not shrink the file
+  struct stat before, after;
+  stat(path, &before);
+  ASSERT(channel_stream_append(a, items, 1), "Append failed");
+  stat(path, &after);
+  channel_stream_close(a);
+  pthread_join(waiter, NULL);
+  ASSERT_EQ(woke_with, COUNT / 2, "Reader not woken by the other handle");
+  ASSERT(after.st_size >= before.st_size, "Append shrank the file");
+  channel_stream_destroy(a);
+  channel_stream_destroy(b);
+  free(items);
+
+  a = channel_stream_open(path, sizeof(int), NULL);
+  ASSERT(a != NULL, "Stream reopen failed");
+  ASSERT_EQ(channel_stream_length(a), COUNT + 1, "Wrong stream length");
+  channel_stream_destroy(a);
+  unlink(path);
+}
+
+TEST(test_stream_rejects_corrupt_header) {
+  char path[] = "/tmp/channels_stream_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0, "mkstemp failed");
+  close(fd);
+  unlink(path);
+
+  channel_stream_t *s = channel_stream_open(path, sizeof(int), NULL);
+  ASSERT(s != NULL, "Stream open failed");
+  ASSERT(channel_stream_group(s, "g") != NULL, "Group lookup failed");
+  channel_stream_close(s);
+  channel_stream_destroy(s);
+
+  // The group count is the fourth 64-bit word of the header
+  fd = open(path, O_RDWR);
+  uint64_t ngroups = 1000;
+  ASSERT_EQ(pwrite(fd, &ngroups, sizeof(ngroups), 24), sizeof(ngroups),
+            "Header write failed");
+  ASSERT(channel_stream_open(path, sizeof(int), NULL) == NULL,
+         "Stream with too many groups should be rejected");
+  ngroups = 1;
+  pwrite(fd, &ngroups, sizeof(ngroups), 24);
+
+  // The first group record starts at byte 64, its offset 48 bytes in
+  uint64_t offset = 5;
+  ASSERT_EQ(pwrite(fd, &offset, sizeof(offset), 112), sizeof(offset),
+            "Header write failed");
+  ASSERT(channel_stream_open(path, sizeof(int), NULL) == NULL,
+         "Group offset past the log should be rejected");
+  offset = 0;
+  pwrite(fd, &offset, sizeof(offset), 112);
+
+  char name[48];
+  memset(name, 'x', sizeof(name));
+  ASSERT_EQ(pwrite(fd, name, sizeof(name), 64), sizeof(name),
+            "Header write failed");
+  ASSERT(channel_stream_open(path, sizeof(int), NULL) == NULL,
+         "Unterminated group name should be rejected");
+  close(fd);
+  unlink(path);
+}
+
+// =============================================================================
+// Tee Tests
+// =============================================================================
+
+typedef struct {
+  channel_t *ch;
+  int received;
+  int wrong;
+} tee_reader_args_t;
+
+static void *tee_reader(void *arg) {
+  tee_reader_args_t *a = arg;
+  int val;
+  while (channel_recv(a->ch, &val)) {
+    if (val != a->received++) {
+      a->wrong++;
+    }
+  }
+  return NULL;
+}
+
+TEST(test_tee_fan_out) {
+  channel_t *src = channel_create(sizeof(int), 64);
+  channel_tee_branch_t branches[3];
+  tee_reader_args_t args[3];
+  pthread_t readers[3];
+  for (int i = 0; i < 3; i++) {
+    // Branches of different capacities, all kept in step by blocking
+    branches[i] = (channel_tee_branch_t){
+        .ch = channel_create(sizeof(int), 4 << (i * 3)),
+        .policy = CHANNEL_TEE_BLOCK};
+    args[i] = (tee_reader_args_t){.ch = branches[i].ch};
+    pthread_create(&readers[i], NULL, tee_reader, &args[i]);
+  }
+  channel_tee_opts_t opts = {.batch = 16};
+  channel_tee_t *t =
+      channel_tee_create(src, sizeof(int), branches, 3, &opts);
+  ASSERT(t != NULL, "Tee creation failed");
+
+  const int n = 50000;
+  for (int i = 0; i < n; i++) {
+    channel_send(src, &i);
+  }
+  channel_close(src);
+  channel_tee_destroy(t);
+
+  for (int i = 0; i < 3; i++) {
+    // The tee closes its branches once the source is drained
+    pthread_join(readers[i], NULL);
+    ASSERT_EQ(args[i].received, n, "Branch missed items");
+    ASSERT_EQ(args[i].wrong, 0, "Branch got items out of order");
+    channel_destroy(branches[i].ch);
+  }
+  channel_destroy(src);
+}
+
+TEST(test_tee_slow_branches) {
+  // Nobody reads the drop and spill branches until the source is drained,
+  // which must not hold up the blocking branch
+  channel_t *src = channel_create(sizeof(int), 64);
+  channel_tee_branch_t branches[3] = {
+      {.ch = channel_create(sizeof(int), 64), .policy = CHANNEL_TEE_BLOCK},
+      {.ch = channel_create(sizeof(int), 8), .policy = CHANNEL_TEE_DROP},
+      {.ch = channel_create(sizeof(int), 8), .policy = CHANNEL_TEE_SPILL},
+  };
+  tee_reader_args_t fast = {.ch = branches[0].ch};
+  pthread_t fast_reader;
+  pthread_create(&fast_reader, NULL, tee_reader, &fast);
+  channel_tee_t *t = channel_tee_create(src, sizeof(int), branches, 3, NULL);
+  ASSERT(t != NULL, "Tee creation failed");
+
+  const int n = 10000;
+  for (int i = 0; i < n; i++) {
+    channel_send(src, &i);
+  }
+  channel_close(src);
+  pthread_join(fast_reader, NULL);
+  ASSERT_EQ(fast.received, n, "Blocking branch missed items");
+  ASSERT_EQ(fast.wrong, 0, "Blocking branch got items out of order");
+
+  channel_tee_stats_t stats;
+  ASSERT(channel_tee_stats(t, 1, &stats), "No stats for branch 1");
+  ASSERT_EQ(stats.delivered, 8, "Drop branch should only get what fits");
+  ASSERT_EQ(stats.dropped, (size_t)n - 8, "Drop branch miscounted drops");
+  ASSERT(channel_tee_stats(t, 2, &stats), "No stats for branch 2");
+  ASSERT_EQ(stats.spilled, (size_t)n - 8, "Spill branch miscounted spills");
+  ASSERT_EQ(stats.dropped, 0, "Spill branch should drop nothing");
+  ASSERT(!channel_tee_stats(t, 3, &stats), "Stats for a missing branch");
+
+  // The spilled items are delivered in order once the branch is read
+  tee_reader_args_t spill = {.ch = branches[2].ch};
+  pthread_t spill_reader;
+  pthread_create(&spill_reader, NULL, tee_reader, &spill);
+  channel_tee_destroy(t);
+  pthread_join(spill_reader, NULL);
+  ASSERT_EQ(spill.received, n, "Spill branch lost items");
+  ASSERT_EQ(spill.wrong, 0, "Spill branch reordered items");
+
+  for (int i = 0; i < 3; i++) {
+    channel_destroy(branches[i].ch);
+  }
+  channel_destroy(src);
+}
+
+// =============================================================================
+// Ingest Tests
+// =============================================================================
+
+// Ingests a file of numbered lines of varying length, the last without a
+// newline, through small chunks so records straddle chunk boundaries
+static bool check_ingest(bool ordered) {
+  char path[] = "/tmp/channels_ingest_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return false;
+  }
+  const int lines = 20000;
+  FILE *f = fdopen(fd, "w");
+  for (int i = 0; i < lines; i++) {
+    fprintf(f, "%d %.*s%s", i, i % 37, "abcdefghijklmnopqrstuvwxyz0123456789",
+            i + 1 < lines ? "\n" : "");
+  }
+  fclose(f);
+
+  channel_t *ch = channel_create(sizeof(channel_ingest_record_t), 256);
+  channel_ingest_opts_t opts = {
+      .threads = 4, .chunk_size = 1000, .ordered = ordered};
+  channel_ingest_t *in = channel_ingest_start(path, ch, &opts);
+  bool ok = in != NULL;
+  char *seen = calloc(lines, 1);
+  int count = 0;
+  uint64_t last_offset = 0;
+  channel_ingest_record_t rec;
+  while (ok && channel_recv(ch, &rec)) {
+    int i = atoi(rec.data);
+    ok = i >= 0 && i < lines && !seen[i] && rec.len == (size_t)
+         snprintf(NULL, 0, "%d ", i) + i % 37;
+    ok = ok && (!ordered || count == 0 || rec.offset > last_offset);
+    if (ok) {
+      seen[i] = 1;
+    }
+    last_offset = rec.offset;
+    count++;
+  }
+
+  channel_ingest_stats_t stats;
+  if (in) {
+    channel_ingest_wait(in, &stats);
+    ok = ok && count == lines && stats.records == (size_t)lines &&
+         stats.chunks > 1 && stats.bytes_per_sec > 0;
+    channel_ingest_destroy(in);
+  }
+  free(seen);
+  channel_destroy(ch);
+  unlink(path);
+  return ok;
+}
+
+TEST(test_ingest_ordered) {
+  ASSERT(check_ingest(true), "Ordered ingest lost or reordered records");
+}
+
+TEST(test_ingest_unordered) {
+  ASSERT(check_ingest(false), "Unordered ingest lost records");
+}
+
+// =============================================================================
+// Per-CPU Channel Tests
+// =============================================================================
+
+typedef struct {
+  channel_percpu_t *c;
+  int start;
+  int count;
+  _Atomic int *seen;
+} percpu_args_t;
+
+void *percpu_producer(void *arg) {
+  percpu_args_t *args = (percpu_args_t *)arg;
+  for (int i = 0; i < args->count; i++) {
+    int val = args->start + i;
+    channel_percpu_send(args->c, &val);
+  }
+  return NULL;
+}
+
+void *percpu_consumer(void *arg) {
+  percpu_args_t *args = (percpu_args_t *)arg;
+  int vals[32];
+  size_t n;
+  while ((n = channel_percpu_recv_batch(args->c, vals, 32))) {
+    for (size_t i = 0; i < n; i++) {
+      atomic_fetch_add(&args->seen[vals[i]], 1);
+    }
+  }
+  return NULL;
+}
+
+TEST(test_percpu_many_producers) {
+  // Small rings so producers fill them and wait for room
+  channel_percpu_t *c = channel_percpu_create(sizeof(int), 16);
+  ASSERT(c != NULL, "Failed to create per-CPU channel");
+
+  enum { PRODUCERS = 32, PER_PRODUCER = 2000, CONSUMERS = 2 };
+  _Atomic int *seen = calloc(PRODUCERS * PER_PRODUCER, sizeof(_Atomic int));
+  pthread_t producers[PRODUCERS], consumers[CONSUMERS];
+  percpu_args_t args[PRODUCERS];
+  percpu_args_t consumer_args = {c, 0, 0, seen};
+  for (int i = 0; i < CONSUMERS; i++) {
+    pthread_create(&consumers[i], NULL, percpu_consumer, &consumer_args);
+  }
+  for (int i = 0; i < PRODUCERS; i++) {
+    args[i] = (percpu_args_t){c, i * PER_PRODUCER, PER_PRODUCER, seen};
+    pthread_create(&producers[i], NULL, percpu_producer, &args[i]);
+  }
+  for (int i = 0; i < PRODUCERS; i++) {
+    pthread_join(producers[i], NULL);
+  }
+  channel_percpu_close(c);
+  for (int i = 0; i < CONSUMERS; i++) {
+    pthread_join(consumers[i], NULL);
+  }
+
+  int once = 0;
+  for (int i = 0; i < PRODUCERS * PER_PRODUCER; i++) {
+    once += atomic_load(&seen[i]) == 1;
+  }
+  ASSERT_EQ(once, PRODUCERS * PER_PRODUCER,
+            "Every item should arrive exactly once");
+
+  free(seen);
+  channel_percpu_destroy(c);
+}
+
+typedef struct {
+  int id;
+  char pad[4092];
+} percpu_big_t;
+
+void *percpu_big_consumer(void *arg) {
+  percpu_args_t *args = (percpu_args_t *)arg;
+  percpu_big_t vals[16];
+  size_t n;
+  while ((n = channel_percpu_recv_batch(args->c, vals, 16))) {
+    for (size_t i = 0; i < n; i++) {
+      atomic_fetch_add(&args->seen[vals[i].id], 1);
+    }
+  }
+  return NULL;
+}
+
+TEST(test_percpu_close_with_receivers) {
+  // Receivers wait while large items go in, then the close lands while they
+  // are still copying them out, so some find a ring held by another receiver
+  enum { ROUNDS = 200, ITEMS = 256, RECEIVERS = 4 };
+  static percpu_big_t item;
+  for (int round = 0; round < ROUNDS; round++) {
+    channel_percpu_t *c = channel_percpu_create(sizeof(percpu_big_t), 64);
+    ASSERT(c != NULL, "Failed to create per-CPU channel");
+    _Atomic int seen[ITEMS] = {0};
+    pthread_t receivers[RECEIVERS];
+    percpu_args_t args = {c, 0, 0, seen};
+    for (int i = 0; i < RECEIVERS; i++) {
+      pthread_create(&receivers[i], NULL, percpu_big_consumer, &args);
+    }
+    for (int i = 0; i < ITEMS; i++) {
+      item.id = i;
+      ASSERT(channel_percpu_send(c, &item), "Send to open channel failed");
+    }
+    channel_percpu_close(c);
+    for (int i = 0; i < RECEIVERS; i++) {
+      pthread_join(receivers[i], NULL);
+    }
+
+    int once = 0;
+    for (int i = 0; i < ITEMS; i++) {
+      once += atomic_load(&seen[i]) == 1;
+    }
+    ASSERT_EQ(once, ITEMS, "Every item should arrive exactly once");
+    channel_percpu_destroy(c);
+  }
+}
+
+TEST(test_percpu_full_and_close) {
+  channel_percpu_t *c = channel_percpu_create(sizeof(int), 3);
+  ASSERT(c != NULL, "Failed to create per-CPU channel");
+
+  // The ring holds 4 items, more only if the thread moves to another CPU
+  int sent = 0;
+  while (sent < 1000 && channel_percpu_try_send(c, &sent)) {
+    sent++;
+  }
+  ASSERT(sent >= 4 && sent < 1000, "Try send should stop at a full ring");
+
+  int vals[8];
+  int received = 0;
+  size_t n;
+  while ((n = channel_percpu_try_recv_batch(c, vals, 8))) {
+    received += (int)n;
+  }
+  ASSERT_EQ(received, sent, "Try receive should drain every ring");
+  ASSERT_EQ(channel_percpu_try_recv_batch(c, vals, 8), 0,
+            "Drained channel should be empty");
+
+  int val = 7;
+  ASSERT(channel_percpu_send(c, &val), "Send to open channel failed");
+  channel_percpu_close(c);
+  ASSERT(!channel_percpu_send(c, &val), "Send after close should fail");
+  ASSERT(channel_percpu_recv(c, &vals[0]) && vals[0] == 7,
+         "Items sent before close should still arrive");
+  ASSERT(!channel_percpu_recv(c, &vals[0]),
+         "Receive should fail once closed and drained");
+
+  channel_percpu_destroy(c);
+}
+
+// =============================================================================
+// Stress Tests
+// =============================================================================
+
+TEST(test_high_volume) {
+  channel_t *ch = channel_create(sizeof(int), 1000);
+
+  const int VOLUME = 100000;
+
+  pthread_t prod, cons;
+  thread_args_t args = {ch, 0, VOLUME};
+
+  pthread_create(&cons, NULL, consumer_thread, &args);
+  pthread_create(&prod, NULL, producer_thread, &args);
+
+  pthread_join(prod, NULL);
+  channel_close(ch);
+
+  int *received;
+  pthread_join(cons, (void **)&received);
+
+  ASSERT_EQ(*received, VOLUME, "High volume test failed");
+
+  free(received);
+  channel_destroy(ch);
+}
+
+TEST(test_many_producers) {
+  channel_t *ch = channel_create(sizeof(int), 100);
+
+  const int NUM_PRODUCERS = 10;
+  const int ITEMS_PER = 1000;
+
+  pthread_t producers[NUM_PRODUCERS];
+  pthread_t consumer;
+
+  thread_args_t prod_args[NUM_PRODUCERS];
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    prod_args[i].ch = ch;
+    prod_args[i].start = i * 100000;
+    prod_args[i].count = ITEMS_PER;
+    pthread_create(&producers[i], NULL, producer_thread, &prod_args[i]);
+  }
+
+  thread_args_t cons_args = {ch, 0, NUM_PRODUCERS * ITEMS_PER};
+  pthread_create(&consumer, NULL, consumer_thread, &cons_args);
+
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    pthread_join(producers[i], NULL);
+  }
+
+  channel_close(ch);
+
   int *received;
   pthread_join(consumer, (void **)&received);
 
@@ -423,6 +2748,51 @@ TEST(test_many_producers) {
   channel_destroy(ch);
 }
 
+TEST(test_queue_lock_contended) {
+  channel_opts_t opts = {.lock = CHANNEL_LOCK_QUEUE};
+  channel_t *ch = channel_create_opts(sizeof(int), 4, &opts);
+  ASSERT(ch != NULL, "Queue lock channel creation failed");
+
+  const int NUM_PRODUCERS = 8;
+  const int ITEMS_PER = 2000;
+
+  pthread_t producers[NUM_PRODUCERS];
+  pthread_t consumers[2];
+
+  thread_args_t prod_args[NUM_PRODUCERS];
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    prod_args[i] = (thread_args_t){ch, i * 100000, ITEMS_PER};
+    pthread_create(&producers[i], NULL, producer_thread, &prod_args[i]);
+  }
+
+  // Both consumers stop only when the channel closes
+  thread_args_t cons_args = {ch, 0, NUM_PRODUCERS * ITEMS_PER};
+  for (int i = 0; i < 2; i++) {
+    pthread_create(&consumers[i], NULL, consumer_thread, &cons_args);
+  }
+
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    pthread_join(producers[i], NULL);
+  }
+  channel_close(ch);
+
+  int total = 0;
+  for (int i = 0; i < 2; i++) {
+    int *received;
+    pthread_join(consumers[i], (void **)&received);
+    total += *received;
+    free(received);
+  }
+  ASSERT_EQ(total, NUM_PRODUCERS * ITEMS_PER, "Items lost under queue lock");
+  channel_destroy(ch);
+
+#if defined(__linux__)
+  opts.priority_inherit = true;
+  ASSERT(channel_create_opts(sizeof(int), 4, &opts) == NULL,
+         "Queue lock with priority inheritance should fail");
+#endif
+}
+
 // =============================================================================
 // Edge Cases
 // =============================================================================
@@ -486,10 +2856,34 @@ int main(void) {
   run_test_send_recv_multiple_items();
   run_test_fifo_order();
   run_test_different_types();
+  run_test_priority_inherit_channel();
 
   // Bounded tests
   run_test_bounded_capacity();
   run_test_bounded_wraparound();
+  run_test_batch_wraparound();
+  run_test_magic_ring_batch();
+  run_test_release_idle_pages();
+  run_test_release_idle_magic_ring();
+  run_test_swap_send_recv();
+  run_test_swap_requires_bounded();
+
+  // Fair queueing
+  run_test_fair_weighted_order();
+  run_test_fair_full_tenant_blocks_alone();
+  run_test_fair_requires_plain_bounded();
+
+  // Deadline order
+  run_test_deadline_order();
+  run_test_deadline_order_unbounded();
+
+  // Expiry tests
+  run_test_ttl_drops_expired();
+  run_test_ttl_bounded_scan();
+  run_test_ttl_requires_option();
+  run_test_codel_drops_standing_queue();
+  run_test_codel_sheds_sends();
+  run_test_codel_sends_leave_dequeue_state();
 
   // Unbounded tests
   run_test_unbounded_growth();
@@ -498,15 +2892,88 @@ int main(void) {
   run_test_close_empty_channel();
   run_test_close_with_data();
   run_test_send_after_close();
+  run_test_recv_timeout();
+  run_test_recv_timeout_queue_lock();
+  run_test_try_send();
+  run_test_try_send_batch();
+  run_test_try_recv();
 
   // Multi-threaded tests
   run_test_single_producer_single_consumer();
   run_test_multiple_producers_single_consumer();
   run_test_concurrent_send_recv();
+  run_test_wake_policy_fifo();
+  run_test_wake_policy_lifo();
+
+  // Adaptive channels
+  run_test_adaptive_spsc_order();
+  run_test_adaptive_upgrade_second_producer();
+  run_test_adaptive_inline_fast_path();
+
+  // Channel groups
+  run_test_group_recv_ready_members();
+  run_test_group_blocking_fan_in();
+
+  // Select
+  run_test_select_futex();
+  run_test_select_fallback();
+  run_test_select_contended_futex();
+  run_test_select_contended_fallback();
+  run_test_select_passes_on_wakeup();
+
+#if defined(__linux__)
+  // Poller
+  run_test_poller_channels_and_fds();
+  run_test_poller_timeout_survives_signals();
+#endif
+
+  // Consumer pools
+  run_test_backlog_watch();
+  run_test_pool_scales_with_backlog();
+  run_test_parallel_for();
+
+  // Async logger
+  run_test_alog_formats_records();
+  run_test_alog_truncates_long_records();
+  run_test_alog_exited_threads();
+  run_test_alog_lossy_drops();
+
+  // File writer
+  run_test_writer_buffered();
+  run_test_writer_direct();
+  run_test_writer_stats();
+
+  // Event bus
+  run_test_bus_fan_out();
+  run_test_bus_churn();
+
+  // RPC
+  run_test_rpc_calls();
+  run_test_rpc_pipelined();
+
+  // Streams
+  run_test_stream_groups();
+  run_test_stream_append_from();
+  run_test_stream_shared_file();
+  run_test_stream_rejects_corrupt_header();
+
+  // Tee
+  run_test_tee_fan_out();
+  run_test_tee_slow_branches();
+
+  // Ingest
+  run_test_ingest_ordered();
+  run_test_ingest_unordered();
+
+  // Per-CPU channels
+  run_test_percpu_many_producers();
+  run_test_percpu_close_with_receivers();
+  run_test_percpu_full_and_close();
 
   // Stress tests
   run_test_high_volume();
   run_test_many_producers();
+  run_test_queue_lock_contended();
 
   // Edge cases
   run_test_zero_capacity_unbounded();